@@ -855,7 +855,24 @@ LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
   lua_lock(L);
   if (!chunkname) chunkname = "?";
   luaZ_init(L, &z, reader, data);
-  status = luaD_protectedparser(L, &z, chunkname);
+  status = luaD_protectedparser(L, &z, chunkname, 0);
+  lua_unlock(L);
+  return status;
+}
+
+
+/*
+** Load a chunk made by lua_dump, regardless of LUA_ALLOW_BYTECODE.
+** Only for chunks the engine dumped itself, never for script input.
+*/
+LUA_API int lua_loadbinary (lua_State *L, lua_Reader reader, void *data,
+                            const char *chunkname) {
+  ZIO z;
+  int status;
+  lua_lock(L);
+  if (!chunkname) chunkname = "?";
+  luaZ_init(L, &z, reader, data);
+  status = luaD_protectedparser(L, &z, chunkname, 1);
   lua_unlock(L);
   return status;
 }
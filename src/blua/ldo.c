@@ -498,6 +498,7 @@ struct SParser {  /* data to `f_parser' */
   ZIO *z;
   Mbuffer buff;  /* buffer to be used by the scanner */
   const char *name;
+  int binary;  /* precompiled chunk from the engine's own cache */
 };
 
 static void f_parser (lua_State *L, void *ud) {
@@ -507,6 +508,12 @@ static void f_parser (lua_State *L, void *ud) {
   struct SParser *p = cast(struct SParser *, ud);
   int c = luaZ_lookahead(p->z);
   luaC_checkGC(L);
+  if (p->binary) {
+    if (c != LUA_SIGNATURE[0])
+      luaG_runerror(L, "invalid format, expected a precompiled chunk");
+    tf = luaU_undump(L, p->z, &p->buff, p->name);
+  }
+  else {
 #ifdef LUA_ALLOW_BYTECODE
   tf = ((c == LUA_SIGNATURE[0]) ? luaU_undump : luaY_parser)(L, p->z,
                                                              &p->buff, p->name);
@@ -515,6 +522,7 @@ static void f_parser (lua_State *L, void *ud) {
 		luaG_runerror(L, "invalid format, cannot load bytecode scripts");
   tf = luaY_parser(L, p->z, &p->buff, p->name);
 #endif
+  }
   cl = luaF_newLclosure(L, tf->nups, hvalue(gt(L)));
   cl->l.p = tf;
   for (i = 0; i < tf->nups; i++)  /* initialize eventual upvalues */
@@ -524,10 +532,10 @@ static void f_parser (lua_State *L, void *ud) {
 }
 
 
-int luaD_protectedparser (lua_State *L, ZIO *z, const char *name) {
+int luaD_protectedparser (lua_State *L, ZIO *z, const char *name, int binary) {
   struct SParser p;
   int status;
-  p.z = z; p.name = name;
+  p.z = z; p.name = name; p.binary = binary;
   luaZ_initbuffer(L, &p.buff);
   status = luaD_pcall(L, f_parser, &p, savestack(L, L->top), L->errfunc);
   luaZ_freebuffer(L, &p.buff);
@@ -63,6 +63,13 @@ static boolean CV_Immutable(const consvar_t *var);
 static consvar_t *consvar_vars; // list of registered console variables
 static UINT16     consvar_number_of_netids = 0;
 
+// Must be a power of two
+#define COM_HASHSIZE 1024
+#define COM_HASH(name) (quickncasehash(name, strlen(name)) & (COM_HASHSIZE - 1))
+
+static consvar_t *consvar_hash[COM_HASHSIZE]; // consvar_vars, bucketed by name
+static consvar_t **consvar_netvars; // indexed by netid
+
 #ifdef OLD22DEMOCOMPAT
 static old_demo_var_t *consvar_old_demo_vars;
 #endif
@@ -313,11 +320,42 @@ typedef struct xcommand_s
 {
 	const char *name;
 	struct xcommand_s *next;
+	struct xcommand_s *hashnext; // next command in the same name hash bucket
 	com_func_t function;
 	com_flags_t flags;
 } xcommand_t;
 
 static xcommand_t *com_commands = NULL; // current commands
+static xcommand_t *com_commands_hash[COM_HASHSIZE]; // com_commands, bucketed by name
+
+/** Finds a command by name, case insensitively.
+  *
+  * \param name Name of the command.
+  * \return The command, or NULL if there is none by that name.
+  */
+static xcommand_t *COM_FindCommand(const char *name)
+{
+	xcommand_t *cmd;
+
+	for (cmd = com_commands_hash[COM_HASH(name)]; cmd; cmd = cmd->hashnext)
+		if (!stricmp(name, cmd->name)) //case insensitive now that we have lower and uppercase!
+			return cmd;
+
+	return NULL;
+}
+
+/** Links a new command into the command list and hash table.
+  */
+static void COM_LinkCommand(xcommand_t *cmd)
+{
+	const UINT32 bucket = COM_HASH(cmd->name);
+
+	cmd->next = com_commands;
+	com_commands = cmd;
+
+	cmd->hashnext = com_commands_hash[bucket];
+	com_commands_hash[bucket] = cmd;
+}
 
 #define MAX_ARGS 80
 static size_t com_argc;
@@ -495,27 +533,24 @@ void COM_AddCommand(const char *name, com_func_t func, com_flags_t flags)
 	}
 
 	// fail if the command already exists
-	for (cmd = com_commands; cmd; cmd = cmd->next)
+	cmd = COM_FindCommand(name);
+	if (cmd)
 	{
-		if (!stricmp(name, cmd->name)) //case insensitive now that we have lower and uppercase!
-		{
-			// don't I_Error for Lua commands
-			// Lua commands can replace game commands, and they have priority.
-			// BUT, if for some reason we screwed up and made two console commands with the same name,
-			// it's good to have this here so we find out.
-			if (cmd->function != COM_Lua_f)
-				I_Error("Command %s already exists\n", name);
+		// don't I_Error for Lua commands
+		// Lua commands can replace game commands, and they have priority.
+		// BUT, if for some reason we screwed up and made two console commands with the same name,
+		// it's good to have this here so we find out.
+		if (cmd->function != COM_Lua_f)
+			I_Error("Command %s already exists\n", name);
 
-			return;
-		}
+		return;
 	}
 
 	cmd = ZZ_Alloc(sizeof *cmd);
 	cmd->name = name;
 	cmd->function = func;
 	cmd->flags = flags;
-	cmd->next = com_commands;
-	com_commands = cmd;
+	COM_LinkCommand(cmd);
 }
 
 /** Adds a console command for Lua.
@@ -532,14 +567,12 @@ int COM_AddLuaCommand(const char *name)
 		return -1;
 
 	// command already exists
-	for (cmd = com_commands; cmd; cmd = cmd->next)
+	cmd = COM_FindCommand(name);
+	if (cmd)
 	{
-		if (!stricmp(name, cmd->name)) //case insensitive now that we have lower and uppercase!
-		{
-			// replace the built in command.
-			cmd->function = COM_Lua_f;
-			return 1;
-		}
+		// replace the built in command.
+		cmd->function = COM_Lua_f;
+		return 1;
 	}
 
 	// Add a new command.
@@ -547,8 +580,7 @@ int COM_AddLuaCommand(const char *name)
 	cmd->name = name;
 	cmd->function = COM_Lua_f;
 	cmd->flags = COM_LUA;
-	cmd->next = com_commands;
-	com_commands = cmd;
+	COM_LinkCommand(cmd);
 	return 0;
 }
 
@@ -559,13 +591,7 @@ int COM_AddLuaCommand(const char *name)
   */
 static boolean COM_Exists(const char *com_name)
 {
-	xcommand_t *cmd;
-
-	for (cmd = com_commands; cmd; cmd = cmd->next)
-		if (!stricmp(com_name, cmd->name))
-			return true;
-
-	return false;
+	return COM_FindCommand(com_name) != NULL;
 }
 
 /** Does command completion for the console.
@@ -638,19 +664,17 @@ static void COM_ExecuteString(char *ptext)
 		return; // no tokens
 
 	// check functions
-	for (cmd = com_commands; cmd; cmd = cmd->next)
+	cmd = COM_FindCommand(com_argv[0]);
+	if (cmd)
 	{
-		if (!stricmp(com_argv[0], cmd->name)) //case insensitive now that we have lower and uppercase!
+		if ((com_flags & COM_LUA) && !(cmd->flags & COM_LUA))
 		{
-			if ((com_flags & COM_LUA) && !(cmd->flags & COM_LUA))
-			{
-				CONS_Alert(CONS_WARNING, "Command '%s' cannot be run from Lua.\n", cmd->name);
-				return;
-			}
-
-			cmd->function();
+			CONS_Alert(CONS_WARNING, "Command '%s' cannot be run from Lua.\n", cmd->name);
 			return;
 		}
+
+		cmd->function();
+		return;
 	}
 
 	// check aliases
@@ -1225,7 +1249,7 @@ consvar_t *CV_FindVar(const char *name)
 {
 	consvar_t *cvar;
 
-	for (cvar = consvar_vars; cvar; cvar = cvar->next)
+	for (cvar = consvar_hash[COM_HASH(name)]; cvar; cvar = cvar->hashnext)
 		if (!stricmp(name,cvar->name))
 			return cvar;
 
@@ -1291,16 +1315,10 @@ static old_demo_var_t *CV_FindOldDemoVar(UINT16 chk)
   */
 static consvar_t *CV_FindNetVar(UINT16 netid)
 {
-	consvar_t *cvar;
-
-	if (netid > consvar_number_of_netids)
+	if (netid == 0 || netid > consvar_number_of_netids)
 		return NULL;
 
-	for (cvar = consvar_vars; cvar; cvar = cvar->next)
-		if (cvar->netid == netid)
-			return cvar;
-
-	return NULL;
+	return consvar_netvars[netid];
 }
 
 static void Setvalue(consvar_t *var, const char *valstr, boolean stealth);
@@ -1360,6 +1378,10 @@ void CV_RegisterVar(consvar_t *variable)
 
 		variable->netid = ++consvar_number_of_netids;
 
+		consvar_netvars = Z_Realloc(consvar_netvars,
+			(consvar_number_of_netids + 1) * sizeof *consvar_netvars, PU_STATIC, NULL);
+		consvar_netvars[variable->netid] = NULL;
+
 #ifdef OLD22DEMOCOMPAT
 		CV_RegisterOldDemoVar(variable);
 #endif
@@ -1368,8 +1390,16 @@ void CV_RegisterVar(consvar_t *variable)
 	// link the variable in
 	if (!(variable->flags & CV_HIDEN))
 	{
+		const UINT32 bucket = COM_HASH(variable->name);
+
 		variable->next = consvar_vars;
 		consvar_vars = variable;
+
+		variable->hashnext = consvar_hash[bucket];
+		consvar_hash[bucket] = variable;
+
+		if (variable->flags & CV_NETVAR)
+			consvar_netvars[variable->netid] = variable;
 	}
 	variable->string = variable->zstring = NULL;
 	memset(&variable->revert, 0, sizeof variable->revert);
@@ -2407,6 +2437,16 @@ static boolean CV_FilterVarByVersion(consvar_t *v, const char *valstr)
 		if (!CV_FilterJoyAxisVars(v, valstr))
 			return false;
 	}
+
+	if (GETMAJOREXECVERSION(cv_execversion.value) < MAJOREXECVERSION
+		|| (GETMAJOREXECVERSION(cv_execversion.value) == MAJOREXECVERSION
+		&& GETMINOREXECVERSION(cv_execversion.value) < 1))
+	{
+		// downloadspeed was changed from 16 to 0 (no cap),
+		// since file sends now pace themselves by the acks
+		if (!stricmp(v->name, "downloadspeed") && atoi(valstr) == 16)
+			return false;
+	}
 	return true;
 }
 
@@ -0,0 +1,7 @@
+
+// Do not edit!  This file was autogenerated
+// by the ../comptime.sh script with git
+//
+const char* compbranch = "master";
+const char* comprevision = "085e690f";
+const char* compnote = "user-022-fix-encode-client-commands-against-one-the-server-acknowledged";
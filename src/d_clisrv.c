@@ -93,6 +93,34 @@ static boolean resendingsavegame[MAXNETNODES]; // Are we resending the savegame?
 static tic_t savegameresendcooldown[MAXNETNODES]; // How long before we can resend again?
 static tic_t freezetimeout[MAXNETNODES]; // Until when can this node freeze the server before getting a timeout?
 
+#ifndef NONET
+typedef struct
+{
+	UINT32 checksum, checksum2;
+	UINT32 offset, length;
+	UINT32 next; // The next chunk with the same bucket, or UINT32_MAX
+} gamestatechunk_t;
+
+// The chunks of a gamestate, see SV_SendSaveGame
+typedef struct
+{
+	gamestatechunk_t *chunks;
+	UINT32 numchunks, maxchunks;
+	UINT32 *buckets; // The last chunk for each checksum modulo numbuckets
+	UINT32 numbuckets;
+	size_t length;
+	UINT32 checksum; // Of the whole gamestate
+} gamestateindex_t;
+
+// The last gamestate sent to each node, so resynchs can send only what changed
+static gamestateindex_t savegamebase[MAXNETNODES];
+static boolean deltasavegame[MAXNETNODES]; // Does the node still have it?
+
+// The last gamestate the client loaded
+static UINT8 *cl_savegamebase;
+static size_t cl_savegamebaselength;
+#endif
+
 // Incremented by cv_joindelay when a client joins, decremented each tic.
 // If higher than cv_joindelay * 2 (3 joins in a short timespan), joins are temporarily disabled.
 static tic_t joindelay = 0;
@@ -112,6 +140,22 @@ static tic_t firstticstosend; // min of the nettics
 static tic_t tictoclear = 0; // optimize d_clearticcmd
 static tic_t maketic;
 
+// Compact tics, negotiated per node at join (see D_WriteCompactTiccmd)
+static boolean nodecompacttics[MAXNETNODES];
+static tic_t nodereffloor[MAXNETNODES]; // first tic the node is sure to have
+static tic_t slotsfrom; // tics before this may have been sent with another numslots
+static boolean cl_compacttics;
+static tic_t cl_reffloor, cl_refceil; // the tics this client has, for references
+
+// Compact client commands are encoded against one the server said it received
+#define CLIENTCMDREFS 64 // commands kept on both ends as references
+static ticcmd_t nodecmdrefs[MAXNETNODES][CLIENTCMDREFS]; // the last commands received from the node
+static UINT8 nodecmdrefseq[MAXNETNODES][CLIENTCMDREFS]; // their sequence numbers, 0 for none
+static UINT8 nodecmdack[MAXNETNODES]; // the last command received from the node, 0 for none
+static ticcmd_t cl_sentcmds[CLIENTCMDREFS]; // the last commands sent
+static UINT8 cl_cmdseq; // sequence number of the last command sent, never 0 once sent
+static UINT8 cl_cmdack; // the last command the server received, 0 for none
+
 static INT16 consistancy[BACKUPTICS];
 
 static UINT8 player_joining = false;
@@ -199,6 +243,220 @@ static inline void *G_ScpyTiccmd(ticcmd_t* dest, void* src, const size_t n)
 	return ret+n;
 }
 
+//
+// Compact ticcmds
+//
+// Each command is a byte of the fields that differ from a previous command,
+// then those fields: moves and latency as bytes, angles as zigzag varint
+// deltas and buttons as a varint of the bits that flipped.
+//
+#define TICCMD_FORWARDMOVE 0x01
+#define TICCMD_SIDEMOVE    0x02
+#define TICCMD_ANGLETURN   0x04
+#define TICCMD_AIMING      0x08
+#define TICCMD_BUTTONS     0x10
+#define TICCMD_LATENCY     0x20
+
+#define COMPACTTICCMDSIZE 13 // largest a compact command can get
+
+// What commands are compared against when there is nothing before them
+static const ticcmd_t zeroticcmds[MAXPLAYERS];
+
+static UINT8 *WriteTicVarint(UINT8 *p, UINT32 value)
+{
+	while (value >= 0x80)
+	{
+		WRITEUINT8(p, (UINT8)(value | 0x80));
+		value >>= 7;
+	}
+	WRITEUINT8(p, (UINT8)value);
+	return p;
+}
+
+static UINT8 *ReadTicVarint(UINT8 *p, UINT32 *value)
+{
+	UINT8 byte;
+	INT32 shift = 0;
+
+	*value = 0;
+	do
+	{
+		byte = READUINT8(p);
+		*value |= (UINT32)(byte & 0x7F) << shift;
+		shift += 7;
+	} while ((byte & 0x80) && shift < 35);
+
+	return p;
+}
+
+static UINT8 *WriteTicDelta(UINT8 *p, INT16 value, INT16 prev)
+{
+	const INT16 delta = (INT16)(value - prev);
+	return WriteTicVarint(p, delta < 0 ? ((UINT32)(-(delta + 1)) << 1) | 1 : (UINT32)delta << 1);
+}
+
+static UINT8 *ReadTicDelta(UINT8 *p, INT16 *value, INT16 prev)
+{
+	UINT32 zigzag;
+	p = ReadTicVarint(p, &zigzag);
+	*value = (INT16)(prev + (INT16)((zigzag & 1) ? -(INT32)(zigzag >> 1) - 1 : (INT32)(zigzag >> 1)));
+	return p;
+}
+
+static UINT8 *D_WriteCompactTiccmd(UINT8 *p, const ticcmd_t *cmd, const ticcmd_t *prev)
+{
+	UINT8 *fields = p++;
+
+	*fields = 0;
+
+	if (cmd->forwardmove != prev->forwardmove)
+	{
+		*fields |= TICCMD_FORWARDMOVE;
+		WRITESINT8(p, cmd->forwardmove);
+	}
+	if (cmd->sidemove != prev->sidemove)
+	{
+		*fields |= TICCMD_SIDEMOVE;
+		WRITESINT8(p, cmd->sidemove);
+	}
+	if (cmd->angleturn != prev->angleturn)
+	{
+		*fields |= TICCMD_ANGLETURN;
+		p = WriteTicDelta(p, cmd->angleturn, prev->angleturn);
+	}
+	if (cmd->aiming != prev->aiming)
+	{
+		*fields |= TICCMD_AIMING;
+		p = WriteTicDelta(p, cmd->aiming, prev->aiming);
+	}
+	if (cmd->buttons != prev->buttons)
+	{
+		*fields |= TICCMD_BUTTONS;
+		p = WriteTicVarint(p, cmd->buttons ^ prev->buttons);
+	}
+	if (cmd->latency != prev->latency)
+	{
+		*fields |= TICCMD_LATENCY;
+		WRITEUINT8(p, cmd->latency);
+	}
+
+	return p;
+}
+
+static UINT8 *D_ReadCompactTiccmd(UINT8 *p, ticcmd_t *cmd, const ticcmd_t *prev)
+{
+	const UINT8 fields = READUINT8(p);
+	UINT32 buttons;
+	INT16 angle;
+
+	cmd->forwardmove = (fields & TICCMD_FORWARDMOVE) ? READSINT8(p) : prev->forwardmove;
+	cmd->sidemove = (fields & TICCMD_SIDEMOVE) ? READSINT8(p) : prev->sidemove;
+
+	angle = prev->angleturn;
+	if (fields & TICCMD_ANGLETURN)
+		p = ReadTicDelta(p, &angle, angle);
+	cmd->angleturn = angle;
+
+	angle = prev->aiming;
+	if (fields & TICCMD_AIMING)
+		p = ReadTicDelta(p, &angle, angle);
+	cmd->aiming = angle;
+
+	if (fields & TICCMD_BUTTONS)
+	{
+		p = ReadTicVarint(p, &buttons);
+		cmd->buttons = (UINT16)(prev->buttons ^ buttons);
+	}
+	else
+		cmd->buttons = prev->buttons;
+
+	cmd->latency = (fields & TICCMD_LATENCY) ? READUINT8(p) : prev->latency;
+
+	return p;
+}
+
+// Writes the sequence number, the reference and the compact client commands
+static UINT8 *CL_WriteCompactClientCmds(UINT8 *p, boolean splitcmd)
+{
+	const ticcmd_t *prev = &zeroticcmds[0];
+	UINT8 refdist = 0;
+
+	if (!++cl_cmdseq)
+		cl_cmdseq = 1; // 0 means none
+
+	if (cl_cmdack && (UINT8)(cl_cmdseq - cl_cmdack) < CLIENTCMDREFS)
+	{
+		refdist = (UINT8)(cl_cmdseq - cl_cmdack);
+		prev = &cl_sentcmds[cl_cmdack % CLIENTCMDREFS];
+	}
+
+	WRITEUINT8(p, cl_cmdseq);
+	WRITEUINT8(p, refdist);
+	p = D_WriteCompactTiccmd(p, &localcmds, prev);
+	G_CopyTiccmd(&cl_sentcmds[cl_cmdseq % CLIENTCMDREFS], &localcmds, 1);
+
+	// the splitscreen cmd is encoded against the first one
+	if (splitcmd)
+		p = D_WriteCompactTiccmd(p, &localcmds2, &localcmds);
+
+	return p;
+}
+
+// Reads the first compact client command from a node and keeps it as a
+// reference. Returns NULL if it was encoded against one we don't hold.
+static UINT8 *SV_ReadCompactClientCmd(INT32 node, UINT8 *p, ticcmd_t *cmd)
+{
+	const ticcmd_t *prev = &zeroticcmds[0];
+	const UINT8 seq = READUINT8(p);
+	const UINT8 refdist = READUINT8(p);
+
+	if (refdist)
+	{
+		const UINT8 refseq = (UINT8)(seq - refdist);
+
+		if (!refseq || nodecmdrefseq[node][refseq % CLIENTCMDREFS] != refseq)
+			return NULL;
+		prev = &nodecmdrefs[node][refseq % CLIENTCMDREFS];
+	}
+
+	p = D_ReadCompactTiccmd(p, cmd, prev);
+
+	if (seq)
+	{
+		G_CopyTiccmd(&nodecmdrefs[node][seq % CLIENTCMDREFS], cmd, 1);
+		nodecmdrefseq[node][seq % CLIENTCMDREFS] = seq;
+		nodecmdack[node] = seq;
+	}
+
+	return p;
+}
+
+// Step over numcmds compact commands without decoding them
+static UINT8 *D_SkipCompactTiccmds(UINT8 *p, size_t numcmds)
+{
+	UINT32 dummy;
+
+	while (numcmds--)
+	{
+		const UINT8 fields = READUINT8(p);
+
+		if (fields & TICCMD_FORWARDMOVE)
+			p++;
+		if (fields & TICCMD_SIDEMOVE)
+			p++;
+		if (fields & TICCMD_ANGLETURN)
+			p = ReadTicVarint(p, &dummy);
+		if (fields & TICCMD_AIMING)
+			p = ReadTicVarint(p, &dummy);
+		if (fields & TICCMD_BUTTONS)
+			p = ReadTicVarint(p, &dummy);
+		if (fields & TICCMD_LATENCY)
+			p++;
+	}
+
+	return p;
+}
+
 
 
 // Some software don't support largest packet
@@ -1321,6 +1579,8 @@ static boolean CL_SendJoin(void)
 	strncpy(netbuffer->u.clientcfg.names[0], cv_playername.zstring, MAXPLAYERNAME);
 	strncpy(netbuffer->u.clientcfg.names[1], player2name, MAXPLAYERNAME);
 
+	netbuffer->u.clientcfg.flags = CLIENTCFG_COMPACTTICS|CLIENTCFG_EXTACKS;
+
 	return HSendPacket(servernode, true, 0, sizeof (clientconfig_pak));
 }
 
@@ -1516,6 +1776,16 @@ static boolean SV_SendServerConfig(INT32 node)
 
 	memcpy(netbuffer->u.servercfg.server_context, server_context, 8);
 
+	netbuffer->u.servercfg.flags = 0;
+	if (nodecompacttics[node])
+		netbuffer->u.servercfg.flags |= SERVERCFG_COMPACTTICS;
+	if (Net_ExtendedAcksEnabled(node))
+		netbuffer->u.servercfg.flags |= SERVERCFG_EXTACKS;
+
+	// The client starts from this tic, so it can't be sent
+	// anything encoded against earlier ones
+	nodereffloor[node] = gametic;
+
 	{
 		const size_t len = sizeof (serverconfig_pak);
 
@@ -1560,72 +1830,514 @@ static boolean SV_ResendingSavegameToAnyone(void)
 	return false;
 }
 
-static void SV_SendSaveGame(INT32 node, boolean resending)
+// Gamestate deltas
+//
+// When resynching, the client tells the server the length and checksum of
+// the last gamestate it loaded. If the server sent that gamestate itself,
+// it cuts the new gamestate into chunks at content-defined boundaries, and
+// every chunk that also appears in the old gamestate is sent as a reference
+// to it. Mobjs that get added or removed only shift the data around them,
+// so a resynch usually sends a small fraction of the whole gamestate.
+//
+// The server doesn't keep the gamestates it sent, only the offset, length
+// and two checksums of each of their chunks, and the client checks what it
+// rebuilt against the checksum of the whole new gamestate.
+//
+// A gamestate is a UINT8 type followed by frames until the end: a UINT32
+// uncompressed length, a UINT32 compressed length or 0 if the frame isn't
+// compressed, then the data. The server compresses each frame and queues it
+// for sending as soon as P_SaveNetGameStreamed has archived it. A delta is
+// a UINT32 checksum of the old gamestate, a list of operations, and after
+// GSDELTA_END a UINT32 checksum of the new gamestate.
+
+#define GAMESTATE_FULL  0
+#define GAMESTATE_DELTA 1
+#define GAMESTATEHEADER sizeof(UINT8)
+#define GAMESTATEFRAMEHEADER (2*sizeof(UINT32))
+
+#define GSDELTA_END     0
+#define GSDELTA_COPY    1 // UINT32 offset, UINT32 length into the old gamestate
+#define GSDELTA_LITERAL 2 // UINT32 length, then the bytes
+
+#define GSCHUNK_MIN  32
+#define GSCHUNK_MAX  2048
+#define GSCHUNK_MASK 0xFF000000 // around 256 bytes per chunk
+
+// Frames hold at most one block of the gamestate, or of a delta
+// plus the operation that went past the block
+#define GAMESTATEMAXFRAME (SAVESTREAMBLOCK + GSCHUNK_MAX + 16)
+
+static UINT32 GamestateChecksumUpdate(UINT32 hash, const UINT8 *p, size_t length)
 {
-	size_t length, compressedlen;
-	UINT8 *savebuffer;
-	UINT8 *compressedsave;
-	UINT8 *buffertosend;
+	while (length--)
+		hash = (hash ^ *p++) * 16777619u;
+	return hash;
+}
 
-	// first save it in a malloced buffer
-	savebuffer = (UINT8 *)malloc(SAVEGAMESIZE);
-	if (!savebuffer)
+static UINT32 GamestateChecksum(const UINT8 *p, size_t length)
+{
+	return GamestateChecksumUpdate(2166136261u, p, length); // FNV-1a
+}
+
+// A second checksum for chunks, so they can be matched without their bytes
+static UINT32 GamestateChunkChecksum(const UINT8 *p, size_t length)
+{
+	UINT32 hash = 5381;
+
+	while (length--)
+		hash = (hash * 33) ^ *p++;
+	return hash;
+}
+
+// Returns the length of the chunk at the start of p.
+static size_t GamestateChunkLength(const UINT8 *p, size_t length)
+{
+	static UINT32 gear[256];
+	static boolean geardone = false;
+	UINT32 hash = 0;
+	size_t i;
+
+	// The top bits of the hash depend on the last 32 bytes
+	if (!geardone)
 	{
-		CONS_Alert(CONS_ERROR, M_GetText("No more free memory for savegame\n"));
-		return;
+		UINT32 seed = 0x9E3779B9;
+		for (i = 0; i < 256; i++)
+			gear[i] = seed = seed * 1664525 + 1013904223;
+		geardone = true;
 	}
 
-	// Leave room for the uncompressed length.
-	save_p = savebuffer + sizeof(UINT32);
+	if (length > GSCHUNK_MAX)
+		length = GSCHUNK_MAX;
 
-	P_SaveNetGame(resending);
+	for (i = 0; i < length; i++)
+	{
+		hash = (hash << 1) + gear[p[i]];
+		if (i >= GSCHUNK_MIN && !(hash & GSCHUNK_MASK))
+			return i + 1;
+	}
+	return length;
+}
 
-	length = save_p - savebuffer;
-	if (length > SAVEGAMESIZE)
+static void SV_FreeSavegameIndex(gamestateindex_t *index)
+{
+	Z_Free(index->chunks);
+	Z_Free(index->buckets);
+	memset(index, 0, sizeof (*index));
+}
+
+static void SV_FreeSavegameBase(INT32 node)
+{
+	SV_FreeSavegameIndex(&savegamebase[node]);
+	deltasavegame[node] = false;
+}
+
+// Links the chunks of a finished gamestate by their checksum.
+static void SV_HashSavegameIndex(gamestateindex_t *index)
+{
+	UINT32 i, slot;
+
+	index->numbuckets = 1;
+	while (index->numbuckets < index->numchunks)
+		index->numbuckets <<= 1;
+
+	index->buckets = Z_Malloc(index->numbuckets * sizeof (UINT32), PU_STATIC, NULL);
+	memset(index->buckets, 0xFF, index->numbuckets * sizeof (UINT32));
+
+	for (i = 0; i < index->numchunks; i++)
 	{
-		free(savebuffer);
-		save_p = NULL;
-		I_Error("Savegame buffer overrun");
+		slot = index->chunks[i].checksum & (index->numbuckets - 1);
+		index->chunks[i].next = index->buckets[slot];
+		index->buckets[slot] = i;
 	}
+}
 
-	// Allocate space for compressed save: one byte fewer than for the
-	// uncompressed data to ensure that the compression is worthwhile.
-	compressedsave = malloc(length - 1);
-	if (!compressedsave)
+// Returns the chunk of the gamestate with the same length and checksums,
+// or UINT32_MAX if there is none.
+static UINT32 SV_FindSavegameChunk(const gamestateindex_t *index, const gamestatechunk_t *chunk)
+{
+	UINT32 i;
+
+	if (!index->buckets)
+		return UINT32_MAX;
+
+	for (i = index->buckets[chunk->checksum & (index->numbuckets - 1)]; i != UINT32_MAX; i = index->chunks[i].next)
+		if (index->chunks[i].checksum == chunk->checksum
+			&& index->chunks[i].checksum2 == chunk->checksum2
+			&& index->chunks[i].length == chunk->length)
+			break;
+	return i;
+}
+
+// The gamestate being sent, as it gets saved
+static INT32 sv_savegamenode;
+static UINT8 *sv_savegameframes; // The frames to send, malloced
+static size_t sv_savegameframeslength, sv_savegameframessize;
+static boolean sv_savegameindexing; // Keeping its chunks for the next delta
+static gamestateindex_t sv_savegameindex;
+static UINT8 sv_savegamecarry[GSCHUNK_MAX*2]; // What isn't cut into chunks yet
+static size_t sv_savegamecarrylength;
+
+// The delta being sent instead of it, if any
+static boolean sv_savegamedelta;
+static UINT8 *sv_savegamedeltablock; // Operations not in a frame yet, malloced
+static UINT8 *sv_savegamedelta_p;
+static UINT8 *sv_savegameliteral; // The length of the last operation if it is a literal
+static UINT32 sv_savegamecopyofs, sv_savegamecopylen; // The copy not written yet
+static size_t sv_savegamedeltalength;
+
+// Compresses data into a new frame at the end of sv_savegameframes.
+static void SV_WriteSavegameFrame(const UINT8 *data, size_t length)
+{
+	size_t needed = sv_savegameframeslength + GAMESTATEFRAMEHEADER + length;
+	size_t compressedlen = 0;
+	UINT8 *p;
+
+	if (needed > sv_savegameframessize)
 	{
-		CONS_Alert(CONS_ERROR, M_GetText("No more free memory for savegame\n"));
+		sv_savegameframessize = max(needed, sv_savegameframessize * 2);
+		p = realloc(sv_savegameframes, sv_savegameframessize);
+		if (!p)
+			I_Error("No more free memory for savegame");
+		sv_savegameframes = p;
+	}
+
+	p = sv_savegameframes + sv_savegameframeslength;
+
+	// Only keep it compressed if that is worthwhile.
+	if (length > 1)
+		compressedlen = lzf_compress(data, length, p + GAMESTATEFRAMEHEADER, length - 1);
+
+	WRITEUINT32(p, length);
+	WRITEUINT32(p, compressedlen);
+	if (!compressedlen)
+		M_Memcpy(p, data, length);
+
+	sv_savegameframeslength += GAMESTATEFRAMEHEADER + (compressedlen ? compressedlen : length);
+}
+
+// Puts the delta operations written so far into a frame.
+static void SV_FlushSavegameDelta(void)
+{
+	const size_t length = sv_savegamedelta_p - sv_savegamedeltablock;
+
+	if (length)
+		SV_WriteSavegameFrame(sv_savegamedeltablock, length);
+	sv_savegamedeltalength += length;
+	sv_savegamedelta_p = sv_savegamedeltablock;
+	sv_savegameliteral = NULL;
+}
+
+static void SV_FlushSavegameCopy(void)
+{
+	if (!sv_savegamecopylen)
+		return;
+
+	WRITEUINT8(sv_savegamedelta_p, GSDELTA_COPY);
+	WRITEUINT32(sv_savegamedelta_p, sv_savegamecopyofs);
+	WRITEUINT32(sv_savegamedelta_p, sv_savegamecopylen);
+	sv_savegamecopylen = 0;
+	sv_savegameliteral = NULL;
+
+	if (sv_savegamedelta_p - sv_savegamedeltablock >= SAVESTREAMBLOCK)
+		SV_FlushSavegameDelta();
+}
+
+// Adds a chunk of the new gamestate to the delta, as a reference to
+// the old gamestate if it has the same chunk.
+static void SV_DeltaSavegameChunk(const UINT8 *data, const gamestatechunk_t *chunk)
+{
+	const gamestateindex_t *base = &savegamebase[sv_savegamenode];
+	const UINT32 i = SV_FindSavegameChunk(base, chunk);
+
+	if (i != UINT32_MAX)
+	{
+		if (sv_savegamecopylen && sv_savegamecopyofs + sv_savegamecopylen == base->chunks[i].offset)
+			sv_savegamecopylen += chunk->length;
+		else
+		{
+			SV_FlushSavegameCopy();
+			sv_savegamecopyofs = base->chunks[i].offset;
+			sv_savegamecopylen = chunk->length;
+		}
 		return;
 	}
 
-	// Attempt to compress it.
-	if((compressedlen = lzf_compress(savebuffer + sizeof(UINT32), length - sizeof(UINT32), compressedsave + sizeof(UINT32), length - sizeof(UINT32) - 1)))
+	SV_FlushSavegameCopy();
+
+	if (sv_savegameliteral)
+	{
+		UINT8 *p = sv_savegameliteral;
+		const UINT32 length = READUINT32(p);
+
+		p = sv_savegameliteral;
+		WRITEUINT32(p, length + chunk->length);
+	}
+	else
+	{
+		WRITEUINT8(sv_savegamedelta_p, GSDELTA_LITERAL);
+		sv_savegameliteral = sv_savegamedelta_p;
+		WRITEUINT32(sv_savegamedelta_p, chunk->length);
+	}
+	WRITEMEM(sv_savegamedelta_p, data, chunk->length);
+
+	if (sv_savegamedelta_p - sv_savegamedeltablock >= SAVESTREAMBLOCK)
+		SV_FlushSavegameDelta();
+}
+
+// Adds the next chunk of the gamestate to its index, and to the delta.
+static void SV_AddSavegameChunk(const UINT8 *data, size_t length)
+{
+	gamestateindex_t *index = &sv_savegameindex;
+	gamestatechunk_t *chunk;
+
+	if (index->numchunks == index->maxchunks)
+	{
+		index->maxchunks = max(index->maxchunks * 2, 256);
+		index->chunks = Z_Realloc(index->chunks, index->maxchunks * sizeof (*index->chunks), PU_STATIC, NULL);
+	}
+
+	chunk = &index->chunks[index->numchunks++];
+	chunk->checksum = GamestateChecksum(data, length);
+	chunk->checksum2 = GamestateChunkChecksum(data, length);
+	chunk->offset = (UINT32)index->length;
+	chunk->length = (UINT32)length;
+
+	index->length += length;
+	index->checksum = GamestateChecksumUpdate(index->checksum, data, length);
+
+	if (sv_savegamedelta)
+		SV_DeltaSavegameChunk(data, chunk);
+}
+
+// Cuts as much of the gamestate into chunks as can be, which is all
+// of it once it is finished. A chunk can't be cut until GSCHUNK_MAX
+// bytes after its start are known, so the rest waits in a small buffer.
+static void SV_CutSavegameChunks(const UINT8 *data, size_t length, boolean finished)
+{
+	size_t pos, len, n;
+
+	do
 	{
-		// Compressing succeeded; send compressed data
+		n = min(length, sizeof (sv_savegamecarry) - sv_savegamecarrylength);
+		if (n)
+			M_Memcpy(sv_savegamecarry + sv_savegamecarrylength, data, n);
+		sv_savegamecarrylength += n;
+		data += n;
+		length -= n;
+
+		for (pos = 0; sv_savegamecarrylength - pos >= GSCHUNK_MAX
+			|| (finished && !length && pos < sv_savegamecarrylength); pos += len)
+		{
+			len = GamestateChunkLength(sv_savegamecarry + pos, sv_savegamecarrylength - pos);
+			SV_AddSavegameChunk(sv_savegamecarry + pos, len);
+		}
+
+		sv_savegamecarrylength -= pos;
+		memmove(sv_savegamecarry, sv_savegamecarry + pos, sv_savegamecarrylength);
+	} while (length);
+}
+
+// Called by P_SaveNetGameStreamed with each block of the gamestate.
+static void SV_StreamSavegame(const UINT8 *data, size_t length)
+{
+	if (sv_savegameindexing)
+		SV_CutSavegameChunks(data, length, false);
+
+	// Deltas get their frames from SV_FlushSavegameDelta
+	if (!sv_savegamedelta)
+		SV_WriteSavegameFrame(data, length);
+
+	// Start sending what is ready while the rest gets archived
+	GrowRamSendQueue(sv_savegamenode, sv_savegameframes, sv_savegameframeslength, false);
+	FileSendTicker();
+}
+
+static void SV_SendSaveGame(INT32 node, boolean resending)
+{
+	UINT8 *savebuffer;
+	UINT8 *p;
+
+	// The client starts over from this tic, so it can't be sent
+	// anything encoded against earlier ones
+	nodereffloor[node] = gametic;
+
+	sv_savegamenode = node;
+	sv_savegameindexing = cv_deltagamestate.value;
+	sv_savegamedelta = sv_savegameindexing && deltasavegame[node] && savegamebase[node].buckets;
+	deltasavegame[node] = false;
 
+	// The buffer is reused for each block of the gamestate
+	savebuffer = (UINT8 *)malloc(SAVESTREAMBLOCK);
+	sv_savegameframessize = SAVESTREAMBLOCK;
+	sv_savegameframes = malloc(sv_savegameframessize);
+	sv_savegamedeltablock = sv_savegamedelta ? malloc(GAMESTATEMAXFRAME) : NULL;
+	if (!savebuffer || !sv_savegameframes || (sv_savegamedelta && !sv_savegamedeltablock))
+	{
 		free(savebuffer);
+		free(sv_savegameframes);
+		free(sv_savegamedeltablock);
+		sv_savegameframes = sv_savegamedeltablock = NULL;
+		CONS_Alert(CONS_ERROR, M_GetText("No more free memory for savegame\n"));
+		return;
+	}
+
+	p = sv_savegameframes;
+	WRITEUINT8(p, sv_savegamedelta ? GAMESTATE_DELTA : GAMESTATE_FULL);
+	sv_savegameframeslength = GAMESTATEHEADER;
+
+	memset(&sv_savegameindex, 0, sizeof (sv_savegameindex));
+	sv_savegameindex.checksum = GamestateChecksum(NULL, 0);
+	sv_savegamecarrylength = 0;
 
-		// State that we're compressed.
-		buffertosend = compressedsave;
-		WRITEUINT32(compressedsave, length - sizeof(UINT32));
-		length = compressedlen + sizeof(UINT32);
+	// If the client still has the last gamestate we sent, only send what changed.
+	if (sv_savegamedelta)
+	{
+		sv_savegamedelta_p = sv_savegamedeltablock;
+		WRITEUINT32(sv_savegamedelta_p, savegamebase[node].checksum);
+		sv_savegameliteral = NULL;
+		sv_savegamecopylen = 0;
+		sv_savegamedeltalength = 0;
 	}
-	else
+
+	AddGrowingRamToSendQueue(node, sv_savegameframes, sv_savegameframeslength, SF_RAM, 0);
+
+	P_SaveNetGameStreamed(resending, savebuffer, SAVESTREAMBLOCK, SV_StreamSavegame);
+	free(savebuffer);
+
+	if (sv_savegameindexing)
 	{
-		// Compression failed to make it smaller; send original
+		SV_CutSavegameChunks(NULL, 0, true);
+		SV_HashSavegameIndex(&sv_savegameindex);
+	}
 
-		free(compressedsave);
+	if (sv_savegamedelta)
+	{
+		SV_FlushSavegameCopy();
+		WRITEUINT8(sv_savegamedelta_p, GSDELTA_END);
+		WRITEUINT32(sv_savegamedelta_p, sv_savegameindex.checksum);
+		SV_FlushSavegameDelta();
+		free(sv_savegamedeltablock);
+		sv_savegamedeltablock = NULL;
 
-		// State that we're not compressed
-		buffertosend = savebuffer;
-		WRITEUINT32(savebuffer, 0);
+		CONS_Printf(M_GetText("Sending %s of %s bytes of game state\n"), sizeu1(sv_savegamedeltalength), sizeu2(sv_savegameindex.length));
 	}
 
-	AddRamToSendQueue(node, buffertosend, length, SF_RAM, 0);
-	save_p = NULL;
+	// Remember what the client will have once this arrives
+	SV_FreeSavegameIndex(&savegamebase[node]);
+	if (sv_savegameindexing)
+		savegamebase[node] = sv_savegameindex;
+	memset(&sv_savegameindex, 0, sizeof (sv_savegameindex));
+
+	GrowRamSendQueue(node, sv_savegameframes, sv_savegameframeslength, true);
+	sv_savegameframes = NULL;
 
 	// Remember when we started sending the savegame so we can handle timeouts
 	sendingsavegame[node] = true;
-	freezetimeout[node] = I_GetTime() + jointimeout + length / 1024; // 1 extra tic for each kilobyte
+	freezetimeout[node] = I_GetTime() + jointimeout + sv_savegameframeslength / 1024; // 1 extra tic for each kilobyte
+}
+
+/** Rebuilds a gamestate from a delta against the last one the client loaded
+  *
+  * \param p The delta
+  * \param length Length of the delta
+  * \param newlength Set to the length of the rebuilt gamestate
+  * \return The rebuilt gamestate, which the caller frees
+  *
+  */
+static UINT8 *CL_ApplySavegameDelta(UINT8 *p, size_t length, size_t *newlength)
+{
+	const UINT8 *end = p + length;
+	UINT8 *ops, *out = NULL, *q = NULL;
+	UINT32 checksum, ofs, len;
+	INT32 pass;
+	boolean done;
+
+	if (length < 2*sizeof(UINT32) + 1)
+		I_Error("Game state delta is too short");
+
+	checksum = READUINT32(p);
+
+	if (!cl_savegamebase || checksum != GamestateChecksum(cl_savegamebase, cl_savegamebaselength))
+		I_Error("Received a game state delta against a game state we don't have");
+
+	// Add up the length of the new gamestate first, then rebuild it
+	*newlength = 0;
+	ops = p;
+	for (pass = 0; pass < 2; pass++)
+	{
+		p = ops;
+
+		for (done = false; !done;)
+		{
+			if (p >= end)
+				I_Error("Game state delta is truncated");
+
+			switch (READUINT8(p))
+			{
+				case GSDELTA_END:
+					done = true;
+					break;
+
+				case GSDELTA_COPY:
+					if (end - p < 8)
+						I_Error("Game state delta is truncated");
+					ofs = READUINT32(p);
+					len = READUINT32(p);
+					if (ofs > cl_savegamebaselength || len > cl_savegamebaselength - ofs)
+						I_Error("Game state delta is corrupt");
+					if (q)
+					{
+						M_Memcpy(q, cl_savegamebase + ofs, len);
+						q += len;
+					}
+					else
+						*newlength += len;
+					break;
+
+				case GSDELTA_LITERAL:
+					if (end - p < 4)
+						I_Error("Game state delta is truncated");
+					len = READUINT32(p);
+					if (len > (size_t)(end - p))
+						I_Error("Game state delta is corrupt");
+					if (q)
+					{
+						M_Memcpy(q, p, len);
+						q += len;
+					}
+					else
+						*newlength += len;
+					p += len;
+					break;
+
+				default:
+					I_Error("Game state delta is corrupt");
+			}
+		}
+
+		if (!pass)
+			q = out = Z_Malloc(max(*newlength, 1), PU_STATIC, NULL);
+	}
+
+	if (end - p < 4)
+		I_Error("Game state delta is truncated");
+	if (READUINT32(p) != GamestateChecksum(out, *newlength))
+		I_Error("Game state delta doesn't match the game state");
+	return out;
+}
+
+static void CL_SetSavegameBase(const UINT8 *buf, size_t length)
+{
+	cl_savegamebase = Z_Realloc(cl_savegamebase, length, PU_STATIC, NULL);
+	M_Memcpy(cl_savegamebase, buf, length);
+	cl_savegamebaselength = length;
+}
+
+static void CL_FreeSavegameBase(void)
+{
+	Z_Free(cl_savegamebase);
+	cl_savegamebase = NULL;
+	cl_savegamebaselength = 0;
 }
 
 #ifdef DUMPCONSISTENCY
@@ -1678,6 +2390,7 @@ static void CL_LoadReceivedSavegame(boolean reloading)
 {
 	UINT8 *savebuffer = NULL;
 	size_t length, decompressedlen;
+	UINT8 type;
 	char tmpsave[256];
 
 	FreeFileNeeded();
@@ -1693,18 +2406,72 @@ static void CL_LoadReceivedSavegame(boolean reloading)
 		return;
 	}
 
-	save_p = savebuffer;
+	if (length < GAMESTATEHEADER)
+		I_Error("Savegame sent is too short");
 
-	// Decompress saved game if necessary.
-	decompressedlen = READUINT32(save_p);
-	if(decompressedlen > 0)
+	// Decompress the saved game's frames.
 	{
-		UINT8 *decompressedbuffer = Z_Malloc(decompressedlen, PU_STATIC, NULL);
-		lzf_decompress(save_p, length - sizeof(UINT32), decompressedbuffer, decompressedlen);
+		const UINT8 *end = savebuffer + length;
+		UINT8 *decompressedbuffer, *q;
+		size_t framelen, compressedlen;
+
+		save_p = savebuffer;
+		type = READUINT8(save_p);
+
+		// The server didn't know the whole length when it started sending,
+		// so add up the frames first
+		decompressedlen = 0;
+		while (save_p < end)
+		{
+			if (end - save_p < (ptrdiff_t)GAMESTATEFRAMEHEADER)
+				I_Error("Savegame sent is corrupt");
+			framelen = READUINT32(save_p);
+			compressedlen = READUINT32(save_p);
+			if (framelen > GAMESTATEMAXFRAME
+				|| (compressedlen ? compressedlen : framelen) > (size_t)(end - save_p))
+				I_Error("Savegame sent is corrupt");
+			save_p += compressedlen ? compressedlen : framelen;
+			decompressedlen += framelen;
+		}
+
+		save_p = savebuffer + GAMESTATEHEADER;
+		q = decompressedbuffer = Z_Malloc(max(decompressedlen, 1), PU_STATIC, NULL);
+
+		while (save_p < end)
+		{
+			framelen = READUINT32(save_p);
+			compressedlen = READUINT32(save_p);
+
+			if (compressedlen)
+			{
+				if (lzf_decompress(save_p, compressedlen, q, framelen) != framelen)
+					I_Error("Savegame sent is corrupt");
+				save_p += compressedlen;
+			}
+			else
+			{
+				M_Memcpy(q, save_p, framelen);
+				save_p += framelen;
+			}
+			q += framelen;
+		}
+
 		Z_Free(savebuffer);
 		save_p = savebuffer = decompressedbuffer;
+		length = decompressedlen;
 	}
 
+	// Rebuild it from the last game state if the server only sent what changed.
+	if (type == GAMESTATE_DELTA)
+	{
+		UINT8 *rebuiltbuffer = CL_ApplySavegameDelta(save_p, length, &length);
+		CONS_Printf(M_GetText("Rebuilt game state length %s\n"), sizeu1(length));
+		Z_Free(savebuffer);
+		save_p = savebuffer = rebuiltbuffer;
+	}
+
+	CL_SetSavegameBase(save_p, length);
+
 	paused = false;
 	demoplayback = false;
 	titlemapinaction = TITLEMAP_OFF;
@@ -1757,6 +2524,9 @@ static void CL_ReloadReceivedSavegame(void)
 		neededtic = gametic;
 	maketic = neededtic;
 
+	// The tics from before the gamestate can't be used as references anymore
+	cl_reffloor = cl_refceil = neededtic;
+
 	ticcmd_oldangleturn[0] = players[consoleplayer].oldrelangleturn;
 	P_ForceLocalAngle(&players[consoleplayer], (angle_t)(players[consoleplayer].angleturn << 16));
 	if (splitscreen)
@@ -3009,6 +3779,7 @@ void CL_Reset(void)
 	server = true;
 	doomcom->numnodes = 1;
 	doomcom->numslots = 1;
+	cl_compacttics = false;
 	SV_StopServer();
 	SV_ResetServer();
 
@@ -3019,6 +3790,7 @@ void CL_Reset(void)
 #ifndef NONET
 	totalfilesrequestednum = 0;
 	totalfilesrequestedsize = 0;
+	CL_FreeSavegameBase();
 #endif
 	firstconnectattempttime = 0;
 	serverisfull = false;
@@ -3528,14 +4300,17 @@ static CV_PossibleValue_t resynchattempts_cons_t[] = {{1, "MIN"}, {20, "MAX"}, {
 consvar_t cv_resynchattempts = CVAR_INIT ("resynchattempts", "10", CV_SAVE|CV_NETVAR, resynchattempts_cons_t, NULL);
 consvar_t cv_blamecfail = CVAR_INIT ("blamecfail", "Off", CV_SAVE|CV_NETVAR, CV_OnOff, NULL);
 
+// Resend only the parts of the gamestate that changed since the client's last one
+consvar_t cv_deltagamestate = CVAR_INIT ("deltagamestate", "On", CV_SAVE, CV_OnOff, NULL);
+
 // max file size to send to a player (in kilobytes)
 static CV_PossibleValue_t maxsend_cons_t[] = {{0, "MIN"}, {204800, "MAX"}, {0, NULL}};
 consvar_t cv_maxsend = CVAR_INIT ("maxsend", "4096", CV_SAVE|CV_NETVAR, maxsend_cons_t, NULL);
 consvar_t cv_noticedownload = CVAR_INIT ("noticedownload", "Off", CV_SAVE|CV_NETVAR, CV_OnOff, NULL);
 
-// Speed of file downloading (in packets per tic)
-static CV_PossibleValue_t downloadspeed_cons_t[] = {{1, "MIN"}, {300, "MAX"}, {0, NULL}};
-consvar_t cv_downloadspeed = CVAR_INIT ("downloadspeed", "16", CV_SAVE|CV_NETVAR, downloadspeed_cons_t, NULL);
+// Most file fragments sent per tic to all nodes together, 0 for no limit
+static CV_PossibleValue_t downloadspeed_cons_t[] = {{0, "MIN"}, {4096, "MAX"}, {0, NULL}};
+consvar_t cv_downloadspeed = CVAR_INIT ("downloadspeed", "0", CV_SAVE|CV_NETVAR, downloadspeed_cons_t, NULL);
 
 static void Got_AddPlayer(UINT8 **p, INT32 playernum);
 
@@ -3559,6 +4334,7 @@ void D_ClientServerInit(void)
 #ifdef PACKETDROP
 	COM_AddCommand("drop", Command_Drop, COM_LUA);
 	COM_AddCommand("droprate", Command_Droprate, COM_LUA);
+	COM_AddCommand("acktest", Command_AckTest, 0);
 #endif
 #ifdef _DEBUG
 	COM_AddCommand("numnodes", Command_Numnodes, COM_LUA);
@@ -3591,6 +4367,7 @@ static void ResetNode(INT32 node)
 
 	nettics[node] = gametic;
 	supposedtics[node] = gametic;
+	nodecompacttics[node] = false;
 
 	nodetoplayer[node] = -1;
 	nodetoplayer2[node] = -1;
@@ -3599,6 +4376,9 @@ static void ResetNode(INT32 node)
 	sendingsavegame[node] = false;
 	resendingsavegame[node] = false;
 	savegameresendcooldown[node] = 0;
+#ifndef NONET
+	SV_FreeSavegameBase(node);
+#endif
 }
 
 void SV_ResetServer(void)
@@ -4162,6 +4942,16 @@ static void HandleConnect(SINT8 node)
 #endif
 			SV_AddNode(node);
 
+			// older clients send a shorter packet without the flags
+			nodecompacttics[node] =
+				doomcom->datalength >= (INT16)(BASEPACKETSIZE + sizeof (clientconfig_pak))
+				&& (netbuffer->u.clientcfg.flags & CLIENTCFG_COMPACTTICS);
+			memset(nodecmdrefseq[node], 0, sizeof (nodecmdrefseq[node]));
+			nodecmdack[node] = 0;
+			if (doomcom->datalength >= (INT16)(BASEPACKETSIZE + sizeof (clientconfig_pak))
+				&& (netbuffer->u.clientcfg.flags & CLIENTCFG_EXTACKS))
+				Net_EnableExtendedAcks(node);
+
 			if (cv_joinnextround.value && gameaction == ga_nothing)
 				G_SetGamestate(GS_WAITINGPLAYERS);
 			if (!SV_SendServerConfig(node))
@@ -4257,9 +5047,12 @@ static void PT_WillResendGamestate(void)
 		return;
 
 	// Send back a PT_CANRECEIVEGAMESTATE packet to the server
-	// so they know they can start sending the game state
+	// so they know they can start sending the game state,
+	// and which game state we already have
 	netbuffer->packettype = PT_CANRECEIVEGAMESTATE;
-	if (!HSendPacket(servernode, true, 0, 0))
+	netbuffer->u.gamestatebase.length = LONG((UINT32)cl_savegamebaselength);
+	netbuffer->u.gamestatebase.checksum = LONG(cl_savegamebase ? GamestateChecksum(cl_savegamebase, cl_savegamebaselength) : 0);
+	if (!HSendPacket(servernode, true, 0, sizeof (gamestatebase_pak)))
 		return;
 
 	CONS_Printf(M_GetText("Reloading game state...\n"));
@@ -4284,6 +5077,12 @@ static void PT_CanReceiveGamestate(SINT8 node)
 
 	CONS_Printf(M_GetText("Resending game state to %s...\n"), player_names[nodetoplayer[node]]);
 
+	// Only send what changed if the client has the last game state we sent it
+	deltasavegame[node] = cv_deltagamestate.value && savegamebase[node].buckets
+		&& doomcom->datalength >= (INT16)(BASEPACKETSIZE + sizeof (gamestatebase_pak))
+		&& (size_t)LONG(netbuffer->u.gamestatebase.length) == savegamebase[node].length
+		&& (UINT32)LONG(netbuffer->u.gamestatebase.checksum) == savegamebase[node].checksum;
+
 	SV_SendSaveGame(node, true); // Resend a complete game state
 	resendingsavegame[node] = true;
 #else
@@ -4425,6 +5224,16 @@ static void HandlePacketFromAwayNode(SINT8 node)
 			serverplayer = netbuffer->u.servercfg.serverplayer;
 			doomcom->numslots = SHORT(netbuffer->u.servercfg.totalslotnum);
 			mynode = netbuffer->u.servercfg.clientnode;
+
+			// older servers send a shorter packet without the flags
+			cl_compacttics =
+				doomcom->datalength >= (INT16)(BASEPACKETSIZE + sizeof (serverconfig_pak))
+				&& (netbuffer->u.servercfg.flags & SERVERCFG_COMPACTTICS);
+			cl_reffloor = cl_refceil = neededtic;
+			cl_cmdseq = cl_cmdack = 0;
+			if (doomcom->datalength >= (INT16)(BASEPACKETSIZE + sizeof (serverconfig_pak))
+				&& (netbuffer->u.servercfg.flags & SERVERCFG_EXTACKS))
+				Net_EnableExtendedAcks(servernode);
 			if (serverplayer >= 0)
 				playernode[(UINT8)serverplayer] = servernode;
 
@@ -4563,6 +5372,13 @@ static void HandlePacketFromPlayer(SINT8 node)
 				break;
 			}
 
+			// The node may have missed the tics that were to be encoded against,
+			// so the tics resent to it don't use a reference
+			if (nodecompacttics[node] && nodereffloor[node] < realend
+				&& (netbuffer->packettype == PT_CLIENTMIS || netbuffer->packettype == PT_CLIENT2MIS
+				|| netbuffer->packettype == PT_NODEKEEPALIVEMIS))
+				nodereffloor[node] = realend;
+
 			// Update the nettics
 			nettics[node] = realend;
 
@@ -4587,7 +5403,29 @@ static void HandlePacketFromPlayer(SINT8 node)
 				faketic++;
 
 			// Copy ticcmd
-			G_MoveTiccmd(&netcmds[faketic%BACKUPTICS][netconsole], &netbuffer->u.clientpak.cmd, 1);
+			if (nodecompacttics[node])
+			{
+				ticcmd_t cmd, cmd2;
+
+				pak = SV_ReadCompactClientCmd(node, (UINT8 *)&netbuffer->u.clientpak.cmd, &cmd);
+				if (!pak)
+				{
+					// Treat it as lost, the node will hear what we have soon
+					DEBFILE(va("client command reference not held from node %d\n", node));
+					break;
+				}
+				G_CopyTiccmd(&netcmds[faketic%BACKUPTICS][netconsole], &cmd, 1);
+
+				// the splitscreen cmd is encoded against the first one
+				if ((netbuffer->packettype == PT_CLIENT2CMD || netbuffer->packettype == PT_CLIENT2MIS)
+					&& nodetoplayer2[node] >= 0)
+				{
+					D_ReadCompactTiccmd(pak, &cmd2, &cmd);
+					G_CopyTiccmd(&netcmds[faketic%BACKUPTICS][(UINT8)nodetoplayer2[node]], &cmd2, 1);
+				}
+			}
+			else
+				G_MoveTiccmd(&netcmds[faketic%BACKUPTICS][netconsole], &netbuffer->u.clientpak.cmd, 1);
 
 			// Check ticcmd for "speed hacks"
 			if (netcmds[faketic%BACKUPTICS][netconsole].forwardmove > MAXPLMOVE || netcmds[faketic%BACKUPTICS][netconsole].forwardmove < -MAXPLMOVE
@@ -4602,7 +5440,7 @@ static void HandlePacketFromPlayer(SINT8 node)
 
 			// Splitscreen cmd
 			if ((netbuffer->packettype == PT_CLIENT2CMD || netbuffer->packettype == PT_CLIENT2MIS)
-				&& nodetoplayer2[node] >= 0)
+				&& nodetoplayer2[node] >= 0 && !nodecompacttics[node])
 				G_MoveTiccmd(&netcmds[faketic%BACKUPTICS][(UINT8)nodetoplayer2[node]],
 					&netbuffer->u.client2pak.cmd2, 1);
 
@@ -4812,7 +5650,14 @@ static void HandlePacketFromPlayer(SINT8 node)
 			realstart = netbuffer->u.serverpak.starttic;
 			realend = realstart + netbuffer->u.serverpak.numtics;
 
-			if (!txtpak)
+			// The server holds the client commands it says it received
+			if (cl_compacttics && ((UINT8 *)&netbuffer->u.serverpak.cmds)[1])
+				cl_cmdack = ((UINT8 *)&netbuffer->u.serverpak.cmds)[1];
+
+			if (!txtpak && cl_compacttics)
+				txtpak = D_SkipCompactTiccmds((UINT8 *)&netbuffer->u.serverpak.cmds + 2,
+					netbuffer->u.serverpak.numslots * netbuffer->u.serverpak.numtics);
+			else if (!txtpak)
 				txtpak = (UINT8 *)&netbuffer->u.serverpak.cmds[netbuffer->u.serverpak.numslots
 					* netbuffer->u.serverpak.numtics];
 
@@ -4823,16 +5668,43 @@ static void HandlePacketFromPlayer(SINT8 node)
 			if (realstart <= neededtic && realend > neededtic)
 			{
 				tic_t i, j;
+				const ticcmd_t *prev = zeroticcmds;
 				pak = (UINT8 *)&netbuffer->u.serverpak.cmds;
 
+				if (cl_compacttics && *pak)
+				{
+					const tic_t reftic = realstart - READUINT8(pak);
+
+					pak++; // client command ack, read above
+
+					// The server only uses tics we told it we have
+					if (reftic < cl_reffloor || reftic >= cl_refceil)
+					{
+						// Ask for them again, the server won't use a reference then
+						DEBFILE(va("compact tics reference %u not held\n", reftic));
+						cl_packetmissed = true;
+						break;
+					}
+					prev = netcmds[reftic%BACKUPTICS];
+				}
+				else if (cl_compacttics)
+					pak += 2;
+
 				for (i = realstart; i < realend; i++)
 				{
 					// clear first
 					D_Clearticcmd(i);
 
 					// copy the tics
-					pak = G_ScpyTiccmd(netcmds[i%BACKUPTICS], pak,
-						netbuffer->u.serverpak.numslots*sizeof (ticcmd_t));
+					if (cl_compacttics)
+					{
+						for (j = 0; j < netbuffer->u.serverpak.numslots; j++)
+							pak = D_ReadCompactTiccmd(pak, &netcmds[i%BACKUPTICS][j], &prev[j]);
+						prev = netcmds[i%BACKUPTICS];
+					}
+					else
+						pak = G_ScpyTiccmd(netcmds[i%BACKUPTICS], pak,
+							netbuffer->u.serverpak.numslots*sizeof (ticcmd_t));
 
 					// copy the textcmds
 					numtxtpak = *txtpak++;
@@ -4848,6 +5720,8 @@ static void HandlePacketFromPlayer(SINT8 node)
 				}
 
 				neededtic = realend;
+				if (realend > cl_refceil)
+					cl_refceil = realend;
 			}
 			else
 			{
@@ -5145,6 +6019,12 @@ static void CL_SendClientCmd(void)
 			G_MoveTiccmd(&netbuffer->u.client2pak.cmd2, &localcmds2, 1);
 		}
 
+		if (cl_compacttics)
+		{
+			UINT8 *p = CL_WriteCompactClientCmds((UINT8 *)&netbuffer->u.clientpak.cmd, splitscreen || botingame);
+			packetsize = p - (UINT8 *)&netbuffer->u;
+		}
+
 		HSendPacket(servernode, false, 0, packetsize);
 	}
 
@@ -5176,12 +6056,24 @@ static void CL_SendClientCmd(void)
 // send tic from firstticstosend to maketic-1
 static void SV_SendTics(void)
 {
+	static UINT8 compactcmds[MAXPACKETLENGTH + MAXPLAYERS * COMPACTTICCMDSIZE];
+	static INT16 sentnumslots = -1;
 	tic_t realfirsttic, lasttictosend, i;
 	UINT32 n;
 	INT32 j;
-	size_t packsize;
+	size_t packsize, cmdsize, ticsize;
 	UINT8 *bufpos;
 	UINT8 *ntextcmd;
+	const ticcmd_t *prev;
+	UINT8 refdist;
+
+	// Tics sent from now on all have this many slots, so only those
+	// can be used as references for compact tics
+	if (doomcom->numslots != sentnumslots)
+	{
+		sentnumslots = doomcom->numslots;
+		slotsfrom = maketic;
+	}
 
 	// send to all client but not to me
 	// for each node create a packet with x tics and send it
@@ -5210,11 +6102,42 @@ static void SV_SendTics(void)
 			if (realfirsttic < firstticstosend)
 				realfirsttic = firstticstosend;
 
+			// Compact tics start from the last tic the node told us it has,
+			// as long as we still have it the way it was sent
+			prev = zeroticcmds;
+			refdist = 0;
+			if (nodecompacttics[n] && nettics[n] > 0)
+			{
+				const tic_t reftic = nettics[n] - 1;
+
+				if (reftic >= nodereffloor[n] && reftic >= slotsfrom && reftic >= tictoclear
+					&& reftic < realfirsttic && realfirsttic - reftic <= UINT8_MAX
+					&& reftic + BACKUPTICS > maketic + 1)
+				{
+					prev = netcmds[reftic%BACKUPTICS];
+					refdist = (UINT8)(realfirsttic - reftic);
+				}
+			}
+
 			// compute the length of the packet and cut it if too large
 			packsize = BASESERVERTICSSIZE;
+			cmdsize = 0;
+			if (nodecompacttics[n])
+				packsize += 2; // reference and client command ack
 			for (i = realfirsttic; i < lasttictosend; i++)
 			{
-				packsize += sizeof (ticcmd_t) * doomcom->numslots;
+				if (nodecompacttics[n])
+				{
+					bufpos = compactcmds + cmdsize;
+					for (j = 0; j < doomcom->numslots; j++)
+						bufpos = D_WriteCompactTiccmd(bufpos, &netcmds[i%BACKUPTICS][j], &prev[j]);
+					prev = netcmds[i%BACKUPTICS];
+					ticsize = bufpos - (compactcmds + cmdsize);
+				}
+				else
+					ticsize = sizeof (ticcmd_t) * doomcom->numslots;
+
+				packsize += ticsize;
 				packsize += TotalTextCmdPerTic(i);
 
 				if (packsize > software_MAXPACKETLENGTH)
@@ -5236,11 +6159,14 @@ static void SV_SendTics(void)
 						else
 						{
 							lasttictosend++; // send it anyway!
+							cmdsize += ticsize;
 							DEBFILE("sending it anyway\n");
 						}
 					}
 					break;
 				}
+
+				cmdsize += ticsize;
 			}
 
 			// Send the tics
@@ -5250,7 +6176,14 @@ static void SV_SendTics(void)
 			netbuffer->u.serverpak.numslots = (UINT8)SHORT(doomcom->numslots);
 			bufpos = (UINT8 *)&netbuffer->u.serverpak.cmds;
 
-			for (i = realfirsttic; i < lasttictosend; i++)
+			if (nodecompacttics[n])
+			{
+				WRITEUINT8(bufpos, refdist);
+				WRITEUINT8(bufpos, nodecmdack[n]);
+				M_Memcpy(bufpos, compactcmds, cmdsize);
+				bufpos += cmdsize;
+			}
+			else for (i = realfirsttic; i < lasttictosend; i++)
 			{
 				bufpos = G_DcpyTiccmd(bufpos, netcmds[i%BACKUPTICS], doomcom->numslots * sizeof (ticcmd_t));
 			}
@@ -5436,6 +6369,8 @@ boolean TryRunTics(tic_t realtics)
 				{
 					PS_STOP_TIMING(ps_tictime);
 					PS_UpdateTickStats();
+					if (ps_benchmarking)
+						PS_BenchmarkTic();
 				}
 
 				// Leave a certain amount of tics present in the net buffer as long as we've ran at least one tic this frame.
@@ -5779,6 +6714,9 @@ void NetUpdate(void)
 	}
 
 	FileSendTicker();
+
+	if (I_NetFlush)
+		I_NetFlush(); // send everything queued up this update at once
 }
 
 /** Returns the number of players playing.
@@ -106,6 +106,9 @@ typedef enum
 #ifdef PACKETDROP
 void Command_Drop(void);
 void Command_Droprate(void);
+#ifndef NONET
+void Command_AckTest(void);
+#endif
 #endif
 #ifdef _DEBUG
 void Command_Numnodes(void);
@@ -116,6 +119,9 @@ void Command_Numnodes(void);
 #endif
 
 // Client to server packet
+// With compact tics, cmd starts with the command's sequence number, then how
+// many commands before it the reference command is (0 for none), then the
+// compact command (and the splitscreen one, encoded against it).
 typedef struct
 {
 	UINT8 client_tic;
@@ -140,6 +146,10 @@ typedef struct
 
 // Server to client packet
 // this packet is too large
+// With compact tics, cmds starts with how many tics before starttic the
+// reference tic is (0 for none), then the sequence number of the last client
+// command received from the node (0 for none), then numtics * numslots
+// compact commands.
 typedef struct
 {
 	tic_t starttic;
@@ -163,8 +173,13 @@ typedef struct
 	UINT8 usedCheats;
 
 	char server_context[8]; // Unique context id, generated at server startup.
+
+	UINT8 flags; // SERVERCFG_ flags, missing from older servers
 } ATTRPACK serverconfig_pak;
 
+#define SERVERCFG_COMPACTTICS 0x01 // tics and client commands use the compact encoding
+#define SERVERCFG_EXTACKS 0x02 // ack numbers are extended and PT_NOTHING carries a bitfield
+
 typedef struct
 {
 	UINT8 fileid;
@@ -175,6 +190,12 @@ typedef struct
 	UINT8 data[0]; // Size is variable using hardware_MAXPACKETLENGTH
 } ATTRPACK filetx_pak;
 
+#define FILETX_COMPRESSED 0x8000 // Set in size when data is zlib compressed
+#define FILETX_GROWING 0x4000 // Set in size while the server is still adding to the file
+
+// Flags after the file list of PT_REQUESTFILE, missing from older clients
+#define REQUESTFILE_COMPRESSED 0x01 // Client can inflate compressed fragments
+
 typedef struct
 {
 	UINT32 start;
@@ -202,8 +223,12 @@ typedef struct
 	UINT8 localplayers;
 	UINT8 mode;
 	char names[MAXSPLITSCREENPLAYERS][MAXPLAYERNAME];
+	UINT8 flags; // CLIENTCFG_ flags, missing from older clients
 } ATTRPACK clientconfig_pak;
 
+#define CLIENTCFG_COMPACTTICS 0x01 // client can use the compact ticcmd encoding
+#define CLIENTCFG_EXTACKS 0x02 // client understands extended ack numbers
+
 #define SV_DEDICATED    0x40 // server is dedicated
 #define SV_LOTSOFADDONS 0x20 // flag used to ask for full file list in d_netfil
 
@@ -296,6 +321,14 @@ typedef struct
 	UINT8 files[MAXFILENEEDED]; // is filled with writexxx (byteptr.h)
 } ATTRPACK filesneededconfig_pak;
 
+// The last gamestate a client loaded, sent with PT_CANRECEIVEGAMESTATE
+// so the server can send only what changed since then
+typedef struct
+{
+	UINT32 length;
+	UINT32 checksum;
+} ATTRPACK gamestatebase_pak;
+
 //
 // Network packet data
 //
@@ -306,7 +339,7 @@ typedef struct
 	UINT8 ackreturn; // The return of the ack number
 
 	UINT8 packettype;
-	UINT8 reserved; // Padding
+	UINT8 reserved; // Padding, extends the ack numbers once both ends agreed to it
 	union
 	{
 		clientcmd_pak clientpak;            //         144 bytes
@@ -328,6 +361,7 @@ typedef struct
 		INT32 filesneedednum;               //           4 bytes
 		filesneededconfig_pak filesneededcfg; //       ??? bytes
 		UINT32 pingtable[MAXPLAYERS+1];     //          68 bytes
+		gamestatebase_pak gamestatebase;    //           8 bytes
 	} u; // This is needed to pack diff packet types data together
 } ATTRPACK doomdata_t;
 
@@ -398,7 +432,7 @@ extern UINT32 playerpingtable[MAXPLAYERS];
 extern tic_t servermaxping;
 
 extern consvar_t cv_netticbuffer, cv_allownewplayer, cv_joinnextround, cv_maxplayers, cv_joindelay, cv_rejointimeout;
-extern consvar_t cv_resynchattempts, cv_blamecfail;
+extern consvar_t cv_resynchattempts, cv_blamecfail, cv_deltagamestate;
 extern consvar_t cv_maxsend, cv_noticedownload, cv_downloadspeed;
 extern consvar_t cv_dedicatedidletime;
 
@@ -1551,8 +1551,22 @@ void D_SRB2Main(void)
 	CONS_Printf("R_Init(): Init SRB2 refresh daemon.\n");
 	R_Init();
 
+	// time the software span drawers, then quit
+	if (M_CheckParm("-benchdraw"))
+	{
+		INT32 benchwidth = 1920, benchheight = 1080;
+
+		if (M_IsNextParm())
+			benchwidth = atoi(M_GetNextParm());
+		if (M_IsNextParm())
+			benchheight = atoi(M_GetNextParm());
+
+		R_BenchmarkDrawers(benchwidth, benchheight);
+		I_Quit();
+	}
+
 	// setting up sound
-	if (dedicated)
+	if (dedicated || M_CheckParm("-benchdemo"))
 	{
 		sound_disabled = true;
 		midi_disabled = digital_disabled = true;
@@ -1639,6 +1653,8 @@ void D_SRB2Main(void)
 	p = M_CheckParm("-playdemo");
 	if (!p)
 		p = M_CheckParm("-timedemo");
+	if (!p)
+		p = M_CheckParm("-benchdemo");
 	if (p && M_IsNextParm())
 	{
 		char tmp[MAX_WADPATH];
@@ -1663,6 +1679,18 @@ void D_SRB2Main(void)
 			singledemo = true; // quit after one demo
 			G_DeferedPlayDemo(tmp);
 		}
+		else if (M_CheckParm("-benchdemo"))
+		{
+			// time every tic of the demo as fast as possible, write the stats, then quit
+			const char *outpath = va("%s"PATHSEP"%s", srb2home, "benchdemo.csv");
+			if (M_CheckParm("-benchout") && M_IsNextParm())
+				outpath = M_GetNextParm();
+
+			PS_StartBenchmark(tmp, outpath);
+			G_TimeDemo(tmp);
+			nodrawers = !M_CheckParm("-benchrender");
+			timedemo_quit = true;
+		}
 		else
 			G_TimeDemo(tmp);
 
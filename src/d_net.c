@@ -27,6 +27,7 @@
 #include "d_netfil.h"
 #include "d_clisrv.h"
 #include "z_zone.h"
+#include "byteptr.h"
 #include "i_tcp.h"
 #include "d_main.h" // srb2home
 
@@ -70,6 +71,7 @@ boolean (*I_NetGet)(void) = NULL;
 void (*I_NetSend)(void) = NULL;
 boolean (*I_NetCanSend)(void) = NULL;
 boolean (*I_NetCanGet)(void) = NULL;
+void (*I_NetFlush)(void) = NULL;
 void (*I_NetCloseSocket)(void) = NULL;
 void (*I_NetFreeNodenum)(INT32 nodenum) = NULL;
 SINT8 (*I_NetMakeNodewPort)(const char *address, const char* port) = NULL;
@@ -133,18 +135,42 @@ boolean Net_GetNetStat(void)
 // -----------------------------------------------------------------
 // Some structs and functions for acknowledgement of packets
 // -----------------------------------------------------------------
-#define MAXACKPACKETS 96 // Minimum number of nodes (wat)
-#define MAXACKTOSEND 96
+#define MAXACKPACKETS 640 // Room for a node with extended acks to fill its window
+#define MAXACKTOSEND 96 // Packets in flight to a node without extended acks
+#define EXTMAXACKTOSEND 512 // Packets in flight to a node with extended acks
 #define URGENTFREESLOTNUM 10
 #define ACKTOSENDTIMEOUT (TICRATE/11)
 
+// Acks are counted with 32 bits here; the header carries the low 8 bits,
+// plus 3 more in the reserved byte once both ends have agreed to it.
+// Numbers whose low byte would be 0 are skipped, 0 meaning "no ack".
+#define ACKWINDOW 1024 // acks tracked past firstacktosend, more than a sender may have outstanding
+#define LEGACYACKMASK 0xFF
+#define EXTACKMASK 0x7FF
+#define HEADER_EXTACKS 0x80 // bits 3-5 extend ack, bits 0-2 extend ackreturn
+#define HEADER_SACK 0x40 // PT_NOTHING carries a bitfield instead of a list of acks
+
+// Retransmission timeout, see RFC 6298. Times are in tics.
+#define MINRTO (2*ACKTOSENDTIMEOUT + 2) // acks can be held back for ACKTOSENDTIMEOUT
+#define MAXRTO (TICRATE*2)
+#define MAXBACKOFF 3
+
+// Congestion window, in CWNDUNIT units per packet.
+// Only low priority packets wait for it, urgent packets are always sent.
+// Game traffic is a few packets per tic, so the window never goes below that,
+// and losses only take a quarter off since most of them aren't congestion.
+#define CWNDUNIT 256
+#define INITCWND 16
+#define MINCWND 8
+
 #ifndef NONET
 typedef struct
 {
-	UINT8 acknum;
-	UINT8 nextacknum;
+	UINT32 acknum; // 0 if the slot is free
+	UINT32 nextacknum;
 	UINT8 destinationnode; // The node to send the ack to
-	tic_t senttime; // The time when the ack was sent
+	boolean fastresend; // A later packet got through, resend without waiting for the timeout
+	tic_t senttime; // The time when the ack was sent, 0 if it still has to be
 	UINT16 length; // The packet size
 	UINT16 resentnum; // The number of times the ack has been resent
 	union {
@@ -158,6 +184,8 @@ typedef enum
 {
 	NF_CLOSE = 1, // Flag is set when connection is closing
 	NF_TIMEOUT = 2, // Flag is set when the node got a timeout
+	NF_EXTACKS = 4, // Node understands extended ack numbers and bitfield acks
+	NF_REMOTEEXTACKS = 8, // Node has started sending extended ack numbers itself
 } node_flags_t;
 
 #ifndef NONET
@@ -168,13 +196,14 @@ static ackpak_t ackpak[MAXACKPACKETS];
 typedef struct
 {
 	// ack return to send (like sliding window protocol)
-	UINT8 firstacktosend;
+	UINT32 firstacktosend;
 
 	// when no consecutive packets are received we keep in mind what packets
-	// we already received in a queue
-	UINT8 acktosend_head;
-	UINT8 acktosend_tail;
-	UINT8 acktosend[MAXACKTOSEND];
+	// we already received, one bit per ack after firstacktosend
+	UINT8 acktosend[ACKWINDOW/8];
+
+	// ack of the last packet accepted, for Net_UnAcknowledgePacket
+	UINT32 lastack;
 
 	// automatically send keep alive packet when not enough trafic
 	tic_t lasttimeacktosend_sent;
@@ -182,8 +211,19 @@ typedef struct
 	tic_t lasttimepacketreceived;
 
 	// flow control: do not send too many packets with ack
-	UINT8 remotefirstack;
-	UINT8 nextacknum;
+	UINT32 remotefirstack;
+	UINT32 nextacknum;
+
+	// round trip time estimate, in eighths of a tic, srtt < 0 until measured
+	INT32 srtt;
+	INT32 rttvar;
+	tic_t rto;
+
+	// congestion control
+	INT32 cwnd;
+	INT32 ssthresh;
+	INT32 inflight; // ackpak slots used for this node
+	UINT32 recoveryack; // losses of acks before this one were already accounted for
 
 	UINT8 flags;
 } node_t;
@@ -191,34 +231,80 @@ typedef struct
 static node_t nodes[MAXNETNODES];
 #define NODETIMEOUT 14
 
+// Only a node that has sent extended acks itself is sure to read them,
+// and 8 bits can't tell apart more than 128 acks in flight
+#define MaxAcksInFlight(node) (((node)->flags & NF_REMOTEEXTACKS) ? EXTMAXACKTOSEND : MAXACKTOSEND)
+
 #ifndef NONET
-// return <0 if a < b (mod 256)
-//         0 if a = n (mod 256)
-//        >0 if a > b (mod 256)
+// return <0 if a < b
+//         0 if a = b
+//        >0 if a > b
 // mnemonic: to use it compare to 0: cmpack(a,b)<0 is "a < b" ...
-FUNCMATH static INT32 cmpack(UINT8 a, UINT8 b)
+FUNCMATH static INT32 cmpack(UINT32 a, UINT32 b)
 {
-	register INT32 d = a - b;
+	return (INT32)(a - b);
+}
 
-	if (d >= 127 || d < -128)
-		return -d;
-	return d;
+FUNCMATH static UINT32 NextAck(UINT32 ack)
+{
+	ack++;
+	if (!(ack & 0xFF))
+		ack++;
+	return ack;
 }
 
+FUNCMATH static UINT32 PrevAck(UINT32 ack)
+{
+	ack--;
+	if (!(ack & 0xFF))
+		ack--;
+	return ack;
+}
+
+// Rebuilds a full ack from the bits the header carries, taking the closest to ref
+FUNCMATH static UINT32 ExpandAck(UINT32 ref, UINT32 wire, UINT32 mask)
+{
+	const UINT32 span = mask + 1;
+	UINT32 ack = (ref & ~mask) | wire;
+
+	if (cmpack(ack, ref) > (INT32)(span/2))
+	{
+		if (ack >= span)
+			ack -= span;
+	}
+	else if (cmpack(ack, ref) <= -(INT32)(span/2))
+		ack += span;
+	return ack;
+}
+
+#define ISACKED(node, ack) ((node)->acktosend[((ack) % ACKWINDOW) >> 3] & (1 << ((ack) & 7)))
+#define SETACKED(node, ack) ((node)->acktosend[((ack) % ACKWINDOW) >> 3] |= (UINT8)(1 << ((ack) & 7)))
+#define CLEARACKED(node, ack) ((node)->acktosend[((ack) % ACKWINDOW) >> 3] &= (UINT8)~(1 << ((ack) & 7)))
+
+// Full ackreturn of the last packet processed, GotAcks reads bitfields from it
+static UINT32 lastackreturn;
+
 /** Sets freeack to a free acknum and copies the netbuffer in the ackpak table
   *
   * \param freeack  The address to store the free acknum at
   * \param lowtimer ???
   * \return True if a free acknum was found
   */
-static boolean GetFreeAcknum(UINT8 *freeack, boolean lowtimer)
+static boolean GetFreeAcknum(UINT32 *freeack, boolean lowtimer)
 {
 	node_t *node = &nodes[doomcom->remotenode];
 	INT32 i, numfreeslot = 0;
 
-	if (cmpack((UINT8)((node->remotefirstack + MAXACKTOSEND) % 256), node->nextacknum) < 0)
+	if (cmpack(node->remotefirstack + MaxAcksInFlight(node), node->nextacknum) < 0)
+	{
+		DEBFILE(va("too fast %u %u\n",node->remotefirstack,node->nextacknum));
+		return false;
+	}
+
+	// Low priority packets wait for the congestion window
+	if (netbuffer->packettype >= PT_CANFAIL && node->inflight * CWNDUNIT >= node->cwnd)
 	{
-		DEBFILE(va("too fast %d %d\n",node->remotefirstack,node->nextacknum));
+		DEBFILE(va("congestion window full %d %d\n", node->inflight, node->cwnd / CWNDUNIT));
 		return false;
 	}
 
@@ -235,11 +321,11 @@ static boolean GetFreeAcknum(UINT8 *freeack, boolean lowtimer)
 
 			ackpak[i].acknum = node->nextacknum;
 			ackpak[i].nextacknum = node->nextacknum;
-			node->nextacknum++;
-			if (!node->nextacknum)
-				node->nextacknum++;
+			node->nextacknum = NextAck(node->nextacknum);
+			node->inflight++;
 			ackpak[i].destinationnode = (UINT8)(node - nodes);
 			ackpak[i].length = doomcom->datalength;
+			ackpak[i].fastresend = false;
 			if (lowtimer)
 			{
 				// Lowtime means can't be sent now so try it as soon as possible
@@ -300,127 +386,159 @@ INT32 Net_GetFreeAcks(boolean urgent)
 }
 
 // Get a ack to send in the queue of this node
-static UINT8 GetAcktosend(INT32 node)
+static UINT32 GetAcktosend(INT32 node)
 {
 	nodes[node].lasttimeacktosend_sent = I_GetTime();
 	return nodes[node].firstacktosend;
 }
 
+static void FreeAck(INT32 i)
+{
+	nodes[ackpak[i].destinationnode].inflight--;
+	ackpak[i].acknum = 0;
+}
+
 static void RemoveAck(INT32 i)
 {
 	INT32 node = ackpak[i].destinationnode;
-	DEBFILE(va("Remove ack %d\n",ackpak[i].acknum));
-	ackpak[i].acknum = 0;
+	DEBFILE(va("Remove ack %u\n",ackpak[i].acknum));
+	FreeAck(i);
 	if (nodes[node].flags & NF_CLOSE)
 		Net_CloseConnection(node);
 }
 
+// Updates the round trip estimate, see RFC 6298
+static void UpdateRTT(node_t *node, tic_t rtt)
+{
+	const INT32 sample = (INT32)min(rtt, MAXRTO) << 3;
+	tic_t rto;
+
+	if (node->srtt < 0)
+	{
+		node->srtt = sample;
+		node->rttvar = sample / 2;
+	}
+	else
+	{
+		INT32 delta = sample - node->srtt;
+		node->srtt += delta / 8;
+		if (delta < 0)
+			delta = -delta;
+		node->rttvar += (delta - node->rttvar) / 4;
+	}
+
+	rto = (tic_t)(node->srtt + max(8, 4 * node->rttvar)) >> 3;
+	node->rto = min(max(rto, MINRTO), MAXRTO);
+}
+
+// The other end got the packet in this slot
+static void AckReceived(INT32 i)
+{
+	node_t *node = &nodes[ackpak[i].destinationnode];
+
+	// Karn's algorithm: resent packets don't tell which copy got acknowledged
+	if (!ackpak[i].resentnum && ackpak[i].senttime)
+		UpdateRTT(node, I_GetTime() - ackpak[i].senttime);
+
+	// Slow start, then grow by one packet per window
+	if (node->cwnd < node->ssthresh * CWNDUNIT)
+		node->cwnd += CWNDUNIT;
+	else
+		node->cwnd += CWNDUNIT * CWNDUNIT / node->cwnd;
+	node->cwnd = min(node->cwnd, MaxAcksInFlight(node) * CWNDUNIT);
+
+	RemoveAck(i);
+}
+
+// A packet in this slot is considered lost, shrink the congestion window
+// once for everything that was in flight with it
+static void AckLost(INT32 i, boolean timeout)
+{
+	node_t *node = &nodes[ackpak[i].destinationnode];
+
+	if (cmpack(ackpak[i].acknum, node->recoveryack) < 0)
+		return;
+
+	// A timeout means nothing got through for a while, take more off
+	node->ssthresh = max(node->cwnd / CWNDUNIT * (timeout ? 2 : 3) / 4, MINCWND);
+	node->cwnd = node->ssthresh * CWNDUNIT;
+	node->recoveryack = node->nextacknum;
+}
+
+// The resend timeout of a slot, doubled for each resend
+static tic_t AckTimeout(INT32 i)
+{
+	const tic_t rto = nodes[ackpak[i].destinationnode].rto;
+	return min(rto << min(ackpak[i].resentnum, MAXBACKOFF), MAXRTO);
+}
+
 // We have got a packet, proceed the ack request and ack return
 static boolean Processackpak(void)
 {
 	INT32 i;
 	boolean goodpacket = true;
 	node_t *node = &nodes[doomcom->remotenode];
+	const boolean extacks = (node->flags & NF_EXTACKS) && (netbuffer->reserved & HEADER_EXTACKS);
+
+	if (extacks)
+		node->flags |= NF_REMOTEEXTACKS;
+	node->lastack = 0;
+	lastackreturn = 0;
 
 	// Received an ack return, so remove the ack in the list
-	if (netbuffer->ackreturn && cmpack(node->remotefirstack, netbuffer->ackreturn) < 0)
+	if (netbuffer->ackreturn)
 	{
-		node->remotefirstack = netbuffer->ackreturn;
-		// Search the ackbuffer and free it
-		for (i = 0; i < MAXACKPACKETS; i++)
-			if (ackpak[i].acknum && ackpak[i].destinationnode == node - nodes
-				&& cmpack(ackpak[i].acknum, netbuffer->ackreturn) <= 0)
-			{
-				RemoveAck(i);
-			}
+		const UINT32 ackreturn = extacks
+			? ExpandAck(node->remotefirstack, netbuffer->ackreturn | ((netbuffer->reserved & 7) << 8), EXTACKMASK)
+			: ExpandAck(node->remotefirstack, netbuffer->ackreturn, LEGACYACKMASK);
+
+		lastackreturn = ackreturn;
+		if (cmpack(node->remotefirstack, ackreturn) < 0 && cmpack(ackreturn, node->nextacknum) < 0)
+		{
+			node->remotefirstack = ackreturn;
+			// Search the ackbuffer and free it
+			for (i = 0; i < MAXACKPACKETS; i++)
+				if (ackpak[i].acknum && ackpak[i].destinationnode == node - nodes
+					&& cmpack(ackpak[i].acknum, ackreturn) <= 0)
+				{
+					AckReceived(i);
+				}
+		}
 	}
 
 	// Received a packet with ack, queue it to send the ack back
 	if (netbuffer->ack)
 	{
-		UINT8 ack = netbuffer->ack;
+		const UINT32 ack = extacks
+			? ExpandAck(node->firstacktosend, netbuffer->ack | ((netbuffer->reserved & (7 << 3)) << 5), EXTACKMASK)
+			: ExpandAck(node->firstacktosend, netbuffer->ack, LEGACYACKMASK);
+
 		getackpacket++;
-		if (cmpack(ack, node->firstacktosend) <= 0)
+		if (cmpack(ack, node->firstacktosend) <= 0 || ISACKED(node, ack))
 		{
-			DEBFILE(va("Discard(1) ack %d (duplicated)\n", ack));
+			DEBFILE(va("Discard ack %u (duplicated)\n", ack));
 			duppacket++;
 			goodpacket = false; // Discard packet (duplicate)
 		}
+		else if (cmpack(ack, node->firstacktosend) >= ACKWINDOW)
+		{
+			// Too far ahead to remember, sender will resend it
+			DEBFILE(va("Discard ack %u (%u expected)\n", ack, NextAck(node->firstacktosend)));
+			goodpacket = false;
+		}
 		else
 		{
-			// Check if it is not already in the queue
-			for (i = node->acktosend_tail; i != node->acktosend_head; i = (i+1) % MAXACKTOSEND)
-				if (node->acktosend[i] == ack)
-				{
-					DEBFILE(va("Discard(2) ack %d (duplicated)\n", ack));
-					duppacket++;
-					goodpacket = false; // Discard packet (duplicate)
-					break;
-				}
-			if (goodpacket)
+			node->lastack = ack;
+			SETACKED(node, ack);
+
+			// Is a good packet so move the acknowledge number past every
+			// consecutive ack we now have
+			if (!ISACKED(node, NextAck(node->firstacktosend)))
+				DEBFILE(va("out of order packet (%u expected)\n", NextAck(node->firstacktosend)));
+			while (ISACKED(node, NextAck(node->firstacktosend)))
 			{
-				// Is a good packet so increment the acknowledge number,
-				// Then search for a "hole" in the queue
-				UINT8 nextfirstack = (UINT8)(node->firstacktosend + 1);
-				if (!nextfirstack)
-					nextfirstack = 1;
-
-				if (ack == nextfirstack)
-				{
-					UINT8 hm1; // head - 1
-					boolean change = true;
-
-					node->firstacktosend = nextfirstack++;
-					if (!nextfirstack)
-						nextfirstack = 1;
-					hm1 = (UINT8)((node->acktosend_head-1+MAXACKTOSEND) % MAXACKTOSEND);
-					while (change)
-					{
-						change = false;
-						for (i = node->acktosend_tail; i != node->acktosend_head;
-							i = (i+1) % MAXACKTOSEND)
-						{
-							if (cmpack(node->acktosend[i], nextfirstack) <= 0)
-							{
-								if (node->acktosend[i] == nextfirstack)
-								{
-									node->firstacktosend = nextfirstack++;
-									if (!nextfirstack)
-										nextfirstack = 1;
-									change = true;
-								}
-								if (i == node->acktosend_tail)
-								{
-									node->acktosend[node->acktosend_tail] = 0;
-									node->acktosend_tail = (UINT8)((i+1) % MAXACKTOSEND);
-								}
-								else if (i == hm1)
-								{
-									node->acktosend[hm1] = 0;
-									node->acktosend_head = hm1;
-									hm1 = (UINT8)((hm1-1+MAXACKTOSEND) % MAXACKTOSEND);
-								}
-							}
-						}
-					}
-				}
-				else // Out of order packet
-				{
-					// Don't increment firsacktosend, put it in asktosend queue
-					// Will be incremented when the nextfirstack comes (code above)
-					UINT8 newhead = (UINT8)((node->acktosend_head+1) % MAXACKTOSEND);
-					DEBFILE(va("out of order packet (%d expected)\n", nextfirstack));
-					if (newhead != node->acktosend_tail)
-					{
-						node->acktosend[node->acktosend_head] = ack;
-						node->acktosend_head = newhead;
-					}
-					else // Buffer full discard packet, sender will resend it
-					{ // We can admit the packet but we will not detect the duplication after :(
-						DEBFILE("no more freeackret\n");
-						goodpacket = false;
-					}
-				}
+				node->firstacktosend = NextAck(node->firstacktosend);
+				CLEARACKED(node, node->firstacktosend);
 			}
 		}
 	}
@@ -434,34 +552,109 @@ void Net_SendAcks(INT32 node)
 #ifdef NONET
 	(void)node;
 #else
+	node_t *n = &nodes[node];
+	UINT32 ack = n->firstacktosend;
+	size_t len = 0, i;
+
 	netbuffer->packettype = PT_NOTHING;
-	M_Memcpy(netbuffer->u.textcmd, nodes[node].acktosend, MAXACKTOSEND);
-	HSendPacket(node, false, 0, MAXACKTOSEND);
+	if (n->flags & NF_REMOTEEXTACKS)
+	{
+		// One bit per ack after firstacktosend, up to the last one received
+		memset(netbuffer->u.textcmd, 0, ACKWINDOW/8);
+		for (i = 0; i < ACKWINDOW; i++)
+		{
+			ack = NextAck(ack);
+			if (cmpack(ack, n->firstacktosend) >= ACKWINDOW)
+				break;
+			if (ISACKED(n, ack))
+			{
+				netbuffer->u.textcmd[i >> 3] |= (UINT8)(1 << (i & 7));
+				len = (i >> 3) + 1;
+			}
+		}
+	}
+	else
+	{
+		// The acks received out of order, padded with zeroes
+		memset(netbuffer->u.textcmd, 0, MAXACKTOSEND);
+		for (i = 0; len < MAXACKTOSEND && i < ACKWINDOW; i++)
+		{
+			ack = NextAck(ack);
+			if (cmpack(ack, n->firstacktosend) >= ACKWINDOW)
+				break;
+			if (ISACKED(n, ack))
+				netbuffer->u.textcmd[len++] = (UINT8)ack;
+		}
+		len = MAXACKTOSEND;
+	}
+	HSendPacket(node, false, 0, len);
 #endif
 }
 
 #ifndef NONET
 static void GotAcks(void)
 {
-	INT32 i, j;
+	node_t *node = &nodes[doomcom->remotenode];
+	const INT32 len = doomcom->datalength - BASEPACKETSIZE;
+	UINT32 acked[ACKWINDOW];
+	UINT8 ackedbits[ACKWINDOW*2/8]; // by distance from remotefirstack
+	UINT32 highest = 0;
+	INT32 i, j, numacked = 0;
 
-	for (j = 0; j < MAXACKTOSEND; j++)
-		if (netbuffer->u.textcmd[j])
-			for (i = 0; i < MAXACKPACKETS; i++)
-				if (ackpak[i].acknum && ackpak[i].destinationnode == doomcom->remotenode)
-				{
-					if (ackpak[i].acknum == netbuffer->u.textcmd[j])
-						RemoveAck(i);
-					// nextacknum is first equal to acknum, then when receiving bigger ack
-					// there is big chance the packet is lost
-					// When resent, nextacknum = nodes[node].nextacknum
-					// will redo the same but with different value
-					else if (cmpack(ackpak[i].nextacknum, netbuffer->u.textcmd[j]) <= 0
-							&& ackpak[i].senttime > 0)
-						{
-							ackpak[i].senttime--; // hurry up
-						}
-				}
+	if ((node->flags & NF_EXTACKS) && (netbuffer->reserved & HEADER_SACK))
+	{
+		UINT32 ack = lastackreturn;
+
+		if (!ack)
+			return;
+		for (j = 0; j < min(len, ACKWINDOW/8) * 8; j++)
+		{
+			ack = NextAck(ack);
+			if (netbuffer->u.textcmd[j >> 3] & (1 << (j & 7)))
+				acked[numacked++] = ack;
+		}
+	}
+	else
+	{
+		for (j = 0; j < min(len, MAXACKTOSEND); j++)
+			if (netbuffer->u.textcmd[j])
+				acked[numacked++] = ExpandAck(node->remotefirstack, netbuffer->u.textcmd[j], LEGACYACKMASK);
+	}
+
+	// Acks in flight are all after remotefirstack, so a bitfield
+	// lets the ackpak table be searched once for all of them
+	memset(ackedbits, 0, sizeof (ackedbits));
+	for (j = 0; j < numacked; j++)
+	{
+		const UINT32 d = acked[j] - node->remotefirstack;
+
+		if (!highest || cmpack(acked[j], highest) > 0)
+			highest = acked[j];
+		if (d < ACKWINDOW*2)
+			ackedbits[d >> 3] |= (UINT8)(1 << (d & 7));
+	}
+
+	if (!highest)
+		return;
+
+	for (i = 0; i < MAXACKPACKETS; i++)
+		if (ackpak[i].acknum && ackpak[i].destinationnode == doomcom->remotenode)
+		{
+			const UINT32 d = ackpak[i].acknum - node->remotefirstack;
+
+			if (d < ACKWINDOW*2 && (ackedbits[d >> 3] & (1 << (d & 7))))
+				AckReceived(i);
+		}
+
+	// nextacknum is first equal to acknum, then when resent it becomes
+	// the nodes[node].nextacknum of the time. If a packet sent after
+	// that got through there is big chance this one is lost
+	for (i = 0; i < MAXACKPACKETS; i++)
+		if (ackpak[i].acknum && ackpak[i].destinationnode == doomcom->remotenode
+			&& ackpak[i].senttime > 0 && cmpack(ackpak[i].nextacknum, highest) <= 0)
+		{
+			ackpak[i].fastresend = true; // hurry up
+		}
 }
 #endif
 
@@ -477,6 +670,7 @@ void Net_ConnectionTimeout(INT32 node)
 	reboundstore[rebound_head].packettype = PT_NODETIMEOUT;
 	reboundstore[rebound_head].ack = 0;
 	reboundstore[rebound_head].ackreturn = 0;
+	reboundstore[rebound_head].reserved = 0;
 	reboundstore[rebound_head].u.textcmd[0] = (UINT8)node;
 	reboundsize[rebound_head] = (INT16)(BASEPACKETSIZE + 1);
 	rebound_head = (rebound_head+1) % MAXREBOUND;
@@ -486,6 +680,31 @@ void Net_ConnectionTimeout(INT32 node)
 	nodes[node].lasttimepacketreceived = I_GetTime();
 }
 
+#ifndef NONET
+static void SendPacket(void);
+
+// Fills in the ack fields of the header for a packet to this node
+static void WriteAckHeader(INT32 node, UINT32 ack)
+{
+	UINT32 ackreturn = 0;
+
+	if (node < MAXNETNODES) // Can be a broadcast
+		ackreturn = GetAcktosend(node);
+
+	netbuffer->ack = (UINT8)ack;
+	netbuffer->ackreturn = (UINT8)ackreturn;
+	netbuffer->reserved = 0;
+
+	if (node < MAXNETNODES && (nodes[node].flags & NF_EXTACKS))
+	{
+		netbuffer->reserved = (UINT8)(HEADER_EXTACKS
+			| (((ack & EXTACKMASK) >> 8) << 3) | ((ackreturn & EXTACKMASK) >> 8));
+		if (netbuffer->packettype == PT_NOTHING && (nodes[node].flags & NF_REMOTEEXTACKS))
+			netbuffer->reserved |= HEADER_SACK;
+	}
+}
+#endif
+
 // Resend the data if needed
 void Net_AckTicker(void)
 {
@@ -496,7 +715,8 @@ void Net_AckTicker(void)
 	{
 		const INT32 nodei = ackpak[i].destinationnode;
 		node_t *node = &nodes[nodei];
-		if (ackpak[i].acknum && ackpak[i].senttime + NODETIMEOUT < I_GetTime())
+		if (ackpak[i].acknum && (ackpak[i].fastresend
+			|| ackpak[i].senttime + AckTimeout(i) <= I_GetTime()))
 		{
 			if (ackpak[i].resentnum > 20 && (node->flags & NF_CLOSE))
 			{
@@ -504,18 +724,24 @@ void Net_AckTicker(void)
 					i, nodei));
 				Net_CloseConnection(nodei | FORCECLOSE);
 
-				ackpak[i].acknum = 0;
+				if (ackpak[i].acknum)
+					FreeAck(i);
 				continue;
 			}
-			DEBFILE(va("Resend ack %d, %u<%d at %u\n", ackpak[i].acknum, ackpak[i].senttime,
-				NODETIMEOUT, I_GetTime()));
+			DEBFILE(va("Resend ack %u, %u<%u at %u\n", ackpak[i].acknum, ackpak[i].senttime,
+				AckTimeout(i), I_GetTime()));
+			if (ackpak[i].senttime)
+				AckLost(i, !ackpak[i].fastresend);
 			M_Memcpy(netbuffer, ackpak[i].pak.raw, ackpak[i].length);
 			ackpak[i].senttime = I_GetTime();
 			ackpak[i].resentnum++;
 			ackpak[i].nextacknum = node->nextacknum;
+			ackpak[i].fastresend = false;
 			retransmit++; // For stat
-			HSendPacket((INT32)(node - nodes), false, ackpak[i].acknum,
-				(size_t)(ackpak[i].length - BASEPACKETSIZE));
+			doomcom->remotenode = (INT16)nodei;
+			doomcom->datalength = (INT16)ackpak[i].length;
+			WriteAckHeader(nodei, ackpak[i].acknum);
+			SendPacket();
 		}
 	}
 
@@ -546,40 +772,49 @@ void Net_UnAcknowledgePacket(INT32 node)
 #ifdef NONET
 	(void)node;
 #else
-	INT32 hm1 = (nodes[node].acktosend_head-1+MAXACKTOSEND) % MAXACKTOSEND;
+	node_t *n = &nodes[node];
+	const UINT32 ack = n->lastack;
 	DEBFILE(va("UnAcknowledge node %d\n", node));
-	if (!node)
+	if (!node || !ack)
 		return;
-	if (nodes[node].acktosend[hm1] == netbuffer->ack)
-	{
-		nodes[node].acktosend[hm1] = 0;
-		nodes[node].acktosend_head = (UINT8)hm1;
-	}
-	else if (nodes[node].firstacktosend == netbuffer->ack)
-	{
-		nodes[node].firstacktosend--;
-		if (!nodes[node].firstacktosend)
-			nodes[node].firstacktosend = UINT8_MAX;
-	}
+	if (cmpack(ack, n->firstacktosend) > 0)
+		CLEARACKED(n, ack);
 	else
 	{
-		while (nodes[node].firstacktosend != netbuffer->ack)
-		{
-			nodes[node].acktosend_tail = (UINT8)
-				((nodes[node].acktosend_tail-1+MAXACKTOSEND) % MAXACKTOSEND);
-			nodes[node].acktosend[nodes[node].acktosend_tail] = nodes[node].firstacktosend;
-
-			nodes[node].firstacktosend--;
-			if (!nodes[node].firstacktosend)
-				nodes[node].firstacktosend = UINT8_MAX;
-		}
-		nodes[node].firstacktosend++;
-		if (!nodes[node].firstacktosend)
-			nodes[node].firstacktosend = 1;
+		// The ack was merged into firstacktosend, along with
+		// the ones after it, which are still received
+		UINT32 a;
+		for (a = NextAck(ack); cmpack(a, n->firstacktosend) <= 0; a = NextAck(a))
+			SETACKED(n, a);
+		n->firstacktosend = PrevAck(ack);
 	}
+	n->lastack = 0;
 #endif
 }
 
+/** Lets a node use extended ack numbers and bitfield acks,
+  * once it has told us it understands them
+  *
+  * \param node The node to enable them for
+  *
+  */
+void Net_EnableExtendedAcks(INT32 node)
+{
+	if (node > 0 && node < MAXNETNODES)
+		nodes[node].flags |= NF_EXTACKS;
+}
+
+/** Checks if a node uses extended ack numbers and bitfield acks
+  *
+  * \param node The node to check
+  * \return True if Net_EnableExtendedAcks was called for this connection
+  *
+  */
+boolean Net_ExtendedAcksEnabled(INT32 node)
+{
+	return node > 0 && node < MAXNETNODES && (nodes[node].flags & NF_EXTACKS);
+}
+
 #ifndef NONET
 /** Checks if all acks have been received
   *
@@ -628,10 +863,18 @@ void Net_WaitAllAckReceived(UINT32 timeout)
 
 static void InitNode(node_t *node)
 {
-	node->acktosend_head = node->acktosend_tail = 0;
+	memset(node->acktosend, 0, sizeof (node->acktosend));
 	node->firstacktosend = 0;
+	node->lastack = 0;
 	node->nextacknum = 1;
 	node->remotefirstack = 0;
+	node->srtt = -1;
+	node->rttvar = 0;
+	node->rto = NODETIMEOUT + 1;
+	node->cwnd = INITCWND * CWNDUNIT;
+	node->ssthresh = EXTMAXACKTOSEND;
+	node->inflight = 0;
+	node->recoveryack = 0;
 	node->flags = 0;
 }
 
@@ -663,7 +906,7 @@ void Net_AbortPacketType(UINT8 packettype)
 		if (ackpak[i].acknum && (ackpak[i].pak.data.packettype == packettype
 			|| packettype == UINT8_MAX))
 		{
-			ackpak[i].acknum = 0;
+			FreeAck(i);
 		}
 #endif
 }
@@ -714,7 +957,7 @@ void Net_CloseConnection(INT32 node)
 			if (!forceclose)
 				return; // connection will be closed when ack is returned
 			else
-				ackpak[i].acknum = 0;
+				FreeAck(i);
 		}
 
 	InitNode(&nodes[node]);
@@ -844,7 +1087,8 @@ static void DebugPrintpacket(const char *header)
 		{
 			servertics_pak *serverpak = &netbuffer->u.serverpak;
 			UINT8 *cmd = (UINT8 *)(&serverpak->cmds[serverpak->numslots * serverpak->numtics]);
-			size_t ntxtcmd = &((UINT8 *)netbuffer)[doomcom->datalength] - cmd;
+			UINT8 *end = &((UINT8 *)netbuffer)[doomcom->datalength];
+			size_t ntxtcmd = cmd < end ? (size_t)(end - cmd) : 0; // compact tics are shorter
 
 			fprintf(debugfile, "    firsttic %u ply %d tics %d ntxtcmd %s\n    ",
 				(UINT32)serverpak->starttic, serverpak->numslots, serverpak->numtics, sizeu1(ntxtcmd));
@@ -995,6 +1239,39 @@ static boolean ShouldDropPacket(void)
 #endif
 #endif
 
+#ifndef NONET
+// Sends the netbuffer, its header already filled in
+static void SendPacket(void)
+{
+	netbuffer->checksum = NetbufferChecksum();
+	sendbytes += packetheaderlength + doomcom->datalength; // For stat
+
+#ifdef PACKETDROP
+	// Simulate internet :)
+	//if (rand() >= (INT32)(RAND_MAX * (PACKETLOSSRATE / 100.f)))
+	if (!ShouldDropPacket())
+	{
+#endif
+#ifdef DEBUGFILE
+		if (debugfile)
+			DebugPrintpacket("SENT");
+#endif
+		I_NetSend();
+#ifdef PACKETDROP
+	}
+	else
+	{
+		if (packetdropquantity[netbuffer->packettype] > 0)
+			packetdropquantity[netbuffer->packettype]--;
+#ifdef DEBUGFILE
+		if (debugfile)
+			DebugPrintpacket("NOT SENT");
+#endif
+	}
+#endif
+}
+#endif
+
 //
 // HSendPacket
 //
@@ -1011,6 +1288,7 @@ boolean HSendPacket(INT32 node, boolean reliable, UINT8 acknum, size_t packetlen
 			return false;
 		}
 		netbuffer->ack = netbuffer->ackreturn = 0; // don't hold over values from last packet sent/received
+		netbuffer->reserved = 0;
 		M_Memcpy(&reboundstore[rebound_head], netbuffer,
 			doomcom->datalength);
 		reboundsize[rebound_head] = doomcom->datalength;
@@ -1046,52 +1324,26 @@ boolean HSendPacket(INT32 node, boolean reliable, UINT8 acknum, size_t packetlen
 		return false;
 	}
 
-	if (node < MAXNETNODES) // Can be a broadcast
-		netbuffer->ackreturn = GetAcktosend(node);
-	else
-		netbuffer->ackreturn = 0;
 	if (reliable)
 	{
+		UINT32 ack;
+
 		if (I_NetCanSend && !I_NetCanSend())
 		{
 			if (netbuffer->packettype < PT_CANFAIL)
-				GetFreeAcknum(&netbuffer->ack, true);
+				GetFreeAcknum(&ack, true);
 
 			DEBFILE("HSendPacket: Out of bandwidth\n");
 			return false;
 		}
-		else if (!GetFreeAcknum(&netbuffer->ack, false))
+		else if (!GetFreeAcknum(&ack, false))
 			return false;
+		WriteAckHeader(node, ack);
 	}
 	else
-		netbuffer->ack = acknum;
+		WriteAckHeader(node, acknum);
 
-	netbuffer->checksum = NetbufferChecksum();
-	sendbytes += packetheaderlength + doomcom->datalength; // For stat
-
-#ifdef PACKETDROP
-	// Simulate internet :)
-	//if (rand() >= (INT32)(RAND_MAX * (PACKETLOSSRATE / 100.f)))
-	if (!ShouldDropPacket())
-	{
-#endif
-#ifdef DEBUGFILE
-		if (debugfile)
-			DebugPrintpacket("SENT");
-#endif
-		I_NetSend();
-#ifdef PACKETDROP
-	}
-	else
-	{
-		if (packetdropquantity[netbuffer->packettype] > 0)
-			packetdropquantity[netbuffer->packettype]--;
-#ifdef DEBUGFILE
-		if (debugfile)
-			DebugPrintpacket("NOT SENT");
-#endif
-	}
-#endif
+	SendPacket();
 
 #endif // ndef NONET
 
@@ -1194,6 +1446,161 @@ boolean HGetPacket(void)
 	return true;
 }
 
+#if defined (PACKETDROP) && !defined (NONET)
+#define ACKTESTQUEUE 1024
+#define ACKTESTTIMEOUT (120*TICRATE)
+
+// Packets in flight on the acktest loopback link
+typedef struct
+{
+	INT16 node; // node the packet arrives from
+	INT16 length;
+	doomdata_t data;
+} acktestpacket_t;
+
+static acktestpacket_t *acktestqueue;
+static INT32 acktesthead, acktesttail;
+
+// Nodes 1 and 2 are the two ends of the link
+static void AckTest_Send(void)
+{
+	acktestpacket_t *p = &acktestqueue[acktesthead];
+
+	if ((acktesthead+1) % ACKTESTQUEUE == acktesttail)
+		return; // Link is full, so this is lost too
+
+	p->node = (doomcom->remotenode == 1) ? 2 : 1;
+	p->length = doomcom->datalength;
+	M_Memcpy(&p->data, netbuffer, doomcom->datalength);
+	acktesthead = (acktesthead+1) % ACKTESTQUEUE;
+}
+
+static boolean AckTest_Get(void)
+{
+	acktestpacket_t *p = &acktestqueue[acktesttail];
+
+	if (acktesttail == acktesthead)
+	{
+		doomcom->remotenode = -1;
+		return false;
+	}
+
+	doomcom->remotenode = p->node;
+	doomcom->datalength = p->length;
+	M_Memcpy(netbuffer, &p->data, p->length);
+	acktesttail = (acktesttail+1) % ACKTESTQUEUE;
+	return true;
+}
+
+/** Sends reliable packets over a loopback link and checks each one
+  * arrives exactly once. Loss comes from the drop and droprate commands.
+  */
+void Command_AckTest(void)
+{
+	void (*oldsend)(void) = I_NetSend;
+	boolean (*oldget)(void) = I_NetGet;
+	boolean (*oldcansend)(void) = I_NetCanSend;
+	const INT32 oldretransmit = retransmit;
+	INT32 packets = 1000, sent = 0, delivered = 0, duplicates = 0;
+	INT32 srtt, cwnd;
+	boolean extended = true, acked;
+	UINT8 *received;
+	tic_t start, now;
+
+	if (COM_Argc() >= 2)
+		packets = atoi(COM_Argv(1));
+	if (COM_Argc() >= 3)
+		extended = !!stricmp(COM_Argv(2), "legacy");
+
+	if (packets <= 0 || packets > 65535)
+	{
+		CONS_Printf("acktest [packets] [legacy]: send reliable packets over a loopback link\n"
+					"Use droprate first to test against packet loss\n");
+		return;
+	}
+
+	if (netgame || rebound_tail != rebound_head)
+	{
+		CONS_Printf("You can't run acktest during a netgame.\n");
+		return;
+	}
+
+	acktestqueue = Z_Malloc(ACKTESTQUEUE * sizeof (*acktestqueue), PU_STATIC, NULL);
+	acktesthead = acktesttail = 0;
+	received = Z_Calloc(packets, PU_STATIC, NULL);
+
+	I_NetSend = AckTest_Send;
+	I_NetGet = AckTest_Get;
+	I_NetCanSend = NULL;
+	netgame = true;
+	InitAck();
+	if (extended)
+	{
+		Net_EnableExtendedAcks(1);
+		Net_EnableExtendedAcks(2);
+	}
+
+	start = I_GetTime();
+	for (now = start; now - start < ACKTESTTIMEOUT; now = I_GetTime())
+	{
+		// Node 2 sends to node 1 as fast as its window allows
+		for (; sent < packets; sent++)
+		{
+			UINT8 *p = netbuffer->u.textcmd;
+
+			netbuffer->packettype = PT_TEXTCMD;
+			WRITEUINT32(p, sent);
+			if (!HSendPacket(1, true, 0, 4))
+				break;
+		}
+
+		while (HGetPacket())
+			if (doomcom->remotenode == 2 && netbuffer->packettype == PT_TEXTCMD)
+			{
+				UINT8 *p = netbuffer->u.textcmd;
+				const UINT32 seq = READUINT32(p);
+
+				if (seq >= (UINT32)packets)
+					continue;
+				if (received[seq])
+					duplicates++;
+				else
+				{
+					received[seq] = 1;
+					delivered++;
+				}
+			}
+
+		if (delivered == packets && Net_AllAcksReceived())
+			break;
+
+		// The link itself never times out, only the packets on it
+		nodes[1].lasttimepacketreceived = nodes[2].lasttimepacketreceived = now;
+		Net_AckTicker();
+		I_Sleep(1);
+	}
+
+	acked = Net_AllAcksReceived();
+	srtt = max(nodes[1].srtt, 0);
+	cwnd = nodes[1].cwnd / CWNDUNIT;
+
+	InitAck();
+	netgame = false;
+	I_NetSend = oldsend;
+	I_NetGet = oldget;
+	I_NetCanSend = oldcansend;
+	Z_Free(received);
+	Z_Free(acktestqueue);
+	acktestqueue = NULL;
+
+	CONS_Printf("acktest: %d/%d delivered, %d duplicates, %d retransmits in %u tics\n"
+		"srtt %d.%03d tics, cwnd %d, %s acks\n",
+		delivered, packets, duplicates, retransmit - oldretransmit, now - start,
+		srtt / 8, srtt % 8 * 125, cwnd, extended ? "extended" : "legacy");
+	CONS_Printf("acktest %s\n", (delivered == packets && !duplicates && acked) ? "passed" : "FAILED");
+}
+#endif
+
 static boolean Internal_Get(void)
 {
 	doomcom->remotenode = -1;
@@ -1268,6 +1675,7 @@ boolean D_CheckNetGame(void)
 	I_NetGet = Internal_Get;
 	I_NetSend = Internal_Send;
 	I_NetCanSend = NULL;
+	I_NetFlush = NULL;
 	I_NetCloseSocket = NULL;
 	I_NetFreeNodenum = Internal_FreeNodenum;
 	I_NetMakeNodewPort = NULL;
@@ -1460,6 +1868,7 @@ void D_CloseConnection(void)
 		I_NetGet = Internal_Get;
 		I_NetSend = Internal_Send;
 		I_NetCanSend = NULL;
+		I_NetFlush = NULL;
 		I_NetCloseSocket = NULL;
 		I_NetFreeNodenum = Internal_FreeNodenum;
 		I_NetMakeNodewPort = NULL;
@@ -63,5 +63,7 @@ void Net_ConnectionTimeout(INT32 node);
 void Net_AbortPacketType(UINT8 packettype);
 void Net_SendAcks(INT32 node);
 void Net_WaitAllAckReceived(UINT32 timeout);
+void Net_EnableExtendedAcks(INT32 node);
+boolean Net_ExtendedAcksEnabled(INT32 node);
 
 #endif
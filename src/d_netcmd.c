@@ -114,6 +114,7 @@ static void Fishcake_OnChange(void);
 static void Command_Playdemo_f(void);
 static void Command_Timedemo_f(void);
 static void Command_Stopdemo_f(void);
+static void Command_Dumphookstats_f(void);
 static void Command_StartMovie_f(void);
 static void Command_StopMovie_f(void);
 static void Command_Map_f(void);
@@ -332,6 +333,8 @@ consvar_t cv_hazardlog = CVAR_INIT ("hazardlog", "Yes", 0, CV_YesNo, NULL);
 
 consvar_t cv_forceskin = CVAR_INIT ("forceskin", "None", CV_NETVAR|CV_CALL|CV_CHEAT|CV_ALLOWLUA, NULL, ForceSkin_OnChange);
 consvar_t cv_downloading = CVAR_INIT ("downloading", "On", 0, CV_OnOff, NULL);
+static CV_PossibleValue_t downloadcachesize_cons_t[] = {{0, "MIN"}, {65535, "MAX"}, {0, NULL}};
+consvar_t cv_downloadcachesize = CVAR_INIT ("downloadcachesize", "1024", CV_SAVE, downloadcachesize_cons_t, NULL); // In megabytes
 consvar_t cv_allowexitlevel = CVAR_INIT ("allowexitlevel", "No", CV_SAVE|CV_NETVAR|CV_ALLOWLUA, CV_YesNo, NULL);
 
 consvar_t cv_killingdead = CVAR_INIT ("killingdead", "Off", CV_NETVAR|CV_ALLOWLUA, CV_OnOff, NULL);
@@ -370,13 +373,16 @@ consvar_t cv_exitmove = CVAR_INIT ("exitmove", "On", CV_SAVE|CV_NETVAR|CV_CALL|C
 
 consvar_t cv_runscripts = CVAR_INIT ("runscripts", "Yes", CV_ALLOWLUA, CV_YesNo, NULL);
 
+// Runs mobj thinkers grouped by type, see P_GroupMobjThinkers
+consvar_t cv_groupmobjthinkers = CVAR_INIT ("groupmobjthinkers", "Off", CV_SAVE|CV_NETVAR, CV_OnOff, NULL);
+
 consvar_t cv_pause = CVAR_INIT ("pausepermission", "Server", CV_SAVE|CV_NETVAR|CV_ALLOWLUA, pause_cons_t, NULL);
 consvar_t cv_mute = CVAR_INIT ("mute", "Off", CV_NETVAR|CV_CALL|CV_ALLOWLUA, CV_OnOff, Mute_OnChange);
 
 consvar_t cv_sleep = CVAR_INIT ("cpusleep", "1", CV_SAVE, sleeping_cons_t, NULL);
 
 static CV_PossibleValue_t perfstats_cons_t[] = {
-	{0, "Off"}, {1, "Rendering"}, {2, "Logic"}, {3, "ThinkFrame"}, {0, NULL}};
+	{0, "Off"}, {1, "Rendering"}, {2, "Logic"}, {3, "ThinkFrame"}, {4, "MobjTypes"}, {5, "LuaHooks"}, {0, NULL}};
 consvar_t cv_perfstats = CVAR_INIT ("perfstats", "Off", CV_CALL, perfstats_cons_t, PS_PerfStats_OnChange);
 static CV_PossibleValue_t ps_samplesize_cons_t[] = {
 	{1, "MIN"}, {1000, "MAX"}, {0, NULL}};
@@ -547,6 +553,7 @@ void D_RegisterServerCommands(void)
 	CV_RegisterVar(&cv_playbackspeed);
 	CV_RegisterVar(&cv_forceskin);
 	CV_RegisterVar(&cv_downloading);
+	CV_RegisterVar(&cv_downloadcachesize);
 
 	CV_RegisterVar(&cv_coopstarposts);
 	CV_RegisterVar(&cv_cooplives);
@@ -574,6 +581,7 @@ void D_RegisterServerCommands(void)
 	CV_RegisterVar(&cv_startinglives);
 	CV_RegisterVar(&cv_countdowntime);
 	CV_RegisterVar(&cv_runscripts);
+	CV_RegisterVar(&cv_groupmobjthinkers);
 	CV_RegisterVar(&cv_overtime);
 	CV_RegisterVar(&cv_pause);
 	CV_RegisterVar(&cv_mute);
@@ -599,6 +607,7 @@ void D_RegisterServerCommands(void)
 	CV_RegisterVar(&cv_joinnextround);
 	CV_RegisterVar(&cv_showjoinaddress);
 	CV_RegisterVar(&cv_blamecfail);
+	CV_RegisterVar(&cv_deltagamestate);
 	CV_RegisterVar(&cv_dedicatedidletime);
 #endif
 
@@ -891,6 +900,7 @@ void D_RegisterClientCommands(void)
 	CV_RegisterVar(&cv_perfstats);
 	CV_RegisterVar(&cv_ps_samplesize);
 	CV_RegisterVar(&cv_ps_descriptor);
+	COM_AddCommand("dumphookstats", Command_Dumphookstats_f, 0);
 
 	// ingame object placing
 	COM_AddCommand("objectplace", Command_ObjectPlace_f, COM_LUA);
@@ -1741,6 +1751,13 @@ static void Command_Stopdemo_f(void)
 	CONS_Printf(M_GetText("Stopped demo.\n"));
 }
 
+// write the hook times recorded by perfstats 5
+static void Command_Dumphookstats_f(void)
+{
+	const char *name = COM_Argc() > 1 ? COM_Argv(1) : "hookstats.csv";
+	PS_DumpHookStats(va("%s"PATHSEP"%s", srb2home, name));
+}
+
 static void Command_StartMovie_f(void)
 {
 	M_StartMovie();
@@ -52,6 +52,10 @@
 
 #include <errno.h>
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 // Prototypes
 static boolean AddFileToSendQueue(INT32 node, UINT8 fileid);
 
@@ -64,6 +68,7 @@ typedef struct filetx_s
 		char *ram; // Pointer to the data in RAM
 	} id;
 	UINT32 size; // Size of the file
+	boolean growing; // More is still being added, see AddGrowingRamToSendQueue
 	UINT8 fileid;
 	INT32 node; // Destination
 	struct filetx_s *next; // Next file in the list
@@ -73,13 +78,37 @@ typedef struct filetx_s
 typedef struct filetran_s
 {
 	filetx_t *txlist; // Linked list of all files for the node
-	UINT8 iteration;
-	UINT8 ackediteration;
-	UINT32 position; // The current position in the file
-	boolean *ackedfragments;
+	UINT32 nextfragment; // The first fragment that was never sent
+	UINT32 numfragments;
+	UINT8 *fragments; // FRAG_ flags for each fragment
+	tic_t *senttimes; // When each fragment was last sent
+	UINT32 ackedfragments;
 	UINT32 ackedsize;
 	FILE *currentfile; // The file currently being sent/received
-	tic_t dontsenduntil;
+
+	// Fragments in the order they were sent, to find the ones that timed out
+	UINT32 *sentqueue;
+	UINT32 senthead, senttail;
+	// Fragments that timed out, sent again before any new one
+	UINT32 *lostqueue;
+	UINT32 losthead, losttail;
+
+	// Pacing, kept from one file to the next
+	INT32 window; // Fragments allowed in flight, in FILEWINDOWUNIT units, 0 if not set up yet
+	INT32 ssthresh;
+	INT32 credit; // Fragments that can be sent this tic, in FILEWINDOWUNIT units
+	UINT32 inflight;
+	INT32 srtt; // In eighths of a tic, < 0 until measured
+	INT32 rttvar;
+	tic_t rto;
+	tic_t lastloss;
+	tic_t lastack;
+	UINT32 ackedthistic;
+	INT32 ackrate; // Fragments acked per tic, in FILEWINDOWUNIT units
+	tic_t ratetic;
+
+	boolean compress; // The node can inflate compressed fragments
+	UINT32 rawbytes, packedbytes; // To stop compressing files that don't shrink
 } filetran_t;
 static filetran_t transfer[MAXNETNODES];
 
@@ -358,6 +387,371 @@ void CL_AbortDownloadResume(void)
 	pauseddownload = NULL;
 }
 
+// Downloaded files are kept in a cache indexed by their checksum, so a file
+// that another server gives under another name isn't downloaded again.
+// Files found in the search paths get indexed too, so they don't have to
+// be searched for and checksummed again on the next join.
+typedef struct
+{
+	UINT8 md5sum[16];
+	UINT32 size;
+	time_t mtime; // To notice files that changed since they were indexed
+	time_t lastused;
+	boolean owned; // Downloaded into the cache, so it can be deleted
+	boolean used; // Used this session, so it can't be deleted yet
+	char *filename;
+} cachedfile_t;
+
+#define CACHEDIR "cache"
+#define CACHEINDEX "index.txt"
+
+static cachedfile_t *cachedfiles = NULL;
+static INT32 numcachedfiles = 0;
+static INT32 maxcachedfiles = 0;
+static INT32 *cachetable = NULL; // Indexes in cachedfiles, -1 for empty slots
+static INT32 cachetablesize = 0;
+static boolean cacheloaded = false;
+static boolean cachedirty = false;
+
+static const char *CL_MD5ToHex(const UINT8 *md5sum)
+{
+	static char hex[33];
+	INT32 i;
+
+	for (i = 0; i < 16; i++)
+		sprintf(&hex[i*2], "%02x", md5sum[i]);
+	return hex;
+}
+
+static boolean CL_HexToMD5(const char *hex, UINT8 *md5sum)
+{
+	INT32 i;
+
+	if (strlen(hex) != 32)
+		return false;
+
+	for (i = 0; i < 16; i++)
+	{
+		unsigned int byte;
+		if (sscanf(&hex[i*2], "%2x", &byte) != 1)
+			return false;
+		md5sum[i] = (UINT8)byte;
+	}
+	return true;
+}
+
+static boolean CL_CanCacheFile(const UINT8 *md5sum)
+{
+	static const UINT8 nomd5sum[16] = {0};
+
+	// Servers without MD5 support give every file the same empty checksum
+	return memcmp(md5sum, nomd5sum, 16) != 0;
+}
+
+static UINT32 CL_CacheSlot(const UINT8 *md5sum)
+{
+	// Checksums are already well mixed, the first bytes make a fine hash
+	return (md5sum[0] | (md5sum[1] << 8) | (md5sum[2] << 16) | ((UINT32)md5sum[3] << 24))
+		& (cachetablesize - 1);
+}
+
+static INT32 CL_FindCacheEntry(const UINT8 *md5sum)
+{
+	UINT32 slot;
+
+	if (!cachetablesize)
+		return -1;
+
+	for (slot = CL_CacheSlot(md5sum); cachetable[slot] != -1;
+		slot = (slot + 1) & (cachetablesize - 1))
+	{
+		if (!memcmp(cachedfiles[cachetable[slot]].md5sum, md5sum, 16))
+			return cachetable[slot];
+	}
+	return -1;
+}
+
+static void CL_InsertCacheEntry(INT32 i)
+{
+	UINT32 slot = CL_CacheSlot(cachedfiles[i].md5sum);
+
+	while (cachetable[slot] != -1)
+		slot = (slot + 1) & (cachetablesize - 1);
+	cachetable[slot] = i;
+}
+
+static void CL_RebuildCacheTable(void)
+{
+	INT32 i;
+
+	// Keep the table at most half full, so lookups stay short
+	if (cachetablesize < maxcachedfiles * 2)
+	{
+		cachetablesize = max(cachetablesize, 64);
+		while (cachetablesize < maxcachedfiles * 2)
+			cachetablesize *= 2;
+
+		free(cachetable);
+		cachetable = malloc(cachetablesize * sizeof(*cachetable));
+		if (!cachetable)
+			I_Error("CL_RebuildCacheTable: No more memory\n");
+	}
+
+	memset(cachetable, 0xFF, cachetablesize * sizeof(*cachetable));
+	for (i = 0; i < numcachedfiles; i++)
+		CL_InsertCacheEntry(i);
+}
+
+static cachedfile_t *CL_AddCacheEntry(const UINT8 *md5sum, const char *filename)
+{
+	cachedfile_t *entry;
+
+	if (numcachedfiles == maxcachedfiles)
+	{
+		maxcachedfiles = max(maxcachedfiles * 2, 32);
+		cachedfiles = realloc(cachedfiles, maxcachedfiles * sizeof(*cachedfiles));
+		if (!cachedfiles)
+			I_Error("CL_AddCacheEntry: No more memory\n");
+		CL_RebuildCacheTable();
+	}
+
+	entry = &cachedfiles[numcachedfiles];
+	memset(entry, 0, sizeof(*entry));
+	memcpy(entry->md5sum, md5sum, 16);
+	entry->filename = strdup(filename);
+	if (!entry->filename)
+		I_Error("CL_AddCacheEntry: No more memory\n");
+
+	CL_InsertCacheEntry(numcachedfiles++);
+	return entry;
+}
+
+static void CL_RemoveCacheEntry(INT32 i)
+{
+	free(cachedfiles[i].filename);
+	cachedfiles[i] = cachedfiles[--numcachedfiles];
+	CL_RebuildCacheTable();
+	cachedirty = true;
+}
+
+/** Forgets about a cached file, deleting it if it was downloaded into the cache
+  *
+  * \param i The index of the file in the cache
+  *
+  */
+static void CL_DeleteCacheEntry(INT32 i)
+{
+	if (cachedfiles[i].owned)
+	{
+		char dir[MAX_WADPATH];
+
+		remove(cachedfiles[i].filename);
+
+		// Also remove the directory named after its checksum
+		strlcpy(dir, cachedfiles[i].filename, sizeof dir);
+		dir[strlen(dir) - min(nameonlylength(dir) + 1, strlen(dir))] = '\0';
+#ifdef _WIN32
+		_rmdir(dir);
+#else
+		rmdir(dir);
+#endif
+	}
+
+	CL_RemoveCacheEntry(i);
+}
+
+static void CL_LoadFileCache(void)
+{
+	char line[MAX_WADPATH + 128];
+	FILE *f;
+
+	if (cacheloaded)
+		return;
+	cacheloaded = true;
+
+	f = fopen(va("%s" PATHSEP CACHEDIR PATHSEP CACHEINDEX, downloaddir), "r");
+	if (!f)
+		return;
+
+	// Each line is: checksum size mtime lastused owned filename
+	while (fgets(line, sizeof line, f))
+	{
+		char hex[33];
+		UINT8 md5sum[16];
+		unsigned long size, mtime, lastused;
+		INT32 owned, namestart = 0;
+		size_t len = strlen(line);
+		cachedfile_t *entry;
+
+		while (len && (line[len-1] == '\n' || line[len-1] == '\r'))
+			line[--len] = '\0';
+
+		if (sscanf(line, "%32s %lu %lu %lu %d %n", hex, &size, &mtime, &lastused, &owned, &namestart) < 5
+			|| !namestart || !line[namestart] || !CL_HexToMD5(hex, md5sum)
+			|| CL_FindCacheEntry(md5sum) != -1)
+			continue;
+
+		entry = CL_AddCacheEntry(md5sum, &line[namestart]);
+		entry->size = (UINT32)size;
+		entry->mtime = (time_t)mtime;
+		entry->lastused = (time_t)lastused;
+		entry->owned = (owned != 0);
+	}
+
+	fclose(f);
+}
+
+static void CL_SaveFileCache(void)
+{
+	FILE *f;
+	INT32 i;
+
+	if (!cachedirty)
+		return;
+	cachedirty = false;
+
+	I_mkdir(downloaddir, 0755);
+	I_mkdir(va("%s" PATHSEP CACHEDIR, downloaddir), 0755);
+
+	f = fopen(va("%s" PATHSEP CACHEDIR PATHSEP CACHEINDEX, downloaddir), "w");
+	if (!f)
+	{
+		CONS_Alert(CONS_WARNING, M_GetText("Couldn't save the download cache index\n"));
+		return;
+	}
+
+	for (i = 0; i < numcachedfiles; i++)
+	{
+		cachedfile_t *entry = &cachedfiles[i];
+		fprintf(f, "%s %lu %lu %lu %d %s\n", CL_MD5ToHex(entry->md5sum),
+			(unsigned long)entry->size, (unsigned long)entry->mtime,
+			(unsigned long)entry->lastused, entry->owned ? 1 : 0, entry->filename);
+	}
+
+	fclose(f);
+}
+
+/** Looks for a file with the given checksum in the download cache
+  *
+  * \param md5sum The checksum of the file
+  * \param filename Set to the path of the file when found
+  * \return True if the file was found
+  *
+  */
+static boolean CL_FindCachedFile(const UINT8 *md5sum, char *filename)
+{
+	cachedfile_t *entry;
+	struct stat st;
+	INT32 i;
+
+	if (!CL_CanCacheFile(md5sum))
+		return false;
+
+	CL_LoadFileCache();
+
+	i = CL_FindCacheEntry(md5sum);
+	if (i == -1)
+		return false;
+	entry = &cachedfiles[i];
+
+	// Changed or gone since it was indexed? Forget about it
+	if (stat(entry->filename, &st) || (UINT32)st.st_size != entry->size
+		|| (unsigned long)st.st_mtime != (unsigned long)entry->mtime)
+	{
+		CL_DeleteCacheEntry(i);
+		return false;
+	}
+
+	strlcpy(filename, entry->filename, MAX_WADPATH);
+	entry->lastused = time(NULL);
+	entry->used = true;
+	cachedirty = true;
+	return true;
+}
+
+/** Indexes a file with a known checksum in the download cache
+  *
+  * \param md5sum The checksum of the file
+  * \param filename The path of the file
+  * \param owned True if the file was downloaded into the cache
+  *
+  */
+static void CL_AddCachedFile(const UINT8 *md5sum, const char *filename, boolean owned)
+{
+	cachedfile_t *entry;
+	struct stat st;
+	INT32 i;
+
+	if (!CL_CanCacheFile(md5sum) || stat(filename, &st))
+		return;
+
+	CL_LoadFileCache();
+
+	i = CL_FindCacheEntry(md5sum);
+	if (i != -1)
+		CL_RemoveCacheEntry(i);
+
+	entry = CL_AddCacheEntry(md5sum, filename);
+	entry->size = (UINT32)st.st_size;
+	entry->mtime = st.st_mtime;
+	entry->lastused = time(NULL);
+	entry->owned = owned;
+	entry->used = true;
+	cachedirty = true;
+}
+
+/** Deletes the least recently used downloads
+  * until the cache fits in cv_downloadcachesize
+  */
+static void CL_TrimFileCache(void)
+{
+	const UINT64 maxsize = (UINT64)cv_downloadcachesize.value << 20;
+	UINT64 size = 0;
+	INT32 i;
+
+	for (i = 0; i < numcachedfiles; i++)
+		if (cachedfiles[i].owned)
+			size += cachedfiles[i].size;
+
+	while (size > maxsize)
+	{
+		INT32 oldest = -1;
+
+		for (i = 0; i < numcachedfiles; i++)
+			if (cachedfiles[i].owned && !cachedfiles[i].used
+				&& (oldest == -1 || cachedfiles[i].lastused < cachedfiles[oldest].lastused))
+				oldest = i;
+
+		if (oldest == -1)
+			break; // Everything left is in use
+
+		CONS_Debug(DBG_NETPLAY, "Removing %s from the download cache\n", cachedfiles[oldest].filename);
+		size -= cachedfiles[oldest].size;
+		CL_DeleteCacheEntry(oldest);
+	}
+}
+
+/** Puts a file name in the download cache,
+  * in a directory named after the checksum of the file
+  *
+  * \param filename The name of the file, without its path
+  * \param md5sum The checksum of the file
+  *
+  */
+static void CL_MakeCachePath(char *filename, const UINT8 *md5sum)
+{
+	char dir[MAX_WADPATH];
+	char name[MAX_WADPATH];
+
+	I_mkdir(downloaddir, 0755);
+	I_mkdir(va("%s" PATHSEP CACHEDIR, downloaddir), 0755);
+	strlcpy(dir, va("%s" PATHSEP CACHEDIR PATHSEP "%s", downloaddir, CL_MD5ToHex(md5sum)), sizeof dir);
+	I_mkdir(dir, 0755);
+
+	strlcpy(name, filename, sizeof name);
+	strlcpy(filename, va("%s" PATHSEP "%s", dir, name), MAX_WADPATH);
+}
+
 /** Sends requests for files in the ::fileneeded table with a status of
   * ::FS_NOTFOUND.
   *
@@ -392,14 +786,22 @@ boolean CL_SendFileRequest(void)
 
 			WRITEUINT8(p, i); // fileid
 
-			// put it in download dir
+			// put it in the download cache, or the download dir if it can't be cached
 			nameonly(fileneeded[i].filename);
-			strcatbf(fileneeded[i].filename, downloaddir, "/");
+			if (CL_CanCacheFile(fileneeded[i].md5sum))
+				CL_MakeCachePath(fileneeded[i].filename, fileneeded[i].md5sum);
+			else
+				strcatbf(fileneeded[i].filename, downloaddir, "/");
 
 			fileneeded[i].status = FS_REQUESTED;
 		}
 
 	WRITEUINT8(p, 0xFF);
+#ifdef HAVE_ZLIB
+	WRITEUINT8(p, REQUESTFILE_COMPRESSED);
+#else
+	WRITEUINT8(p, 0);
+#endif
 
 	I_GetDiskFreeSpace(&availablefreespace);
 	if (totalfreespaceneeded > availablefreespace)
@@ -417,13 +819,24 @@ boolean CL_SendFileRequest(void)
 boolean PT_RequestFile(INT32 node)
 {
 	UINT8 *p = netbuffer->u.textcmd;
+	UINT8 *end = netbuffer->u.textcmd + min(doomcom->datalength - BASEPACKETSIZE, MAXTEXTCMD-1);
 	UINT8 id;
 
+	transfer[node].compress = false;
+
 	while (p < netbuffer->u.textcmd + MAXTEXTCMD-1) // Don't allow hacked client to overflow
 	{
 		id = READUINT8(p);
 		if (id == 0xFF)
+		{
+#ifdef HAVE_ZLIB
+			if (p < end)
+				transfer[node].compress = (READUINT8(p) & REQUESTFILE_COMPRESSED) != 0;
+#else
+			(void)end;
+#endif
 			break;
+		}
 
 		if (!AddFileToSendQueue(node, id))
 		{
@@ -512,14 +925,22 @@ INT32 CL_CheckFiles(void)
 
 		if (fileneeded[i].folder)
 			fileneeded[i].status = findfolder(fileneeded[i].filename);
+		else if (CL_FindCachedFile(fileneeded[i].md5sum, fileneeded[i].filename))
+			fileneeded[i].status = FS_FOUND;
 		else
+		{
 			fileneeded[i].status = findfile(fileneeded[i].filename, fileneeded[i].md5sum, true);
+			if (fileneeded[i].status == FS_FOUND)
+				CL_AddCachedFile(fileneeded[i].md5sum, fileneeded[i].filename, false);
+		}
 
 		CONS_Debug(DBG_NETPLAY, "found %d\n", fileneeded[i].status);
 		return 4;
 	}
 
 	//now making it here means we've checked the entire list and no FS_NOTCHECKED files remain
+	CL_SaveFileCache();
+
 	if (numwadfiles+filestoload > MAX_WADFILES)
 		return 3;
 	else if (downloadrequired)
@@ -892,6 +1313,28 @@ void AddRamToSendQueue(INT32 node, void *data, size_t size, freemethod_t freemet
 	filestosend++;
 }
 
+/** Adds a memory block that is still being written to the file list for a node.
+  * Parts of it can be sent before it is complete, see GrowRamSendQueue.
+  *
+  * \param node The node to send the memory block to
+  * \param data What has been written to the block so far
+  * \param size The size of that in bytes
+  * \param freemethod How to free the block after it has been sent
+  * \param fileid The index of the file in the list of added files
+  * \sa AddRamToSendQueue
+  *
+  */
+void AddGrowingRamToSendQueue(INT32 node, void *data, size_t size, freemethod_t freemethod, UINT8 fileid)
+{
+	filetx_t *p;
+
+	AddRamToSendQueue(node, data, size, freemethod, fileid);
+
+	for (p = transfer[node].txlist; p->next; p = p->next)
+		;
+	p->growing = true;
+}
+
 /** Adds a file requested by Lua to the file list for a node
   *
   * \param node The node to send the file to
@@ -974,25 +1417,376 @@ static void SV_EndFileSend(INT32 node)
 
 	// Indicate that the transmission is over
 	transfer[node].currentfile = NULL;
-	if (transfer[node].ackedfragments)
-		free(transfer[node].ackedfragments);
-	transfer[node].ackedfragments = NULL;
+	free(transfer[node].fragments);
+	free(transfer[node].senttimes);
+	free(transfer[node].sentqueue);
+	free(transfer[node].lostqueue);
+	transfer[node].fragments = NULL;
+	transfer[node].senttimes = NULL;
+	transfer[node].sentqueue = NULL;
+	transfer[node].lostqueue = NULL;
+
+	// Start over with the pacing for the next downloads
+	if (!transfer[node].txlist)
+		transfer[node].window = 0;
 
 	filestosend--;
 }
 
 #define FILEFRAGMENTSIZE (software_MAXPACKETLENGTH - (FILETXHEADER + BASEPACKETSIZE))
 
+// Fragments are paced per node: a window of fragments in flight grows
+// as they get acknowledged and shrinks when many of them time out at once,
+// and is sent over one round trip. Nothing else limits the rate unless
+// cv_downloadspeed is set, which caps the total per tic.
+#define FILEWINDOWUNIT 256
+#define FILEINITWINDOW 32
+#define FILEMINWINDOW 4
+#define FILEMAXWINDOW 1024
+#define FILEMINRTO 3 // Acks are sent once per tic
+#define FILEMAXRTO (TICRATE*2)
+#define FILESENTQUEUE (FILEMAXWINDOW*4)
+#define FILELOSTQUEUE (FILEMAXWINDOW+1) // Room for a whole window
+
+// Compression is given up for files that don't shrink after this much
+#define FILECOMPRESSPROBE (64*1024)
+
+#define FRAG_ACKED 1
+#define FRAG_INFLIGHT 2
+#define FRAG_RESENT 4 // Acks for it don't give a round trip time
+
+// Fragments of a file that can be sent. While it grows, that is only those
+// that are full and don't hold its last byte, so the client always gets its
+// last fragment after it is complete, with FILETX_GROWING cleared.
+static UINT32 SV_SendableFragments(const filetx_t *f)
+{
+	if (f->growing)
+		return f->size ? (f->size - 1) / FILEFRAGMENTSIZE : 0;
+
+	// An empty file still takes one empty fragment
+	return max((f->size + FILEFRAGMENTSIZE - 1) / FILEFRAGMENTSIZE, 1);
+}
+
+static void SV_SetNumFragments(filetran_t *trans, UINT32 numfragments)
+{
+	const size_t count = max(numfragments, 1);
+
+	trans->fragments = realloc(trans->fragments, count * sizeof(*trans->fragments));
+	trans->senttimes = realloc(trans->senttimes, count * sizeof(*trans->senttimes));
+	if (!(trans->fragments && trans->senttimes))
+		I_Error("FileSendTicker: No more memory\n");
+
+	if (numfragments > trans->numfragments)
+	{
+		memset(&trans->fragments[trans->numfragments], 0, (numfragments - trans->numfragments) * sizeof(*trans->fragments));
+		memset(&trans->senttimes[trans->numfragments], 0, (numfragments - trans->numfragments) * sizeof(*trans->senttimes));
+	}
+	trans->numfragments = numfragments;
+}
+
+static void SV_InitFileSendRate(filetran_t *trans)
+{
+	trans->window = FILEINITWINDOW * FILEWINDOWUNIT;
+	trans->ssthresh = FILEMAXWINDOW;
+	trans->credit = trans->window; // Send the first window right away
+	trans->srtt = -1;
+	trans->rttvar = 0;
+	trans->rto = TICRATE / 2;
+	trans->lastloss = 0;
+	trans->lastack = I_GetTime();
+	trans->ackedthistic = 0;
+	trans->ackrate = 0;
+	trans->ratetic = I_GetTime();
+}
+
+/** Opens the first file in the list of a node and sets up its fragments
+  *
+  * \param node The destination
+  *
+  */
+static void SV_OpenFileSend(INT32 node)
+{
+	filetran_t *trans = &transfer[node];
+	filetx_t *f = trans->txlist;
+
+	if (!f->ram) // Sending a file
+	{
+		long filesize;
+
+		trans->currentfile = fopen(f->id.filename, "rb");
+
+		if (!trans->currentfile)
+			I_Error("File %s does not exist",
+				f->id.filename);
+
+		fseek(trans->currentfile, 0, SEEK_END);
+		filesize = ftell(trans->currentfile);
+
+		// Nobody wants to transfer a file bigger
+		// than 4GB!
+		if (filesize >= LONG_MAX)
+			I_Error("filesize of %s is too large", f->id.filename);
+		if (filesize == -1)
+			I_Error("Error getting filesize of %s", f->id.filename);
+
+		f->size = (UINT32)filesize;
+		fseek(trans->currentfile, 0, SEEK_SET);
+	}
+	else // Sending RAM
+		trans->currentfile = (FILE *)1; // Set currentfile to a non-null value to indicate that it is open
+
+	trans->numfragments = 0;
+	SV_SetNumFragments(trans, SV_SendableFragments(f));
+	trans->nextfragment = 0;
+	trans->ackedfragments = 0;
+	trans->ackedsize = 0;
+	trans->inflight = 0;
+	trans->senthead = trans->senttail = 0;
+	trans->losthead = trans->losttail = 0;
+	trans->rawbytes = trans->packedbytes = 0;
+
+	trans->sentqueue = malloc(FILESENTQUEUE * sizeof(*trans->sentqueue));
+	trans->lostqueue = malloc(FILELOSTQUEUE * sizeof(*trans->lostqueue));
+	if (!(trans->sentqueue && trans->lostqueue))
+		I_Error("FileSendTicker: No more memory\n");
+
+	if (!trans->window)
+		SV_InitFileSendRate(trans);
+}
+
+/** Updates a memory block added with AddGrowingRamToSendQueue.
+  * It must still be the last file in the list for the node.
+  *
+  * \param node The node the memory block is sent to
+  * \param data The block, which may have moved
+  * \param size How much of it has been written so far
+  * \param finished True if nothing more will be added
+  *
+  */
+void GrowRamSendQueue(INT32 node, void *data, size_t size, boolean finished)
+{
+	filetran_t *trans = &transfer[node];
+	filetx_t *f = trans->txlist;
+
+	while (f && f->next)
+		f = f->next;
+	if (!(f && f->growing))
+		I_Error("GrowRamSendQueue: no growing file for node %d\n", node);
+
+	f->id.ram = data;
+	f->size = (UINT32)size;
+	f->growing = !finished;
+
+	// Let the new fragments be sent if it is already being sent
+	if (f == trans->txlist && trans->currentfile)
+		SV_SetNumFragments(trans, SV_SendableFragments(f));
+}
+
+/** Marks the fragments that weren't acknowledged in time as lost,
+  * and shrinks the window once per round trip if too many were
+  *
+  * \param node The destination
+  *
+  */
+static void SV_CheckLostFragments(INT32 node)
+{
+	filetran_t *trans = &transfer[node];
+	const tic_t now = I_GetTime();
+	INT32 lost = 0;
+
+	while (trans->senthead != trans->senttail)
+	{
+		const UINT32 n = trans->sentqueue[trans->senttail];
+		UINT8 *flags = &trans->fragments[n];
+
+		if (*flags & FRAG_INFLIGHT)
+		{
+			if (trans->senttimes[n] + trans->rto > now)
+				break; // Everything after it was sent later
+
+			*flags = (UINT8)((*flags & ~FRAG_INFLIGHT) | FRAG_RESENT);
+			trans->inflight--;
+			trans->lostqueue[trans->losthead] = n;
+			trans->losthead = (trans->losthead + 1) % FILELOSTQUEUE;
+			lost++;
+		}
+
+		trans->senttail = (trans->senttail + 1) % FILESENTQUEUE;
+	}
+
+	// A few scattered losses are just a bad link, they get sent again.
+	// Losing a good part of the window means the node can't keep up.
+	// A lost ack packet looks the same, so only back off a quarter.
+	if (lost * 8 * FILEWINDOWUNIT > trans->window
+		&& now - trans->lastloss > (tic_t)max(trans->srtt >> 3, 1))
+	{
+		trans->ssthresh = max(trans->window / FILEWINDOWUNIT * 3 / 4, FILEMINWINDOW);
+		trans->window = trans->ssthresh * FILEWINDOWUNIT;
+		trans->lastloss = now;
+	}
+
+	// Nothing came back for a while, wait longer before sending again
+	if (lost && now - trans->lastack > trans->rto)
+		trans->rto = min(trans->rto * 2, FILEMAXRTO);
+}
+
+/** Updates the ack rate and the pacing credit of a node, once per tic
+  *
+  * \param node The destination
+  *
+  */
+static void SV_UpdateFileSendRate(INT32 node)
+{
+	filetran_t *trans = &transfer[node];
+	const tic_t now = I_GetTime();
+	INT32 rate;
+
+	if (now != trans->ratetic)
+	{
+		rate = (INT32)(trans->ackedthistic * FILEWINDOWUNIT / (now - trans->ratetic));
+		trans->ackrate += (rate - trans->ackrate) / 4;
+		trans->ackedthistic = 0;
+		trans->ratetic = now;
+	}
+
+	// Send the window over one round trip, without saving up for bursts
+	rate = trans->window * 8 / max(trans->srtt, 8);
+	trans->credit = min(trans->credit + rate, max(rate, FILEWINDOWUNIT));
+}
+
+/** Returns the next fragment to send to a node, lost fragments first
+  *
+  * \param node The destination
+  * \return The fragment number, or UINT32_MAX if there is nothing to send
+  *
+  */
+static UINT32 SV_NextFragment(INT32 node)
+{
+	filetran_t *trans = &transfer[node];
+
+	while (trans->losthead != trans->losttail)
+	{
+		const UINT32 n = trans->lostqueue[trans->losttail];
+		trans->losttail = (trans->losttail + 1) % FILELOSTQUEUE;
+		if (!(trans->fragments[n] & FRAG_ACKED))
+			return n;
+	}
+
+	// Fragments acknowledged before being sent, when resuming a download
+	while (trans->nextfragment < trans->numfragments
+		&& (trans->fragments[trans->nextfragment] & FRAG_ACKED))
+		trans->nextfragment++;
+
+	if (trans->nextfragment < trans->numfragments)
+		return trans->nextfragment++;
+	return UINT32_MAX;
+}
+
+/** Checks if a node has room for another fragment
+  *
+  * \param node The destination
+  * \return True if a fragment can be sent now
+  *
+  */
+static boolean SV_CanSendFragment(INT32 node)
+{
+	filetran_t *trans = &transfer[node];
+
+	return trans->txlist && trans->currentfile
+		&& trans->credit >= FILEWINDOWUNIT
+		&& (INT32)trans->inflight * FILEWINDOWUNIT < trans->window
+		&& (trans->senthead + 1) % FILESENTQUEUE != trans->senttail
+		&& (trans->losthead != trans->losttail || trans->nextfragment < trans->numfragments);
+}
+
+/** Sends the next fragment to a node
+  *
+  * \param node The destination
+  * \return True if a fragment was sent
+  *
+  */
+static boolean SV_SendFragment(INT32 node)
+{
+	filetran_t *trans = &transfer[node];
+	filetx_t *f = trans->txlist;
+	filetx_pak *p = &netbuffer->u.filetxpak;
+	UINT32 n = SV_NextFragment(node);
+	UINT32 position;
+	size_t fragmentsize, packetsize;
+	UINT16 flags = 0;
+
+	if (n == UINT32_MAX)
+		return false;
+
+	// Build a packet containing a file fragment
+	position = n * FILEFRAGMENTSIZE;
+	fragmentsize = min(f->size - position, FILEFRAGMENTSIZE);
+	if (f->ram)
+		M_Memcpy(p->data, &f->id.ram[position], fragmentsize);
+	else
+	{
+		fseek(trans->currentfile, position, SEEK_SET);
+
+		if (fread(p->data, 1, fragmentsize, trans->currentfile) != fragmentsize)
+			I_Error("FileSendTicker: can't read %s byte on %s at %d because %s", sizeu1(fragmentsize), f->id.filename, position, M_FileError(trans->currentfile));
+	}
+	packetsize = fragmentsize;
+
+#ifdef HAVE_ZLIB
+	if (trans->compress && fragmentsize
+		&& (trans->rawbytes < FILECOMPRESSPROBE || trans->packedbytes < trans->rawbytes / 16 * 15))
+	{
+		static Bytef packed[MAXPACKETLENGTH];
+		uLongf packedsize = sizeof(packed);
+
+		if (compress2(packed, &packedsize, (Bytef *)p->data, (uLong)fragmentsize, Z_BEST_SPEED) == Z_OK
+			&& packedsize < fragmentsize)
+		{
+			M_Memcpy(p->data, packed, packedsize);
+			packetsize = packedsize;
+			flags = FILETX_COMPRESSED;
+		}
+		trans->rawbytes += (UINT32)fragmentsize;
+		trans->packedbytes += (UINT32)packetsize;
+	}
+#endif
+
+	netbuffer->packettype = PT_FILEFRAGMENT;
+	p->iteration = 1; // Only echoed back by clients
+	p->position = LONG(position);
+	p->fileid = f->fileid;
+	p->filesize = LONG(f->size);
+	if (f->growing)
+		flags |= FILETX_GROWING;
+	p->size = SHORT((UINT16)(FILEFRAGMENTSIZE | flags));
+
+	// Send the packet
+	if (!HSendPacket(node, false, 0, FILETXHEADER + packetsize)) // Don't use the default acknowledgement system
+	{ // Not sent for some odd reason, retry at next call
+		trans->lostqueue[trans->losthead] = n;
+		trans->losthead = (trans->losthead + 1) % FILELOSTQUEUE;
+		return false;
+	}
+
+	trans->fragments[n] |= FRAG_INFLIGHT;
+	trans->senttimes[n] = I_GetTime();
+	trans->inflight++;
+	trans->credit -= FILEWINDOWUNIT;
+	trans->sentqueue[trans->senthead] = n;
+	trans->senthead = (trans->senthead + 1) % FILESENTQUEUE;
+	return true;
+}
+
 /** Handles file transmission
   *
   */
 void FileSendTicker(void)
 {
 	static INT32 currentnode = 0;
-	filetx_pak *p;
-	size_t fragmentsize;
-	filetx_t *f;
-	INT32 packetsent, ram, i, j;
+	static tic_t lasttic = 0;
+	static INT32 packetsent = 0;
+	boolean sent;
+	INT32 i, j;
 
 	// If someone is taking too long to download, kick them with a timeout
 	// to prevent blocking the rest of the server...
@@ -1013,128 +1807,101 @@ void FileSendTicker(void)
 	if (!filestosend) // No file to send
 		return;
 
-	packetsent = cv_downloadspeed.value;
+	// Open the files that aren't open yet, they can start right away
+	for (i = 0; i < MAXNETNODES; i++)
+		if (transfer[i].txlist && !transfer[i].currentfile)
+			SV_OpenFileSend(i);
 
-	netbuffer->packettype = PT_FILEFRAGMENT;
+	if (I_GetTime() != lasttic)
+	{
+		lasttic = I_GetTime();
+		packetsent = cv_downloadspeed.value ? cv_downloadspeed.value : INT32_MAX;
+
+		for (i = 0; i < MAXNETNODES; i++)
+			if (transfer[i].txlist)
+			{
+				SV_CheckLostFragments(i);
+				SV_UpdateFileSendRate(i);
+			}
+	}
 
-	// (((sendbytes-nowsentbyte)*TICRATE)/(I_GetTime()-starttime)<(UINT32)net_bandwidth)
-	while (packetsent-- && filestosend != 0)
+	// Hand out one fragment per node at a time, so every download gets its share
+	do
 	{
-		for (i = currentnode, j = 0; j < MAXNETNODES;
+		sent = false;
+		for (i = currentnode, j = 0; j < MAXNETNODES && packetsent > 0;
 			i = (i+1) % MAXNETNODES, j++)
 		{
-			if (transfer[i].txlist)
-				break;
+			if (SV_CanSendFragment(i) && SV_SendFragment(i))
+			{
+				sent = true;
+				packetsent--;
+			}
 		}
-		// no transfer to do
-		if (j >= MAXNETNODES)
-			I_Error("filestosend=%d but no file to send found\n", filestosend);
+	} while (sent && packetsent > 0);
 
-		currentnode = (i+1) % MAXNETNODES;
-		f = transfer[i].txlist;
-		ram = f->ram;
+	currentnode = (currentnode+1) % MAXNETNODES;
+}
 
-		// Open the file if it isn't open yet, or
-		if (!transfer[i].currentfile)
-		{
-			if (!ram) // Sending a file
-			{
-				long filesize;
+/** Handles an acknowledged fragment, growing the window
+  *
+  * \param node The destination
+  * \param n The fragment number
+  * \return True if that was the last fragment of the file
+  *
+  */
+static boolean SV_FragmentAcked(INT32 node, UINT32 n)
+{
+	filetran_t *trans = &transfer[node];
+	UINT8 *flags = &trans->fragments[n];
 
-				transfer[i].currentfile =
-					fopen(f->id.filename, "rb");
+	if (*flags & FRAG_ACKED)
+		return false;
 
-				if (!transfer[i].currentfile)
-					I_Error("File %s does not exist",
-						f->id.filename);
+	if (*flags & FRAG_INFLIGHT)
+	{
+		// Grow no further than what the node has shown it can take
+		const INT32 limit = max(FILEINITWINDOW * FILEWINDOWUNIT, 4 * trans->ackrate * (max(trans->srtt, 0) + 8) / 8);
 
-				fseek(transfer[i].currentfile, 0, SEEK_END);
-				filesize = ftell(transfer[i].currentfile);
+		trans->inflight--;
+		trans->ackedthistic++; // acks for fragments the node already had don't show its rate
 
-				// Nobody wants to transfer a file bigger
-				// than 4GB!
-				if (filesize >= LONG_MAX)
-					I_Error("filesize of %s is too large", f->id.filename);
-				if (filesize == -1)
-					I_Error("Error getting filesize of %s", f->id.filename);
+		if (!(*flags & FRAG_RESENT))
+		{
+			const INT32 rtt = (INT32)min(I_GetTime() - trans->senttimes[n], FILEMAXRTO) << 3;
+			tic_t rto;
 
-				f->size = (UINT32)filesize;
-				fseek(transfer[i].currentfile, 0, SEEK_SET);
+			if (trans->srtt < 0)
+			{
+				trans->srtt = rtt;
+				trans->rttvar = rtt / 2;
 			}
-			else // Sending RAM
-				transfer[i].currentfile = (FILE *)1; // Set currentfile to a non-null value to indicate that it is open
-
-			transfer[i].iteration = 1;
-			transfer[i].ackediteration = 0;
-			transfer[i].position = 0;
-			transfer[i].ackedsize = 0;
-
-			transfer[i].ackedfragments = calloc(f->size / FILEFRAGMENTSIZE + 1, sizeof(*transfer[i].ackedfragments));
-			if (!transfer[i].ackedfragments)
-				I_Error("FileSendTicker: No more memory\n");
-
-			transfer[i].dontsenduntil = 0;
-		}
-
-		// If the client hasn't acknowledged any fragment from the previous iteration,
-		// it is most likely because their acks haven't had enough time to reach the server
-		// yet, due to latency. In that case, we wait a little to avoid useless resend.
-		if (I_GetTime() < transfer[i].dontsenduntil)
-			continue;
-
-		// Find the first non-acknowledged fragment
-		while (transfer[i].ackedfragments[transfer[i].position / FILEFRAGMENTSIZE])
-		{
-			transfer[i].position += FILEFRAGMENTSIZE;
-			if (transfer[i].position >= f->size)
+			else
 			{
-				if (transfer[i].ackediteration < transfer[i].iteration)
-					transfer[i].dontsenduntil = I_GetTime() + TICRATE / 2;
-
-				transfer[i].position = 0;
-				transfer[i].iteration++;
+				INT32 delta = rtt - trans->srtt;
+				trans->srtt += delta / 8;
+				trans->rttvar += (abs(delta) - trans->rttvar) / 4;
 			}
+			rto = (tic_t)(trans->srtt + max(8, 4 * trans->rttvar)) >> 3;
+			trans->rto = min(max(rto, FILEMINRTO), FILEMAXRTO);
 		}
 
-		// Build a packet containing a file fragment
-		p = &netbuffer->u.filetxpak;
-		fragmentsize = FILEFRAGMENTSIZE;
-		if (f->size-transfer[i].position < fragmentsize)
-			fragmentsize = f->size-transfer[i].position;
-		if (ram)
-			M_Memcpy(p->data, &f->id.ram[transfer[i].position], fragmentsize);
-		else
+		if (trans->window < limit)
 		{
-			fseek(transfer[i].currentfile, transfer[i].position, SEEK_SET);
-
-			if (fread(p->data, 1, fragmentsize, transfer[i].currentfile) != fragmentsize)
-				I_Error("FileSendTicker: can't read %s byte on %s at %d because %s", sizeu1(fragmentsize), f->id.filename, transfer[i].position, M_FileError(transfer[i].currentfile));
-		}
-		p->iteration = transfer[i].iteration;
-		p->position = LONG(transfer[i].position);
-		p->fileid = f->fileid;
-		p->filesize = LONG(f->size);
-		p->size = SHORT((UINT16)FILEFRAGMENTSIZE);
-
-		// Send the packet
-		if (HSendPacket(i, false, 0, FILETXHEADER + fragmentsize)) // Don't use the default acknowledgement system
-		{ // Success
-			transfer[i].position = (UINT32)(transfer[i].position + fragmentsize);
-			if (transfer[i].position >= f->size)
-			{
-				if (transfer[i].ackediteration < transfer[i].iteration)
-					transfer[i].dontsenduntil = I_GetTime() + TICRATE / 2;
-
-				transfer[i].position = 0;
-				transfer[i].iteration++;
-			}
-		}
-		else
-		{ // Not sent for some odd reason, retry at next call
-			// Exit the while (can't send this one so why should i send the next?)
-			break;
+			if (trans->window < trans->ssthresh * FILEWINDOWUNIT)
+				trans->window += FILEWINDOWUNIT;
+			else
+				trans->window += FILEWINDOWUNIT * FILEWINDOWUNIT / trans->window;
+			trans->window = min(trans->window, FILEMAXWINDOW * FILEWINDOWUNIT);
 		}
 	}
+
+	*flags = (UINT8)((*flags & ~FRAG_INFLIGHT) | FRAG_ACKED);
+	trans->ackedfragments++;
+	trans->ackedsize += min(trans->txlist->size - n * FILEFRAGMENTSIZE, FILEFRAGMENTSIZE);
+	trans->lastack = I_GetTime();
+
+	return trans->ackedfragments == trans->numfragments && !trans->txlist->growing;
 }
 
 void PT_FileAck(void)
@@ -1145,7 +1912,7 @@ void PT_FileAck(void)
 	INT32 i, j;
 
 	// Wrong file id? Ignore it, it's probably a late packet
-	if (!(trans->txlist && packet->fileid == trans->txlist->fileid))
+	if (!(trans->txlist && packet->fileid == trans->txlist->fileid && trans->fragments))
 		return;
 
 	if (packet->numsegments * sizeof(*packet->segments) != doomcom->datalength - BASEPACKETSIZE - sizeof(*packet))
@@ -1154,13 +1921,6 @@ void PT_FileAck(void)
 		return;
 	}
 
-	if (packet->iteration > trans->ackediteration)
-	{
-		trans->ackediteration = packet->iteration;
-		if (trans->ackediteration >= trans->iteration - 1)
-			trans->dontsenduntil = 0;
-	}
-
 	for (i = 0; i < packet->numsegments; i++)
 	{
 		fileacksegment_t *segment = &packet->segments[i];
@@ -1168,23 +1928,19 @@ void PT_FileAck(void)
 		for (j = 0; j < 32; j++)
 			if (LONG(segment->acks) & (1 << j))
 			{
-				if (LONG(segment->start) * FILEFRAGMENTSIZE >= trans->txlist->size)
+				const UINT32 n = LONG(segment->start) + j;
+
+				if (n >= trans->numfragments)
 				{
 					Net_CloseConnection(node);
 					return;
 				}
 
-				if (!trans->ackedfragments[LONG(segment->start) + j])
+				// If the last missing fragment was acked, finish!
+				if (SV_FragmentAcked(node, n))
 				{
-					trans->ackedfragments[LONG(segment->start) + j] = true;
-					trans->ackedsize += FILEFRAGMENTSIZE;
-
-					// If the last missing fragment was acked, finish!
-					if (trans->ackedsize == trans->txlist->size)
-					{
-						SV_EndFileSend(node);
-						return;
-					}
+					SV_EndFileSend(node);
+					return;
 				}
 			}
 	}
@@ -1286,8 +2042,9 @@ void PT_FileFragment(void)
 	INT32 filenum = netbuffer->u.filetxpak.fileid;
 	fileneeded_t *file = &fileneeded[filenum];
 	UINT32 fragmentpos = LONG(netbuffer->u.filetxpak.position);
-	UINT16 fragmentsize = SHORT(netbuffer->u.filetxpak.size);
+	UINT16 fragmentsize = SHORT(netbuffer->u.filetxpak.size) & ~(FILETX_COMPRESSED|FILETX_GROWING);
 	UINT16 boundedfragmentsize = doomcom->datalength - BASEPACKETSIZE - sizeof(netbuffer->u.filetxpak);
+	UINT8 *data = netbuffer->u.filetxpak.data;
 	char *filename;
 
 	if (!file)
@@ -1321,6 +2078,7 @@ void PT_FileFragment(void)
 		file->status = FS_DOWNLOADING;
 		file->fragmentsize = fragmentsize;
 		file->iteration = 0;
+		file->growing = (SHORT(netbuffer->u.filetxpak.size) & FILETX_GROWING) != 0;
 
 		file->ackpacket = calloc(1, sizeof(*file->ackpacket) + 512);
 		if (!file->ackpacket)
@@ -1365,6 +2123,27 @@ void PT_FileFragment(void)
 
 	if (file->status == FS_DOWNLOADING)
 	{
+		// The file can still get longer until a fragment without the flag
+		// tells its final size; fragments can come in any order
+		if (file->growing)
+		{
+			const UINT32 filesize = LONG(netbuffer->u.filetxpak.filesize);
+
+			if (filesize > file->totalsize)
+			{
+				const UINT32 oldcount = file->totalsize / fragmentsize + 1;
+				const UINT32 newcount = filesize / fragmentsize + 1;
+
+				file->receivedfragments = realloc(file->receivedfragments, newcount * sizeof(*file->receivedfragments));
+				if (!file->receivedfragments)
+					I_Error("FileSendTicker: No more memory\n");
+				memset(&file->receivedfragments[oldcount], 0, (newcount - oldcount) * sizeof(*file->receivedfragments));
+				file->totalsize = filesize;
+			}
+			if (!(SHORT(netbuffer->u.filetxpak.size) & FILETX_GROWING))
+				file->growing = false;
+		}
+
 		if (fragmentpos >= file->totalsize)
 			I_Error("Invalid file fragment\n");
 
@@ -1372,18 +2151,38 @@ void PT_FileFragment(void)
 
 		if (!file->receivedfragments[fragmentpos / fragmentsize]) // Not received yet
 		{
+			if (SHORT(netbuffer->u.filetxpak.size) & FILETX_COMPRESSED)
+			{
+#ifdef HAVE_ZLIB
+				static Bytef unpacked[MAXPACKETLENGTH];
+				uLongf unpackedsize = min(fragmentsize, sizeof(unpacked));
+
+				if (uncompress(unpacked, &unpackedsize, data, boundedfragmentsize) != Z_OK
+					|| unpackedsize != min(fragmentsize, file->totalsize - fragmentpos))
+				{
+					// Don't acknowledge it, the server will send it again
+					DEBFILE(va("Bad compressed file fragment %u\n", fragmentpos));
+					return;
+				}
+				data = unpacked;
+				boundedfragmentsize = (UINT16)unpackedsize;
+#else
+				return; // We never asked for those
+#endif
+			}
+
 			file->receivedfragments[fragmentpos / fragmentsize] = true;
 
 			// We can receive packets in the wrong order, anyway all OSes support gaped files
 			fseek(file->file, fragmentpos, SEEK_SET);
-			if (fragmentsize && fwrite(netbuffer->u.filetxpak.data, boundedfragmentsize, 1, file->file) != 1)
+			if (fragmentsize && boundedfragmentsize && fwrite(data, boundedfragmentsize, 1, file->file) != 1)
 				I_Error("Can't write to %s: %s\n",filename, M_FileError(file->file));
 			file->currentsize += boundedfragmentsize;
 
 			AddFragmentToAckPacket(file->ackpacket, file->iteration, fragmentpos / fragmentsize, filenum);
 
 			// Finished?
-			if (file->currentsize == file->totalsize)
+			if (file->currentsize == file->totalsize && !file->growing)
 			{
 				fclose(file->file);
 				file->file = NULL;
@@ -1394,6 +2193,15 @@ void PT_FileFragment(void)
 				CONS_Printf(M_GetText("Downloading %s...(done)\n"),
 					filename);
 
+				// Keep it for the next servers that need it, if it is what was asked for
+				if (file->type == FILENEEDED_WAD && CL_CanCacheFile(file->md5sum)
+					&& checkfilemd5(file->filename, file->md5sum) == FS_FOUND)
+				{
+					CL_AddCachedFile(file->md5sum, file->filename, true);
+					CL_TrimFileCache();
+					CL_SaveFileCache();
+				}
+
 				// Tell the server we have received the file
 				netbuffer->packettype = PT_FILERECEIVED;
 				netbuffer->u.filereceived = filenum;
@@ -1465,6 +2273,7 @@ void SV_AbortSendFiles(INT32 node)
 {
 	while (transfer[node].txlist)
 		SV_EndFileSend(node);
+	transfer[node].compress = false;
 }
 
 void CloseNetFile(void)
@@ -1538,6 +2347,7 @@ void Command_Downloads_f(void)
 			CONS_Printf("%2d  %c%s  ", node, ratecolor, name); // Node and file name
 			CONS_Printf("\x80%uK\x84/\x80%uK ", position / 1024, size / 1024); // Progress in kB
 			CONS_Printf("\x80(%c%u%%\x80)  ", ratecolor, (UINT32)(100.0 * position / size)); // Progress in %
+			CONS_Printf("%uK/s  ", (UINT32)((INT64)transfer[node].ackrate * FILEFRAGMENTSIZE * TICRATE / FILEWINDOWUNIT / 1024)); // Measured rate
 			CONS_Printf("%s\n", I_GetNodeAddress(node)); // Address and newline
 		}
 }
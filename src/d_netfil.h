@@ -56,6 +56,7 @@ typedef struct
 	// Used only for download
 	FILE *file;
 	boolean *receivedfragments;
+	boolean growing; // The server is still adding to it, see FILETX_GROWING
 	UINT32 fragmentsize;
 	UINT8 iteration;
 	fileack_pak *ackpacket;
@@ -88,6 +89,9 @@ INT32 CL_CheckFiles(void);
 boolean CL_LoadServerFiles(void);
 void AddRamToSendQueue(INT32 node, void *data, size_t size, freemethod_t freemethod,
 	UINT8 fileid);
+void AddGrowingRamToSendQueue(INT32 node, void *data, size_t size, freemethod_t freemethod,
+	UINT8 fileid);
+void GrowRamSendQueue(INT32 node, void *data, size_t size, boolean finished);
 
 void FileSendTicker(void);
 void PT_FileAck(void);
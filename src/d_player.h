@@ -610,6 +610,8 @@ typedef struct player_s
 #ifdef HWRENDER
 	fixed_t fovadd; // adjust FOV for hw rendering
 #endif
+
+	INT32 luahandle; // Lua userdata reference, see LUA_PushUserdataHandle
 } player_t;
 
 // Values for dashmode
@@ -52,6 +52,8 @@ typedef struct thinker_s
 	// this one using pointers. Used for garbage collection.
 	INT32 references;
 
+	INT32 luahandle; // Lua userdata reference, see LUA_PushUserdataHandle
+
 #ifdef PARANOIA
 	INT32 debug_mobjtype;
 	tic_t debug_time;
@@ -641,6 +641,7 @@ extern consvar_t cv_powerupdisplay; // display powerups
 extern consvar_t cv_showinputjoy; // display joystick in time attack
 extern consvar_t cv_forceskin; // force clients to use the server's skin
 extern consvar_t cv_downloading; // allow clients to downloading WADs.
+extern consvar_t cv_downloadcachesize; // downloaded WADs kept for other servers, in MB
 extern ticcmd_t netcmds[BACKUPTICS][MAXPLAYERS];
 extern INT32 serverplayer;
 extern INT32 adminplayers[MAXPLAYERS];
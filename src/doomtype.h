@@ -257,12 +257,14 @@ enum {false = 0, true = 1};
 	#endif
 
 	#define ATTRUNUSED __attribute__((unused))
+	#define ATTRTHREADLOCAL __thread
 #elif defined (_MSC_VER)
 	#define ATTRNORETURN __declspec(noreturn)
 	#define ATTRINLINE __forceinline
 	#if _MSC_VER > 1200 // >= MSVC 6.0
 		#define ATTRNOINLINE __declspec(noinline)
 	#endif
+	#define ATTRTHREADLOCAL __declspec(thread)
 #endif
 
 #ifndef FUNCPRINTF
@@ -310,6 +312,9 @@ enum {false = 0, true = 1};
 #ifndef ATTRNOINLINE
 #define ATTRNOINLINE
 #endif
+#ifndef ATTRTHREADLOCAL
+#define ATTRTHREADLOCAL
+#endif
 
 /* Miscellaneous types that don't fit anywhere else (Can this be changed?) */
 
@@ -40,6 +40,7 @@
 #include "lua_hook.h"
 #include "md5.h" // demo checksums
 #include "d_netfil.h" // G_CheckDemoExtraFiles
+#include "m_perfstats.h" // -benchdemo
 
 boolean timingdemo; // if true, exit with report on completion
 boolean nodrawers; // for comparative timing purposes
@@ -2813,7 +2814,11 @@ static void G_StopTimingDemo(void)
 	double f1, f2;
 	demotime = I_GetTime() - demostarttime;
 	if (!demotime)
-		return;
+	{
+		if (!ps_benchmarking)
+			return;
+		demotime = 1; // Headless playback can finish within a tic
+	}
 	G_StopDemo();
 	timingdemo = false;
 	f1 = (double)demotime;
@@ -2858,6 +2863,9 @@ static void G_StopTimingDemo(void)
 		}
 	}
 
+	if (ps_benchmarking)
+		PS_FinishBenchmark();
+
 	if (restorecv_vidwait != cv_vidwait.value)
 		CV_SetValue(&cv_vidwait, restorecv_vidwait);
 	D_AdvanceDemo();
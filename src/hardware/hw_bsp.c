@@ -22,7 +22,8 @@
 #include "../m_argv.h"
 #include "../i_video.h"
 #include "../w_wad.h"
-#include "../p_setup.h" // levelfadecol
+#include "../p_setup.h" // levelfadecol, level cache
+#include "../byteptr.h"
 
 // --------------------------------------------------------------------------
 // This is global data for planes rendering
@@ -949,6 +950,98 @@ static void AdjustSegs(void)
 }
 
 
+// Saves what WalkBSPNode and SolveTProblem worked out into the level cache:
+// how many subsectors there are now, each node's children and bounding
+// boxes (both of which WalkBSPNode changes), then each subsector's polygon.
+// Points are copied as they are, since the cache never leaves this machine.
+// T-joins change the polygons, so they get a section of their own.
+#define PLANEPOLYSECTION (cv_glsolvetjoin.value ? "GLPT" : "GLPL")
+
+static void HWR_CachePlanePolygons(void)
+{
+	size_t length = 4 + numnodes*(2*2 + 8*4);
+	size_t i;
+	UINT8 *data, *p;
+	INT32 j;
+
+	for (i = 0; i < addsubsector; i++)
+		length += 4 + (extrasubsectors[i].planepoly ? extrasubsectors[i].planepoly->numpts*sizeof (polyvertex_t) : 0);
+
+	p = data = Z_Malloc(length, PU_STATIC, NULL);
+	WRITEUINT32(p, addsubsector);
+	for (i = 0; i < numnodes; i++)
+	{
+		WRITEUINT16(p, nodes[i].children[0]);
+		WRITEUINT16(p, nodes[i].children[1]);
+		for (j = 0; j < 8; j++)
+			WRITEFIXED(p, nodes[i].bbox[j/4][j%4]);
+	}
+	for (i = 0; i < addsubsector; i++)
+	{
+		poly_t *poly = extrasubsectors[i].planepoly;
+		WRITEINT32(p, poly ? poly->numpts : 0);
+		if (poly)
+		{
+			M_Memcpy(p, poly->pts, poly->numpts*sizeof (polyvertex_t));
+			p += poly->numpts*sizeof (polyvertex_t);
+		}
+	}
+
+	P_AddLevelCacheSection(PLANEPOLYSECTION, data, p - data);
+	Z_Free(data);
+}
+
+// Puts back what HWR_CachePlanePolygons saved, if the level cache has it.
+static boolean HWR_LoadCachedPlanePolygons(void)
+{
+	size_t length, i;
+	UINT8 *p = P_FindLevelCacheSection(PLANEPOLYSECTION, &length);
+	UINT8 *end = p + length;
+	UINT32 numsubs;
+	INT32 j, numpts;
+
+	if (!p || length < 4 + numnodes*(2*2 + 8*4))
+		return false;
+
+	numsubs = READUINT32(p);
+	if (numsubs < numsubsectors || numsubs > totsubsectors)
+		return false;
+
+	// Check it all adds up before touching anything
+	{
+		UINT8 *q = p + numnodes*(2*2 + 8*4);
+		for (i = 0; i < numsubs; i++)
+		{
+			if (end - q < 4)
+				return false;
+			numpts = READINT32(q);
+			if (numpts < 0 || (size_t)(end - q) < numpts*sizeof (polyvertex_t))
+				return false;
+			q += numpts*sizeof (polyvertex_t);
+		}
+	}
+
+	addsubsector = numsubs;
+	for (i = 0; i < numnodes; i++)
+	{
+		nodes[i].children[0] = READUINT16(p);
+		nodes[i].children[1] = READUINT16(p);
+		for (j = 0; j < 8; j++)
+			nodes[i].bbox[j/4][j%4] = READFIXED(p);
+	}
+	for (i = 0; i < addsubsector; i++)
+	{
+		numpts = READINT32(p);
+		if (!numpts)
+			continue;
+		extrasubsectors[i].planepoly = HWR_AllocPoly(numpts);
+		M_Memcpy(extrasubsectors[i].planepoly->pts, p, numpts*sizeof (polyvertex_t));
+		p += numpts*sizeof (polyvertex_t);
+	}
+
+	return true;
+}
+
 // call this routine after the BSP of a Doom wad file is loaded,
 // and it will generate all the convex polys for the hardware renderer
 void HWR_CreatePlanePolygons(INT32 bspnum)
@@ -990,6 +1083,12 @@ void HWR_CreatePlanePolygons(INT32 bspnum)
 	// number of the first new subsector that might be added
 	addsubsector = numsubsectors;
 
+	if (HWR_LoadCachedPlanePolygons())
+	{
+		AdjustSegs();
+		return;
+	}
+
 	// construct the initial convex poly that encloses the full map
 	rootp = HWR_AllocPoly(4);
 	rootpv = rootp->pts;
@@ -1011,6 +1110,7 @@ void HWR_CreatePlanePolygons(INT32 bspnum)
 
 	i = SolveTProblem();
 	//CONS_Debug(DBG_RENDER, "%d point divides a polygon line\n",i);
+	HWR_CachePlanePolygons();
 	AdjustSegs();
 
 	//debug debug..
@@ -283,6 +283,7 @@ typedef struct {
 	int PPCMM64    : 1; ///< PowerPC Movemem 64bit ok?
 	int ALPHAbyte  : 1; ///< ?
 	int PAE        : 1; ///< Physical Address Extension
+	int AVX2       : 1; ///< AVX2 features
 	int CPUs       : 8;
 } CPUInfoFlags;
 
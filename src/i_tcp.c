@@ -12,6 +12,12 @@
 ///        This is not really OS-dependent because all OSes have the same socket API.
 ///        Just use ifdef for OS-dependent parts.
 
+#if defined (__linux__) && !defined (NOMMSG)
+	#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE // recvmmsg, sendmmsg
+	#endif
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -165,6 +171,13 @@
 	#define ERRSOCKET (-1)
 #endif
 
+#if defined (__linux__) && !defined (NOMMSG) && !defined (NONET)
+	#define HAVE_MMSG // move datagrams in batches, one syscall each
+#endif
+
+#define NODEHASHSIZE 256 // power of two, comfortably above MAXNETNODES
+#define SOCKBATCH 32 // datagrams per recvmmsg/sendmmsg
+
 #ifndef NONET
 	// define socklen_t in DOS/Windows if it is not already defined
 	#ifdef USE_WINSOCK1
@@ -180,6 +193,30 @@
 	static boolean nodeconnected[MAXNETNODES+1];
 	static mysockaddr_t banned[MAXBANS];
 	static UINT8 bannedmask[MAXBANS];
+
+	// client addresses by host, so SOCK_Get doesn't compare against every node
+	static UINT8 nodehash[NODEHASHSIZE]; // first node in each bucket, 0 if empty
+	static UINT8 nodehashnext[MAXNETNODES+1];
+	static boolean nodehashed[MAXNETNODES+1];
+#endif
+
+#ifdef HAVE_MMSG
+	// datagrams from one recvmmsg, handed out one at a time by SOCK_Get
+	static char recvdata[SOCKBATCH][MAXPACKETLENGTH];
+	static mysockaddr_t recvaddress[SOCKBATCH];
+	static struct iovec recvvec[SOCKBATCH];
+	static struct mmsghdr recvmsgs[SOCKBATCH];
+	static size_t recvsocket;
+	static int recvcount, recvnext;
+
+	// datagrams queued by SOCK_Send until SOCK_FlushSends
+	static char senddata[SOCKBATCH][MAXPACKETLENGTH];
+	static mysockaddr_t sendaddress[SOCKBATCH];
+	static struct iovec sendvec[SOCKBATCH];
+	static struct mmsghdr sendmsgs[SOCKBATCH];
+	static SOCKET_TYPE sendsocket[SOCKBATCH];
+	static INT32 sendnode[SOCKBATCH]; // node to report errors for, -1 to ignore them
+	static int sendcount;
 #endif
 
 static size_t numbans = 0;
@@ -458,6 +495,86 @@ static boolean SOCK_cmpaddr(mysockaddr_t *a, mysockaddr_t *b, UINT8 mask)
 		return false;
 }
 
+// Only the family and host are hashed, so addresses SOCK_cmpaddr matches
+// through a wildcard port still share a bucket.
+static UINT8 SOCK_HashAddr(mysockaddr_t *sk)
+{
+	const UINT8 *p = NULL;
+	size_t len = 0;
+	UINT32 hash = 2166136261u;
+
+	if (sk->any.sa_family == AF_INET)
+	{
+		p = (const UINT8 *)&sk->ip4.sin_addr;
+		len = sizeof (sk->ip4.sin_addr);
+	}
+#ifdef HAVE_IPV6
+	else if (sk->any.sa_family == AF_INET6)
+	{
+		p = (const UINT8 *)&sk->ip6.sin6_addr;
+		len = sizeof (sk->ip6.sin6_addr);
+	}
+#endif
+
+	hash = (hash ^ sk->any.sa_family) * 16777619u;
+	while (len--)
+		hash = (hash ^ *p++) * 16777619u;
+
+	return (UINT8)((hash ^ (hash >> 16)) & (NODEHASHSIZE - 1));
+}
+
+static void SOCK_UnhashNode(INT32 node)
+{
+	UINT8 *link;
+
+	if (!nodehashed[node])
+		return;
+
+	for (link = &nodehash[SOCK_HashAddr(&clientaddress[node])]; *link; link = &nodehashnext[*link])
+	{
+		if (*link == node)
+		{
+			*link = nodehashnext[node];
+			break;
+		}
+	}
+
+	nodehashed[node] = false;
+}
+
+// Set the address of a node, or clear it when addr is NULL
+static void SOCK_SetNodeAddress(INT32 node, const void *addr, size_t len)
+{
+	UINT8 bucket;
+
+	SOCK_UnhashNode(node);
+	memset(&clientaddress[node], 0, sizeof (clientaddress[node]));
+
+	if (!addr)
+		return;
+
+	memcpy(&clientaddress[node], addr, len);
+
+	bucket = SOCK_HashAddr(&clientaddress[node]);
+	nodehashnext[node] = nodehash[bucket];
+	nodehash[bucket] = (UINT8)node;
+	nodehashed[node] = true;
+}
+
+// Same result as comparing against every node from 1 up, LAN included
+static INT32 SOCK_FindNode(mysockaddr_t *sk)
+{
+	INT32 node, found = 0;
+
+	for (node = nodehash[SOCK_HashAddr(sk)]; node; node = nodehashnext[node])
+	{
+		if ((!found || node < found) && SOCK_cmpaddr(sk, &clientaddress[node], 0))
+			found = node;
+	}
+
+	return found;
+}
+
 // This is a hack. For some reason, nodes aren't being freed properly.
 // This goes through and cleans up what nodes were supposed to be freed.
 /** \warning This function causes the file downloading to stop if someone joins.
@@ -545,6 +662,107 @@ void Command_Numnodes(void)
 #endif
 
 #ifndef NONET
+static socklen_t SOCK_AddrLen(mysockaddr_t *sockaddr)
+{
+	switch (sockaddr->any.sa_family)
+	{
+		case AF_INET:  return (socklen_t)sizeof(struct sockaddr_in);
+#ifdef HAVE_IPV6
+		case AF_INET6: return (socklen_t)sizeof(struct sockaddr_in6);
+#endif
+		default:       return (socklen_t)sizeof(mysockaddr_t);
+	}
+}
+
+static void SOCK_SendError(INT32 node)
+{
+	int e = errno; // save error code so it can't be modified later
+	if (node >= 0 && e != ECONNREFUSED && e != EWOULDBLOCK)
+		I_Error("SOCK_Send, error sending to node %d (%s) #%u: %s", node,
+			SOCK_GetNodeAddress(node), e, strerror(e));
+}
+
+#ifdef HAVE_MMSG
+static void SOCK_FlushSends(void)
+{
+	int first = 0;
+	int sent;
+
+	// sendmmsg takes one socket, so send each run of datagrams for the same one
+	while (first < sendcount)
+	{
+		int last = first + 1;
+
+		while (last < sendcount && sendsocket[last] == sendsocket[first])
+			last++;
+
+		sent = sendmmsg(sendsocket[first], &sendmsgs[first], last - first, MSG_DONTWAIT);
+
+		// it stops at the first datagram that fails, so report that one and carry on
+		if (sent <= 0)
+		{
+			SOCK_SendError(sendnode[first]);
+			first++;
+		}
+		else
+			first += sent;
+	}
+
+	sendcount = 0;
+}
+
+// Returns the next datagram from socket n in doomcom->data, receiving
+// another batch first if none are left.
+static ssize_t SOCK_Recv(size_t n, mysockaddr_t *fromaddress, socklen_t *fromlen)
+{
+	struct mmsghdr *msg;
+	int i;
+
+	if (recvnext < recvcount && recvsocket != n)
+		return ERRSOCKET; // drain the socket we already read from first
+
+	if (recvnext >= recvcount)
+	{
+		for (i = 0; i < SOCKBATCH; i++)
+		{
+			recvvec[i].iov_base = recvdata[i];
+			recvvec[i].iov_len = MAXPACKETLENGTH;
+			recvmsgs[i].msg_hdr.msg_name = &recvaddress[i];
+			recvmsgs[i].msg_hdr.msg_namelen = (socklen_t)sizeof(recvaddress[i]);
+			recvmsgs[i].msg_hdr.msg_iov = &recvvec[i];
+			recvmsgs[i].msg_hdr.msg_iovlen = 1;
+			recvmsgs[i].msg_hdr.msg_control = NULL;
+			recvmsgs[i].msg_hdr.msg_controllen = 0;
+			recvmsgs[i].msg_hdr.msg_flags = 0;
+		}
+
+		recvnext = 0;
+		recvcount = recvmmsg(mysockets[n], recvmsgs, SOCKBATCH, MSG_DONTWAIT, NULL);
+		if (recvcount <= 0)
+		{
+			recvcount = 0;
+			return ERRSOCKET;
+		}
+		recvsocket = n;
+	}
+
+	msg = &recvmsgs[recvnext];
+	M_Memcpy(&doomcom->data, recvdata[recvnext], msg->msg_len);
+	*fromlen = msg->msg_hdr.msg_namelen;
+	M_Memcpy(fromaddress, &recvaddress[recvnext], *fromlen);
+	recvnext++;
+
+	return (ssize_t)msg->msg_len;
+}
+#else
+static inline ssize_t SOCK_Recv(size_t n, mysockaddr_t *fromaddress, socklen_t *fromlen)
+{
+	*fromlen = (socklen_t)sizeof(*fromaddress);
+	return recvfrom(mysockets[n], (char *)&doomcom->data, MAXPACKETLENGTH, 0,
+		(void *)fromaddress, fromlen);
+}
+#endif
+
 // Returns true if a packet was received from a new node, false in all other cases
 static boolean SOCK_Get(void)
 {
@@ -554,23 +772,24 @@ static boolean SOCK_Get(void)
 	mysockaddr_t fromaddress;
 	socklen_t fromlen;
 
+#ifdef HAVE_MMSG
+	// whoever polls for packets is likely waiting on a reply to what they queued
+	SOCK_FlushSends();
+#endif
+
 	for (n = 0; n < mysocketses; n++)
 	{
-		fromlen = (socklen_t)sizeof(fromaddress);
-		c = recvfrom(mysockets[n], (char *)&doomcom->data, MAXPACKETLENGTH, 0,
-			(void *)&fromaddress, &fromlen);
+		c = SOCK_Recv(n, &fromaddress, &fromlen);
 		if (c != ERRSOCKET)
 		{
 			// find remote node number
-			for (j = 1; j <= MAXNETNODES; j++) //include LAN
+			j = SOCK_FindNode(&fromaddress);
+			if (j)
 			{
-				if (SOCK_cmpaddr(&fromaddress, &clientaddress[j], 0))
-				{
-					doomcom->remotenode = (INT16)j; // good packet from a game player
-					doomcom->datalength = (INT16)c;
-					nodesocket[j] = mysockets[n];
-					return false;
-				}
+				doomcom->remotenode = (INT16)j; // good packet from a game player
+				doomcom->datalength = (INT16)c;
+				nodesocket[j] = mysockets[n];
+				return false;
 			}
 			// not found
 
@@ -578,7 +797,7 @@ static boolean SOCK_Get(void)
 			j = getfreenode();
 			if (j > 0)
 			{
-				M_Memcpy(&clientaddress[j], &fromaddress, fromlen);
+				SOCK_SetNodeAddress(j, &fromaddress, fromlen);
 				nodesocket[j] = mysockets[n];
 				DEBFILE(va("New node detected: node:%d address:%s\n", j,
 						SOCK_GetNodeAddress(j)));
@@ -652,6 +871,10 @@ static boolean SOCK_CanGet(void)
 	fd_set tset;
 	int rselect;
 
+#ifdef HAVE_MMSG
+	if (recvnext < recvcount)
+		return true;
+#endif
 	if(!FD_CPY(&masterset, &tset, mysockets, mysocketses))
 		return false;
 	rselect = select(255, &tset, NULL, NULL, &timeval_for_select);
@@ -663,29 +886,35 @@ static boolean SOCK_CanGet(void)
 #endif
 
 #ifndef NONET
-static inline ssize_t SOCK_SendToAddr(SOCKET_TYPE socket, mysockaddr_t *sockaddr)
+// Send doomcom->data to an address, reporting errors for node unless it is -1
+static void SOCK_SendToAddr(SOCKET_TYPE socket, mysockaddr_t *sockaddr, INT32 node)
 {
-	socklen_t d4 = (socklen_t)sizeof(struct sockaddr_in);
-#ifdef HAVE_IPV6
-	socklen_t d6 = (socklen_t)sizeof(struct sockaddr_in6);
-#endif
-	socklen_t d, da = (socklen_t)sizeof(mysockaddr_t);
-
-	switch (sockaddr->any.sa_family)
-	{
-		case AF_INET:  d = d4; break;
-#ifdef HAVE_IPV6
-		case AF_INET6: d = d6; break;
+#ifdef HAVE_MMSG
+	const int k = sendcount++;
+
+	M_Memcpy(senddata[k], &doomcom->data, doomcom->datalength);
+	M_Memcpy(&sendaddress[k], sockaddr, sizeof (sendaddress[k]));
+	sendvec[k].iov_base = senddata[k];
+	sendvec[k].iov_len = doomcom->datalength;
+	memset(&sendmsgs[k], 0, sizeof (sendmsgs[k]));
+	sendmsgs[k].msg_hdr.msg_name = &sendaddress[k];
+	sendmsgs[k].msg_hdr.msg_namelen = SOCK_AddrLen(sockaddr);
+	sendmsgs[k].msg_hdr.msg_iov = &sendvec[k];
+	sendmsgs[k].msg_hdr.msg_iovlen = 1;
+	sendsocket[k] = socket;
+	sendnode[k] = node;
+
+	if (sendcount == SOCKBATCH)
+		SOCK_FlushSends();
+#else
+	if (sendto(socket, (char *)&doomcom->data, doomcom->datalength, 0,
+		&sockaddr->any, SOCK_AddrLen(sockaddr)) == ERRSOCKET)
+		SOCK_SendError(node);
 #endif
-		default:       d = da; break;
-	}
-
-	return sendto(socket, (char *)&doomcom->data, doomcom->datalength, 0, &sockaddr->any, d);
 }
 
 static void SOCK_Send(void)
 {
-	ssize_t c = ERRSOCKET;
 	size_t i, j;
 
 	if (!nodeconnected[doomcom->remotenode])
@@ -698,31 +927,22 @@ static void SOCK_Send(void)
 			for (j = 0; j < broadcastaddresses; j++)
 			{
 				if (myfamily[i] == broadcastaddress[j].any.sa_family)
-					SOCK_SendToAddr(mysockets[i], &broadcastaddress[j]);
+					SOCK_SendToAddr(mysockets[i], &broadcastaddress[j], -1);
 			}
 		}
-		return;
 	}
 	else if (nodesocket[doomcom->remotenode] == (SOCKET_TYPE)ERRSOCKET)
 	{
 		for (i = 0; i < mysocketses; i++)
 		{
 			if (myfamily[i] == clientaddress[doomcom->remotenode].any.sa_family)
-				SOCK_SendToAddr(mysockets[i], &clientaddress[doomcom->remotenode]);
+				SOCK_SendToAddr(mysockets[i], &clientaddress[doomcom->remotenode], -1);
 		}
-		return;
 	}
 	else
 	{
-		c = SOCK_SendToAddr(nodesocket[doomcom->remotenode], &clientaddress[doomcom->remotenode]);
-	}
-
-	if (c == ERRSOCKET)
-	{
-		int e = errno; // save error code so it can't be modified later
-		if (e != ECONNREFUSED && e != EWOULDBLOCK)
-			I_Error("SOCK_Send, error sending to node %d (%s) #%u: %s", doomcom->remotenode,
-				SOCK_GetNodeAddress(doomcom->remotenode), e, strerror(e));
+		SOCK_SendToAddr(nodesocket[doomcom->remotenode], &clientaddress[doomcom->remotenode],
+			doomcom->remotenode);
 	}
 }
 #endif
@@ -740,7 +960,7 @@ static void SOCK_FreeNodenum(INT32 numnode)
 	nodesocket[numnode] = ERRSOCKET;
 
 	// put invalid address
-	memset(&clientaddress[numnode], 0, sizeof (clientaddress[numnode]));
+	SOCK_SetNodeAddress(numnode, NULL, 0);
 }
 #endif
 
@@ -1150,6 +1370,10 @@ boolean I_InitTcpDriver(void)
 static void SOCK_CloseSocket(void)
 {
 	size_t i;
+#ifdef HAVE_MMSG
+	SOCK_FlushSends();
+	recvcount = recvnext = 0;
+#endif
 	for (i=0; i < MAXNETNODES+1; i++)
 	{
 		if (mysockets[i] != (SOCKET_TYPE)ERRSOCKET
@@ -1221,7 +1445,7 @@ static SINT8 SOCK_NetMakeNodewPort(const char *address, const char *port)
 					sendto(mysockets[i], NULL, 0, 0,
 						runp->ai_addr, runp->ai_addrlen) == 0)
 			{
-				memcpy(&clientaddress[newnode], runp->ai_addr, runp->ai_addrlen);
+				SOCK_SetNodeAddress(newnode, runp->ai_addr, runp->ai_addrlen);
 				break;
 			}
 		}
@@ -1242,6 +1466,8 @@ static boolean SOCK_OpenSocket(void)
 	size_t i;
 
 	memset(clientaddress, 0, sizeof (clientaddress));
+	memset(nodehash, 0, sizeof (nodehash));
+	memset(nodehashed, 0, sizeof (nodehashed));
 
 	nodeconnected[0] = true; // always connected to self
 	for (i = 1; i < MAXNETNODES; i++)
@@ -1252,6 +1478,9 @@ static boolean SOCK_OpenSocket(void)
 	I_NetCloseSocket = SOCK_CloseSocket;
 	I_NetFreeNodenum = SOCK_FreeNodenum;
 	I_NetMakeNodewPort = SOCK_NetMakeNodewPort;
+#ifdef HAVE_MMSG
+	I_NetFlush = SOCK_FlushSends;
+#endif
 
 #ifdef SELECTTEST
 	// seem like not work with libsocket : (
@@ -76,6 +76,27 @@ static int lib_concat(lua_State *L)
 	return 1;
 }
 
+// collectgarbage, but "count" is followed by the peak and the KB
+// reserved for Lua, from the arena in lua_script.c
+static int lib_collectGarbage(lua_State *L)
+{
+	const int n = lua_gettop(L);
+	const boolean count = !strcmp(luaL_optstring(L, 1, "collect"), "count");
+
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_insert(L, 1);
+	lua_call(L, n, 1);
+
+	if (count)
+	{
+		const luaarenastats_t *stats = LUA_GetArenaStats();
+		lua_pushinteger(L, stats->peak >> 10);
+		lua_pushinteger(L, stats->reserved >> 10);
+		return 3;
+	}
+	return 1;
+}
+
 // Wrapper for CONS_Printf
 // Copied from base Lua code
 static int lib_print(lua_State *L)
@@ -626,7 +647,7 @@ static int lib_pSpawnMobj(lua_State *L)
 	INLEVEL
 	if (type >= NUMMOBJTYPES)
 		return luaL_error(L, "mobj type %d out of range (0 - %d)", type, NUMMOBJTYPES-1);
-	LUA_PushUserdata(L, P_SpawnMobj(x, y, z, type), META_MOBJ);
+	LUA_PushMobj(L, P_SpawnMobj(x, y, z, type));
 	return 1;
 }
 
@@ -643,7 +664,7 @@ static int lib_pSpawnMobjFromMobj(lua_State *L)
 		return LUA_ErrInvalid(L, "mobj_t");
 	if (type >= NUMMOBJTYPES)
 		return luaL_error(L, "mobj type %d out of range (0 - %d)", type, NUMMOBJTYPES-1);
-	LUA_PushUserdata(L, P_SpawnMobjFromMobj(actor, x, y, z, type), META_MOBJ);
+	LUA_PushMobj(L, P_SpawnMobjFromMobj(actor, x, y, z, type));
 	return 1;
 }
 
@@ -711,7 +732,7 @@ static int lib_pSpawnMissile(lua_State *L)
 		return LUA_ErrInvalid(L, "mobj_t");
 	if (type >= NUMMOBJTYPES)
 		return luaL_error(L, "mobj type %d out of range (0 - %d)", type, NUMMOBJTYPES-1);
-	LUA_PushUserdata(L, P_SpawnMissile(source, dest, type), META_MOBJ);
+	LUA_PushMobj(L, P_SpawnMissile(source, dest, type));
 	return 1;
 }
 
@@ -729,7 +750,7 @@ static int lib_pSpawnXYZMissile(lua_State *L)
 		return LUA_ErrInvalid(L, "mobj_t");
 	if (type >= NUMMOBJTYPES)
 		return luaL_error(L, "mobj type %d out of range (0 - %d)", type, NUMMOBJTYPES-1);
-	LUA_PushUserdata(L, P_SpawnXYZMissile(source, dest, type, x, y, z), META_MOBJ);
+	LUA_PushMobj(L, P_SpawnXYZMissile(source, dest, type, x, y, z));
 	return 1;
 }
 
@@ -749,7 +770,7 @@ static int lib_pSpawnPointMissile(lua_State *L)
 		return LUA_ErrInvalid(L, "mobj_t");
 	if (type >= NUMMOBJTYPES)
 		return luaL_error(L, "mobj type %d out of range (0 - %d)", type, NUMMOBJTYPES-1);
-	LUA_PushUserdata(L, P_SpawnPointMissile(source, xa, ya, za, type, x, y, z), META_MOBJ);
+	LUA_PushMobj(L, P_SpawnPointMissile(source, xa, ya, za, type, x, y, z));
 	return 1;
 }
 
@@ -767,7 +788,7 @@ static int lib_pSpawnAlteredDirectionMissile(lua_State *L)
 		return LUA_ErrInvalid(L, "mobj_t");
 	if (type >= NUMMOBJTYPES)
 		return luaL_error(L, "mobj type %d out of range (0 - %d)", type, NUMMOBJTYPES-1);
-	LUA_PushUserdata(L, P_SpawnAlteredDirectionMissile(source, type, x, y, z, shiftingAngle), META_MOBJ);
+	LUA_PushMobj(L, P_SpawnAlteredDirectionMissile(source, type, x, y, z, shiftingAngle));
 	return 1;
 }
 
@@ -798,7 +819,7 @@ static int lib_pSPMAngle(lua_State *L)
 		return LUA_ErrInvalid(L, "mobj_t");
 	if (type >= NUMMOBJTYPES)
 		return luaL_error(L, "mobj type %d out of range (0 - %d)", type, NUMMOBJTYPES-1);
-	LUA_PushUserdata(L, P_SPMAngle(source, type, angle, allowaim, flags2), META_MOBJ);
+	LUA_PushMobj(L, P_SPMAngle(source, type, angle, allowaim, flags2));
 	return 1;
 }
 
@@ -813,7 +834,7 @@ static int lib_pSpawnPlayerMissile(lua_State *L)
 		return LUA_ErrInvalid(L, "mobj_t");
 	if (type >= NUMMOBJTYPES)
 		return luaL_error(L, "mobj type %d out of range (0 - %d)", type, NUMMOBJTYPES-1);
-	LUA_PushUserdata(L, P_SpawnPlayerMissile(source, type, flags2), META_MOBJ);
+	LUA_PushMobj(L, P_SpawnPlayerMissile(source, type, flags2));
 	return 1;
 }
 
@@ -869,7 +890,7 @@ static int lib_pGetClosestAxis(lua_State *L)
 	INLEVEL
 	if (!source)
 		return LUA_ErrInvalid(L, "mobj_t");
-	LUA_PushUserdata(L, P_GetClosestAxis(source), META_MOBJ);
+	LUA_PushMobj(L, P_GetClosestAxis(source));
 	return 1;
 }
 
@@ -1409,7 +1430,7 @@ static int lib_pSpawnGhostMobj(lua_State *L)
 	INLEVEL
 	if (!mobj)
 		return LUA_ErrInvalid(L, "mobj_t");
-	LUA_PushUserdata(L, P_SpawnGhostMobj(mobj), META_MOBJ);
+	LUA_PushMobj(L, P_SpawnGhostMobj(mobj));
 	return 1;
 }
 
@@ -1602,7 +1623,7 @@ static int lib_pLookForEnemies(lua_State *L)
 	INLEVEL
 	if (!player)
 		return LUA_ErrInvalid(L, "player_t");
-	LUA_PushUserdata(L, P_LookForEnemies(player, nonenemies, bullet), META_MOBJ);
+	LUA_PushMobj(L, P_LookForEnemies(player, nonenemies, bullet));
 	return 1;
 }
 
@@ -1751,7 +1772,7 @@ static int lib_pCheckPosition(lua_State *L)
 	if (!thing)
 		return LUA_ErrInvalid(L, "mobj_t");
 	lua_pushboolean(L, P_CheckPosition(thing, x, y));
-	LUA_PushUserdata(L, tmthing, META_MOBJ);
+	LUA_PushMobj(L, tmthing);
 	P_SetTarget(&tmthing, ptmthing);
 	return 2;
 }
@@ -1768,7 +1789,7 @@ static int lib_pTryMove(lua_State *L)
 	if (!thing)
 		return LUA_ErrInvalid(L, "mobj_t");
 	lua_pushboolean(L, P_TryMove(thing, x, y, allowdropoff));
-	LUA_PushUserdata(L, tmthing, META_MOBJ);
+	LUA_PushMobj(L, tmthing);
 	P_SetTarget(&tmthing, ptmthing);
 	return 2;
 }
@@ -1783,7 +1804,7 @@ static int lib_pMove(lua_State *L)
 	if (!actor)
 		return LUA_ErrInvalid(L, "mobj_t");
 	lua_pushboolean(L, P_Move(actor, speed));
-	LUA_PushUserdata(L, tmthing, META_MOBJ);
+	LUA_PushMobj(L, tmthing);
 	P_SetTarget(&tmthing, ptmthing);
 	return 2;
 }
@@ -1801,7 +1822,7 @@ static int lib_pTeleportMove(lua_State *L)
 		return LUA_ErrInvalid(L, "mobj_t");
 	LUA_Deprecated(L, "P_TeleportMove", "P_SetOrigin\" or \"P_MoveOrigin");
 	lua_pushboolean(L, P_MoveOrigin(thing, x, y, z));
-	LUA_PushUserdata(L, tmthing, META_MOBJ);
+	LUA_PushMobj(L, tmthing);
 	P_SetTarget(&tmthing, ptmthing);
 	return 2;
 }
@@ -1818,7 +1839,7 @@ static int lib_pSetOrigin(lua_State *L)
 	if (!thing)
 		return LUA_ErrInvalid(L, "mobj_t");
 	lua_pushboolean(L, P_SetOrigin(thing, x, y, z));
-	LUA_PushUserdata(L, tmthing, META_MOBJ);
+	LUA_PushMobj(L, tmthing);
 	P_SetTarget(&tmthing, ptmthing);
 	return 2;
 }
@@ -1835,7 +1856,7 @@ static int lib_pMoveOrigin(lua_State *L)
 	if (!thing)
 		return LUA_ErrInvalid(L, "mobj_t");
 	lua_pushboolean(L, P_MoveOrigin(thing, x, y, z));
-	LUA_PushUserdata(L, tmthing, META_MOBJ);
+	LUA_PushMobj(L, tmthing);
 	P_SetTarget(&tmthing, ptmthing);
 	return 2;
 }
@@ -2262,7 +2283,7 @@ static int lib_pMobjTouchingSectorSpecial(lua_State *L)
 	INLEVEL
 	if (!mo)
 		return LUA_ErrInvalid(L, "mobj_t");
-	LUA_PushUserdata(L, P_MobjTouchingSectorSpecial(mo, section, number), META_SECTOR);
+	LUA_PushSector(L, P_MobjTouchingSectorSpecial(mo, section, number));
 	return 1;
 }
 
@@ -2274,7 +2295,7 @@ static int lib_pThingOnSpecial3DFloor(lua_State *L)
 	if (!mo)
 		return LUA_ErrInvalid(L, "mobj_t");
 	LUA_Deprecated(L, "P_ThingOnSpecial3DFloor", "P_MobjTouchingSectorSpecial\" or \"P_MobjTouchingSectorSpecialFlag");
-	LUA_PushUserdata(L, P_ThingOnSpecial3DFloor(mo), META_SECTOR);
+	LUA_PushSector(L, P_ThingOnSpecial3DFloor(mo));
 	return 1;
 }
 
@@ -2286,7 +2307,7 @@ static int lib_pMobjTouchingSectorSpecialFlag(lua_State *L)
 	INLEVEL
 	if (!mo)
 		return LUA_ErrInvalid(L, "mobj_t");
-	LUA_PushUserdata(L, P_MobjTouchingSectorSpecialFlag(mo, flag), META_SECTOR);
+	LUA_PushSector(L, P_MobjTouchingSectorSpecialFlag(mo, flag));
 	return 1;
 }
 
@@ -2299,7 +2320,7 @@ static int lib_pPlayerTouchingSectorSpecial(lua_State *L)
 	INLEVEL
 	if (!player)
 		return LUA_ErrInvalid(L, "player_t");
-	LUA_PushUserdata(L, P_PlayerTouchingSectorSpecial(player, section, number), META_SECTOR);
+	LUA_PushSector(L, P_PlayerTouchingSectorSpecial(player, section, number));
 	return 1;
 }
 
@@ -2311,7 +2332,7 @@ static int lib_pPlayerTouchingSectorSpecialFlag(lua_State *L)
 	INLEVEL
 	if (!player)
 		return LUA_ErrInvalid(L, "player_t");
-	LUA_PushUserdata(L, P_PlayerTouchingSectorSpecialFlag(player, flag), META_SECTOR);
+	LUA_PushSector(L, P_PlayerTouchingSectorSpecialFlag(player, flag));
 	return 1;
 }
 
@@ -2725,7 +2746,7 @@ static int lib_rPointInSubsector(lua_State *L)
 	fixed_t y = luaL_checkfixed(L, 2);
 	//HUDSAFE
 	INLEVEL
-	LUA_PushUserdata(L, R_PointInSubsector(x, y), META_SUBSECTOR);
+	LUA_PushSubsector(L, R_PointInSubsector(x, y));
 	return 1;
 }
 
@@ -2737,7 +2758,7 @@ static int lib_rPointInSubsectorOrNil(lua_State *L)
 	//HUDSAFE
 	INLEVEL
 	if (sub)
-		LUA_PushUserdata(L, sub, META_SUBSECTOR);
+		LUA_PushSubsector(L, sub);
 	else
 		lua_pushnil(L);
 	return 1;
@@ -3616,7 +3637,7 @@ static int lib_gAddPlayer(lua_State *L)
 		strlcat(player_names[newplayernum], "\x84[BOT]\x80", sizeof(*player_names));
 	}
 
-	LUA_PushUserdata(L, newplayer, META_PLAYER);
+	LUA_PushPlayer(L, newplayer);
 	return 1;
 }
 
@@ -4310,5 +4331,9 @@ int LUA_BaseLib(lua_State *L)
 	// Set global functions
 	lua_pushvalue(L, LUA_GLOBALSINDEX);
 	luaL_register(L, NULL, lib);
+
+	lua_getfield(L, -1, "collectgarbage");
+	lua_pushcclosure(L, lib_collectGarbage, 1);
+	lua_setfield(L, -2, "collectgarbage");
 	return 0;
 }
@@ -48,8 +48,8 @@ static UINT8 lib_searchBlockmap_Objects(lua_State *L, INT32 x, INT32 y, mobj_t *
 		if (mobj == thing)
 			continue; // our thing just found itself, so move on
 		lua_pushvalue(L, 1); // push function
-		LUA_PushUserdata(L, thing, META_MOBJ);
-		LUA_PushUserdata(L, mobj, META_MOBJ);
+		LUA_PushMobj(L, thing);
+		LUA_PushMobj(L, mobj);
 		if (lua_pcall(gL, 2, 1, 0)) {
 			if (!blockfuncerror || cv_debug & DBG_LUA)
 				CONS_Alert(CONS_WARNING,"%s\n",lua_tostring(gL, -1));
@@ -109,8 +109,8 @@ static UINT8 lib_searchBlockmap_Lines(lua_State *L, INT32 x, INT32 y, mobj_t *th
 				po->lines[i]->validcount = validcount;
 
 				lua_pushvalue(L, 1);
-				LUA_PushUserdata(L, thing, META_MOBJ);
-				LUA_PushUserdata(L, po->lines[i], META_LINE);
+				LUA_PushMobj(L, thing);
+				LUA_PushLine(L, po->lines[i]);
 				if (lua_pcall(gL, 2, 1, 0)) {
 					if (!blockfuncerror || cv_debug & DBG_LUA)
 						CONS_Alert(CONS_WARNING,"%s\n",lua_tostring(gL, -1));
@@ -146,8 +146,8 @@ static UINT8 lib_searchBlockmap_Lines(lua_State *L, INT32 x, INT32 y, mobj_t *th
 		ld->validcount = validcount;
 
 		lua_pushvalue(L, 1);
-		LUA_PushUserdata(L, thing, META_MOBJ);
-		LUA_PushUserdata(L, ld, META_LINE);
+		LUA_PushMobj(L, thing);
+		LUA_PushLine(L, ld);
 		if (lua_pcall(gL, 2, 1, 0)) {
 			if (!blockfuncerror || cv_debug & DBG_LUA)
 				CONS_Alert(CONS_WARNING,"%s\n",lua_tostring(gL, -1));
@@ -192,7 +192,7 @@ static UINT8 lib_searchBlockmap_PolyObjs(lua_State *L, INT32 x, INT32 y, mobj_t
 			po->validcount = validcount;
 
 			lua_pushvalue(L, 1);
-			LUA_PushUserdata(L, thing, META_MOBJ);
+			LUA_PushMobj(L, thing);
 			LUA_PushUserdata(L, po, META_POLYOBJ);
 			if (lua_pcall(gL, 2, 1, 0)) {
 				if (!blockfuncerror || cv_debug & DBG_LUA)
@@ -31,6 +31,7 @@ automatically.
 	X (TouchSpecial),/* P_TouchSpecialThing */\
 	X (MobjFuse),/* when mobj->fuse runs out */\
 	X (MobjThinker),/* P_MobjThinker, P_SceneryThinker */\
+	X (MobjThinkerBatch),/* P_RunThinkers, once per tic with every mobj of the type */\
 	X (BossThinker),/* P_GenericBossThinker */\
 	X (ShouldDamage),/* P_DamageMobj (Should mobj take damage?) */\
 	X (MobjDamage),/* P_DamageMobj (Mobj actually takes damage!) */\
@@ -127,6 +128,7 @@ int  LUA_HookTiccmd(player_t *, ticcmd_t *, int hook);
 int  LUA_HookKey(event_t *event, int hook); // Hooks for key events
 
 void LUA_HookThinkFrame(void);
+void LUA_HookMobjThinkerBatch(void);
 int  LUA_HookMobjLineCollide(mobj_t *, line_t *);
 int  LUA_HookTouchSpecial(mobj_t *special, mobj_t *toucher);
 int  LUA_HookShouldDamage(mobj_t *target, mobj_t *inflictor, mobj_t *source, INT32 damage, UINT8 damagetype);
@@ -65,8 +65,18 @@ static int   nextid;
 // After a hook errors once, don't print the error again.
 static UINT8 * hooksErrored;
 
+// Indexed by hook id, the entry in ps_hookstats the hook's calls count towards.
+static INT32 * hookStatIds;
+
 static int errorRef;
 
+// Mobj types with a MobjThinkerBatch hook, in ascending order so MT_NULL
+// (every mobj) comes first. batchSlots maps a type to its position + 1.
+static mobjtype_t * batchTypes;
+static INT32      * batchCounts;
+static int          numBatchTypes;
+static UINT16       batchSlots[NUMMOBJTYPES];
+
 static boolean mobj_hook_available(int hook_type, mobjtype_t mobj_type)
 {
 	return
@@ -164,12 +174,30 @@ static void add_hook(hook_t *map)
 	map->ids[map->numHooks++] = nextid;
 }
 
+static void add_batch_type(mobjtype_t mobj_type)
+{
+	int i;
+
+	Z_Realloc(batchTypes, (numBatchTypes + 1) * sizeof *batchTypes, PU_STATIC, &batchTypes);
+	Z_Realloc(batchCounts, (numBatchTypes + 1) * sizeof *batchCounts, PU_STATIC, &batchCounts);
+
+	for (i = numBatchTypes++; i > 0 && batchTypes[i - 1] > mobj_type; --i)
+		batchTypes[i] = batchTypes[i - 1];
+	batchTypes[i] = mobj_type;
+
+	for (i = 0; i < numBatchTypes; ++i)
+		batchSlots[batchTypes[i]] = (UINT16)(i + 1);
+}
+
 static void add_mobj_hook(lua_State *L, int hook_type)
 {
 	mobjtype_t   mobj_type = luaL_optnumber(L, 3, MT_NULL);
 
 	luaL_argcheck(L, mobj_type < NUMMOBJTYPES, 3, "invalid mobjtype_t");
 
+	if (hook_type == MOBJ_HOOK(MobjThinkerBatch) && !batchSlots[mobj_type])
+		add_batch_type(mobj_type);
+
 	add_hook(&mobjHookIds[mobj_type][hook_type]);
 }
 
@@ -179,8 +207,10 @@ static void add_hud_hook(lua_State *L, int idx)
 				idx, "game", hudHookNames)]);
 }
 
-static void add_hook_ref(lua_State *L, int idx)
+static void add_hook_ref(lua_State *L, int idx, const char *name)
 {
+	lua_Debug ar;
+
 	if (!(nextid & 7))
 	{
 		Z_Realloc(hooksErrored,
@@ -190,6 +220,12 @@ static void add_hook_ref(lua_State *L, int idx)
 	}
 
 	Z_Realloc(hookRefs, (nextid + 1) * sizeof *hookRefs, PU_STATIC, &hookRefs);
+	Z_Realloc(hookStatIds, (nextid + 1) * sizeof *hookStatIds, PU_STATIC, &hookStatIds);
+
+	// group perfstats by where the function was defined
+	lua_pushvalue(L, idx);
+	lua_getinfo(L, ">S", &ar);
+	hookStatIds[nextid] = PS_AddHookStat(name, ar.short_src, ar.linedefined);
 
 	// set the hook function in the registry.
 	lua_pushvalue(L, idx);
@@ -212,25 +248,29 @@ static int lib_addHook(lua_State *L)
 	if (( type = hook_in_list(name, stringHookNames) ) < STRING_HOOK(MAX))
 	{
 		add_string_hook(L, type);
+		name = stringHookNames[type];
 	}
 	else if (( type = hook_in_list(name, mobjHookNames) ) < MOBJ_HOOK(MAX))
 	{
 		add_mobj_hook(L, type);
+		name = mobjHookNames[type];
 	}
 	else if (( type = hook_in_list(name, hookNames) ) < HOOK(MAX))
 	{
 		add_hook(&hookIds[type]);
+		name = hookNames[type];
 	}
 	else if (strcmp(name, "HUD") == 0)
 	{
 		add_hud_hook(L, 3);
+		name = "HUD";
 	}
 	else
 	{
 		return luaL_argerror(L, 1, lua_pushfstring(L, "invalid hook " LUA_QS, name));
 	}
 
-	add_hook_ref(L, 2);/* the function */
+	add_hook_ref(L, 2, name);/* the function */
 
 	return 0;
 }
@@ -255,7 +295,7 @@ int lib_hudadd(lua_State *L)
 	luaL_checktype(L, 1, LUA_TFUNCTION);
 
 	add_hud_hook(L, 2);
-	add_hook_ref(L, 1);
+	add_hook_ref(L, 1, "HUD");
 
 	return 0;
 }
@@ -404,7 +444,24 @@ static void get_hook_from_table(Hook_State *hook, int n)
 
 static int call_single_hook_no_copy(Hook_State *hook)
 {
-	if (lua_pcall(gL, hook->values, hook->results, EINDEX) == 0)
+	// perfstats 5 times every hook, including any hooks run from inside it
+	const boolean timed = (cv_perfstats.value == 5);
+	precise_t time_taken = 0;
+	int status;
+
+	if (timed)
+		time_taken = I_GetPreciseTime();
+
+	status = lua_pcall(gL, hook->values, hook->results, EINDEX);
+
+	if (timed)
+	{
+		ps_hookstat_t *stat = &ps_hookstats[hookStatIds[hook->id]];
+		stat->time_taken += I_GetPreciseTime() - time_taken;
+		stat->calls++;
+	}
+
+	if (status == 0)
 	{
 		if (hook->results > 0)
 		{
@@ -560,7 +617,7 @@ int LUA_HookMobj(mobj_t *mobj, int hook_type)
 	Hook_State hook;
 	if (prepare_mobj_hook(&hook, false, hook_type, mobj))
 	{
-		LUA_PushUserdata(gL, mobj, META_MOBJ);
+		LUA_PushMobj(gL, mobj);
 		call_hooks(&hook, 1, res_true);
 	}
 	return hook.status;
@@ -571,8 +628,8 @@ int LUA_Hook2Mobj(mobj_t *t1, mobj_t *t2, int hook_type)
 	Hook_State hook;
 	if (prepare_mobj_hook(&hook, 0, hook_type, t1))
 	{
-		LUA_PushUserdata(gL, t1, META_MOBJ);
-		LUA_PushUserdata(gL, t2, META_MOBJ);
+		LUA_PushMobj(gL, t1);
+		LUA_PushMobj(gL, t2);
 		call_hooks(&hook, 1, res_force);
 	}
 	return hook.status;
@@ -610,7 +667,7 @@ int LUA_HookPlayer(player_t *player, int hook_type)
 	Hook_State hook;
 	if (prepare_hook(&hook, false, hook_type))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
+		LUA_PushPlayer(gL, player);
 		call_hooks(&hook, 1, res_true);
 	}
 	return hook.status;
@@ -621,7 +678,7 @@ int LUA_HookTiccmd(player_t *player, ticcmd_t *cmd, int hook_type)
 	Hook_State hook;
 	if (prepare_hook(&hook, false, hook_type))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
+		LUA_PushPlayer(gL, player);
 		LUA_PushUserdata(gL, cmd, META_TICCMD);
 
 		if (hook_type == HOOK(PlayerCmd))
@@ -714,13 +771,90 @@ void LUA_HookThinkFrame(void)
 	}
 }
 
+// Runs once per tic, after the whole mobj thinker list (and so after every
+// MobjThinker hook) and before the remaining thinker lists. Each type with a
+// MobjThinkerBatch hook gets one call with an array of its mobjs in thinker
+// list order; MT_NULL hooks go first and get every mobj, then the rest in
+// ascending type order. Types with no mobjs this tic are skipped.
+void LUA_HookMobjThinkerBatch(void)
+{
+	const int type = MOBJ_HOOK(MobjThinkerBatch);
+	thinker_t *th;
+	Hook_State hook;
+	int calls = 0;
+	int i;
+
+	if (!numBatchTypes)
+		return;
+
+	start_hook_stack();
+
+	if (!lua_checkstack(gL, numBatchTypes + 1))
+	{
+		CONS_Alert(CONS_WARNING, "Too many MobjThinkerBatch mobj types!\n");
+		lua_settop(gL, 0);
+		return;
+	}
+
+	// one array per type, right above the error handler
+	for (i = 0; i < numBatchTypes; ++i)
+	{
+		lua_newtable(gL);
+		batchCounts[i] = 0;
+	}
+
+	for (th = thlist[THINK_MOBJ].next; th != &thlist[THINK_MOBJ]; th = th->next)
+	{
+		mobj_t *mo = (mobj_t *)th;
+		int slot;
+
+		if (th->function.acp1 != (actionf_p1)P_MobjThinker)
+			continue;
+
+		if (( slot = batchSlots[MT_NULL] ))
+		{
+			LUA_PushMobj(gL, mo);
+			lua_rawseti(gL, EINDEX + slot, ++batchCounts[slot - 1]);
+		}
+
+		if (mo->type != MT_NULL && ( slot = batchSlots[mo->type] ))
+		{
+			LUA_PushMobj(gL, mo);
+			lua_rawseti(gL, EINDEX + slot, ++batchCounts[slot - 1]);
+		}
+	}
+
+	hook.status = 0;
+	hook.hook_type = type;
+	hook.string = NULL;
+
+	for (i = 0; i < numBatchTypes; ++i)
+	{
+		if (!batchCounts[i])
+			continue;
+
+		hook.mobj_type = batchTypes[i];
+		begin_hook_values(&hook);
+		lua_pushvalue(gL, EINDEX + 1 + i);
+		init_hook_call(&hook, 0, res_none);
+
+		calls += call_mapped(&hook, &mobjHookIds[batchTypes[i]][type]);
+
+		lua_pop(gL, 1);
+	}
+
+	ps_lua_mobjhooks.value.i += calls;
+
+	lua_settop(gL, 0);
+}
+
 int LUA_HookMobjLineCollide(mobj_t *mobj, line_t *line)
 {
 	Hook_State hook;
 	if (prepare_mobj_hook(&hook, 0, MOBJ_HOOK(MobjLineCollide), mobj))
 	{
-		LUA_PushUserdata(gL, mobj, META_MOBJ);
-		LUA_PushUserdata(gL, line, META_LINE);
+		LUA_PushMobj(gL, mobj);
+		LUA_PushLine(gL, line);
 		call_hooks(&hook, 1, res_force);
 	}
 	return hook.status;
@@ -731,8 +865,8 @@ int LUA_HookTouchSpecial(mobj_t *special, mobj_t *toucher)
 	Hook_State hook;
 	if (prepare_mobj_hook(&hook, false, MOBJ_HOOK(TouchSpecial), special))
 	{
-		LUA_PushUserdata(gL, special, META_MOBJ);
-		LUA_PushUserdata(gL, toucher, META_MOBJ);
+		LUA_PushMobj(gL, special);
+		LUA_PushMobj(gL, toucher);
 		call_hooks(&hook, 1, res_true);
 	}
 	return hook.status;
@@ -751,9 +885,9 @@ static int damage_hook
 	Hook_State hook;
 	if (prepare_mobj_hook(&hook, 0, hook_type, target))
 	{
-		LUA_PushUserdata(gL, target, META_MOBJ);
-		LUA_PushUserdata(gL, inflictor, META_MOBJ);
-		LUA_PushUserdata(gL, source, META_MOBJ);
+		LUA_PushMobj(gL, target);
+		LUA_PushMobj(gL, inflictor);
+		LUA_PushMobj(gL, source);
 		if (hook_type != MOBJ_HOOK(MobjDeath))
 			lua_pushinteger(gL, damage);
 		lua_pushinteger(gL, damagetype);
@@ -785,9 +919,9 @@ int LUA_HookMobjMoveBlocked(mobj_t *t1, mobj_t *t2, line_t *line)
 	Hook_State hook;
 	if (prepare_mobj_hook(&hook, 0, MOBJ_HOOK(MobjMoveBlocked), t1))
 	{
-		LUA_PushUserdata(gL, t1, META_MOBJ);
-		LUA_PushUserdata(gL, t2, META_MOBJ);
-		LUA_PushUserdata(gL, line, META_LINE);
+		LUA_PushMobj(gL, t1);
+		LUA_PushMobj(gL, t2);
+		LUA_PushLine(gL, line);
 		call_hooks(&hook, 1, res_true);
 	}
 	return hook.status;
@@ -855,8 +989,8 @@ int LUA_HookBotAI(mobj_t *sonic, mobj_t *tails, ticcmd_t *cmd)
 
 	if (prepare_string_hook(&hook, false, STRING_HOOK(BotAI), skin))
 	{
-		LUA_PushUserdata(gL, sonic, META_MOBJ);
-		LUA_PushUserdata(gL, tails, META_MOBJ);
+		LUA_PushMobj(gL, sonic);
+		LUA_PushMobj(gL, tails);
 
 		botai.tails = tails;
 		botai.cmd   = cmd;
@@ -875,9 +1009,9 @@ void LUA_HookLinedefExecute(line_t *line, mobj_t *mo, sector_t *sector)
 	if (prepare_string_hook
 			(&hook, 0, STRING_HOOK(LinedefExecute), line->stringargs[0]))
 	{
-		LUA_PushUserdata(gL, line, META_LINE);
-		LUA_PushUserdata(gL, mo, META_MOBJ);
-		LUA_PushUserdata(gL, sector, META_SECTOR);
+		LUA_PushLine(gL, line);
+		LUA_PushMobj(gL, mo);
+		LUA_PushSector(gL, sector);
 		ps_lua_mobjhooks.value.i += call_hooks(&hook, 0, res_none);
 	}
 }
@@ -887,7 +1021,7 @@ int LUA_HookPlayerMsg(int source, int target, int flags, char *msg)
 	Hook_State hook;
 	if (prepare_hook(&hook, false, HOOK(PlayerMsg)))
 	{
-		LUA_PushUserdata(gL, &players[source], META_PLAYER); // Source player
+		LUA_PushPlayer(gL, &players[source]); // Source player
 		if (flags & 2 /*HU_CSAY*/) { // csay TODO: make HU_CSAY accessible outside hu_stuff.c
 			lua_pushinteger(gL, 3); // type
 			lua_pushnil(gL); // target
@@ -899,7 +1033,7 @@ int LUA_HookPlayerMsg(int source, int target, int flags, char *msg)
 			lua_pushnil(gL); // target
 		} else { // sayto
 			lua_pushinteger(gL, 2); // type
-			LUA_PushUserdata(gL, &players[target-1], META_PLAYER); // target
+			LUA_PushPlayer(gL, &players[target-1]); // target
 		}
 		lua_pushstring(gL, msg); // msg
 		call_hooks(&hook, 1, res_true);
@@ -912,9 +1046,9 @@ int LUA_HookHurtMsg(player_t *player, mobj_t *inflictor, mobj_t *source, UINT8 d
 	Hook_State hook;
 	if (prepare_mobj_hook(&hook, false, MOBJ_HOOK(HurtMsg), inflictor))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
-		LUA_PushUserdata(gL, inflictor, META_MOBJ);
-		LUA_PushUserdata(gL, source, META_MOBJ);
+		LUA_PushPlayer(gL, player);
+		LUA_PushMobj(gL, inflictor);
+		LUA_PushMobj(gL, source);
 		lua_pushinteger(gL, damagetype);
 		call_hooks(&hook, 1, res_true);
 	}
@@ -956,7 +1090,7 @@ int LUA_HookMapThingSpawn(mobj_t *mobj, mapthing_t *mthing)
 	Hook_State hook;
 	if (prepare_mobj_hook(&hook, false, MOBJ_HOOK(MapThingSpawn), mobj))
 	{
-		LUA_PushUserdata(gL, mobj, META_MOBJ);
+		LUA_PushMobj(gL, mobj);
 		LUA_PushUserdata(gL, mthing, META_MAPTHING);
 		call_hooks(&hook, 1, res_true);
 	}
@@ -968,8 +1102,8 @@ int LUA_HookFollowMobj(player_t *player, mobj_t *mobj)
 	Hook_State hook;
 	if (prepare_mobj_hook(&hook, false, MOBJ_HOOK(FollowMobj), mobj))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
-		LUA_PushUserdata(gL, mobj, META_MOBJ);
+		LUA_PushPlayer(gL, player);
+		LUA_PushMobj(gL, mobj);
 		call_hooks(&hook, 1, res_true);
 	}
 	return hook.status;
@@ -980,8 +1114,8 @@ int LUA_HookPlayerCanDamage(player_t *player, mobj_t *mobj)
 	Hook_State hook;
 	if (prepare_hook(&hook, 0, HOOK(PlayerCanDamage)))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
-		LUA_PushUserdata(gL, mobj, META_MOBJ);
+		LUA_PushPlayer(gL, player);
+		LUA_PushMobj(gL, mobj);
 		call_hooks(&hook, 1, res_force);
 	}
 	return hook.status;
@@ -992,7 +1126,7 @@ void LUA_HookPlayerQuit(player_t *plr, kickreason_t reason)
 	Hook_State hook;
 	if (prepare_hook(&hook, 0, HOOK(PlayerQuit)))
 	{
-		LUA_PushUserdata(gL, plr, META_PLAYER); // Player that quit
+		LUA_PushPlayer(gL, plr); // Player that quit
 		lua_pushinteger(gL, reason); // Reason for quitting
 		call_hooks(&hook, 0, res_none);
 	}
@@ -1003,7 +1137,7 @@ int LUA_HookTeamSwitch(player_t *player, int newteam, boolean fromspectators, bo
 	Hook_State hook;
 	if (prepare_hook(&hook, true, HOOK(TeamSwitch)))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
+		LUA_PushPlayer(gL, player);
 		lua_pushinteger(gL, newteam);
 		lua_pushboolean(gL, fromspectators);
 		lua_pushboolean(gL, tryingautobalance);
@@ -1018,8 +1152,8 @@ int LUA_HookViewpointSwitch(player_t *player, player_t *newdisplayplayer, boolea
 	Hook_State hook;
 	if (prepare_hook(&hook, 0, HOOK(ViewpointSwitch)))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
-		LUA_PushUserdata(gL, newdisplayplayer, META_PLAYER);
+		LUA_PushPlayer(gL, player);
+		LUA_PushPlayer(gL, newdisplayplayer);
 		lua_pushboolean(gL, forced);
 
 		hud_running = true; // local hook
@@ -1034,8 +1168,8 @@ int LUA_HookSeenPlayer(player_t *player, player_t *seenfriend)
 	Hook_State hook;
 	if (prepare_hook(&hook, true, HOOK(SeenPlayer)))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
-		LUA_PushUserdata(gL, seenfriend, META_PLAYER);
+		LUA_PushPlayer(gL, player);
+		LUA_PushPlayer(gL, seenfriend);
 
 		hud_running = true; // local hook
 		call_hooks(&hook, 1, res_false);
@@ -1050,7 +1184,7 @@ int LUA_HookShouldJingleContinue(player_t *player, const char *musname)
 	if (prepare_string_hook
 			(&hook, false, STRING_HOOK(ShouldJingleContinue), musname))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
+		LUA_PushPlayer(gL, player);
 		push_string();
 
 		hud_running = true; // local hook
@@ -1166,7 +1300,7 @@ fixed_t LUA_HookPlayerHeight(player_t *player)
 	Hook_State hook;
 	if (prepare_hook(&hook, -1, HOOK(PlayerHeight)))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
+		LUA_PushPlayer(gL, player);
 		call_hooks(&hook, 1, res_playerheight);
 	}
 	return hook.status;
@@ -1177,7 +1311,7 @@ int LUA_HookPlayerCanEnterSpinGaps(player_t *player)
 	Hook_State hook;
 	if (prepare_hook(&hook, 0, HOOK(PlayerCanEnterSpinGaps)))
 	{
-		LUA_PushUserdata(gL, player, META_PLAYER);
+		LUA_PushPlayer(gL, player);
 		call_hooks(&hook, 1, res_force);
 	}
 	return hook.status;
@@ -345,7 +345,7 @@ static int camera_get(lua_State *L)
 		lua_pushinteger(L, cam->angle);
 		break;
 	case camera_subsector:
-		LUA_PushUserdata(L, cam->subsector, META_SUBSECTOR);
+		LUA_PushSubsector(L, cam->subsector);
 		break;
 	case camera_floorz:
 		lua_pushinteger(L, cam->floorz);
@@ -1475,12 +1475,12 @@ void LUA_SetHudHook(int hook, huddrawlist_h list)
 					&players[secondarydisplayplayer])
 				? &camera2 : &camera;
 
-			LUA_PushUserdata(gL, stplyr, META_PLAYER);
+			LUA_PushPlayer(gL, stplyr);
 			LUA_PushUserdata(gL, cam, META_CAMERA);
 		}	break;
 
 		case HUD_HOOK(titlecard):
-			LUA_PushUserdata(gL, stplyr, META_PLAYER);
+			LUA_PushPlayer(gL, stplyr);
 			lua_pushinteger(gL, lt_ticker);
 			lua_pushinteger(gL, (lt_endtime + TICRATE));
 			break;
@@ -653,7 +653,7 @@ static void A_Lua(mobj_t *actor)
 	}
 	lua_pop(gL, 1); // pop LREG_ACTION
 
-	LUA_PushUserdata(gL, actor, META_MOBJ);
+	LUA_PushMobj(gL, actor);
 	lua_pushinteger(gL, var1);
 	lua_pushinteger(gL, var2);
 	LUA_Call(gL, 3, 0, 1);
@@ -876,7 +876,7 @@ boolean LUA_CallAction(enum actionnum actionnum, mobj_t *actor)
 	// Found a function.
 	// Call it with (actor, var1, var2)
 	I_Assert(lua_isfunction(gL, -1));
-	LUA_PushUserdata(gL, actor, META_MOBJ);
+	LUA_PushMobj(gL, actor);
 	lua_pushinteger(gL, var1);
 	lua_pushinteger(gL, var2);
 
@@ -93,6 +93,14 @@ extern boolean mousegrabbedbylua;
 #define META_KEYEVENT "KEYEVENT_T*"
 #define META_MOUSE "MOUSE_T*"
 
+// Objects pushed often enough to keep their userdata reference with them
+#define LUA_PushMobj(L, mo) LUA_PushUserdataHandle(L, mo, META_MOBJ, offsetof(thinker_t, luahandle))
+#define LUA_PushPlayer(L, player) LUA_PushUserdataHandle(L, player, META_PLAYER, offsetof(player_t, luahandle))
+#define LUA_PushSector(L, sector) LUA_PushUserdataHandle(L, sector, META_SECTOR, offsetof(sector_t, luahandle))
+#define LUA_PushSubsector(L, ss) LUA_PushUserdataHandle(L, ss, META_SUBSECTOR, offsetof(subsector_t, luahandle))
+#define LUA_PushLine(L, line) LUA_PushUserdataHandle(L, line, META_LINE, offsetof(line_t, luahandle))
+#define LUA_PushSide(L, side) LUA_PushUserdataHandle(L, side, META_SIDE, offsetof(side_t, luahandle))
+
 boolean luaL_checkboolean(lua_State *L, int narg);
 
 int LUA_EnumLib(lua_State *L);
@@ -451,7 +451,7 @@ static int lib_iterateSectorThinglist(lua_State *L)
 
 	if (thing)
 	{
-		LUA_PushUserdata(L, thing, META_MOBJ);
+		LUA_PushMobj(L, thing);
 		return 1;
 	}
 	return 0;
@@ -595,7 +595,7 @@ static int sectorlines_get(lua_State *L)
 	i = (size_t)lua_tointeger(L, 2);
 	if (i >= numoflines)
 		return 0;
-	LUA_PushUserdata(L, (*seclines)[i], META_LINE);
+	LUA_PushLine(L, (*seclines)[i]);
 	return 1;
 }
 
@@ -724,18 +724,18 @@ static int sector_get(lua_State *L)
 		return 1;
 	case sector_thinglist: // thinglist
 		lua_pushcfunction(L, lib_iterateSectorThinglist);
-		LUA_PushUserdata(L, sector->thinglist, META_MOBJ);
+		LUA_PushMobj(L, sector->thinglist);
 		lua_pushcclosure(L, sector_iterate, 2); // push lib_iterateSectorThinglist and sector->thinglist as upvalues for the function
 		return 1;
 	case sector_heightsec: // heightsec - fake floor heights
 		if (sector->heightsec < 0)
 			return 0;
-		LUA_PushUserdata(L, &sectors[sector->heightsec], META_SECTOR);
+		LUA_PushSector(L, &sectors[sector->heightsec]);
 		return 1;
 	case sector_camsec: // camsec - camera clipping heights
 		if (sector->camsec < 0)
 			return 0;
-		LUA_PushUserdata(L, &sectors[sector->camsec], META_SECTOR);
+		LUA_PushSector(L, &sectors[sector->camsec]);
 		return 1;
 	case sector_lines: // lines
 		LUA_PushUserdata(L, &sector->lines, META_SECTORLINES); // push the address of the "lines" member in the struct, to allow our hacks in sectorlines_get/_num to work
@@ -789,6 +789,8 @@ static int sector_set(lua_State *L)
 	if (hook_cmd_running)
 		return luaL_error(L, "Do not alter sector_t in CMD building code!");
 
+	P_InvalidateSightCache();
+
 	switch(field)
 	{
 	case sector_valid: // valid
@@ -938,7 +940,7 @@ static int subsector_get(lua_State *L)
 		lua_pushboolean(L, 1);
 		return 1;
 	case subsector_sector:
-		LUA_PushUserdata(L, subsector->sector, META_SECTOR);
+		LUA_PushSector(L, subsector->sector);
 		return 1;
 	case subsector_numlines:
 		lua_pushinteger(L, subsector->numlines);
@@ -1069,12 +1071,12 @@ static int line_get(lua_State *L)
 		LUA_PushUserdata(L, line->sidenum, META_SIDENUM);
 		return 1;
 	case line_frontside: // frontside
-		LUA_PushUserdata(L, &sides[line->sidenum[0]], META_SIDE);
+		LUA_PushSide(L, &sides[line->sidenum[0]]);
 		return 1;
 	case line_backside: // backside
 		if (line->sidenum[1] == 0xffff)
 			return 0;
-		LUA_PushUserdata(L, &sides[line->sidenum[1]], META_SIDE);
+		LUA_PushSide(L, &sides[line->sidenum[1]]);
 		return 1;
 	case line_alpha:
 		lua_pushfixed(L, line->alpha);
@@ -1100,10 +1102,10 @@ static int line_get(lua_State *L)
 		}
 		return 1;
 	case line_frontsector:
-		LUA_PushUserdata(L, line->frontsector, META_SECTOR);
+		LUA_PushSector(L, line->frontsector);
 		return 1;
 	case line_backsector:
-		LUA_PushUserdata(L, line->backsector, META_SECTOR);
+		LUA_PushSector(L, line->backsector);
 		return 1;
 	case line_polyobj:
 		LUA_PushUserdata(L, line->polyobj, META_POLYOBJ);
@@ -1230,10 +1232,10 @@ static int side_get(lua_State *L)
 		lua_pushinteger(L, side->midtexture);
 		return 1;
 	case side_line:
-		LUA_PushUserdata(L, side->line, META_LINE);
+		LUA_PushLine(L, side->line);
 		return 1;
 	case side_sector:
-		LUA_PushUserdata(L, side->sector, META_SECTOR);
+		LUA_PushSector(L, side->sector);
 		return 1;
 	case side_special:
 		lua_pushinteger(L, side->special);
@@ -1423,16 +1425,16 @@ static int seg_get(lua_State *L)
 		lua_pushangle(L, seg->angle);
 		return 1;
 	case seg_sidedef:
-		LUA_PushUserdata(L, seg->sidedef, META_SIDE);
+		LUA_PushSide(L, seg->sidedef);
 		return 1;
 	case seg_linedef:
-		LUA_PushUserdata(L, seg->linedef, META_LINE);
+		LUA_PushLine(L, seg->linedef);
 		return 1;
 	case seg_frontsector:
-		LUA_PushUserdata(L, seg->frontsector, META_SECTOR);
+		LUA_PushSector(L, seg->frontsector);
 		return 1;
 	case seg_backsector:
-		LUA_PushUserdata(L, seg->backsector, META_SECTOR);
+		LUA_PushSector(L, seg->backsector);
 		return 1;
 	case seg_polyseg:
 		LUA_PushUserdata(L, seg->polyseg, META_POLYOBJ);
@@ -1679,7 +1681,7 @@ static int lib_iterateSectors(lua_State *L)
 		i = (size_t)(*((sector_t **)luaL_checkudata(L, 1, META_SECTOR)) - sectors)+1;
 	if (i < numsectors)
 	{
-		LUA_PushUserdata(L, &sectors[i], META_SECTOR);
+		LUA_PushSector(L, &sectors[i]);
 		return 1;
 	}
 	return 0;
@@ -1693,7 +1695,7 @@ static int lib_getSector(lua_State *L)
 		size_t i = lua_tointeger(L, 2);
 		if (i >= numsectors)
 			return 0;
-		LUA_PushUserdata(L, &sectors[i], META_SECTOR);
+		LUA_PushSector(L, &sectors[i]);
 		return 1;
 	}
 	return 0;
@@ -1721,7 +1723,7 @@ static int lib_iterateSubsectors(lua_State *L)
 		i = (size_t)(*((subsector_t **)luaL_checkudata(L, 1, META_SUBSECTOR)) - subsectors)+1;
 	if (i < numsubsectors)
 	{
-		LUA_PushUserdata(L, &subsectors[i], META_SUBSECTOR);
+		LUA_PushSubsector(L, &subsectors[i]);
 		return 1;
 	}
 	return 0;
@@ -1738,7 +1740,7 @@ static int lib_getSubsector(lua_State *L)
 		size_t i = lua_tointeger(L, 1);
 		if (i >= numsubsectors)
 			return 0;
-		LUA_PushUserdata(L, &subsectors[i], META_SUBSECTOR);
+		LUA_PushSubsector(L, &subsectors[i]);
 		return 1;
 	}
 	field = luaL_checkoption(L, 1, NULL, array_opt);
@@ -1773,7 +1775,7 @@ static int lib_iterateLines(lua_State *L)
 		i = (size_t)(*((line_t **)luaL_checkudata(L, 1, META_LINE)) - lines)+1;
 	if (i < numlines)
 	{
-		LUA_PushUserdata(L, &lines[i], META_LINE);
+		LUA_PushLine(L, &lines[i]);
 		return 1;
 	}
 	return 0;
@@ -1787,7 +1789,7 @@ static int lib_getLine(lua_State *L)
 		size_t i = lua_tointeger(L, 2);
 		if (i >= numlines)
 			return 0;
-		LUA_PushUserdata(L, &lines[i], META_LINE);
+		LUA_PushLine(L, &lines[i]);
 		return 1;
 	}
 	return 0;
@@ -1815,7 +1817,7 @@ static int lib_iterateSides(lua_State *L)
 		i = (size_t)(*((side_t **)luaL_checkudata(L, 1, META_SIDE)) - sides)+1;
 	if (i < numsides)
 	{
-		LUA_PushUserdata(L, &sides[i], META_SIDE);
+		LUA_PushSide(L, &sides[i]);
 		return 1;
 	}
 	return 0;
@@ -1832,7 +1834,7 @@ static int lib_getSide(lua_State *L)
 		size_t i = lua_tointeger(L, 1);
 		if (i >= numsides)
 			return 0;
-		LUA_PushUserdata(L, &sides[i], META_SIDE);
+		LUA_PushSide(L, &sides[i]);
 		return 1;
 	}
 	field = luaL_checkoption(L, 1, NULL, array_opt);
@@ -2140,7 +2142,7 @@ static int ffloor_get(lua_State *L)
 		LUA_PushUserdata(L, *ffloor->b_slope, META_SLOPE);
 		return 1;
 	case ffloor_sector:
-		LUA_PushUserdata(L, &sectors[ffloor->secnum], META_SECTOR);
+		LUA_PushSector(L, &sectors[ffloor->secnum]);
 		return 1;
 	case ffloor_fofflags:
 		lua_pushinteger(L, ffloor->fofflags);
@@ -2149,10 +2151,10 @@ static int ffloor_get(lua_State *L)
 		lua_pushinteger(L, P_GetOldFOFFlags(ffloor));
 		return 1;
 	case ffloor_master:
-		LUA_PushUserdata(L, ffloor->master, META_LINE);
+		LUA_PushLine(L, ffloor->master);
 		return 1;
 	case ffloor_target:
-		LUA_PushUserdata(L, ffloor->target, META_SECTOR);
+		LUA_PushSector(L, ffloor->target);
 		return 1;
 	case ffloor_next:
 		LUA_PushUserdata(L, ffloor->next, META_FFLOOR);
@@ -2283,6 +2285,8 @@ static int ffloor_set(lua_State *L)
 	if (hook_cmd_running)
 		return luaL_error(L, "Do not alter ffloor_t in CMD building code!");
 
+	P_InvalidateSightCache();
+
 	switch(field)
 	{
 	case ffloor_valid: // valid
@@ -2423,6 +2427,8 @@ static int slope_set(lua_State *L)
 	if (hook_cmd_running)
 		return luaL_error(L, "Do not alter pslope_t in CMD building code!");
 
+	P_InvalidateSightCache();
+
 	switch(field) // todo: reorganize this shit
 	{
 	case slope_valid: // valid
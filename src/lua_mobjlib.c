@@ -219,7 +219,7 @@ static int mobj_get(lua_State *L)
 		lua_pushfixed(L, mo->z);
 		break;
 	case mobj_snext:
-		LUA_PushUserdata(L, mo->snext, META_MOBJ);
+		LUA_PushMobj(L, mo->snext);
 		break;
 	case mobj_sprev:
 		// sprev is actually the previous mobj's snext pointer,
@@ -267,7 +267,7 @@ static int mobj_get(lua_State *L)
 		LUA_PushUserdata(L, mo->floorspriteslope, META_SLOPE);
 		break;
 	case mobj_drawonlyforplayer:
-		LUA_PushUserdata(L, mo->drawonlyforplayer, META_PLAYER);
+		LUA_PushPlayer(L, mo->drawonlyforplayer);
 		break;
 	case mobj_dontdrawforviewmobj:
 		if (mo->dontdrawforviewmobj && P_MobjWasRemoved(mo->dontdrawforviewmobj))
@@ -275,12 +275,12 @@ static int mobj_get(lua_State *L)
 			P_SetTarget(&mo->dontdrawforviewmobj, NULL);
 			return 0;
 		}
-		LUA_PushUserdata(L, mo->dontdrawforviewmobj, META_MOBJ);
+		LUA_PushMobj(L, mo->dontdrawforviewmobj);
 		break;
 	case mobj_touching_sectorlist:
 		return UNIMPLEMENTED;
 	case mobj_subsector:
-		LUA_PushUserdata(L, mo->subsector, META_SUBSECTOR);
+		LUA_PushSubsector(L, mo->subsector);
 		break;
 	case mobj_floorz:
 		lua_pushfixed(L, mo->floorz);
@@ -342,7 +342,7 @@ static int mobj_get(lua_State *L)
 		lua_pushinteger(L, mo->blendmode);
 		break;
 	case mobj_bnext:
-		LUA_PushUserdata(L, mo->bnext, META_MOBJ);
+		LUA_PushMobj(L, mo->bnext);
 		break;
 	case mobj_bprev:
 		// bprev -- same deal as sprev above, but for the blockmap.
@@ -353,7 +353,7 @@ static int mobj_get(lua_State *L)
 			P_SetTarget(&mo->hnext, NULL);
 			return 0;
 		}
-		LUA_PushUserdata(L, mo->hnext, META_MOBJ);
+		LUA_PushMobj(L, mo->hnext);
 		break;
 	case mobj_hprev:
 		if (mo->hprev && P_MobjWasRemoved(mo->hprev))
@@ -361,7 +361,7 @@ static int mobj_get(lua_State *L)
 			P_SetTarget(&mo->hprev, NULL);
 			return 0;
 		}
-		LUA_PushUserdata(L, mo->hprev, META_MOBJ);
+		LUA_PushMobj(L, mo->hprev);
 		break;
 	case mobj_type:
 		lua_pushinteger(L, mo->type);
@@ -384,7 +384,7 @@ static int mobj_get(lua_State *L)
 			P_SetTarget(&mo->target, NULL);
 			return 0;
 		}
-		LUA_PushUserdata(L, mo->target, META_MOBJ);
+		LUA_PushMobj(L, mo->target);
 		break;
 	case mobj_reactiontime:
 		lua_pushinteger(L, mo->reactiontime);
@@ -393,7 +393,7 @@ static int mobj_get(lua_State *L)
 		lua_pushinteger(L, mo->threshold);
 		break;
 	case mobj_player:
-		LUA_PushUserdata(L, mo->player, META_PLAYER);
+		LUA_PushPlayer(L, mo->player);
 		break;
 	case mobj_lastlook:
 		lua_pushinteger(L, mo->lastlook);
@@ -407,7 +407,7 @@ static int mobj_get(lua_State *L)
 			P_SetTarget(&mo->tracer, NULL);
 			return 0;
 		}
-		LUA_PushUserdata(L, mo->tracer, META_MOBJ);
+		LUA_PushMobj(L, mo->tracer);
 		break;
 	case mobj_friction:
 		lua_pushfixed(L, mo->friction);
@@ -602,6 +602,7 @@ static int mobj_set(lua_State *L)
 		mo->radius = luaL_checkfixed(L, 3);
 		if (mo->radius < 0)
 			mo->radius = 0;
+		P_RefreshThingIndex(mo);
 		P_CheckPosition(mo, mo->x, mo->y);
 		mo->floorz = tmfloorz;
 		mo->ceilingz = tmceilingz;
@@ -1030,7 +1031,7 @@ static int mapthing_get(lua_State *L)
 			LUA_PushUserdata(L, mt->stringargs, META_THINGSTRINGARGS);
 			break;
 		case mapthing_mobj:
-			LUA_PushUserdata(L, mt->mobj, META_MOBJ);
+			LUA_PushMobj(L, mt->mobj);
 			break;
 		default:
 			if (devparm)
@@ -41,7 +41,7 @@ static int lib_iteratePlayers(lua_State *L)
 			continue;
 		if (!players[i].mo)
 			continue;
-		LUA_PushUserdata(L, &players[i], META_PLAYER);
+		LUA_PushPlayer(L, &players[i]);
 		return 1;
 	}
 	return 0;
@@ -60,7 +60,7 @@ static int lib_getPlayer(lua_State *L)
 			return 0;
 		if (!players[i].mo)
 			return 0;
-		LUA_PushUserdata(L, &players[i], META_PLAYER);
+		LUA_PushPlayer(L, &players[i]);
 		return 1;
 	}
 
@@ -405,7 +405,7 @@ static int player_get(lua_State *L)
 		lua_pushstring(L, player_names[plr-players]);
 		break;
 	case player_realmo:
-		LUA_PushUserdata(L, plr->mo, META_MOBJ);
+		LUA_PushMobj(L, plr->mo);
 		break;
 	// Kept for backward-compatibility
 	// Should be fixed to work like "realmo" later
@@ -413,7 +413,7 @@ static int player_get(lua_State *L)
 		if (plr->spectator)
 			lua_pushnil(L);
 		else
-			LUA_PushUserdata(L, plr->mo, META_MOBJ);
+			LUA_PushMobj(L, plr->mo);
 		break;
 	case player_cmd:
 		LUA_PushUserdata(L, &plr->cmd, META_TICCMD);
@@ -542,7 +542,7 @@ static int player_get(lua_State *L)
 		lua_pushinteger(L, plr->followitem);
 		break;
 	case player_followmobj:
-		LUA_PushUserdata(L, plr->followmobj, META_MOBJ);
+		LUA_PushMobj(L, plr->followmobj);
 		break;
 	case player_actionspd:
 		lua_pushfixed(L, plr->actionspd);
@@ -671,10 +671,10 @@ static int player_get(lua_State *L)
 		lua_pushangle(L, plr->old_angle_pos);
 		break;
 	case player_axis1:
-		LUA_PushUserdata(L, plr->axis1, META_MOBJ);
+		LUA_PushMobj(L, plr->axis1);
 		break;
 	case player_axis2:
-		LUA_PushUserdata(L, plr->axis2, META_MOBJ);
+		LUA_PushMobj(L, plr->axis2);
 		break;
 	case player_bumpertime:
 		lua_pushinteger(L, plr->bumpertime);
@@ -707,10 +707,10 @@ static int player_get(lua_State *L)
 		lua_pushboolean(L, plr->bonustime);
 		break;
 	case player_capsule:
-		LUA_PushUserdata(L, plr->capsule, META_MOBJ);
+		LUA_PushMobj(L, plr->capsule);
 		break;
 	case player_drone:
-		LUA_PushUserdata(L, plr->drone, META_MOBJ);
+		LUA_PushMobj(L, plr->drone);
 		break;
 	case player_oldscale:
 		lua_pushfixed(L, plr->oldscale);
@@ -794,7 +794,7 @@ static int player_get(lua_State *L)
 		lua_pushinteger(L, plr->onconveyor);
 		break;
 	case player_awayviewmobj:
-		LUA_PushUserdata(L, plr->awayviewmobj, META_MOBJ);
+		LUA_PushMobj(L, plr->awayviewmobj);
 		break;
 	case player_awayviewtics:
 		lua_pushinteger(L, plr->awayviewtics);
@@ -812,7 +812,7 @@ static int player_get(lua_State *L)
 		lua_pushinteger(L, plr->bot);
 		break;
 	case player_botleader:
-		LUA_PushUserdata(L, plr->botleader, META_PLAYER);
+		LUA_PushPlayer(L, plr->botleader);
 		break;
 	case player_lastbuttons:
 		lua_pushinteger(L, plr->lastbuttons);
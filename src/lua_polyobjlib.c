@@ -164,7 +164,7 @@ static int polyobjlines_get(lua_State *L)
 	i = (size_t)lua_tointeger(L, 2);
 	if (i >= numoflines)
 		return 0;
-	LUA_PushUserdata(L, (*polylines)[i], META_LINE);
+	LUA_PushLine(L, (*polylines)[i]);
 	return 1;
 }
 
@@ -291,7 +291,7 @@ static int polyobj_get(lua_State *L)
 		LUA_PushUserdata(L, &polyobj->lines, META_POLYOBJLINES); // push the address of the "lines" member in the struct, to allow our hacks to work
 		break;
 	case polyobj_sector: // shortcut that exists only in Lua!
-		LUA_PushUserdata(L, polyobj->lines[0]->backsector, META_SECTOR);
+		LUA_PushSector(L, polyobj->lines[0]->backsector);
 		break;
 	case polyobj_angle:
 		lua_pushangle(L, polyobj->angle);
@@ -343,6 +343,8 @@ static int polyobj_set(lua_State *L)
 	if (hud_running)
 		return luaL_error(L, "Do not alter polyobj_t in HUD rendering code!");
 
+	P_InvalidateSightCache();
+
 	switch (field)
 	{
 	default:
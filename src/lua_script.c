@@ -27,6 +27,10 @@
 #include "p_local.h"
 #include "p_slopes.h" // for P_SlopeById and slopelist
 #include "p_polyobj.h" // polyobj_t, PolyObjects
+#include "m_misc.h" // FIL_ReadFile, FIL_WriteFile
+#include "d_main.h" // srb2home
+#include "i_system.h" // I_mkdir
+#include "md5.h" // bytecode cache keys
 #ifdef LUA_ALLOW_BYTECODE
 #include "d_netfil.h" // for LUA_DumpFile
 #endif
@@ -62,16 +66,161 @@ static lua_CFunction liblist[] = {
 	NULL
 };
 
+// ==========================================================================
+//                                 LUA ARENA
+// ==========================================================================
+//
+// Each Lua state has its own allocator instead of going through the zone.
+// Lua always passes the old size of a block when it resizes or frees it,
+// so small blocks need no header: they are carved out of 64 KB chunks by
+// size class, and freed blocks go on a list for their class. The chunks
+// are only given back when the state is closed. Bigger blocks are left
+// to malloc.
+
+#define LUAARENACHUNK (64*1024)
+#define LUAARENAMAX (LUA_ARENASTEP * LUA_ARENACLASSES)
+#define LUAARENACLASS(size) (((size) + LUA_ARENASTEP - 1) / LUA_ARENASTEP - 1)
+
+typedef struct luaarenachunk_s
+{
+	struct luaarenachunk_s *next;
+} luaarenachunk_t;
+
+#define LUAARENACHUNKHEADER ((sizeof (luaarenachunk_t) + LUA_ARENASTEP - 1) & ~(size_t)(LUA_ARENASTEP - 1))
+
+typedef struct
+{
+	void *freelist[LUA_ARENACLASSES]; // freed blocks, linked through their first bytes
+	UINT8 *unused[LUA_ARENACLASSES], *unusedend[LUA_ARENACLASSES]; // rest of the newest chunk
+	luaarenachunk_t *chunks;
+	luaarenastats_t stats;
+} luaarena_t;
+
+static luaarena_t luaarena; // gL
+static luaarena_t evalmatharena; // LUA_EvalMath's state
+
+static void *LUA_ArenaSystemAlloc(void *ptr, size_t size)
+{
+	void *p = realloc(ptr, size);
+	if (!p)
+		I_Error("Out of memory allocating %s bytes for Lua", sizeu1(size));
+	return p;
+}
+
+static void *LUA_ArenaAlloc(luaarena_t *arena, size_t size)
+{
+	void *p;
+
+	if (size > LUAARENAMAX)
+	{
+		arena->stats.blocks[LUA_ARENACLASSES]++;
+		arena->stats.reserved += size;
+		return LUA_ArenaSystemAlloc(NULL, size);
+	}
+	else
+	{
+		const size_t c = LUAARENACLASS(size);
+		const size_t blocksize = (c + 1) * LUA_ARENASTEP;
+
+		arena->stats.blocks[c]++;
+
+		if ((p = arena->freelist[c]) != NULL)
+		{
+			arena->freelist[c] = *(void **)p;
+			return p;
+		}
+
+		if ((size_t)(arena->unusedend[c] - arena->unused[c]) < blocksize)
+		{
+			luaarenachunk_t *chunk = LUA_ArenaSystemAlloc(NULL, LUAARENACHUNK);
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+			arena->stats.reserved += LUAARENACHUNK;
+			arena->unused[c] = (UINT8 *)chunk + LUAARENACHUNKHEADER;
+			arena->unusedend[c] = (UINT8 *)chunk + LUAARENACHUNK;
+		}
+
+		p = arena->unused[c];
+		arena->unused[c] += blocksize;
+		return p;
+	}
+}
+
+static void LUA_ArenaFree(luaarena_t *arena, void *ptr, size_t size)
+{
+	if (size > LUAARENAMAX)
+	{
+		arena->stats.blocks[LUA_ARENACLASSES]--;
+		arena->stats.reserved -= size;
+		free(ptr);
+	}
+	else
+	{
+		const size_t c = LUAARENACLASS(size);
+		arena->stats.blocks[c]--;
+		*(void **)ptr = arena->freelist[c];
+		arena->freelist[c] = ptr;
+	}
+}
+
+// Gives every chunk back, once the state using the arena is closed.
+static void LUA_ResetArena(luaarena_t *arena)
+{
+	while (arena->chunks)
+	{
+		luaarenachunk_t *next = arena->chunks->next;
+		free(arena->chunks);
+		arena->chunks = next;
+	}
+	memset(arena, 0, sizeof (*arena));
+}
+
 // Lua asks for memory using this.
 static void *LUA_Alloc(void *ud, void *ptr, size_t osize, size_t nsize)
 {
-	(void)ud;
-	if (nsize == 0) {
-		if (osize != 0)
-			Z_Free(ptr);
+	luaarena_t *arena = ud;
+	void *p;
+
+	if (!ptr)
+		osize = 0;
+
+	arena->stats.live += nsize - osize;
+	if (arena->stats.live > arena->stats.peak)
+		arena->stats.peak = arena->stats.live;
+
+	if (nsize == 0)
+	{
+		if (ptr)
+			LUA_ArenaFree(arena, ptr, osize);
 		return NULL;
-	} else
-		return Z_Realloc(ptr, nsize, PU_LUA, NULL);
+	}
+
+	if (ptr)
+	{
+		if (osize > LUAARENAMAX && nsize > LUAARENAMAX)
+		{
+			arena->stats.reserved += nsize - osize;
+			return LUA_ArenaSystemAlloc(ptr, nsize);
+		}
+		else if (osize <= LUAARENAMAX && nsize <= LUAARENAMAX
+			&& LUAARENACLASS(osize) == LUAARENACLASS(nsize))
+			return ptr;
+	}
+
+	p = LUA_ArenaAlloc(arena, nsize);
+	if (ptr)
+	{
+		M_Memcpy(p, ptr, min(osize, nsize));
+		LUA_ArenaFree(arena, ptr, osize);
+	}
+	return p;
+}
+
+/** Returns how much memory the game's Lua state is using.
+  */
+const luaarenastats_t *LUA_GetArenaStats(void)
+{
+	return &luaarena.stats;
 }
 
 // Panic function Lua calls when there's an unprotected error.
@@ -226,10 +375,10 @@ int LUA_PushGlobals(lua_State *L, const char *word)
 		lua_pushinteger(L, cv_pointlimit.value);
 		return 1;
 	} else if (fastcmp(word, "redflag")) {
-		LUA_PushUserdata(L, redflag, META_MOBJ);
+		LUA_PushMobj(L, redflag);
 		return 1;
 	} else if (fastcmp(word, "blueflag")) {
-		LUA_PushUserdata(L, blueflag, META_MOBJ);
+		LUA_PushMobj(L, blueflag);
 		return 1;
 	} else if (fastcmp(word, "rflagpoint")) {
 		LUA_PushUserdata(L, rflagpoint, META_MAPTHING);
@@ -367,17 +516,17 @@ int LUA_PushGlobals(lua_State *L, const char *word)
 	} else if (fastcmp(word,"consoleplayer")) { // player controlling console (aka local player 1)
 		if (!addedtogame || consoleplayer < 0 || !playeringame[consoleplayer])
 			return 0;
-		LUA_PushUserdata(L, &players[consoleplayer], META_PLAYER);
+		LUA_PushPlayer(L, &players[consoleplayer]);
 		return 1;
 	} else if (fastcmp(word,"displayplayer")) { // player visible on screen (aka display player 1)
 		if (displayplayer < 0 || !playeringame[displayplayer])
 			return 0;
-		LUA_PushUserdata(L, &players[displayplayer], META_PLAYER);
+		LUA_PushPlayer(L, &players[displayplayer]);
 		return 1;
 	} else if (fastcmp(word,"secondarydisplayplayer")) { // local/display player 2, for splitscreen
 		if (!splitscreen || secondarydisplayplayer < 0 || !playeringame[secondarydisplayplayer])
 			return 0;
-		LUA_PushUserdata(L, &players[secondarydisplayplayer], META_PLAYER);
+		LUA_PushPlayer(L, &players[secondarydisplayplayer]);
 		return 1;
 	} else if (fastcmp(word,"isserver")) {
 		lua_pushboolean(L, server);
@@ -389,7 +538,7 @@ int LUA_PushGlobals(lua_State *L, const char *word)
 	} else if (fastcmp(word,"server")) {
 		if ((!multiplayer || !netgame) && !playeringame[serverplayer])
 			return 0;
-		LUA_PushUserdata(L, &players[serverplayer], META_PLAYER);
+		LUA_PushPlayer(L, &players[serverplayer]);
 		return 1;
 	} else if (fastcmp(word,"emeralds")) {
 		lua_pushinteger(L, emeralds);
@@ -538,6 +687,130 @@ static int setglobals(lua_State *L)
 	return luaL_error(L, "Implicit global " LUA_QS " prevented. Create a local variable instead.", csname);
 }
 
+// Every userdata pushed to Lua is kept in the LREG_VALID table under an
+// integer reference, so fetching it is an array lookup. The reference for
+// each pointer is found through this index, which lives outside of Lua so
+// that freeing memory Lua has never seen doesn't touch the Lua state.
+typedef struct
+{
+	void *data;
+	INT32 ref;
+} luaudindex_t;
+
+static luaudindex_t *udindex = NULL;
+static size_t udindexsize = 0, udindexcount = 0;
+static int validref = LUA_NOREF;
+
+static size_t LUA_UserdataHome(void *data)
+{
+	UINT32 hash = (UINT32)((size_t)data >> 4) ^ (UINT32)((UINT64)(size_t)data >> 32);
+	hash *= 2654435761u;
+	return (hash ^ (hash >> 16)) & (udindexsize - 1);
+}
+
+// Returns where data is in the index, or udindexsize if it isn't there.
+static size_t LUA_FindUserdataIndex(void *data)
+{
+	size_t i;
+
+	if (!udindexcount)
+		return udindexsize;
+
+	for (i = LUA_UserdataHome(data); udindex[i].data; i = (i + 1) & (udindexsize - 1))
+		if (udindex[i].data == data)
+			return i;
+
+	return udindexsize;
+}
+
+static void LUA_AddUserdataIndex(void *data, INT32 ref)
+{
+	size_t i;
+
+	if ((udindexcount + 1) * 2 > udindexsize)
+	{
+		luaudindex_t *old = udindex;
+		size_t oldsize = udindexsize;
+
+		// PU_LUA, so freeing the old index doesn't come back here
+		udindexsize = oldsize ? oldsize * 2 : 1024;
+		udindex = Z_Calloc(udindexsize * sizeof (*udindex), PU_LUA, NULL);
+		for (i = 0; i < oldsize; i++)
+		{
+			size_t j;
+			if (!old[i].data)
+				continue;
+			for (j = LUA_UserdataHome(old[i].data); udindex[j].data; j = (j + 1) & (udindexsize - 1)) ;
+			udindex[j] = old[i];
+		}
+		Z_Free(old);
+	}
+
+	for (i = LUA_UserdataHome(data); udindex[i].data; i = (i + 1) & (udindexsize - 1)) ;
+	udindex[i].data = data;
+	udindex[i].ref = ref;
+	udindexcount++;
+}
+
+static void LUA_RemoveUserdataIndex(size_t i)
+{
+	const size_t mask = udindexsize - 1;
+	size_t j = i;
+
+	// Shift back any entries that probed past this one
+	while (true)
+	{
+		size_t home;
+
+		j = (j + 1) & mask;
+		if (!udindex[j].data)
+			break;
+
+		home = LUA_UserdataHome(udindex[j].data);
+		if (i <= j ? (home <= i || home > j) : (home <= i && home > j))
+		{
+			udindex[i] = udindex[j];
+			i = j;
+		}
+	}
+
+	udindex[i].data = NULL;
+	udindex[i].ref = 0;
+	udindexcount--;
+}
+
+static void LUA_ClearUserdataIndex(void)
+{
+	if (udindex)
+		memset(udindex, 0, udindexsize * sizeof (*udindex));
+	udindexcount = 0;
+}
+
+// Tables keep the same id in every archive for as long as they exist,
+// so that values which didn't change are archived to the same bytes.
+// Resynchs only send the parts of the gamestate that changed.
+// Strings are numbered from 1 again in each archive instead, in the order
+// they first come up, which is the same as long as nothing changed: Lua
+// never collects string keys from weak tables, so they would pile up there.
+static int archiveidsref = LUA_NOREF; // weak keyed registry table of table ids
+static UINT32 archivenextid;
+static UINT32 archivenextstringid; // Only counts within one archive
+#define ARCHIVEIDLIMIT (1<<20) // start over at the next archive after this many
+
+static void LUA_ResetArchiveIds(lua_State *L)
+{
+	if (archiveidsref != LUA_NOREF)
+		luaL_unref(L, LUA_REGISTRYINDEX, archiveidsref);
+
+	lua_newtable(L);
+	lua_newtable(L);
+	lua_pushliteral(L, "k");
+	lua_setfield(L, -2, "__mode");
+	lua_setmetatable(L, -2);
+	archiveidsref = luaL_ref(L, LUA_REGISTRYINDEX);
+	archivenextid = 0;
+}
+
 // Clear and create a new Lua state, laddo!
 // There's SCRIPTIN to be had!
 static void LUA_ClearState(void)
@@ -549,11 +822,13 @@ static void LUA_ClearState(void)
 	if (gL)
 		lua_close(gL);
 	gL = NULL;
+	LUA_ClearUserdataIndex();
+	LUA_ResetArena(&luaarena);
 
 	CONS_Printf(M_GetText("Pardon me while I initialize the Lua scripting interface...\n"));
 
 	// allocate state
-	L = lua_newstate(LUA_Alloc, NULL);
+	L = lua_newstate(LUA_Alloc, &luaarena);
 	lua_atpanic(L, LUA_Panic);
 
 	// open base libraries
@@ -562,7 +837,13 @@ static void LUA_ClearState(void)
 
 	// make LREG_VALID table for all pushed userdata cache.
 	lua_newtable(L);
+	lua_pushvalue(L, -1);
 	lua_setfield(L, LUA_REGISTRYINDEX, LREG_VALID);
+	validref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	// ids for tables and strings in net archives
+	archiveidsref = LUA_NOREF;
+	LUA_ResetArchiveIds(L);
 
 	// make LREG_METATABLES table for all registered metatables
 	lua_newtable(L);
@@ -601,6 +882,309 @@ void LUA_ClearExtVars(void)
 // (i.e. they were called in hooks or coroutines etc)
 INT32 lua_lumploading = 0;
 
+// ==========================================================================
+//                               BYTECODE CACHE
+// ==========================================================================
+//
+// Compiled scripts are kept in srb2home/cache/lua, one file per script
+// named after the MD5 of its source. Scripts are only ever loaded from there
+// if the file was written by this same build for the same source and chunk
+// name, and is signed with this install's cache key.
+//
+// The key is made up on first use and kept in the same folder. Neither
+// addons nor servers can write there, so bytecode that didn't come out of
+// this game's own compiler can't be passed off as a cached script.
+//
+// A file is "SRB2LUA", a version byte, the source MD5, the signature,
+// then the build string, chunk name and bytecode, each after its length.
+
+#define LUACACHEVERSION 2
+#define LUACACHEHEADER (8 + 16 + 16)
+#define LUACACHEKEYSIZE 16
+
+// The Lua and game build that compiled the cached bytecode
+static const char *LUA_CacheBuild(void)
+{
+	static char build[128];
+	if (!build[0])
+		snprintf(build, sizeof build, "%s %s %s", LUA_RELEASE, VERSIONSTRING, comprevision);
+	return build;
+}
+
+static void LUA_CachePath(char *path, size_t size, const char *name)
+{
+	snprintf(path, size, "%s"PATHSEP"cache"PATHSEP"lua"PATHSEP"%s", srb2home, name);
+}
+
+static void LUA_CacheFilePath(char *path, size_t size, const UINT8 *md5)
+{
+	char hex[33 + 5];
+	INT32 i;
+
+	for (i = 0; i < 16; i++)
+		sprintf(&hex[i*2], "%02x", md5[i]);
+	strcpy(&hex[32], ".luac");
+
+	LUA_CachePath(path, size, hex);
+}
+
+static void LUA_MakeCacheFolder(void)
+{
+	char path[MAX_WADPATH];
+
+	snprintf(path, sizeof path, "%s"PATHSEP"cache", srb2home);
+	I_mkdir(path, 0755);
+	LUA_CachePath(path, sizeof path, "");
+	I_mkdir(path, 0755);
+}
+
+// Returns the key cache files are signed with, or NULL if there is none.
+static const UINT8 *LUA_CacheKey(void)
+{
+	static UINT8 key[LUACACHEKEYSIZE];
+	static INT32 keystate = 0; // 1 once read or made, -1 if it can't be
+	char path[MAX_WADPATH];
+	UINT8 *file;
+	size_t length;
+
+	if (keystate)
+		return (keystate > 0) ? key : NULL;
+	keystate = -1;
+
+	LUA_CachePath(path, sizeof path, "key");
+	length = FIL_ReadFile(path, &file);
+	if (length)
+	{
+		const boolean valid = (length == LUACACHEKEYSIZE);
+
+		if (valid)
+			M_Memcpy(key, file, LUACACHEKEYSIZE);
+		Z_Free(file);
+		if (valid)
+		{
+			keystate = 1;
+			return key;
+		}
+	}
+
+	// A new key leaves every file signed with the old one out of date
+	if (I_GetRandomBytes((char *)key, LUACACHEKEYSIZE) != LUACACHEKEYSIZE)
+		return NULL;
+	LUA_MakeCacheFolder();
+	if (!FIL_WriteFile(path, key, LUACACHEKEYSIZE))
+		return NULL;
+
+	keystate = 1;
+	return key;
+}
+
+#ifndef NOMD5
+// HMAC-MD5 of a cache file, leaving out the signature itself
+static void LUA_SignCache(const UINT8 *key, const UINT8 *file, size_t length, UINT8 *signature)
+{
+	const size_t signedlength = length - 16;
+	UINT8 *inner = Z_Malloc(64 + signedlength, PU_STATIC, NULL);
+	UINT8 outer[64 + 16];
+	INT32 i;
+
+	for (i = 0; i < 64; i++)
+	{
+		const UINT8 k = (i < LUACACHEKEYSIZE) ? key[i] : 0;
+		inner[i] = k ^ 0x36;
+		outer[i] = k ^ 0x5c;
+	}
+	M_Memcpy(inner + 64, file, 24);
+	M_Memcpy(inner + 64 + 24, file + LUACACHEHEADER, length - LUACACHEHEADER);
+	md5_buffer((char *)inner, 64 + signedlength, outer + 64);
+	md5_buffer((char *)outer, sizeof outer, signature);
+
+	Z_Free(inner);
+}
+#endif
+
+// Reads a length prefixed field of a cache file, or returns NULL if it overruns.
+static UINT8 *LUA_ReadCacheField(UINT8 **p, const UINT8 *end, UINT32 *length)
+{
+	UINT8 *field;
+
+	if (end - *p < 4)
+		return NULL;
+	*length = READUINT32(*p);
+	if ((size_t)(end - *p) < *length)
+		return NULL;
+	field = *p;
+	*p += *length;
+	return field;
+}
+
+/** Pushes the cached compiled script for some source, if there is one.
+  *
+  * \return True if the chunk was pushed.
+  */
+static boolean LUA_LoadCachedChunk(const UINT8 *sourcemd5, const char *chunkname)
+{
+#ifdef NOMD5
+	(void)sourcemd5;
+	(void)chunkname;
+	return false;
+#else
+	const char *build = LUA_CacheBuild();
+	const UINT8 *key = LUA_CacheKey();
+	char path[MAX_WADPATH];
+	UINT8 *file, *p, *end, *field, *code;
+	UINT8 signature[16];
+	UINT32 length, codelength;
+	size_t filelength;
+	boolean loaded = false;
+
+	if (!key)
+		return false;
+
+	LUA_CacheFilePath(path, sizeof path, sourcemd5);
+	filelength = FIL_ReadFile(path, &file);
+	if (!filelength)
+		return false;
+
+	p = file;
+	end = file + filelength;
+
+	if (filelength < LUACACHEHEADER
+		|| memcmp(p, "SRB2LUA", 7) || p[7] != LUACACHEVERSION
+		|| memcmp(p + 8, sourcemd5, 16))
+		goto outofdate;
+
+	LUA_SignCache(key, file, filelength, signature);
+	if (memcmp(p + 24, signature, 16))
+		goto outofdate;
+	p += LUACACHEHEADER;
+
+	field = LUA_ReadCacheField(&p, end, &length);
+	if (!field || length != strlen(build) || memcmp(field, build, length))
+		goto outofdate;
+
+	field = LUA_ReadCacheField(&p, end, &length);
+	if (!field || length != strlen(chunkname) || memcmp(field, chunkname, length))
+		goto outofdate;
+
+	code = LUA_ReadCacheField(&p, end, &codelength);
+	if (!code)
+		goto outofdate;
+
+	if (luaL_loadbinarybuffer(gL, (char *)code, codelength, chunkname))
+	{
+		CONS_Debug(DBG_LUA, "LUA_LoadCachedChunk: %s\n", lua_tostring(gL, -1));
+		lua_pop(gL, 1);
+	}
+	else
+		loaded = true;
+
+	Z_Free(file);
+	return loaded;
+
+outofdate:
+	CONS_Debug(DBG_LUA, "LUA_LoadCachedChunk: cache for %s is out of date\n", chunkname);
+	Z_Free(file);
+	return false;
+#endif
+}
+
+typedef struct
+{
+	UINT8 *data;
+	size_t length, capacity;
+} luacachewriter_t;
+
+// must match lua_Writer
+static int LUA_CacheWriter(lua_State *L, const void *p, size_t sz, void *ud)
+{
+	luacachewriter_t *writer = ud;
+	(void)L;
+	if (writer->length + sz > writer->capacity)
+	{
+		// lua_dump writes a few bytes at a time
+		writer->capacity = max(writer->capacity * 2, writer->length + sz + 4096);
+		writer->data = Z_Realloc(writer->data, writer->capacity, PU_STATIC, NULL);
+	}
+	M_Memcpy(writer->data + writer->length, p, sz);
+	writer->length += sz;
+	return 0;
+}
+
+// Saves the compiled script on top of the stack to the cache.
+static void LUA_SaveCachedChunk(const UINT8 *sourcemd5, const char *chunkname)
+{
+#ifdef NOMD5
+	(void)sourcemd5;
+	(void)chunkname;
+#else
+	const char *build = LUA_CacheBuild();
+	const size_t buildlength = strlen(build), namelength = strlen(chunkname);
+	const UINT8 *key = LUA_CacheKey();
+	luacachewriter_t code = {NULL, 0, 0};
+	char path[MAX_WADPATH];
+	UINT8 *buf, *p;
+	size_t length;
+
+	if (!key)
+		return;
+
+	if (lua_dump(gL, LUA_CacheWriter, &code) || !code.length)
+	{
+		Z_Free(code.data);
+		return;
+	}
+
+	length = LUACACHEHEADER + 4 + buildlength + 4 + namelength + 4 + code.length;
+	p = buf = Z_Malloc(length, PU_STATIC, NULL);
+	M_Memcpy(p, "SRB2LUA", 7);
+	p[7] = LUACACHEVERSION;
+	M_Memcpy(p + 8, sourcemd5, 16);
+	p += LUACACHEHEADER;
+	WRITEUINT32(p, buildlength);
+	M_Memcpy(p, build, buildlength);
+	p += buildlength;
+	WRITEUINT32(p, namelength);
+	M_Memcpy(p, chunkname, namelength);
+	p += namelength;
+	WRITEUINT32(p, code.length);
+	M_Memcpy(p, code.data, code.length);
+	LUA_SignCache(key, buf, length, buf + 24);
+
+	LUA_MakeCacheFolder();
+	LUA_CacheFilePath(path, sizeof path, sourcemd5);
+	if (!FIL_WriteFile(path, buf, length))
+		CONS_Debug(DBG_LUA, "LUA_SaveCachedChunk: couldn't write the cache for %s\n", chunkname);
+
+	Z_Free(buf);
+	Z_Free(code.data);
+#endif
+}
+
+/** Compiles a script, or loads it from the bytecode cache if it was
+  * compiled before. Works like luaL_loadbuffer.
+  */
+static int LUA_LoadChunk(const char *data, size_t size, const char *chunkname)
+{
+	UINT8 sourcemd5[16];
+	char name[1024];
+
+	// Usually from va, which the cache functions may call again
+	strlcpy(name, chunkname, sizeof name);
+	chunkname = name;
+
+#ifndef NOMD5
+	md5_buffer(data, size, sourcemd5);
+#endif
+	if (LUA_LoadCachedChunk(sourcemd5, chunkname))
+		return 0;
+
+	if (luaL_loadbuffer(gL, data, size, chunkname))
+		return 1;
+
+	LUA_SaveCachedChunk(sourcemd5, chunkname);
+	return 0;
+}
+
 // Load a script from a MYFILE
 static inline void LUA_LoadFile(MYFILE *f, char *name, boolean noresults)
 {
@@ -618,7 +1202,7 @@ static inline void LUA_LoadFile(MYFILE *f, char *name, boolean noresults)
 
 	lua_pushcfunction(gL, LUA_GetErrorMessage);
 	errorhandlerindex = lua_gettop(gL);
-	if (luaL_loadbuffer(gL, f->data, f->size, va("@%s",name)) || lua_pcall(gL, 0, noresults ? 0 : LUA_MULTRET, lua_gettop(gL) - 1)) {
+	if (LUA_LoadChunk(f->data, f->size, va("@%s",name)) || lua_pcall(gL, 0, noresults ? 0 : LUA_MULTRET, lua_gettop(gL) - 1)) {
 		CONS_Alert(CONS_WARNING,"%s\n",lua_tostring(gL,-1));
 		lua_pop(gL,1);
 	}
@@ -743,7 +1327,7 @@ fixed_t LUA_EvalMath(const char *word)
 	{
 		// make a new state so SOC can't interefere with scripts
 		// allocate state
-		L = lua_newstate(LUA_Alloc, NULL);
+		L = lua_newstate(LUA_Alloc, &evalmatharena);
 		lua_atpanic(L, LUA_Panic);
 
 		// open only enum lib
@@ -778,76 +1362,117 @@ fixed_t LUA_EvalMath(const char *word)
 	return res;
 }
 
-// Takes a pointer, any pointer, and a metatable name
-// Creates a userdata for that pointer with the given metatable
-// Pushes it to the stack and stores it in the registry.
-void LUA_PushUserdata(lua_State *L, void *data, const char *meta)
-{
-	if (LUA_RawPushUserdata(L, data) == LPUSHED_NEW)
-	{
-		luaL_getmetatable(L, meta);
-		lua_setmetatable(L, -2);
-	}
-}
-
-// Same as LUA_PushUserdata but don't set a metatable yet.
-lpushed_t LUA_RawPushUserdata(lua_State *L, void *data)
+// Pushes the userdata for a pointer, creating it if needed.
+// handle is where the object keeps its reference, or NULL if it doesn't.
+// It is only a hint: it's checked against the userdata it leads to,
+// so copied or reused objects just fall back to the index.
+static lpushed_t LUA_RawPushUserdataHandle(lua_State *L, void *data, INT32 *handle)
 {
-	lpushed_t status = LPUSHED_NIL;
-
+	lpushed_t status;
 	void **userdata;
+	size_t i;
+	INT32 ref;
 
 	if (!data) { // push a NULL
 		lua_pushnil(L);
-		return status;
+		return LPUSHED_NIL;
 	}
 
-	lua_getfield(L, LUA_REGISTRYINDEX, LREG_VALID);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, validref);
 	I_Assert(lua_istable(L, -1));
 
-	lua_pushlightuserdata(L, data);
-	lua_rawget(L, -2);
-
-	if (lua_isnil(L, -1)) { // no userdata? deary me, we'll have to make one.
-		lua_pop(L, 1); // pop the nil
+	if (handle && *handle > 0)
+	{
+		lua_rawgeti(L, -1, *handle);
+		userdata = lua_touserdata(L, -1);
+		if (userdata && *userdata == data)
+		{
+			lua_remove(L, -2); // remove LREG_VALID
+			return LPUSHED_EXISTING;
+		}
+		lua_pop(L, 1);
+	}
 
+	i = LUA_FindUserdataIndex(data);
+	if (i < udindexsize)
+	{
+		ref = udindex[i].ref;
+		lua_rawgeti(L, -1, ref);
+		status = LPUSHED_EXISTING;
+	}
+	else // no userdata? deary me, we'll have to make one.
+	{
 		// create the userdata
 		userdata = lua_newuserdata(L, sizeof(void *));
 		*userdata = data;
 
-		// Set it in the registry so we can find it again
-		lua_pushlightuserdata(L, data); // k (store the userdata via the data's pointer)
-		lua_pushvalue(L, -2); // v (copy of the userdata)
-		lua_rawset(L, -4);
+		// Keep it in the registry so we can find it again
+		lua_pushvalue(L, -1);
+		ref = luaL_ref(L, -3);
+		LUA_AddUserdataIndex(data, ref);
 
 		// stack is left with the userdata on top, as if getting it had originally succeeded.
 
 		status = LPUSHED_NEW;
 	}
-	else
-		status = LPUSHED_EXISTING;
+
+	if (handle)
+		*handle = ref;
 
 	lua_remove(L, -2); // remove LREG_VALID
 
 	return status;
 }
 
+// Takes a pointer, any pointer, and a metatable name
+// Creates a userdata for that pointer with the given metatable
+// Pushes it to the stack and stores it in the registry.
+void LUA_PushUserdata(lua_State *L, void *data, const char *meta)
+{
+	if (LUA_RawPushUserdata(L, data) == LPUSHED_NEW)
+	{
+		luaL_getmetatable(L, meta);
+		lua_setmetatable(L, -2);
+	}
+}
+
+// Same as LUA_PushUserdata, for objects that keep their reference
+// at the given offset so they can be pushed again without a lookup.
+void LUA_PushUserdataHandle(lua_State *L, void *data, const char *meta, size_t handle)
+{
+	if (LUA_RawPushUserdataHandle(L, data, data ? (INT32 *)(void *)((UINT8 *)data + handle) : NULL) == LPUSHED_NEW)
+	{
+		luaL_getmetatable(L, meta);
+		lua_setmetatable(L, -2);
+	}
+}
+
+// Same as LUA_PushUserdata but don't set a metatable yet.
+lpushed_t LUA_RawPushUserdata(lua_State *L, void *data)
+{
+	return LUA_RawPushUserdataHandle(L, data, NULL);
+}
+
 // When userdata is freed, use this function to remove it from Lua.
 void LUA_InvalidateUserdata(void *data)
 {
 	void **userdata;
+	size_t i;
+	INT32 ref;
+
 	if (!gL)
 		return;
 
+	i = LUA_FindUserdataIndex(data);
+	if (i >= udindexsize) // not found, not in lua
+		return;
+	ref = udindex[i].ref;
+	LUA_RemoveUserdataIndex(i);
+
 	// fetch the userdata
-	lua_getfield(gL, LUA_REGISTRYINDEX, LREG_VALID);
+	lua_rawgeti(gL, LUA_REGISTRYINDEX, validref);
 	I_Assert(lua_istable(gL, -1));
-		lua_pushlightuserdata(gL, data);
-		lua_rawget(gL, -2);
-			if (lua_isnil(gL, -1)) { // not found, not in lua
-				lua_pop(gL, 2); // pop nil and LREG_VALID
-				return;
-			}
+		lua_rawgeti(gL, -1, ref);
 
 			// nullify any additional data
 			lua_getfield(gL, LUA_REGISTRYINDEX, LREG_EXTVARS);
@@ -863,9 +1488,7 @@ void LUA_InvalidateUserdata(void *data)
 		lua_pop(gL, 1);
 
 		// remove it from the registry
-		lua_pushlightuserdata(gL, data);
-		lua_pushnil(gL);
-		lua_rawset(gL, -3);
+		luaL_unref(gL, -1, ref);
 	lua_pop(gL, 1); // pop LREG_VALID
 }
 
@@ -962,12 +1585,10 @@ enum
 	ARCH_NULL=0,
 	ARCH_TRUE,
 	ARCH_FALSE,
-	ARCH_INT8,
-	ARCH_INT16,
-	ARCH_INT32,
-	ARCH_SMALLSTRING,
-	ARCH_LARGESTRING,
-	ARCH_TABLE,
+	ARCH_INT, // zigzag varint
+	ARCH_STRING, // varint id, varint length, then the bytes
+	ARCH_STRINGREF, // varint id of a string already in the archive
+	ARCH_TABLE, // varint id
 
 	ARCH_MOBJINFO,
 	ARCH_STATE,
@@ -1022,6 +1643,69 @@ static const struct {
 	{NULL,          ARCH_NULL}
 };
 
+// Numbers, lengths and indexes are archived as varints:
+// 7 bits at a time, lowest first, with the top bit set on all but the last.
+static void WriteArchiveVarint(UINT32 value)
+{
+	while (value >= 0x80)
+	{
+		WRITEUINT8(save_p, (value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	WRITEUINT8(save_p, value);
+}
+
+static UINT32 ReadArchiveVarint(void)
+{
+	UINT32 value = 0;
+	INT32 shift = 0;
+	UINT8 byte;
+
+	do
+	{
+		byte = READUINT8(save_p);
+		value |= (UINT32)(byte & 0x7F) << shift;
+		shift += 7;
+	} while ((byte & 0x80) && shift < 35);
+
+	return value;
+}
+
+// Signed numbers are zigzagged first, so small negative numbers stay short
+#define WriteArchiveSigned(n) WriteArchiveVarint(((UINT32)(n) << 1) ^ (UINT32)((INT32)(n) >> 31))
+#define ReadArchiveSigned() ArchiveUnzigzag(ReadArchiveVarint())
+
+static INT32 ArchiveUnzigzag(UINT32 value)
+{
+	return (INT32)((value >> 1) ^ (~(value & 1) + 1));
+}
+
+// Returns the id of the table at index.
+static UINT32 GetArchiveId(int index)
+{
+	UINT32 id;
+
+	lua_rawgeti(gL, LUA_REGISTRYINDEX, archiveidsref);
+	lua_pushvalue(gL, index);
+	lua_rawget(gL, -2);
+	if (lua_isnil(gL, -1))
+	{
+		id = ++archivenextid;
+		lua_pop(gL, 1);
+		lua_pushvalue(gL, index);
+		lua_pushinteger(gL, id);
+		lua_rawset(gL, -3);
+	}
+	else
+	{
+		id = (UINT32)lua_tointeger(gL, -1);
+		lua_pop(gL, 1);
+	}
+	lua_pop(gL, 1);
+
+	return id;
+}
+
 static UINT8 GetUserdataArchType(int index)
 {
 	UINT8 i;
@@ -1062,88 +1746,64 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 		WRITEUINT8(save_p, lua_toboolean(gL, myindex) ? ARCH_TRUE : ARCH_FALSE);
 		break;
 	case LUA_TNUMBER:
-	{
-		lua_Integer number = lua_tointeger(gL, myindex);
-		if (number >= INT8_MIN && number <= INT8_MAX)
-		{
-			WRITEUINT8(save_p, ARCH_INT8);
-			WRITESINT8(save_p, number);
-		}
-		else if (number >= INT16_MIN && number <= INT16_MAX)
-		{
-			WRITEUINT8(save_p, ARCH_INT16);
-			WRITEINT16(save_p, number);
-		}
-		else
-		{
-			WRITEUINT8(save_p, ARCH_INT32);
-			WRITEFIXED(save_p, number);
-		}
+		WRITEUINT8(save_p, ARCH_INT);
+		WriteArchiveSigned(lua_tointeger(gL, myindex));
 		break;
-	}
 	case LUA_TSTRING:
 	{
-		UINT32 len = (UINT32)lua_objlen(gL, myindex); // get length of string, including embedded zeros
-		const char *s = lua_tostring(gL, myindex);
-		UINT32 i = 0;
-		// if you're wondering why we're writing a string to save_p this way,
-		// it turns out that Lua can have embedded zeros ('\0') in the strings,
-		// so we can't use WRITESTRING as that cuts off when it finds a '\0'.
-		// Saving the size of the string also allows us to get the size of the string on the other end,
-		// fixing the awful crashes previously encountered for reading strings longer than 1024
-		// (yes I know that's kind of a stupid thing to care about, but it'd be evil to trim or ignore them?)
-		// -- Monster Iestyn 05/08/18
-		if (len < 255)
+		// TABLESINDEX holds the id of every string already archived
+		lua_pushvalue(gL, myindex);
+		lua_rawget(gL, TABLESINDEX);
+		if (lua_isnil(gL, -1))
 		{
-			WRITEUINT8(save_p, ARCH_SMALLSTRING);
-			WRITEUINT8(save_p, len); // save size of string
+			size_t len;
+			const char *s = lua_tolstring(gL, myindex, &len); // including embedded zeros
+			const UINT32 id = ++archivenextstringid;
+
+			lua_pushvalue(gL, myindex);
+			lua_pushinteger(gL, id);
+			lua_rawset(gL, TABLESINDEX);
+
+			WRITEUINT8(save_p, ARCH_STRING);
+			WriteArchiveVarint(id);
+			WriteArchiveVarint((UINT32)len);
+			P_WriteSaveStreamMem(s, len);
 		}
 		else
 		{
-			WRITEUINT8(save_p, ARCH_LARGESTRING);
-			WRITEUINT32(save_p, len); // save size of string
+			WRITEUINT8(save_p, ARCH_STRINGREF);
+			WriteArchiveVarint((UINT32)lua_tointeger(gL, -1));
 		}
-		while (i < len)
-			WRITECHAR(save_p, s[i++]); // write chars individually, including the embedded zeros
+		lua_pop(gL, 1);
 		break;
 	}
 	case LUA_TTABLE:
 	{
-		boolean found = false;
-		INT32 i;
-		UINT16 t = (UINT16)lua_objlen(gL, TABLESINDEX);
-
-		for (i = 1; i <= t && !found; i++)
-		{
-			lua_rawgeti(gL, TABLESINDEX, i);
-			if (lua_rawequal(gL, myindex, -1))
-			{
-				t = i;
-				found = true;
-			}
-			lua_pop(gL, 1);
-		}
-		if (!found)
-		{
-			t++;
+		// TABLESINDEX lists the tables to archive in order,
+		// and holds the id of every table in the list
+		UINT32 id;
 
-			if (t == 0)
-			{
-				CONS_Alert(CONS_ERROR, "Too many tables to archive!\n");
-				WRITEUINT8(save_p, ARCH_NULL);
-				return 0;
-			}
-		}
+		lua_pushvalue(gL, myindex);
+		lua_rawget(gL, TABLESINDEX);
+		id = (UINT32)lua_tointeger(gL, -1);
+		lua_pop(gL, 1);
 
 		WRITEUINT8(save_p, ARCH_TABLE);
-		WRITEUINT16(save_p, t);
 
-		if (!found)
+		if (!id)
 		{
+			id = GetArchiveId(myindex);
+			WriteArchiveVarint(id);
+
 			lua_pushvalue(gL, myindex);
-			lua_rawseti(gL, TABLESINDEX, t);
+			lua_pushinteger(gL, id);
+			lua_rawset(gL, TABLESINDEX);
+			lua_pushvalue(gL, myindex);
+			lua_rawseti(gL, TABLESINDEX, lua_objlen(gL, TABLESINDEX) + 1);
 			return 1;
 		}
+
+		WriteArchiveVarint(id);
 		break;
 	}
 	case LUA_TUSERDATA:
@@ -1153,14 +1813,14 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 		{
 			mobjinfo_t *info = *((mobjinfo_t **)lua_touserdata(gL, myindex));
 			WRITEUINT8(save_p, ARCH_MOBJINFO);
-			WRITEUINT16(save_p, info - mobjinfo);
+			WriteArchiveVarint(info - mobjinfo);
 			break;
 		}
 		case ARCH_STATE:
 		{
 			state_t *state = *((state_t **)lua_touserdata(gL, myindex));
 			WRITEUINT8(save_p, ARCH_STATE);
-			WRITEUINT16(save_p, state - states);
+			WriteArchiveVarint(state - states);
 			break;
 		}
 		case ARCH_MOBJ:
@@ -1170,7 +1830,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_MOBJ);
-				WRITEUINT32(save_p, mobj->mobjnum);
+				WriteArchiveVarint(mobj->mobjnum);
 			}
 			break;
 		}
@@ -1181,7 +1841,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_PLAYER);
-				WRITEUINT8(save_p, player - players);
+				WriteArchiveVarint(player - players);
 			}
 			break;
 		}
@@ -1192,7 +1852,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_MAPTHING);
-				WRITEUINT16(save_p, mapthing - mapthings);
+				WriteArchiveVarint(mapthing - mapthings);
 			}
 			break;
 		}
@@ -1203,7 +1863,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_VERTEX);
-				WRITEUINT16(save_p, vertex - vertexes);
+				WriteArchiveVarint(vertex - vertexes);
 			}
 			break;
 		}
@@ -1214,7 +1874,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_LINE);
-				WRITEUINT16(save_p, line - lines);
+				WriteArchiveVarint(line - lines);
 			}
 			break;
 		}
@@ -1225,7 +1885,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_SIDE);
-				WRITEUINT16(save_p, side - sides);
+				WriteArchiveVarint(side - sides);
 			}
 			break;
 		}
@@ -1236,7 +1896,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_SUBSECTOR);
-				WRITEUINT16(save_p, subsector - subsectors);
+				WriteArchiveVarint(subsector - subsectors);
 			}
 			break;
 		}
@@ -1247,7 +1907,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_SECTOR);
-				WRITEUINT16(save_p, sector - sectors);
+				WriteArchiveVarint(sector - sectors);
 			}
 			break;
 		}
@@ -1259,7 +1919,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_SEG);
-				WRITEUINT16(save_p, seg - segs);
+				WriteArchiveVarint(seg - segs);
 			}
 			break;
 		}
@@ -1270,7 +1930,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_NODE);
-				WRITEUINT16(save_p, node - nodes);
+				WriteArchiveVarint(node - nodes);
 			}
 			break;
 		}
@@ -1287,8 +1947,8 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				else
 				{
 					WRITEUINT8(save_p, ARCH_FFLOOR);
-					WRITEUINT16(save_p, rover->target - sectors);
-					WRITEUINT16(save_p, i);
+					WriteArchiveVarint(rover->target - sectors);
+					WriteArchiveVarint(i);
 				}
 			}
 			break;
@@ -1300,7 +1960,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_POLYOBJ);
-				WRITEUINT16(save_p, polyobj-PolyObjects);
+				WriteArchiveVarint(polyobj-PolyObjects);
 			}
 			break;
 		}
@@ -1311,7 +1971,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_SLOPE);
-				WRITEUINT16(save_p, slope->id);
+				WriteArchiveVarint(slope->id);
 			}
 			break;
 		}
@@ -1322,7 +1982,7 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 				WRITEUINT8(save_p, ARCH_NULL);
 			else {
 				WRITEUINT8(save_p, ARCH_MAPHEADER);
-				WRITEUINT16(save_p, header - *mapheaderinfo);
+				WriteArchiveVarint(header - *mapheaderinfo);
 			}
 			break;
 		}
@@ -1330,21 +1990,21 @@ static UINT8 ArchiveValue(int TABLESINDEX, int myindex)
 		{
 			skincolor_t *info = *((skincolor_t **)lua_touserdata(gL, myindex));
 			WRITEUINT8(save_p, ARCH_SKINCOLOR);
-			WRITEUINT16(save_p, info - skincolors);
+			WriteArchiveVarint(info - skincolors);
 			break;
 		}
 		case ARCH_MOUSE:
 		{
 			mouse_t *m = *((mouse_t **)lua_touserdata(gL, myindex));
 			WRITEUINT8(save_p, ARCH_MOUSE);
-			WRITEUINT8(save_p, m == &mouse ? 1 : 2);
+			WriteArchiveVarint(m == &mouse ? 1 : 2);
 			break;
 		}
 		case ARCH_SKIN:
 		{
 			skin_t *skin = *((skin_t **)lua_touserdata(gL, myindex));
 			WRITEUINT8(save_p, ARCH_SKIN);
-			WRITEUINT8(save_p, skin - skins); // UINT8 because MAXSKINS is only 32
+			WriteArchiveVarint(skin - skins);
 			break;
 		}
 		default:
@@ -1363,7 +2023,7 @@ static void ArchiveExtVars(void *pointer, const char *ptype)
 
 	if (!gL) {
 		if (fastcmp(ptype,"player")) // players must always be included, even if no vars
-			WRITEUINT16(save_p, 0);
+			WriteArchiveVarint(0);
 		return;
 	}
 
@@ -1379,7 +2039,7 @@ static void ArchiveExtVars(void *pointer, const char *ptype)
 	{ // no extra values table
 		lua_pop(gL, 1);
 		if (fastcmp(ptype,"player")) // players must always be included, even if no vars
-			WRITEUINT16(save_p, 0);
+			WriteArchiveVarint(0);
 		return;
 	}
 
@@ -1391,19 +2051,20 @@ static void ArchiveExtVars(void *pointer, const char *ptype)
 	if (i == 0)
 	{
 		if (fastcmp(ptype,"player")) // always include players even if they have no extra variables
-			WRITEUINT16(save_p, 0);
+			WriteArchiveVarint(0);
 		lua_pop(gL, 1);
 		return;
 	}
 
 	if (fastcmp(ptype,"mobj")) // mobjs must write their mobjnum as a header
-		WRITEUINT32(save_p, ((mobj_t *)pointer)->mobjnum);
-	WRITEUINT16(save_p, i);
+		WriteArchiveVarint(((mobj_t *)pointer)->mobjnum);
+	WriteArchiveVarint(i);
 	lua_pushnil(gL);
 	while (lua_next(gL, -2))
 	{
+		P_FlushSaveStream(false);
 		I_Assert(lua_type(gL, -2) == LUA_TSTRING);
-		WRITESTRING(save_p, lua_tostring(gL, -2));
+		ArchiveValue(TABLESINDEX, -2); // the same few names come up over and over
 		if (ArchiveValue(TABLESINDEX, -1) == 2)
 			CONS_Alert(CONS_ERROR, "Type of value for %s entry '%s' (%s) could not be archived!\n", ptype, lua_tostring(gL, -2), luaL_typename(gL, -1));
 		lua_pop(gL, 1);
@@ -1417,14 +2078,17 @@ static int NetArchive(lua_State *L)
 	int TABLESINDEX = lua_upvalueindex(1);
 	int i, n = lua_gettop(L);
 	for (i = 1; i <= n; i++)
+	{
+		P_FlushSaveStream(false);
 		ArchiveValue(TABLESINDEX, i);
+	}
 	return n;
 }
 
 static void ArchiveTables(void)
 {
 	int TABLESINDEX;
-	UINT16 i, n;
+	UINT32 i, n;
 	UINT8 e;
 
 	if (!gL)
@@ -1432,23 +2096,25 @@ static void ArchiveTables(void)
 
 	TABLESINDEX = lua_gettop(gL);
 
-	n = (UINT16)lua_objlen(gL, TABLESINDEX);
+	n = (UINT32)lua_objlen(gL, TABLESINDEX);
 	for (i = 1; i <= n; i++)
 	{
 		lua_rawgeti(gL, TABLESINDEX, i);
 		lua_pushnil(gL);
 		while (lua_next(gL, -2))
 		{
+			P_FlushSaveStream(false);
+
 			// Write key
 			e = ArchiveValue(TABLESINDEX, -2); // key should be either a number or a string, ArchiveValue can handle this.
 			if (e == 2) // invalid key type (function, thread, lightuserdata, or anything we don't recognise)
-				CONS_Alert(CONS_ERROR, "Index '%s' (%s) of table %d could not be archived!\n", lua_tostring(gL, -2), luaL_typename(gL, -2), i);
+				CONS_Alert(CONS_ERROR, "Index '%s' (%s) of table %u could not be archived!\n", lua_tostring(gL, -2), luaL_typename(gL, -2), (unsigned)i);
 			// Write value
 			e = ArchiveValue(TABLESINDEX, -1);
 			if (e == 1)
 				n++; // the table contained a new table we'll have to archive. :(
 			else if (e == 2) // invalid value type
-				CONS_Alert(CONS_ERROR, "Type of value for table %d entry '%s' (%s) could not be archived!\n", i, lua_tostring(gL, -2), luaL_typename(gL, -1));
+				CONS_Alert(CONS_ERROR, "Type of value for table %u entry '%s' (%s) could not be archived!\n", (unsigned)i, lua_tostring(gL, -2), luaL_typename(gL, -1));
 
 			lua_pop(gL, 1);
 		}
@@ -1485,116 +2151,114 @@ static UINT8 UnArchiveValue(int TABLESINDEX)
 	case ARCH_FALSE:
 		lua_pushboolean(gL, false);
 		break;
-	case ARCH_INT8:
-		lua_pushinteger(gL, READSINT8(save_p));
+	case ARCH_INT:
+		lua_pushinteger(gL, ReadArchiveSigned());
 		break;
-	case ARCH_INT16:
-		lua_pushinteger(gL, READINT16(save_p));
-		break;
-	case ARCH_INT32:
-		lua_pushinteger(gL, READFIXED(save_p));
-		break;
-	case ARCH_SMALLSTRING:
-	case ARCH_LARGESTRING:
+	case ARCH_STRING:
 	{
-		UINT32 len;
-		char *value;
-		UINT32 i = 0;
-
-		// See my comments in the ArchiveValue function;
-		// it's much the same for reading strings as writing them!
-		// (i.e. we can't use READSTRING either)
-		// -- Monster Iestyn 05/08/18
-		if (type == ARCH_SMALLSTRING)
-			len = READUINT8(save_p); // length of string, including embedded zeros
-		else
-			len = READUINT32(save_p); // length of string, including embedded zeros
-		value = malloc(len); // make temp buffer of size len
-		// now read the actual string
-		while (i < len)
-			value[i++] = READCHAR(save_p); // read chars individually, including the embedded zeros
-		lua_pushlstring(gL, value, len); // push the string (note: this function supports embedded zeros)
-		free(value); // free the buffer
+		// TABLESINDEX holds every string by id in a table at 0
+		const INT32 id = (INT32)ReadArchiveVarint();
+		const UINT32 len = ReadArchiveVarint(); // including embedded zeros
+		lua_rawgeti(gL, TABLESINDEX, 0);
+		lua_pushlstring(gL, (const char *)save_p, len);
+		save_p += len;
+		lua_pushvalue(gL, -1);
+		lua_rawseti(gL, -3, id);
+		lua_remove(gL, -2);
 		break;
 	}
+	case ARCH_STRINGREF:
+		lua_rawgeti(gL, TABLESINDEX, 0);
+		lua_rawgeti(gL, -1, (INT32)ReadArchiveVarint());
+		lua_remove(gL, -2);
+		if (!lua_isstring(gL, -1))
+		{
+			lua_pop(gL, 1);
+			lua_pushnil(gL);
+		}
+		break;
 	case ARCH_TABLE:
 	{
-		UINT16 tid = READUINT16(save_p);
-		lua_rawgeti(gL, TABLESINDEX, tid);
+		// It also holds every table by negative id,
+		// and lists the tables to read in order, from 1 up
+		const INT32 id = (INT32)ReadArchiveVarint();
+		lua_rawgeti(gL, TABLESINDEX, -id);
 		if (lua_isnil(gL, -1))
 		{
 			lua_pop(gL, 1);
 			lua_newtable(gL);
 			lua_pushvalue(gL, -1);
-			lua_rawseti(gL, TABLESINDEX, tid);
+			lua_rawseti(gL, TABLESINDEX, -id);
+			lua_pushvalue(gL, -1);
+			lua_rawseti(gL, TABLESINDEX, lua_objlen(gL, TABLESINDEX) + 1);
 			return 2;
 		}
 		break;
 	}
 	case ARCH_MOBJINFO:
-		LUA_PushUserdata(gL, &mobjinfo[READUINT16(save_p)], META_MOBJINFO);
+		LUA_PushUserdata(gL, &mobjinfo[ReadArchiveVarint()], META_MOBJINFO);
 		break;
 	case ARCH_STATE:
-		LUA_PushUserdata(gL, &states[READUINT16(save_p)], META_STATE);
+		LUA_PushUserdata(gL, &states[ReadArchiveVarint()], META_STATE);
 		break;
 	case ARCH_MOBJ:
-		LUA_PushUserdata(gL, P_FindNewPosition(READUINT32(save_p)), META_MOBJ);
+		LUA_PushMobj(gL, P_FindNewPosition(ReadArchiveVarint()));
 		break;
 	case ARCH_PLAYER:
-		LUA_PushUserdata(gL, &players[READUINT8(save_p)], META_PLAYER);
+		LUA_PushPlayer(gL, &players[ReadArchiveVarint()]);
 		break;
 	case ARCH_MAPTHING:
-		LUA_PushUserdata(gL, &mapthings[READUINT16(save_p)], META_MAPTHING);
+		LUA_PushUserdata(gL, &mapthings[ReadArchiveVarint()], META_MAPTHING);
 		break;
 	case ARCH_VERTEX:
-		LUA_PushUserdata(gL, &vertexes[READUINT16(save_p)], META_VERTEX);
+		LUA_PushUserdata(gL, &vertexes[ReadArchiveVarint()], META_VERTEX);
 		break;
 	case ARCH_LINE:
-		LUA_PushUserdata(gL, &lines[READUINT16(save_p)], META_LINE);
+		LUA_PushLine(gL, &lines[ReadArchiveVarint()]);
 		break;
 	case ARCH_SIDE:
-		LUA_PushUserdata(gL, &sides[READUINT16(save_p)], META_SIDE);
+		LUA_PushSide(gL, &sides[ReadArchiveVarint()]);
 		break;
 	case ARCH_SUBSECTOR:
-		LUA_PushUserdata(gL, &subsectors[READUINT16(save_p)], META_SUBSECTOR);
+		LUA_PushSubsector(gL, &subsectors[ReadArchiveVarint()]);
 		break;
 	case ARCH_SECTOR:
-		LUA_PushUserdata(gL, &sectors[READUINT16(save_p)], META_SECTOR);
+		LUA_PushSector(gL, &sectors[ReadArchiveVarint()]);
 		break;
 #ifdef HAVE_LUA_SEGS
 	case ARCH_SEG:
-		LUA_PushUserdata(gL, &segs[READUINT16(save_p)], META_SEG);
+		LUA_PushUserdata(gL, &segs[ReadArchiveVarint()], META_SEG);
 		break;
 	case ARCH_NODE:
-		LUA_PushUserdata(gL, &nodes[READUINT16(save_p)], META_NODE);
+		LUA_PushUserdata(gL, &nodes[ReadArchiveVarint()], META_NODE);
 		break;
 #endif
 	case ARCH_FFLOOR:
 	{
-		sector_t *sector = &sectors[READUINT16(save_p)];
-		UINT16 id = READUINT16(save_p);
+		sector_t *sector = &sectors[ReadArchiveVarint()];
+		UINT16 id = ReadArchiveVarint();
 		ffloor_t *rover = P_GetFFloorByID(sector, id);
 		if (rover)
 			LUA_PushUserdata(gL, rover, META_FFLOOR);
 		break;
 	}
 	case ARCH_POLYOBJ:
-		LUA_PushUserdata(gL, &PolyObjects[READUINT16(save_p)], META_POLYOBJ);
+		LUA_PushUserdata(gL, &PolyObjects[ReadArchiveVarint()], META_POLYOBJ);
 		break;
 	case ARCH_SLOPE:
-		LUA_PushUserdata(gL, P_SlopeById(READUINT16(save_p)), META_SLOPE);
+		LUA_PushUserdata(gL, P_SlopeById(ReadArchiveVarint()), META_SLOPE);
 		break;
 	case ARCH_MAPHEADER:
-		LUA_PushUserdata(gL, mapheaderinfo[READUINT16(save_p)], META_MAPHEADER);
+		LUA_PushUserdata(gL, mapheaderinfo[ReadArchiveVarint()], META_MAPHEADER);
 		break;
 	case ARCH_SKINCOLOR:
-		LUA_PushUserdata(gL, &skincolors[READUINT16(save_p)], META_SKINCOLOR);
+		LUA_PushUserdata(gL, &skincolors[ReadArchiveVarint()], META_SKINCOLOR);
 		break;
 	case ARCH_MOUSE:
-		LUA_PushUserdata(gL, READUINT16(save_p) == 1 ? &mouse : &mouse2, META_MOUSE);
+		LUA_PushUserdata(gL, ReadArchiveVarint() == 1 ? &mouse : &mouse2, META_MOUSE);
 		break;
 	case ARCH_SKIN:
-		LUA_PushUserdata(gL, &skins[READUINT8(save_p)], META_SKIN);
+		LUA_PushUserdata(gL, &skins[ReadArchiveVarint()], META_SKIN);
 		break;
 	case ARCH_TEND:
 		return 1;
@@ -1605,9 +2269,8 @@ static UINT8 UnArchiveValue(int TABLESINDEX)
 static void UnArchiveExtVars(void *pointer)
 {
 	int TABLESINDEX;
-	UINT16 field_count = READUINT16(save_p);
-	UINT16 i;
-	char field[1024];
+	UINT32 field_count = ReadArchiveVarint();
+	UINT32 i;
 
 	if (field_count == 0)
 		return;
@@ -1618,9 +2281,18 @@ static void UnArchiveExtVars(void *pointer)
 
 	for (i = 0; i < field_count; i++)
 	{
-		READSTRING(save_p, field);
+		UnArchiveValue(TABLESINDEX); // field name
 		UnArchiveValue(TABLESINDEX);
-		lua_setfield(gL, -2, field);
+		if (lua_isstring(gL, -2))
+			lua_rawset(gL, -3);
+		else
+			lua_pop(gL, 2);
+	}
+
+	if (!pointer) // only reading past them
+	{
+		lua_pop(gL, 1);
+		return;
 	}
 
 	lua_getfield(gL, LUA_REGISTRYINDEX, LREG_EXTVARS);
@@ -1643,7 +2315,7 @@ static int NetUnArchive(lua_State *L)
 static void UnArchiveTables(void)
 {
 	int TABLESINDEX;
-	UINT16 i, n;
+	UINT32 i, n;
 	UINT16 metatableid;
 
 	if (!gL)
@@ -1651,7 +2323,7 @@ static void UnArchiveTables(void)
 
 	TABLESINDEX = lua_gettop(gL);
 
-	n = (UINT16)lua_objlen(gL, TABLESINDEX);
+	n = (UINT32)lua_objlen(gL, TABLESINDEX);
 	for (i = 1; i <= n; i++)
 	{
 		lua_rawgeti(gL, TABLESINDEX, i);
@@ -1663,7 +2335,7 @@ static void UnArchiveTables(void)
 				n++;
 			if (lua_isnil(gL, -2)) // if key is nil (if a function etc was accidentally saved)
 			{
-				CONS_Alert(CONS_ERROR, "A nil key in table %d was found! (Invalid key type or corrupted save?)\n", i);
+				CONS_Alert(CONS_ERROR, "A nil key in table %u was found! (Invalid key type or corrupted save?)\n", (unsigned)i);
 				lua_pop(gL, 2); // pop key and value instead of setting them in the table, to prevent Lua panic errors
 			}
 			else
@@ -1700,7 +2372,12 @@ void LUA_Archive(void)
 	thinker_t *th;
 
 	if (gL)
+	{
+		if (archivenextid >= ARCHIVEIDLIMIT)
+			LUA_ResetArchiveIds(gL);
+		archivenextstringid = 0;
 		lua_newtable(gL); // tables to be archived.
+	}
 
 	for (i = 0; i < MAXPLAYERS; i++)
 	{
@@ -1718,9 +2395,10 @@ void LUA_Archive(void)
 		// archive function will determine when to skip mobjs,
 		// and write mobjnum in otherwise.
 		ArchiveExtVars(th, "mobj");
+		P_FlushSaveStream(false);
 	}
 
-	WRITEUINT32(save_p, UINT32_MAX); // end of mobjs marker, replaces mobjnum.
+	WriteArchiveVarint(UINT32_MAX); // end of mobjs marker, replaces mobjnum.
 
 	LUA_HookNetArchive(NetArchive); // call the NetArchive hook in archive mode
 	ArchiveTables();
@@ -1733,10 +2411,14 @@ void LUA_UnArchive(void)
 {
 	UINT32 mobjnum;
 	INT32 i;
-	thinker_t *th;
+	thinker_t *th, *next = thlist[THINK_MOBJ].next;
 
 	if (gL)
+	{
 		lua_newtable(gL); // tables to be read
+		lua_newtable(gL); // and strings
+		lua_rawseti(gL, -2, 0);
+	}
 
 	for (i = 0; i < MAXPLAYERS; i++)
 	{
@@ -1746,16 +2428,33 @@ void LUA_UnArchive(void)
 	}
 
 	do {
-		mobjnum = READUINT32(save_p); // read a mobjnum
-		for (th = thlist[THINK_MOBJ].next; th != &thlist[THINK_MOBJ]; th = th->next)
+		mobjnum = ReadArchiveVarint(); // read a mobjnum
+		if (mobjnum == UINT32_MAX)
+			break;
+
+		// Mobjs were archived in thinker order, so carry on from the last one.
+		// Look through the whole list once before giving up, to be safe.
+		for (th = next, i = 0; i < 2; th = th->next)
 		{
+			if (th == &thlist[THINK_MOBJ])
+			{
+				i++;
+				continue;
+			}
 			if (th->function.acp1 == (actionf_p1)P_RemoveThinkerDelayed)
 				continue;
 			if (((mobj_t *)th)->mobjnum != mobjnum) // find matching mobj
 				continue;
 			UnArchiveExtVars(th); // apply variables
+			next = th->next;
+			break;
+		}
+		if (i == 2)
+		{
+			CONS_Alert(CONS_ERROR, "Lua variables for mobj %u have nowhere to go!\n", mobjnum);
+			UnArchiveExtVars(NULL); // skip them
 		}
-	} while(mobjnum != UINT32_MAX); // repeat until end of mobjs marker.
+	} while (true); // repeat until end of mobjs marker.
 
 	LUA_HookNetArchive(NetUnArchive); // call the NetArchive hook in unarchive mode
 	UnArchiveTables();
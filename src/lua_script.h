@@ -43,6 +43,19 @@ void LUA_ClearExtVars(void);
 
 extern INT32 lua_lumploading; // is LUA_LoadLump being called?
 
+#define LUA_ARENASTEP 16
+#define LUA_ARENACLASSES 16 // blocks up to 256 bytes, in LUA_ARENASTEP steps
+
+typedef struct
+{
+	size_t live; // bytes the Lua state has allocated
+	size_t peak; // most bytes it had allocated at once
+	size_t reserved; // bytes taken from the system, unused arena space included
+	UINT32 blocks[LUA_ARENACLASSES + 1]; // live blocks in each size class, then larger blocks
+} luaarenastats_t;
+
+const luaarenastats_t *LUA_GetArenaStats(void);
+
 int LUA_GetErrorMessage(lua_State *L);
 int LUA_Call(lua_State *L, int nargs, int nresults, int errorhandlerindex);
 void LUA_LoadLump(UINT16 wad, UINT16 lump, boolean noresults);
@@ -88,6 +101,7 @@ typedef enum {
 } lpushed_t;
 
 void LUA_PushUserdata(lua_State *L, void *data, const char *meta);
+void LUA_PushUserdataHandle(lua_State *L, void *data, const char *meta, size_t handle);
 lpushed_t LUA_RawPushUserdata(lua_State *L, void *data);
 
 void LUA_InvalidateUserdata(void *data);
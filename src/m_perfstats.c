@@ -18,6 +18,9 @@
 #include "z_zone.h"
 #include "p_local.h"
 #include "r_fps.h"
+#include "deh_tables.h" // MOBJTYPE_LIST, FREE_MOBJS
+#include "w_wad.h" // wadfiles, for the benchmark report
+#include "m_misc.h" // FIL_FileExists
 
 #ifdef HWRENDER
 #include "hardware/hw_main.h"
@@ -64,12 +67,18 @@ static ps_metric_t ps_precipcount = {0};
 static ps_metric_t ps_removecount = {0};
 
 ps_metric_t ps_checkposition_calls = {0};
+ps_metric_t ps_sightcache_hits = {0};
+ps_metric_t ps_sightcache_misses = {0};
 
 ps_metric_t ps_lua_thinkframe_time = {0};
 ps_metric_t ps_lua_mobjhooks = {0};
 
 ps_metric_t ps_otherlogictime = {0};
 
+// Per mobj type thinker time and count, filled in by P_RunMobjThinkersTimed
+ps_metric_t ps_mobjtype_times[NUMMOBJTYPES];
+INT32 ps_mobjtype_counts[NUMMOBJTYPES];
+
 // Columns for perfstats pages.
 
 // Position on screen is determined separately in the drawing functions.
@@ -101,6 +110,9 @@ perfstatrow_t rendertime_rows[] = {
 	{" bsptime", " RenderBSPNode: ", &ps_bsptime, PS_TIME|PS_LEVEL|PS_SW},
 	{" sprclip", " R_ClipSprites: ", &ps_sw_spritecliptime, PS_TIME|PS_LEVEL|PS_SW},
 	{" portals", " Portals+Skybox:", &ps_sw_portaltime, PS_TIME|PS_LEVEL|PS_SW},
+#ifdef HAVE_THREADS
+	{" walls  ", " Wall columns:  ", &ps_sw_walltime, PS_TIME|PS_LEVEL|PS_SW},
+#endif
 	{" planes ", " R_DrawPlanes:  ", &ps_sw_planetime, PS_TIME|PS_LEVEL|PS_SW},
 	{" masked ", " R_DrawMasked:  ", &ps_sw_maskedtime, PS_TIME|PS_LEVEL|PS_SW},
 	{" other  ", " Other:         ", &ps_otherrendertime, PS_TIME|PS_LEVEL|PS_SW},
@@ -179,6 +191,8 @@ perfstatrow_t thinkercount_rows[] = {
 perfstatrow_t misc_calls_rows[] = {
 	{"lmhook", "Lua mobj hooks: ", &ps_lua_mobjhooks, PS_LEVEL},
 	{"chkpos", "P_CheckPosition:", &ps_checkposition_calls, PS_LEVEL},
+	{"sghit",  "Sight hits:     ", &ps_sightcache_hits, PS_LEVEL},
+	{"sgmiss", "Sight misses:   ", &ps_sightcache_misses, PS_LEVEL},
 	{0}
 };
 
@@ -221,6 +235,120 @@ void PS_SetThinkFrameHookInfo(int index, precise_t time_taken, char* short_src)
 	thinkframe_hooks_length = index + 1;
 }
 
+// Hook stats for perfstats 5, one entry per place a hook function is defined
+ps_hookstat_t *ps_hookstats = NULL;
+static INT32 ps_numhookstats = 0;
+static tic_t ps_hookstats_tics = 0; // tics recorded since the stats were reset
+
+/** Finds or adds the stats entry for hook functions defined at
+  * short_src:line. Called whenever a hook is added.
+  *
+  * \return Index into ps_hookstats.
+  */
+INT32 PS_AddHookStat(const char *hook_name, const char *short_src, INT32 line)
+{
+	ps_hookstat_t *stat;
+	INT32 i;
+
+	for (i = 0; i < ps_numhookstats; i++)
+		if (ps_hookstats[i].line == line && !strcmp(ps_hookstats[i].short_src, short_src))
+			return i;
+
+	ps_hookstats = Z_Realloc(ps_hookstats, sizeof (*ps_hookstats) * (ps_numhookstats + 1), PU_STATIC, NULL);
+	stat = &ps_hookstats[ps_numhookstats];
+	strlcpy(stat->short_src, short_src, sizeof stat->short_src);
+	stat->line = line;
+	stat->hook_name = hook_name;
+	stat->calls = 0;
+	stat->time_taken = 0;
+	return ps_numhookstats++;
+}
+
+static void PS_ResetHookStats(void)
+{
+	INT32 i;
+	for (i = 0; i < ps_numhookstats; i++)
+	{
+		ps_hookstats[i].calls = 0;
+		ps_hookstats[i].time_taken = 0;
+	}
+	ps_hookstats_tics = 0;
+}
+
+// Slowest first, then most called
+static int PS_CompareHookStats(const void *a, const void *b)
+{
+	const ps_hookstat_t *sa = &ps_hookstats[*(const INT32 *)a];
+	const ps_hookstat_t *sb = &ps_hookstats[*(const INT32 *)b];
+	if (sa->time_taken != sb->time_taken)
+		return (sa->time_taken < sb->time_taken) ? 1 : -1;
+	if (sa->calls != sb->calls)
+		return (sa->calls < sb->calls) ? 1 : -1;
+	return *(const INT32 *)a - *(const INT32 *)b;
+}
+
+// Returns the indices of ps_hookstats in drawing order. Free with Z_Free.
+static INT32 *PS_SortHookStats(void)
+{
+	INT32 *sorted = Z_Malloc(sizeof (*sorted) * max(ps_numhookstats, 1), PU_STATIC, NULL);
+	INT32 i;
+	for (i = 0; i < ps_numhookstats; i++)
+		sorted[i] = i;
+	qsort(sorted, ps_numhookstats, sizeof (*sorted), PS_CompareHookStats);
+	return sorted;
+}
+
+/** Writes the hook stats recorded by perfstats 5 to path as CSV, slowest
+  * first. Times are in microseconds, and include any hooks run from inside
+  * the hook.
+  */
+void PS_DumpHookStats(const char *path)
+{
+	const double scale = 1000000.0 / I_GetPrecisePrecision();
+	const double tics = max(ps_hookstats_tics, 1);
+	INT32 *sorted;
+	FILE *f;
+	INT32 i;
+
+	if (!ps_hookstats_tics)
+	{
+		CONS_Printf(M_GetText("No hook stats recorded, set perfstats to LuaHooks first.\n"));
+		return;
+	}
+
+	f = fopen(path, "w");
+	if (!f)
+	{
+		CONS_Alert(CONS_ERROR, M_GetText("Couldn't write hook stats to '%s'\n"), path);
+		return;
+	}
+
+	fputs("source,line,hook,calls,total_us,us_per_call,us_per_tic\n", f);
+
+	sorted = PS_SortHookStats();
+	for (i = 0; i < ps_numhookstats; i++)
+	{
+		const ps_hookstat_t *stat = &ps_hookstats[sorted[i]];
+		const double total = stat->time_taken * scale;
+		fprintf(f, "\"%s\",%d,%s,%u,%.2f,%.2f,%.2f\n",
+			stat->short_src, stat->line, stat->hook_name, stat->calls,
+			total, stat->calls ? total / stat->calls : 0.0, total / tics);
+	}
+	Z_Free(sorted);
+
+	fclose(f);
+
+	CONS_Printf(M_GetText("Hook stats for %u tics saved to '%s'\n"), ps_hookstats_tics, path);
+}
+
+void PS_ResetMobjTypeStats(void)
+{
+	int i;
+	for (i = 0; i < NUMMOBJTYPES; i++)
+		ps_mobjtype_times[i].value.p = 0;
+	memset(ps_mobjtype_counts, 0, sizeof ps_mobjtype_counts);
+}
+
 static boolean PS_HighResolution(void)
 {
 	return (vid.width >= 640 && vid.height >= 400);
@@ -469,6 +597,7 @@ static void PS_UpdateFrameStats(void)
 			ps_otherrendertime.value.p -=
 				ps_sw_spritecliptime.value.p +
 				ps_sw_portaltime.value.p +
+				ps_sw_walltime.value.p +
 				ps_sw_planetime.value.p +
 				ps_sw_maskedtime.value.p;
 		}
@@ -584,6 +713,18 @@ void PS_UpdateTickStats(void)
 			PS_UpdateMetricHistory(&thinkframe_hooks[i].time_taken, true, false, false);
 		}
 	}
+	if (cv_perfstats.value == 4 && cv_ps_samplesize.value > 1 && PS_IsLevelActive())
+	{
+		int i;
+		for (i = 0; i < NUMMOBJTYPES; i++)
+		{
+			// Keep recording types that have gone away, so their averages decay.
+			if (ps_mobjtype_times[i].history || ps_mobjtype_counts[i])
+				PS_UpdateMetricHistory(&ps_mobjtype_times[i], true, false, false);
+		}
+	}
+	if (cv_perfstats.value == 5)
+		ps_hookstats_tics++;
 	if (cv_perfstats.value && cv_ps_samplesize.value > 1)
 	{
 		ps_tick_index++;
@@ -594,6 +735,206 @@ void PS_UpdateTickStats(void)
 	}
 }
 
+// -----------------------------
+// -benchdemo
+// -----------------------------
+
+// Game logic metrics recorded for every tic of a benchmarked demo
+static perfstatrow_t *benchmark_rows[] = {gamelogic_rows, misc_calls_rows, NULL};
+
+boolean ps_benchmarking = false;
+static char benchmark_demo[256];
+static char benchmark_path[256];
+static INT64 *benchmark_samples = NULL; // numbenchcolumns samples per tic
+static size_t benchmark_tics, benchmark_size;
+static size_t numbenchcolumns;
+static precise_t benchmark_start;
+
+/** Starts recording every tic's game logic stats, until PS_FinishBenchmark.
+  *
+  * \param demoname Demo being played, for the report.
+  * \param outpath File to write the report to. Written as JSON if it ends
+  *                in .json, CSV otherwise.
+  */
+void PS_StartBenchmark(const char *demoname, const char *outpath)
+{
+	INT32 r, i;
+
+	numbenchcolumns = 0;
+	for (r = 0; benchmark_rows[r]; r++)
+		for (i = 0; benchmark_rows[r][i].metric; i++)
+			numbenchcolumns++;
+
+	strlcpy(benchmark_demo, demoname, sizeof benchmark_demo);
+	strlcpy(benchmark_path, outpath, sizeof benchmark_path);
+	benchmark_tics = benchmark_size = 0;
+	benchmark_start = I_GetPreciseTime();
+	ps_benchmarking = true;
+}
+
+/** Records the stats of the tic that was just run.
+  */
+void PS_BenchmarkTic(void)
+{
+	INT64 *sample;
+	INT32 r, i;
+
+	if (!ps_benchmarking || gamestate != GS_LEVEL)
+		return;
+
+	if (benchmark_tics == benchmark_size)
+	{
+		benchmark_size = benchmark_size ? benchmark_size * 2 : 4096;
+		benchmark_samples = Z_Realloc(benchmark_samples, sizeof (*benchmark_samples) * numbenchcolumns * benchmark_size, PU_STATIC, NULL);
+	}
+
+	// Usually only worked out for the perfstats page
+	ps_otherlogictime.value.p =
+		ps_tictime.value.p -
+		ps_playerthink_time.value.p -
+		ps_thinkertime.value.p -
+		ps_lua_thinkframe_time.value.p;
+
+	sample = &benchmark_samples[numbenchcolumns * benchmark_tics++];
+	for (r = 0; benchmark_rows[r]; r++)
+		for (i = 0; benchmark_rows[r][i].metric; i++)
+		{
+			const perfstatrow_t *row = &benchmark_rows[r][i];
+			*sample++ = (row->flags & PS_TIME) ? (INT64)row->metric->value.p : row->metric->value.i;
+		}
+}
+
+static int PS_CompareSamples(const void *a, const void *b)
+{
+	const INT64 x = *(const INT64 *)a, y = *(const INT64 *)b;
+	return (x > y) - (x < y);
+}
+
+// Label without the padding used to line it up on screen
+static const char *PS_BenchmarkName(const perfstatrow_t *row)
+{
+	static char name[16];
+	const char *label = row->lores_label;
+	size_t len;
+
+	while (*label == ' ')
+		label++;
+	strlcpy(name, label, sizeof name);
+	for (len = strlen(name); len && name[len - 1] == ' '; len--)
+		name[len - 1] = '\0';
+	return name;
+}
+
+// Writes a string as a JSON string
+static void PS_WriteJSONString(FILE *f, const char *str)
+{
+	fputc('"', f);
+	for (; *str; str++)
+	{
+		if (*str == '"' || *str == '\\')
+			fputc('\\', f);
+		if ((UINT8)*str >= ' ')
+			fputc(*str, f);
+	}
+	fputc('"', f);
+}
+
+/** Stops recording and writes the report: the distribution of every
+  * metric over all tics. Times are in microseconds.
+  */
+void PS_FinishBenchmark(void)
+{
+	const precise_t precision = I_GetPrecisePrecision();
+	const double seconds = (double)(I_GetPreciseTime() - benchmark_start) / precision;
+	const size_t len = strlen(benchmark_path);
+	const boolean json = len >= 5 && !stricmp(benchmark_path + len - 5, ".json");
+	INT64 *sorted;
+	FILE *f;
+	size_t column = 0, t;
+	INT32 r, i;
+	boolean first = true, headerrow;
+
+	if (!ps_benchmarking)
+		return;
+	ps_benchmarking = false;
+
+	headerrow = !FIL_FileExists(benchmark_path);
+	f = fopen(benchmark_path, json ? "w" : "a+");
+	if (!f)
+	{
+		CONS_Alert(CONS_ERROR, M_GetText("Couldn't write benchmark results to '%s'\n"), benchmark_path);
+		Z_Free(benchmark_samples);
+		benchmark_samples = NULL;
+		return;
+	}
+
+	if (json)
+	{
+		fputs("{\n\t\"demo\": ", f);
+		PS_WriteJSONString(f, benchmark_demo);
+		fprintf(f, ",\n\t\"version\": \"%s\",\n\t\"addons\": [", VERSIONSTRING);
+		for (t = mainwads; t < numwadfiles; t++)
+		{
+			if (t > mainwads)
+				fputs(", ", f);
+			PS_WriteJSONString(f, wadfiles[t]->filename);
+		}
+		fprintf(f, "],\n\t\"tics\": %s,\n\t\"seconds\": %f,\n\t\"metrics\": {", sizeu1(benchmark_tics), seconds);
+	}
+	else if (headerrow)
+		fputs("demo,version,metric,unit,tics,min,mean,p50,p90,p99,max\n", f);
+
+	sorted = Z_Malloc(sizeof (*sorted) * max(benchmark_tics, 1), PU_STATIC, NULL);
+
+	for (r = 0; benchmark_rows[r]; r++)
+		for (i = 0; benchmark_rows[r][i].metric; i++, column++)
+		{
+			const perfstatrow_t *row = &benchmark_rows[r][i];
+			const boolean istime = (row->flags & PS_TIME);
+			const double scale = istime ? 1000000.0 / precision : 1.0;
+			double total = 0.0, stats[6] = {0};
+
+			if (benchmark_tics)
+			{
+				for (t = 0; t < benchmark_tics; t++)
+				{
+					sorted[t] = benchmark_samples[numbenchcolumns * t + column];
+					total += sorted[t];
+				}
+				qsort(sorted, benchmark_tics, sizeof (*sorted), PS_CompareSamples);
+
+				stats[0] = sorted[0] * scale;
+				stats[1] = total / benchmark_tics * scale;
+				stats[2] = sorted[(benchmark_tics - 1) * 50 / 100] * scale;
+				stats[3] = sorted[(benchmark_tics - 1) * 90 / 100] * scale;
+				stats[4] = sorted[(benchmark_tics - 1) * 99 / 100] * scale;
+				stats[5] = sorted[benchmark_tics - 1] * scale;
+			}
+
+			if (json)
+			{
+				fprintf(f, "%s\n\t\t\"%s\": {\"unit\": \"%s\", \"min\": %.2f, \"mean\": %.2f, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f}",
+					first ? "" : ",", PS_BenchmarkName(row), istime ? "us" : "calls",
+					stats[0], stats[1], stats[2], stats[3], stats[4], stats[5]);
+				first = false;
+			}
+			else
+				fprintf(f, "\"%s\",\"%s\",%s,%s,%s,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+					benchmark_demo, VERSIONSTRING, PS_BenchmarkName(row), istime ? "us" : "calls", sizeu1(benchmark_tics),
+					stats[0], stats[1], stats[2], stats[3], stats[4], stats[5]);
+		}
+
+	if (json)
+		fputs("\n\t}\n}\n", f);
+	fclose(f);
+
+	CONS_Printf(M_GetText("Benchmarked %s tics in %f seconds, results saved to '%s'\n"), sizeu1(benchmark_tics), seconds, benchmark_path);
+
+	Z_Free(sorted);
+	Z_Free(benchmark_samples);
+	benchmark_samples = NULL;
+}
+
 static void PS_DrawDescriptorHeader(void)
 {
 	if (cv_ps_samplesize.value > 1)
@@ -610,7 +951,7 @@ static void PS_DrawDescriptorHeader(void)
 		int samples_left = max(ps_frame_samples_left, ps_tick_samples_left);
 		int x, y;
 
-		if (cv_perfstats.value == 3)
+		if (cv_perfstats.value >= 3)
 		{
 			x = 2;
 			y = 0;
@@ -780,6 +1121,118 @@ if (y > 192) \
 	}
 }
 
+static const char *PS_MobjTypeName(mobjtype_t type)
+{
+	if (type < MT_FIRSTFREESLOT)
+		return MOBJTYPE_LIST[type] + 3; // skip "MT_"
+	if (FREE_MOBJS[type - MT_FIRSTFREESLOT])
+		return FREE_MOBJS[type - MT_FIRSTFREESLOT];
+	return va("freeslot %d", type - MT_FIRSTFREESLOT);
+}
+
+static int PS_CompareMobjTypeTimes(const void *a, const void *b)
+{
+	const INT32 *ta = a, *tb = b;
+	if (ta[1] != tb[1])
+		return (ta[1] < tb[1]) ? 1 : -1;
+	return ta[0] - tb[0];
+}
+
+static void PS_DrawMobjTypeStats(void)
+{
+	static INT32 sorted[NUMMOBJTYPES][2]; // type, screen value
+	int numsorted = 0;
+	char s[100];
+	int i;
+	int x = 2;
+	int y = 4;
+
+	PS_DrawDescriptorHeader();
+
+	for (i = 0; i < NUMMOBJTYPES; i++)
+	{
+		if (!ps_mobjtype_counts[i] && !ps_mobjtype_times[i].history)
+			continue;
+		sorted[numsorted][0] = i;
+		sorted[numsorted][1] = PS_GetMetricScreenValue(&ps_mobjtype_times[i], true);
+		numsorted++;
+	}
+
+	qsort(sorted, numsorted, sizeof sorted[0], PS_CompareMobjTypeTimes);
+
+	for (i = 0; i < numsorted; i++)
+	{
+		const mobjtype_t type = sorted[i][0];
+		const char *name = PS_MobjTypeName(type);
+		int len = (int)strlen(name);
+
+		if (len > 20)
+			name += len - 20;
+		snprintf(s, sizeof s - 1, "%20s: %5d %5d", name, sorted[i][1], ps_mobjtype_counts[type]);
+		V_DrawSmallString(x, y, V_MONOSPACE | V_ALLOWLOWERCASE | V_YELLOWMAP, s);
+
+		y += 4;
+		if (y > 192)
+		{
+			y = 4;
+			x += 106;
+			if (x > 214)
+				break;
+		}
+	}
+}
+
+static void PS_DrawHookStats(void)
+{
+	const precise_t precision = I_GetPrecisePrecision() / 1000000;
+	const tic_t tics = max(ps_hookstats_tics, 1);
+	INT32 *sorted;
+	char s[100];
+	int i;
+	int x = 2;
+	int y = 4;
+
+	V_DrawSmallString(x, 0, V_MONOSPACE | V_ALLOWLOWERCASE | V_GREENMAP,
+		va("Lua hooks over %u tics: time per tic (us), total calls", ps_hookstats_tics));
+
+	sorted = PS_SortHookStats();
+
+	for (i = 0; i < ps_numhookstats; i++)
+	{
+		const ps_hookstat_t *stat = &ps_hookstats[sorted[i]];
+		const char *src = stat->short_src;
+		const char *name;
+		int len;
+
+		if (!stat->calls)
+			break;
+
+		// cut off the mod file and folders
+		for (name = src; *src; src++)
+			if (*src == '|' || *src == '/' || *src == '\\')
+				name = src + 1;
+		name = va("%s:%d", name, stat->line);
+		len = (int)strlen(name);
+		if (len > 20)
+			name += len - 20;
+
+		snprintf(s, sizeof s - 1, "%20s:%5d %6u", name,
+			(INT32)(stat->time_taken / precision / tics), stat->calls);
+		V_DrawSmallString(x, y, V_MONOSPACE | V_ALLOWLOWERCASE | V_YELLOWMAP, s);
+
+		y += 4;
+		if (y > 192)
+		{
+			y = 4;
+			x += 106;
+			if (x > 214)
+				break;
+		}
+	}
+
+	Z_Free(sorted);
+}
+
 void M_DrawPerfStats(void)
 {
 	if (cv_perfstats.value == 1) // rendering
@@ -810,6 +1263,32 @@ void M_DrawPerfStats(void)
 			PS_DrawThinkFrameStats();
 		}
 	}
+	else if (cv_perfstats.value == 4) // mobj thinkers by type
+	{
+		if (!PS_IsLevelActive())
+			return;
+		if (!PS_HighResolution())
+		{
+			V_DrawThinString(80, 92, V_MONOSPACE | V_ALLOWLOWERCASE | V_YELLOWMAP, "Perfstats 4 is not available");
+			V_DrawThinString(80, 100, V_MONOSPACE | V_ALLOWLOWERCASE | V_YELLOWMAP, "for resolutions below 640x400.");
+		}
+		else
+		{
+			PS_DrawMobjTypeStats();
+		}
+	}
+	else if (cv_perfstats.value == 5) // lua hooks
+	{
+		if (!PS_HighResolution())
+		{
+			V_DrawThinString(80, 92, V_MONOSPACE | V_ALLOWLOWERCASE | V_YELLOWMAP, "Perfstats 5 is not available");
+			V_DrawThinString(80, 100, V_MONOSPACE | V_ALLOWLOWERCASE | V_YELLOWMAP, "for resolutions below 640x400.");
+		}
+		else
+		{
+			PS_DrawHookStats();
+		}
+	}
 }
 
 // remove and unallocate history from all metrics
@@ -823,6 +1302,10 @@ static void PS_ClearHistory(void)
 	{
 		thinkframe_hooks[i].time_taken.history = NULL;
 	}
+	for (i = 0; i < NUMMOBJTYPES; i++)
+	{
+		ps_mobjtype_times[i].history = NULL;
+	}
 
 	ps_frame_index = ps_tick_index = 0;
 	// PS_UpdateMetricHistory will set these correctly when it runs
@@ -831,6 +1314,8 @@ static void PS_ClearHistory(void)
 
 void PS_PerfStats_OnChange(void)
 {
+	if (cv_perfstats.value == 5)
+		PS_ResetHookStats();
 	if (cv_perfstats.value && cv_ps_samplesize.value > 1)
 		PS_ClearHistory();
 }
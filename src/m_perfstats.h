@@ -31,6 +31,16 @@ typedef struct
 	char short_src[LUA_IDSIZE];
 } ps_hookinfo_t;
 
+// Calls and cumulative time of every hook function defined at one place
+typedef struct
+{
+	char short_src[LUA_IDSIZE];
+	INT32 line; // line the function was defined at
+	const char *hook_name; // hook type it was first added for
+	UINT32 calls;
+	precise_t time_taken;
+} ps_hookstat_t;
+
 #define PS_START_TIMING(metric) metric.value.p = I_GetPreciseTime()
 #define PS_STOP_TIMING(metric) metric.value.p = I_GetPreciseTime() - metric.value.p
 
@@ -42,16 +52,32 @@ extern ps_metric_t ps_thinkertime;
 extern ps_metric_t ps_thlist_times[];
 
 extern ps_metric_t ps_checkposition_calls;
+extern ps_metric_t ps_sightcache_hits;
+extern ps_metric_t ps_sightcache_misses;
 
 extern ps_metric_t ps_lua_thinkframe_time;
 extern ps_metric_t ps_lua_mobjhooks;
 
 extern ps_metric_t ps_otherlogictime;
 
+extern ps_metric_t ps_mobjtype_times[NUMMOBJTYPES];
+extern INT32 ps_mobjtype_counts[NUMMOBJTYPES];
+
 void PS_SetThinkFrameHookInfo(int index, precise_t time_taken, char* short_src);
 
+extern ps_hookstat_t *ps_hookstats;
+INT32 PS_AddHookStat(const char *hook_name, const char *short_src, INT32 line);
+void PS_DumpHookStats(const char *path);
+
+void PS_ResetMobjTypeStats(void);
+
 void PS_UpdateTickStats(void);
 
+extern boolean ps_benchmarking;
+void PS_StartBenchmark(const char *demoname, const char *outpath);
+void PS_BenchmarkTic(void);
+void PS_FinishBenchmark(void);
+
 void M_DrawPerfStats(void);
 
 void PS_PerfStats_OnChange(void);
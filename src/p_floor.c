@@ -1828,6 +1828,8 @@ void EV_CrumbleChain(sector_t *sec, ffloor_t *rover)
 	sector_t *controlsec = rover->master->frontsector;
 	mtag_t tag = Tag_FGet(&controlsec->tags);
 
+	P_InvalidateSightCache();
+
 	if (sec == NULL)
 	{
 		if (controlsec->numattached)
@@ -2075,7 +2077,10 @@ void EV_MarioBlock(ffloor_t *rover, sector_t *sector, mobj_t *puncher)
 		return;
 
 	if (!(rover->fofflags & FOF_SOLID))
+	{
 		rover->fofflags |= (FOF_SOLID|FOF_RENDERALL|FOF_CUTLEVEL);
+		P_InvalidateSightCache();
+	}
 
 	// Find an item to pop out!
 	thing = SearchMarioNode(roversec->touching_thinglist);
@@ -2290,7 +2290,7 @@ boolean P_CheckPosition(mobj_t *thing, fixed_t x, fixed_t y)
 		for (bx = xl; bx <= xh; bx++)
 			for (by = yl; by <= yh; by++)
 			{
-				if (!P_BlockThingsIterator(bx, by, PIT_CheckThing))
+				if (!P_BlockThingsIteratorNear(bx, by, PIT_CheckThing))
 					blockval = false;
 				else
 					tmhitthing = tmfloorthing;
@@ -4487,6 +4487,9 @@ boolean P_CheckSector(sector_t *sector, boolean crunch)
 	//
 	// killough 4/7/98: simplified to avoid using complicated counter
 
+	// The sector's heights have changed, so any sight check could have too
+	P_InvalidateSightCache();
+
 	// First, let's see if anything will keep it from crushing.
 	if (!P_CheckSectorHelper(sector, false, crunch))
 		return true;
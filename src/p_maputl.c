@@ -685,6 +685,157 @@ void P_LineOpening(line_t *linedef, mobj_t *mobj)
 // THING POSITION SETTING
 //
 
+//
+// THING INDEX
+//
+// Every blockmap block also keeps its things in a contiguous array, along
+// with the position and radius each had when it was last linked. Collision
+// checks can then throw away things that are too far away without
+// touching the mobjs themselves. Arrays are in the same order as the
+// blocklinks chains, newest last, so things are visited in the same order
+// as P_BlockThingsIterator would.
+//
+
+typedef struct
+{
+	mobj_t *mobj;
+	fixed_t x, y, radius;
+} thingindexentry_t;
+
+typedef struct
+{
+	thingindexentry_t *entries;
+	INT32 count, size;
+	boolean dirty; // Bounds need to be worked out again
+	fixed_t minx, miny, maxx, maxy; // Bounds of the cached positions
+	fixed_t maxradius;
+} thingindexcell_t;
+
+// Iterators running over a cell, kept up to date when things are unlinked
+typedef struct thingindexcursor_s
+{
+	thingindexcell_t *cell;
+	INT32 pos; // Next entry to visit
+	struct thingindexcursor_s *next;
+} thingindexcursor_t;
+
+static thingindexcell_t *thingindex;
+static thingindexcursor_t *thingindexcursors;
+
+//
+// P_InitThingIndex
+// Sets up an empty thing index, for a new blockmap.
+//
+void P_InitThingIndex(void)
+{
+	thingindex = Z_Calloc(sizeof (*thingindex) * bmapwidth * bmapheight, PU_LEVEL, NULL);
+	thingindexcursors = NULL;
+}
+
+static void P_ThingIndexCellBounds(thingindexcell_t *cell)
+{
+	INT32 i;
+
+	cell->minx = cell->miny = INT32_MAX;
+	cell->maxx = cell->maxy = INT32_MIN;
+	cell->maxradius = 0;
+
+	for (i = 0; i < cell->count; i++)
+	{
+		const thingindexentry_t *entry = &cell->entries[i];
+		cell->minx = min(cell->minx, entry->x);
+		cell->maxx = max(cell->maxx, entry->x);
+		cell->miny = min(cell->miny, entry->y);
+		cell->maxy = max(cell->maxy, entry->y);
+		cell->maxradius = max(cell->maxradius, entry->radius);
+	}
+
+	cell->dirty = false;
+}
+
+static void P_LinkThingIndex(mobj_t *thing, INT32 block)
+{
+	thingindexcell_t *cell = &thingindex[block];
+	thingindexentry_t *entry;
+
+	if (cell->count == cell->size)
+	{
+		cell->size = cell->size ? cell->size * 2 : 4;
+		cell->entries = Z_Realloc(cell->entries, sizeof (*cell->entries) * cell->size, PU_LEVEL, NULL);
+	}
+
+	entry = &cell->entries[cell->count++];
+	entry->mobj = thing;
+	entry->x = thing->x;
+	entry->y = thing->y;
+	entry->radius = thing->radius;
+
+	if (!cell->dirty)
+	{
+		if (cell->count == 1)
+			P_ThingIndexCellBounds(cell);
+		else
+		{
+			cell->minx = min(cell->minx, entry->x);
+			cell->maxx = max(cell->maxx, entry->x);
+			cell->miny = min(cell->miny, entry->y);
+			cell->maxy = max(cell->maxy, entry->y);
+			cell->maxradius = max(cell->maxradius, entry->radius);
+		}
+	}
+
+	thing->thingcell = block + 1;
+}
+
+static void P_UnlinkThingIndex(mobj_t *thing)
+{
+	thingindexcell_t *cell = &thingindex[thing->thingcell - 1];
+	thingindexcursor_t *cursor;
+	INT32 i;
+
+	thing->thingcell = 0;
+
+	for (i = cell->count - 1; i >= 0; i--)
+		if (cell->entries[i].mobj == thing)
+			break;
+	if (i < 0)
+		return;
+
+	memmove(&cell->entries[i], &cell->entries[i + 1], sizeof (*cell->entries) * (cell->count - i - 1));
+	cell->count--;
+	cell->dirty = true;
+
+	// Anything still to be visited moved down by one
+	for (cursor = thingindexcursors; cursor; cursor = cursor->next)
+		if (cursor->cell == cell && i <= cursor->pos)
+			cursor->pos--;
+}
+
+//
+// P_RefreshThingIndex
+// Updates the position and radius the thing index has cached for a thing.
+// Needed whenever those change without P_SetThingPosition.
+//
+void P_RefreshThingIndex(mobj_t *thing)
+{
+	thingindexcell_t *cell;
+	INT32 i;
+
+	if (!thing->thingcell)
+		return;
+
+	cell = &thingindex[thing->thingcell - 1];
+	for (i = cell->count - 1; i >= 0; i--)
+		if (cell->entries[i].mobj == thing)
+		{
+			cell->entries[i].x = thing->x;
+			cell->entries[i].y = thing->y;
+			cell->entries[i].radius = thing->radius;
+			cell->dirty = true;
+			return;
+		}
+}
+
 //
 // P_UnsetThingPosition
 // Unlinks a thing from block map and sectors.
@@ -744,6 +895,9 @@ void P_UnsetThingPosition(mobj_t *thing)
 		mobj_t *bnext, **bprev = thing->bprev;
 		if (bprev && (*bprev = bnext = thing->bnext) != NULL)  // unlink from block map
 			bnext->bprev = bprev;
+
+		if (thing->thingcell)
+			P_UnlinkThingIndex(thing);
 	}
 }
 
@@ -829,6 +983,8 @@ void P_SetThingPosition(mobj_t *thing)
 				bnext->bprev = &thing->bnext;
 			thing->bprev = link;
 			*link = thing;
+
+			P_LinkThingIndex(thing, blocky*bmapwidth + blockx);
 		}
 		else // thing is off the map
 			thing->bnext = NULL, thing->bprev = NULL;
@@ -1001,6 +1157,65 @@ boolean P_BlockThingsIterator(INT32 x, INT32 y, boolean (*func)(mobj_t *))
 	return true;
 }
 
+//
+// P_BlockThingsIteratorNear
+// Like P_BlockThingsIterator, but only calls func for the things
+// whose bounding boxes touch tmthing's at tmx, tmy. Anything further
+// away would be thrown away by PIT_CheckThing anyway.
+//
+boolean P_BlockThingsIteratorNear(INT32 x, INT32 y, boolean (*func)(mobj_t *))
+{
+	thingindexcell_t *cell;
+	thingindexcursor_t cursor;
+	mobj_t *bnext = NULL;
+	boolean ret = true;
+	INT64 reach;
+
+	if (x < 0 || y < 0 || x >= bmapwidth || y >= bmapheight)
+		return true;
+
+	cell = &thingindex[y*bmapwidth + x];
+	if (!cell->count)
+		return true;
+
+	// Skip the whole block if nothing in it can reach
+	if (cell->dirty)
+		P_ThingIndexCellBounds(cell);
+	reach = (INT64)tmthing->radius + cell->maxradius;
+	if ((INT64)tmx + reach <= cell->minx || (INT64)tmx - reach >= cell->maxx
+	|| (INT64)tmy + reach <= cell->miny || (INT64)tmy - reach >= cell->maxy)
+		return true;
+
+	cursor.cell = cell;
+	cursor.pos = cell->count - 1;
+	cursor.next = thingindexcursors;
+	thingindexcursors = &cursor;
+
+	while (cursor.pos >= 0)
+	{
+		const thingindexentry_t *entry = &cell->entries[cursor.pos--];
+		const fixed_t blockdist = entry->radius + tmthing->radius;
+		mobj_t *mobj = entry->mobj;
+
+		if (abs(entry->x - tmx) >= blockdist || abs(entry->y - tmy) >= blockdist)
+			continue;
+
+		P_SetTarget(&bnext, cursor.pos >= 0 ? cell->entries[cursor.pos].mobj : NULL); // Same as in P_BlockThingsIterator
+		if (!func(mobj))
+		{
+			ret = false;
+			break;
+		}
+		if (P_MobjWasRemoved(tmthing) // func just popped our tmthing, cannot continue.
+		|| (bnext && P_MobjWasRemoved(bnext))) // func just broke blockmap chain, cannot continue.
+			break;
+	}
+
+	P_SetTarget(&bnext, NULL);
+	thingindexcursors = cursor.next;
+	return ret;
+}
+
 //
 // INTERCEPT ROUTINES
 //
@@ -62,6 +62,10 @@ void P_LineOpening(line_t *plinedef, mobj_t *mobj);
 
 boolean P_BlockLinesIterator(INT32 x, INT32 y, boolean(*func)(line_t *));
 boolean P_BlockThingsIterator(INT32 x, INT32 y, boolean(*func)(mobj_t *));
+boolean P_BlockThingsIteratorNear(INT32 x, INT32 y, boolean(*func)(mobj_t *));
+
+void P_InitThingIndex(void);
+void P_RefreshThingIndex(mobj_t *thing);
 
 #define PT_ADDLINES     1
 #define PT_ADDTHINGS    2
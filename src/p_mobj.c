@@ -4746,6 +4746,7 @@ static void P_Boss4DestroyCage(mobj_t *mobj)
 						rover->fofflags &= ~FOF_EXISTS;
 						sector->moved = true;
 						rsec->moved = true;
+						P_InvalidateSightCache();
 					}
 				}
 		}
@@ -6400,6 +6401,7 @@ void P_SetScale(mobj_t *mobj, fixed_t newscale)
 
 	mobj->radius = FixedMul(FixedDiv(mobj->radius, oldscale), newscale);
 	mobj->height = FixedMul(FixedDiv(mobj->height, oldscale), newscale);
+	P_RefreshThingIndex(mobj);
 
 	player = mobj->player;
 
@@ -11663,6 +11665,7 @@ void P_SpawnPlayer(INT32 playernum)
 	// Set bounds accurately.
 	mobj->radius = FixedMul(skins[p->skin].radius, mobj->scale);
 	mobj->height = P_GetPlayerHeight(p);
+	P_RefreshThingIndex(mobj);
 
 	if (!leveltime && !p->spectator && ((maptol & TOL_NIGHTS) == TOL_NIGHTS) != (G_IsSpecialStage(gamemap))) // non-special NiGHTS stage or special non-NiGHTS stage
 	{
@@ -12602,7 +12605,10 @@ static boolean P_SetupNiGHTSDrone(mapthing_t *mthing, mobj_t *mobj)
 		mobj->health = timelimit;
 
 	if (hitboxradius > 0)
+	{
 		mobj->radius = hitboxradius;
+		P_RefreshThingIndex(mobj);
+	}
 
 	if (hitboxheight > 0)
 		mobj->height = hitboxheight;
@@ -13100,6 +13106,7 @@ static boolean P_SetupSpawnedMapThing(mapthing_t *mthing, mobj_t *mobj, boolean
 			mobj->flags2 |= MF2_AMBUSH;
 
 		mobj->radius = abs(mthing->args[2]) << FRACBITS;
+		P_RefreshThingIndex(mobj);
 		// FALLTHRU
 	case MT_AXISTRANSFER:
 	case MT_AXISTRANSFERLINE:
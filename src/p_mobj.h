@@ -341,6 +341,7 @@ typedef struct mobj_s
 	// Links in blocks (if needed).
 	struct mobj_s *bnext;
 	struct mobj_s **bprev; // killough 8/11/98: change to ptr-to-ptr
+	INT32 thingcell; // Block in the thing index + 1, or 0 if not in it
 
 	// Additional pointers for NiGHTS hoops
 	struct mobj_s *hnext;
@@ -611,6 +611,9 @@ static void Polyobj_attachToSubsec(polyobj_t *po)
 	if (po->isBad)
 		return;
 
+	// it's somewhere else now, so it could block different sight lines
+	P_InvalidateSightCache();
+
 	numVertices = (fixed_t)(po->numVertices*FRACUNIT);
 
 	for (i = 0; i < po->numVertices; ++i)
@@ -39,6 +39,20 @@
 savedata_t savedata;
 UINT8 *save_p;
 
+// Streamed saving
+//
+// While P_SaveNetGameStreamed runs, everything written so far is handed to
+// the stream function between sections, and whenever the buffer gets within
+// SAVESTREAMSLACK bytes of full. The buffer is then reused from the start,
+// so it only ever holds one block instead of the whole gamestate.
+//
+// Anything that can write more than SAVESTREAMSLACK bytes in all must call
+// P_FlushSaveStream(false) at least that often, or write through
+// P_WriteSaveStreamMem.
+static savestream_f savestream;
+static UINT8 *savestreamstart;
+static size_t savestreamsize;
+
 // Block UINT32s to attempt to ensure that the correct data is
 // being sent and received
 #define ARCHIVEBLOCK_MISC     0x7FEEDEED
@@ -135,6 +149,8 @@ static void P_NetArchivePlayers(void)
 
 	for (i = 0; i < MAXPLAYERS; i++)
 	{
+		P_FlushSaveStream(false);
+
 		WRITESINT8(save_p, (SINT8)adminplayers[i]);
 
 		if (!playeringame[i])
@@ -674,6 +690,8 @@ static void P_NetArchiveColormaps(void)
 
 	for (exc = net_colormaps; i < num_net_colormaps; i++, exc = exc_next)
 	{
+		P_FlushSaveStream(false);
+
 		// We must save num_net_colormaps worth of data
 		// So fill non-existent entries with default.
 		if (!exc)
@@ -807,6 +825,7 @@ static void P_NetArchiveWaypoints(void)
 
 	for (i = 0; i < NUMWAYPOINTSEQUENCES; i++)
 	{
+		P_FlushSaveStream(false);
 		WRITEUINT16(save_p, numwaypoints[i]);
 		for (j = 0; j < numwaypoints[i]; j++)
 			WRITEUINT32(save_p, waypoints[i][j] ? waypoints[i][j]->mobjnum : 0);
@@ -1009,6 +1028,8 @@ static void ArchiveSectors(void)
 
 	for (i = 0; i < numsectors; i++, ss++, spawnss++)
 	{
+		P_FlushSaveStream(false);
+
 		diff = diff2 = diff3 = diff4 = 0;
 		if (ss->floorheight != spawnss->floorheight)
 			diff |= SD_FLOORHT;
@@ -1282,6 +1303,8 @@ static void ArchiveLines(void)
 
 	for (i = 0; i < numlines; i++, spawnli++, li++)
 	{
+		P_FlushSaveStream(false);
+
 		diff = diff2 = 0;
 
 		if (li->special != spawnli->special)
@@ -2503,6 +2526,8 @@ static void P_NetArchiveThinkers(void)
 		// save off the current thinkers
 		for (th = thlist[i].next; th != &thlist[i]; th = th->next)
 		{
+			P_FlushSaveStream(false);
+
 			if (!(th->function.acp1 == (actionf_p1)P_RemoveThinkerDelayed
 			 || th->function.acp1 == (actionf_p1)P_NullPrecipThinker))
 				numsaved++;
@@ -4023,7 +4048,10 @@ static inline void P_ArchivePolyObjects(void)
 	WRITEINT32(save_p, numPolyObjects);
 
 	for (i = 0; i < numPolyObjects; ++i)
+	{
+		P_FlushSaveStream(false);
 		P_ArchivePolyObj(&PolyObjects[i]);
+	}
 }
 
 static inline void P_UnArchivePolyObjects(void)
@@ -4790,6 +4818,70 @@ void P_SaveGame(INT16 mapnum)
 	P_ArchiveLuabanksAndConsistency();
 }
 
+/** Hands what was saved so far to the stream, if a block's worth has built up
+  *
+  * \param force Hand it over however little there is
+  *
+  */
+void P_FlushSaveStream(boolean force)
+{
+	size_t length;
+
+	if (!savestream)
+		return;
+
+	length = save_p - savestreamstart;
+	if (length > savestreamsize)
+		I_Error("Savegame buffer overrun");
+	if (!length || (!force && length + SAVESTREAMSLACK < savestreamsize))
+		return;
+
+	savestream(savestreamstart, length);
+	save_p = savestreamstart;
+}
+
+/** Writes a block of memory to the save, a piece at a time if streaming
+  *
+  * \param data The memory to write
+  * \param length How much of it to write
+  *
+  */
+void P_WriteSaveStreamMem(const void *data, size_t length)
+{
+	const UINT8 *p = data;
+
+	while (savestream && length > SAVESTREAMSLACK)
+	{
+		WRITEMEM(save_p, p, SAVESTREAMSLACK);
+		p += SAVESTREAMSLACK;
+		length -= SAVESTREAMSLACK;
+		P_FlushSaveStream(false);
+	}
+	WRITEMEM(save_p, p, length);
+}
+
+/** Saves the netgame a block at a time
+  *
+  * \param resending Passed on to P_SaveNetGame
+  * \param buffer Buffer to save each block into
+  * \param size Size of the buffer, at least SAVESTREAMBLOCK
+  * \param stream Called with each block once it has been saved
+  *
+  */
+void P_SaveNetGameStreamed(boolean resending, UINT8 *buffer, size_t size, savestream_f stream)
+{
+	savestream = stream;
+	savestreamstart = save_p = buffer;
+	savestreamsize = size;
+
+	P_SaveNetGame(resending);
+	P_FlushSaveStream(true);
+
+	savestream = NULL;
+	savestreamstart = NULL;
+	save_p = NULL;
+}
+
 void P_SaveNetGame(boolean resending)
 {
 	thinker_t *th;
@@ -4799,6 +4891,7 @@ void P_SaveNetGame(boolean resending)
 	CV_SaveNetVars(&save_p);
 	P_NetArchiveMisc(resending);
 	P_NetArchiveEmblems();
+	P_FlushSaveStream(true);
 
 	// Assign the mobjnumber for pointer tracking
 	for (th = thlist[THINK_MOBJ].next; th != &thlist[THINK_MOBJ]; th = th->next)
@@ -4813,16 +4906,21 @@ void P_SaveNetGame(boolean resending)
 	}
 
 	P_NetArchivePlayers();
+	P_FlushSaveStream(true);
 	if (gamestate == GS_LEVEL)
 	{
 		P_NetArchiveWorld();
 		P_ArchivePolyObjects();
+		P_FlushSaveStream(true);
 		P_NetArchiveThinkers();
+		P_FlushSaveStream(true);
 		P_NetArchiveSpecials();
 		P_NetArchiveColormaps();
 		P_NetArchiveWaypoints();
+		P_FlushSaveStream(true);
 	}
 	LUA_Archive();
+	P_FlushSaveStream(true);
 
 	P_ArchiveLuabanksAndConsistency();
 }
@@ -25,6 +25,14 @@
 
 void P_SaveGame(INT16 mapnum);
 void P_SaveNetGame(boolean resending);
+
+// Streamed saving: see P_SaveNetGameStreamed
+#define SAVESTREAMBLOCK (64*1024)
+#define SAVESTREAMSLACK (16*1024) // Most written between two P_FlushSaveStream calls
+typedef void (*savestream_f)(const UINT8 *data, size_t length);
+void P_SaveNetGameStreamed(boolean resending, UINT8 *buffer, size_t size, savestream_f stream);
+void P_FlushSaveStream(boolean force);
+void P_WriteSaveStreamMem(const void *data, size_t length);
 boolean P_LoadGame(INT16 mapoverride);
 boolean P_LoadNetGame(boolean reloading);
 
@@ -84,7 +84,7 @@
 
 #include "p_slopes.h"
 
-#include "fastcmp.h" // textmap parsing
+#include <float.h> // FLT_EVAL_METHOD, for textmap parsing
 
 #include "taglist.h"
 
@@ -1534,86 +1534,701 @@ static void P_LoadThings(UINT8 *data)
 	}
 }
 
-// Stores positions for relevant map data spread through a TEXTMAP.
-UINT32 mapthingsPos[UINT16_MAX];
-UINT32 linesPos[UINT16_MAX];
-UINT32 sidesPos[UINT16_MAX];
-UINT32 vertexesPos[UINT16_MAX];
-UINT32 sectorsPos[UINT16_MAX];
+// UDMF TEXTMAP parsing.
+// The lump is scanned once, storing each element's fields as a keyword
+// number and the position of its value in the lump. The element parsers
+// then read the values straight out of the lump.
 
-// Determine total amount of map data in TEXTMAP.
-static boolean TextmapCount(size_t size)
+typedef enum
+{
+	TMK_NONE = 0,
+
+	// Elements
+	TMK_THING,
+	TMK_LINEDEF,
+	TMK_SIDEDEF,
+	TMK_VERTEX,
+	TMK_SECTOR,
+
+	// Vertices
+	TMK_X,
+	TMK_Y,
+	TMK_ZFLOOR,
+	TMK_ZCEILING,
+
+	// Sectors
+	TMK_HEIGHTFLOOR,
+	TMK_HEIGHTCEILING,
+	TMK_TEXTUREFLOOR,
+	TMK_TEXTURECEILING,
+	TMK_LIGHTLEVEL,
+	TMK_LIGHTFLOOR,
+	TMK_LIGHTFLOORABSOLUTE,
+	TMK_LIGHTCEILING,
+	TMK_LIGHTCEILINGABSOLUTE,
+	TMK_ID,
+	TMK_MOREIDS,
+	TMK_XPANNINGFLOOR,
+	TMK_YPANNINGFLOOR,
+	TMK_XPANNINGCEILING,
+	TMK_YPANNINGCEILING,
+	TMK_ROTATIONFLOOR,
+	TMK_ROTATIONCEILING,
+	TMK_FLOORPLANE_A,
+	TMK_FLOORPLANE_B,
+	TMK_FLOORPLANE_C,
+	TMK_FLOORPLANE_D,
+	TMK_CEILINGPLANE_A,
+	TMK_CEILINGPLANE_B,
+	TMK_CEILINGPLANE_C,
+	TMK_CEILINGPLANE_D,
+	TMK_LIGHTCOLOR,
+	TMK_LIGHTALPHA,
+	TMK_FADECOLOR,
+	TMK_FADEALPHA,
+	TMK_FADESTART,
+	TMK_FADEEND,
+	TMK_COLORMAPFOG,
+	TMK_COLORMAPFADESPRITES,
+	TMK_COLORMAPPROTECTED,
+	TMK_FLIPSPECIAL_NOFLOOR,
+	TMK_FLIPSPECIAL_CEILING,
+	TMK_TRIGGERSPECIAL_TOUCH,
+	TMK_TRIGGERSPECIAL_HEADBUMP,
+	TMK_TRIGGERLINE_PLANE,
+	TMK_TRIGGERLINE_MOBJ,
+	TMK_INVERTPRECIP,
+	TMK_GRAVITYFLIP,
+	TMK_HEATWAVE,
+	TMK_NOCLIPCAMERA,
+	TMK_OUTERSPACE,
+	TMK_DOUBLESTEPUP,
+	TMK_NOSTEPDOWN,
+	TMK_SPEEDPAD,
+	TMK_STARPOSTACTIVATOR,
+	TMK_EXIT,
+	TMK_SPECIALSTAGEPIT,
+	TMK_RETURNFLAG,
+	TMK_REDTEAMBASE,
+	TMK_BLUETEAMBASE,
+	TMK_FAN,
+	TMK_SUPERTRANSFORM,
+	TMK_FORCESPIN,
+	TMK_ZOOMTUBESTART,
+	TMK_ZOOMTUBEEND,
+	TMK_FINISHLINE,
+	TMK_ROPEHANG,
+	TMK_JUMPFLIP,
+	TMK_GRAVITYOVERRIDE,
+	TMK_FRICTION,
+	TMK_GRAVITY,
+	TMK_DAMAGETYPE,
+	TMK_TRIGGERTAG,
+	TMK_TRIGGERER,
+
+	// Sidedefs
+	TMK_OFFSETX,
+	TMK_OFFSETY,
+	TMK_OFFSETX_TOP,
+	TMK_OFFSETX_MID,
+	TMK_OFFSETX_BOTTOM,
+	TMK_OFFSETY_TOP,
+	TMK_OFFSETY_MID,
+	TMK_OFFSETY_BOTTOM,
+	TMK_TEXTURETOP,
+	TMK_TEXTUREBOTTOM,
+	TMK_TEXTUREMIDDLE,
+	TMK_REPEATCNT,
+
+	// Linedefs
+	TMK_SPECIAL,
+	TMK_V1,
+	TMK_V2,
+	TMK_SIDEFRONT,
+	TMK_SIDEBACK,
+	TMK_ALPHA,
+	TMK_BLENDMODE,
+	TMK_RENDERSTYLE,
+	TMK_EXECUTORDELAY,
+	TMK_BLOCKING,
+	TMK_BLOCKMONSTERS,
+	TMK_TWOSIDED,
+	TMK_DONTPEGTOP,
+	TMK_DONTPEGBOTTOM,
+	TMK_SKEWTD,
+	TMK_NOCLIMB,
+	TMK_NOSKEW,
+	TMK_MIDPEG,
+	TMK_MIDSOLID,
+	TMK_WRAPMIDTEX,
+	TMK_NONET,
+	TMK_NETONLY,
+	TMK_BOUNCY,
+	TMK_TRANSFER,
+
+	// Things
+	TMK_HEIGHT,
+	TMK_ANGLE,
+	TMK_PITCH,
+	TMK_ROLL,
+	TMK_TYPE,
+	TMK_SCALE,
+	TMK_SCALEX,
+	TMK_SCALEY,
+	TMK_MOBJSCALE,
+	TMK_FLIP,
+	TMK_ABSOLUTEZ,
+
+	// Numbered keys, matched by prefix instead of by hash
+	TMK_ARG,
+	TMK_STRINGARG,
+
+	NUMTEXTMAPKEYS
+} textmapkey_t;
+
+static const char *const textmapkeynames[TMK_ARG] = {
+	NULL,
+
+	"thing", "linedef", "sidedef", "vertex", "sector",
+
+	"x", "y", "zfloor", "zceiling",
+
+	"heightfloor", "heightceiling", "texturefloor", "textureceiling",
+	"lightlevel", "lightfloor", "lightfloorabsolute", "lightceiling",
+	"lightceilingabsolute", "id", "moreids", "xpanningfloor",
+	"ypanningfloor", "xpanningceiling", "ypanningceiling", "rotationfloor",
+	"rotationceiling", "floorplane_a", "floorplane_b", "floorplane_c",
+	"floorplane_d", "ceilingplane_a", "ceilingplane_b", "ceilingplane_c",
+	"ceilingplane_d", "lightcolor", "lightalpha", "fadecolor",
+	"fadealpha", "fadestart", "fadeend", "colormapfog",
+	"colormapfadesprites", "colormapprotected", "flipspecial_nofloor", "flipspecial_ceiling",
+	"triggerspecial_touch", "triggerspecial_headbump", "triggerline_plane", "triggerline_mobj",
+	"invertprecip", "gravityflip", "heatwave", "noclipcamera",
+	"outerspace", "doublestepup", "nostepdown", "speedpad",
+	"starpostactivator", "exit", "specialstagepit", "returnflag",
+	"redteambase", "blueteambase", "fan", "supertransform",
+	"forcespin", "zoomtubestart", "zoomtubeend", "finishline",
+	"ropehang", "jumpflip", "gravityoverride", "friction",
+	"gravity", "damagetype", "triggertag", "triggerer",
+
+	"offsetx", "offsety", "offsetx_top", "offsetx_mid",
+	"offsetx_bottom", "offsety_top", "offsety_mid", "offsety_bottom",
+	"texturetop", "texturebottom", "texturemiddle", "repeatcnt",
+
+	"special", "v1", "v2", "sidefront",
+	"sideback", "alpha", "blendmode", "renderstyle",
+	"executordelay", "blocking", "blockmonsters", "twosided",
+	"dontpegtop", "dontpegbottom", "skewtd", "noclimb",
+	"noskew", "midpeg", "midsolid", "wrapmidtex",
+	"nonet", "netonly", "bouncy", "transfer",
+
+	"height", "angle", "pitch", "roll",
+	"type", "scale", "scalex", "scaley",
+	"mobjscale", "flip", "absolutez",
+};
+
+// Keywords are hashed into this table with a seed that gives each of
+// them a slot to itself, so a lookup is one hash and one compare.
+#define TEXTMAPKEYSLOTS 4096
+static UINT8 textmapkeyslots[TEXTMAPKEYSLOTS];
+static UINT32 textmapkeyseed = 0;
+
+typedef struct
+{
+	UINT8 key;
+	UINT16 argnum; // For TMK_ARG and TMK_STRINGARG
+	UINT32 pos, len; // Value, within the textmap
+} textmapfield_t;
+
+typedef struct
+{
+	UINT32 field, numfields;
+} textmapblock_t;
+
+#define NUMTEXTMAPBLOCKS (TMK_SECTOR - TMK_THING + 1)
+
+static const char *textmapdata;
+static UINT32 textmapsize, textmappos;
+
+static textmapfield_t *textmapfields;
+static size_t numtextmapfields, maxtextmapfields;
+static textmapblock_t *textmapblocks[NUMTEXTMAPBLOCKS];
+static size_t numtextmapblocks[NUMTEXTMAPBLOCKS], maxtextmapblocks[NUMTEXTMAPBLOCKS];
+
+static UINT32 TextmapHashKey(const char *key, size_t len, UINT32 seed)
+{
+	UINT32 hash = 2166136261u ^ seed;
+	while (len--)
+	{
+		hash ^= (UINT8)*key++;
+		hash *= 16777619u;
+	}
+	return (hash ^ (hash >> 16)) & (TEXTMAPKEYSLOTS - 1);
+}
+
+/** Picks a hash seed under which no two TEXTMAP keywords collide.
+  */
+static void TextmapInitKeys(void)
+{
+	UINT32 seed;
+	size_t key;
+
+	for (seed = 1; seed < UINT16_MAX; seed++)
+	{
+		memset(textmapkeyslots, TMK_NONE, sizeof (textmapkeyslots));
+		for (key = TMK_NONE + 1; key < TMK_ARG; key++)
+		{
+			UINT32 slot = TextmapHashKey(textmapkeynames[key], strlen(textmapkeynames[key]), seed);
+			if (textmapkeyslots[slot] != TMK_NONE)
+				break;
+			textmapkeyslots[slot] = (UINT8)key;
+		}
+
+		if (key == TMK_ARG)
+		{
+			textmapkeyseed = seed;
+			return;
+		}
+	}
+
+	I_Error("TextmapInitKeys: Couldn't find a perfect hash for the TEXTMAP keywords");
+}
+
+/** Reads a number the way atol does, but without needing the string to be terminated.
+  */
+static INT32 TextmapParseInt(const char *s, const char *end)
 {
-	const char *tkn = M_TokenizerRead(0);
-	UINT8 brackets = 0;
+	UINT32 val = 0;
+	boolean negative = false;
 
-	nummapthings = 0;
-	numlines = 0;
-	numsides = 0;
-	numvertexes = 0;
-	numsectors = 0;
+	while (s < end && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n' || *s == '\v' || *s == '\f'))
+		s++;
+	if (s < end && (*s == '-' || *s == '+'))
+		negative = (*s++ == '-');
+	while (s < end && *s >= '0' && *s <= '9')
+		val = val*10 + (*s++ - '0');
+
+	return (INT32)(negative ? 0u - val : val);
+}
+
+/** Reads a number the way atof does.
+  * Plain decimals that fit a double exactly are converted here, and give
+  * the same correctly rounded result; anything else goes to atof.
+  */
+static double TextmapParseFloat(const char *s, const char *end)
+{
+	static const double powersof10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	char buf[64];
+	size_t len;
+#if defined (FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+	const char *p = s;
+	UINT64 mantissa = 0;
+	INT32 digits = 0, fraction = -1;
+	boolean negative = false;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+	for (; p < end; p++)
+	{
+		if (*p >= '0' && *p <= '9')
+		{
+			mantissa = mantissa*10 + (*p - '0');
+			digits++;
+			if (fraction >= 0)
+				fraction++;
+		}
+		else if (*p == '.' && fraction < 0)
+			fraction = 0;
+		else
+			break;
+	}
+
+	// Both the mantissa and the power of ten are exact doubles here,
+	// so a single division rounds the same way atof does
+	if (p == end && digits && digits <= 15)
+	{
+		double val = (double)mantissa;
+		if (fraction > 0)
+			val /= powersof10[fraction];
+		return negative ? -val : val;
+	}
+#else
+	(void)powersof10;
+#endif
+
+	len = min((size_t)(end - s), sizeof (buf) - 1);
+	M_Memcpy(buf, s, len);
+	buf[len] = '\0';
+	return atof(buf);
+}
+
+#define TextmapInt(field) TextmapParseInt(textmapdata + (field)->pos, textmapdata + (field)->pos + (field)->len)
+#define TextmapFixed(field) FLOAT_TO_FIXED(TextmapParseFloat(textmapdata + (field)->pos, textmapdata + (field)->pos + (field)->len))
+
+static boolean TextmapValueIs(const textmapfield_t *field, const char *val)
+{
+	return !strncmp(textmapdata + field->pos, val, field->len) && !val[field->len];
+}
+
+static boolean TextmapTrue(const textmapfield_t *field)
+{
+	return TextmapValueIs(field, "true");
+}
+
+/** Copies a field's value into a string, for the functions that need one.
+  */
+static const char *TextmapString(const textmapfield_t *field, char *buf, size_t size)
+{
+	size_t len = min((size_t)field->len, size - 1);
+	M_Memcpy(buf, textmapdata + field->pos, len);
+	buf[len] = '\0';
+	return buf;
+}
+
+static char *TextmapStringArg(const textmapfield_t *field)
+{
+	char *arg = Z_Malloc(field->len + 1, PU_LEVEL, NULL);
+	M_Memcpy(arg, textmapdata + field->pos, field->len);
+	arg[field->len] = '\0';
+	return arg;
+}
+
+static void TextmapAddMoreIDs(taglist_t *tags, const textmapfield_t *field)
+{
+	const char *id = textmapdata + field->pos;
+	const char *end = id + field->len;
+
+	while (true)
+	{
+		Tag_Add(tags, TextmapParseInt(id, end));
+		while (id < end && *id != ' ')
+			id++;
+		if (id == end)
+			break;
+		id++;
+	}
+}
+
+static UINT8 TextmapLookupKey(const char *key, UINT32 len, UINT16 *argnum)
+{
+	UINT8 num = textmapkeyslots[TextmapHashKey(key, len, textmapkeyseed)];
+	INT32 arg;
+
+	if (num != TMK_NONE && !strncmp(textmapkeynames[num], key, len) && !textmapkeynames[num][len])
+		return num;
+
+	if (len > 9 && !strncmp(key, "stringarg", 9))
+	{
+		num = TMK_STRINGARG;
+		arg = TextmapParseInt(key + 9, key + len);
+	}
+	else if (len > 3 && !strncmp(key, "arg", 3))
+	{
+		num = TMK_ARG;
+		arg = TextmapParseInt(key + 3, key + len);
+	}
+	else
+		return TMK_NONE;
+
+	*argnum = (arg < 0 || arg > UINT16_MAX) ? UINT16_MAX : (UINT16)arg;
+	return num;
+}
+
+typedef struct
+{
+	UINT32 pos, len;
+	boolean quoted;
+} textmaptoken_t;
+
+// Character classes for TextmapReadToken
+#define TMC_SPACE 1 // Whitespace, and the UDMF separators
+#define TMC_BREAK 2 // Ends a bare token
+#define TMC_SLASH 4 // Might start a comment
+static UINT8 textmapchars[256];
+
+static void TextmapInitChars(void)
+{
+	const char *c;
+
+	for (c = " \t\r\n=;"; *c; c++)
+		textmapchars[(UINT8)*c] = TMC_SPACE|TMC_BREAK;
+	textmapchars[0] = TMC_SPACE|TMC_BREAK;
+	for (c = "{},"; *c; c++)
+		textmapchars[(UINT8)*c] = TMC_BREAK;
+	textmapchars['/'] = TMC_SLASH;
+}
+
+#define TextmapIsComment(s, end) ((s) + 1 < (end) && ((s)[1] == '/' || (s)[1] == '*'))
+
+/** Reads the next token of the textmap, splitting them the same way M_TokenizerRead does.
+  */
+static boolean TextmapReadToken(textmaptoken_t *tkn)
+{
+	const char *s = textmapdata + textmappos;
+	const char *end = textmapdata + textmapsize;
+	const char *start;
+
+	// Skip whitespace, separators and comments
+	while (s < end)
+	{
+		if (textmapchars[(UINT8)*s] & TMC_SPACE)
+			s++;
+		else if (*s == '/' && TextmapIsComment(s, end))
+		{
+			if (s[1] == '/')
+			{
+				while (s < end && *s != '\n')
+					s++;
+			}
+			else
+			{
+				for (s += 2; s + 1 < end && !(s[0] == '*' && s[1] == '/'); s++) ;
+				s = min(s + 2, end);
+			}
+		}
+		else
+			break;
+	}
+
+	if (s >= end)
+	{
+		textmappos = textmapsize;
+		return false;
+	}
+
+	tkn->quoted = false;
+	if (textmapchars[(UINT8)*s] & TMC_BREAK)
+	{
+		tkn->pos = (UINT32)(s - textmapdata);
+		tkn->len = 1;
+		textmappos = tkn->pos + 1;
+		return true;
+	}
+
+	// Quoted strings are returned without their quotes
+	if (*s == '"')
+	{
+		start = ++s;
+		while (s < end && *s != '"')
+			s++;
+		tkn->quoted = true;
+		tkn->pos = (UINT32)(start - textmapdata);
+		tkn->len = (UINT32)(s - start);
+		textmappos = (UINT32)(min(s + 1, end) - textmapdata);
+		return true;
+	}
+
+	start = s++;
+	for (; s < end; s++)
+	{
+		UINT8 charclass = textmapchars[(UINT8)*s];
+		if (!charclass)
+			continue;
+		if ((charclass & TMC_BREAK) || TextmapIsComment(s, end))
+			break;
+	}
+	tkn->pos = (UINT32)(start - textmapdata);
+	tkn->len = (UINT32)(s - start);
+	textmappos = (UINT32)(s - textmapdata);
+	return true;
+}
+
+#undef TextmapIsComment
+
+// Quoted strings compare the same as bare ones, as with M_TokenizerRead.
+static boolean TextmapTokenIs(const textmaptoken_t *tkn, const char *str)
+{
+	return !strncmp(textmapdata + tkn->pos, str, tkn->len) && !str[tkn->len];
+}
+
+#define TextmapIsBrace(tkn, c) (!(tkn)->quoted && textmapdata[(tkn)->pos] == (c))
+
+static void TextmapAddField(UINT8 key, UINT16 argnum, const textmaptoken_t *val)
+{
+	textmapfield_t *field;
+
+	if (numtextmapfields == maxtextmapfields)
+	{
+		maxtextmapfields = maxtextmapfields ? maxtextmapfields*2 : 4096;
+		textmapfields = Z_Realloc(textmapfields, maxtextmapfields * sizeof (*textmapfields), PU_STATIC, NULL);
+	}
+
+	field = &textmapfields[numtextmapfields++];
+	field->key = key;
+	field->argnum = argnum;
+	field->pos = val->pos;
+	field->len = val->len;
+}
+
+static textmapblock_t *TextmapAddBlock(UINT8 key)
+{
+	size_t type = key - TMK_THING;
+	textmapblock_t *block;
+
+	if (numtextmapblocks[type] == maxtextmapblocks[type])
+	{
+		maxtextmapblocks[type] = maxtextmapblocks[type] ? maxtextmapblocks[type]*2 : 1024;
+		textmapblocks[type] = Z_Realloc(textmapblocks[type], maxtextmapblocks[type] * sizeof (*textmapblocks[type]), PU_STATIC, NULL);
+	}
+
+	block = &textmapblocks[type][numtextmapblocks[type]++];
+	block->field = (UINT32)numtextmapfields;
+	block->numfields = 0;
+	return block;
+}
+
+static void TextmapFreeFields(void)
+{
+	size_t i;
+
+	Z_Free(textmapfields);
+	textmapfields = NULL;
+	numtextmapfields = maxtextmapfields = 0;
+
+	for (i = 0; i < NUMTEXTMAPBLOCKS; i++)
+	{
+		Z_Free(textmapblocks[i]);
+		textmapblocks[i] = NULL;
+		numtextmapblocks[i] = maxtextmapblocks[i] = 0;
+	}
+}
+
+/** Reads a {}-encapsulated element, storing its fields for the parsers below.
+  */
+static boolean TextmapScanBlock(UINT8 key)
+{
+	textmapblock_t *block = TextmapAddBlock(key);
+	textmaptoken_t param, val;
+	UINT32 pos = textmappos;
+	UINT16 argnum = 0;
+
+	if (!TextmapReadToken(&param) || !TextmapIsBrace(&param, '{'))
+	{
+		// Leave the element with its defaults, and whatever followed it to the caller
+		CONS_Alert(CONS_WARNING, "Invalid UDMF data capsule!\n");
+		textmappos = pos;
+		return true;
+	}
+
+	while (true)
+	{
+		if (!TextmapReadToken(&param))
+			return false;
+		if (TextmapIsBrace(&param, '}'))
+			break;
+
+		if (!TextmapReadToken(&val))
+			return false;
+		if (TextmapIsBrace(&val, '}'))
+			break;
+
+		key = TextmapLookupKey(textmapdata + param.pos, param.len, &argnum);
+		if (key != TMK_NONE)
+		{
+			TextmapAddField(key, argnum, &val);
+			block->numfields++;
+		}
+	}
+
+	return true;
+}
+
+/** Reads through the whole textmap once, counting its map data and storing every field.
+  */
+static boolean TextmapScan(const char *data, size_t size)
+{
+	const char *nul = memchr(data, '\0', size);
+	textmaptoken_t tkn;
+	boolean closed = true;
+	UINT16 argnum;
+	UINT8 key;
+
+	if (!textmapkeyseed)
+	{
+		TextmapInitKeys();
+		TextmapInitChars();
+	}
+
+	textmapdata = data;
+	textmapsize = (UINT32)(nul ? (size_t)(nul - data) : size);
+	textmappos = 0;
 
 	// Look for namespace at the beginning.
-	if (!fastcmp(tkn, "namespace"))
+	if (!TextmapReadToken(&tkn) || !TextmapTokenIs(&tkn, "namespace"))
 	{
 		CONS_Alert(CONS_ERROR, "No namespace at beginning of lump!\n");
 		return false;
 	}
 
 	// Check if namespace is valid.
-	tkn = M_TokenizerRead(0);
-	if (!fastcmp(tkn, "srb2"))
-		CONS_Alert(CONS_WARNING, "Invalid namespace '%s', only 'srb2' is supported.\n", tkn);
+	if (!TextmapReadToken(&tkn))
+		tkn.pos = tkn.len = 0;
+	if (!TextmapTokenIs(&tkn, "srb2"))
+		CONS_Alert(CONS_WARNING, "Invalid namespace '%.*s', only 'srb2' is supported.\n", (int)tkn.len, textmapdata + tkn.pos);
 
-	while ((tkn = M_TokenizerRead(0)) && M_TokenizerGetEndPos() < size)
+	while (closed && TextmapReadToken(&tkn))
 	{
-		// Avoid anything inside bracketed stuff, only look for external keywords.
-		if (brackets)
+		// Skip over anything bracketed that isn't an element.
+		if (TextmapIsBrace(&tkn, '{'))
 		{
-			if (fastcmp(tkn, "}"))
-				brackets--;
+			UINT32 brackets = 1;
+			while (brackets && TextmapReadToken(&tkn))
+			{
+				if (TextmapIsBrace(&tkn, '{'))
+					brackets++;
+				else if (TextmapIsBrace(&tkn, '}'))
+					brackets--;
+			}
+			closed = !brackets;
+			continue;
 		}
-		else if (fastcmp(tkn, "{"))
-			brackets++;
+
 		// Check for valid fields.
-		else if (fastcmp(tkn, "thing"))
-			mapthingsPos[nummapthings++] = M_TokenizerGetEndPos();
-		else if (fastcmp(tkn, "linedef"))
-			linesPos[numlines++] = M_TokenizerGetEndPos();
-		else if (fastcmp(tkn, "sidedef"))
-			sidesPos[numsides++] = M_TokenizerGetEndPos();
-		else if (fastcmp(tkn, "vertex"))
-			vertexesPos[numvertexes++] = M_TokenizerGetEndPos();
-		else if (fastcmp(tkn, "sector"))
-			sectorsPos[numsectors++] = M_TokenizerGetEndPos();
+		key = TextmapLookupKey(textmapdata + tkn.pos, tkn.len, &argnum);
+		if (key >= TMK_THING && key <= TMK_SECTOR)
+			closed = TextmapScanBlock(key);
 		else
-			CONS_Alert(CONS_NOTICE, "Unknown field '%s'.\n", tkn);
+			CONS_Alert(CONS_NOTICE, "Unknown field '%.*s'.\n", (int)tkn.len, textmapdata + tkn.pos);
 	}
 
-	if (brackets)
+	if (!closed)
 	{
 		CONS_Alert(CONS_ERROR, "Unclosed brackets detected in textmap lump.\n");
 		return false;
 	}
 
+	nummapthings = numtextmapblocks[TMK_THING - TMK_THING];
+	numlines = numtextmapblocks[TMK_LINEDEF - TMK_THING];
+	numsides = numtextmapblocks[TMK_SIDEDEF - TMK_THING];
+	numvertexes = numtextmapblocks[TMK_VERTEX - TMK_THING];
+	numsectors = numtextmapblocks[TMK_SECTOR - TMK_THING];
+
 	return true;
 }
 
-static void ParseTextmapVertexParameter(UINT32 i, const char *param, const char *val)
+static void ParseTextmapVertexParameter(UINT32 i, const textmapfield_t *field)
 {
-	if (fastcmp(param, "x"))
-		vertexes[i].x = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "y"))
-		vertexes[i].y = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "zfloor"))
+	switch (field->key)
 	{
-		vertexes[i].floorz = FLOAT_TO_FIXED(atof(val));
-		vertexes[i].floorzset = true;
-	}
-	else if (fastcmp(param, "zceiling"))
-	{
-		vertexes[i].ceilingz = FLOAT_TO_FIXED(atof(val));
-		vertexes[i].ceilingzset = true;
+		case TMK_X:
+			vertexes[i].x = TextmapFixed(field);
+			break;
+		case TMK_Y:
+			vertexes[i].y = TextmapFixed(field);
+			break;
+		case TMK_ZFLOOR:
+			vertexes[i].floorz = TextmapFixed(field);
+			vertexes[i].floorzset = true;
+			break;
+		case TMK_ZCEILING:
+			vertexes[i].ceilingz = TextmapFixed(field);
+			vertexes[i].ceilingzset = true;
+			break;
+		default:
+			break;
 	}
 }
 
@@ -1646,439 +2261,433 @@ typedef struct textmap_plane_s {
 textmap_plane_t textmap_planefloor = {0, 0, 0, 0, 0};
 textmap_plane_t textmap_planeceiling = {0, 0, 0, 0, 0};
 
-static void ParseTextmapSectorParameter(UINT32 i, const char *param, const char *val)
-{
-	if (fastcmp(param, "heightfloor"))
-		sectors[i].floorheight = atol(val) << FRACBITS;
-	else if (fastcmp(param, "heightceiling"))
-		sectors[i].ceilingheight = atol(val) << FRACBITS;
-	if (fastcmp(param, "texturefloor"))
-		sectors[i].floorpic = P_AddLevelFlat(val, foundflats);
-	else if (fastcmp(param, "textureceiling"))
-		sectors[i].ceilingpic = P_AddLevelFlat(val, foundflats);
-	else if (fastcmp(param, "lightlevel"))
-		sectors[i].lightlevel = atol(val);
-	else if (fastcmp(param, "lightfloor"))
-		sectors[i].floorlightlevel = atol(val);
-	else if (fastcmp(param, "lightfloorabsolute") && fastcmp("true", val))
-		sectors[i].floorlightabsolute = true;
-	else if (fastcmp(param, "lightceiling"))
-		sectors[i].ceilinglightlevel = atol(val);
-	else if (fastcmp(param, "lightceilingabsolute") && fastcmp("true", val))
-		sectors[i].ceilinglightabsolute = true;
-	else if (fastcmp(param, "id"))
-		Tag_FSet(&sectors[i].tags, atol(val));
-	else if (fastcmp(param, "moreids"))
-	{
-		const char* id = val;
-		while (id)
-		{
-			Tag_Add(&sectors[i].tags, atol(id));
-			if ((id = strchr(id, ' ')))
-				id++;
-		}
-	}	
-	else if (fastcmp(param, "xpanningfloor"))
-		sectors[i].floorxoffset = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "ypanningfloor"))
-		sectors[i].flooryoffset = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "xpanningceiling"))
-		sectors[i].ceilingxoffset = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "ypanningceiling"))
-		sectors[i].ceilingyoffset = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "rotationfloor"))
-		sectors[i].floorangle = FixedAngle(FLOAT_TO_FIXED(atof(val)));
-	else if (fastcmp(param, "rotationceiling"))
-		sectors[i].ceilingangle = FixedAngle(FLOAT_TO_FIXED(atof(val)));
-	else if (fastcmp(param, "floorplane_a"))
-	{
-		textmap_planefloor.defined |= PD_A;
-		textmap_planefloor.a = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "floorplane_b"))
-	{
-		textmap_planefloor.defined |= PD_B;
-		textmap_planefloor.b = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "floorplane_c"))
-	{
-		textmap_planefloor.defined |= PD_C;
-		textmap_planefloor.c = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "floorplane_d"))
+static void ParseTextmapSectorParameter(UINT32 i, const textmapfield_t *field)
+{
+	UINT32 flag = 0, specialflag = 0;
+	char name[64];
+
+	switch (field->key)
 	{
-		textmap_planefloor.defined |= PD_D;
-		textmap_planefloor.d = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "ceilingplane_a"))
-	{
-		textmap_planeceiling.defined |= PD_A;
-		textmap_planeceiling.a = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "ceilingplane_b"))
-	{
-		textmap_planeceiling.defined |= PD_B;
-		textmap_planeceiling.b = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "ceilingplane_c"))
-	{
-		textmap_planeceiling.defined |= PD_C;
-		textmap_planeceiling.c = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "ceilingplane_d"))
-	{
-		textmap_planeceiling.defined |= PD_D;
-		textmap_planeceiling.d = FLOAT_TO_FIXED(atof(val));
-	}
-	else if (fastcmp(param, "lightcolor"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.lightcolor = atol(val);
-	}
-	else if (fastcmp(param, "lightalpha"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.lightalpha = atol(val);
-	}
-	else if (fastcmp(param, "fadecolor"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.fadecolor = atol(val);
-	}
-	else if (fastcmp(param, "fadealpha"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.fadealpha = atol(val);
-	}
-	else if (fastcmp(param, "fadestart"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.fadestart = atol(val);
-	}
-	else if (fastcmp(param, "fadeend"))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.fadeend = atol(val);
-	}
-	else if (fastcmp(param, "colormapfog") && fastcmp("true", val))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.flags |= CMF_FOG;
-	}
-	else if (fastcmp(param, "colormapfadesprites") && fastcmp("true", val))
-	{
-		textmap_colormap.used = true;
-		textmap_colormap.flags |= CMF_FADEFULLBRIGHTSPRITES;
-	}
-	else if (fastcmp(param, "colormapprotected") && fastcmp("true", val))
-		sectors[i].colormap_protected = true;
-	else if (fastcmp(param, "flipspecial_nofloor") && fastcmp("true", val))
-		sectors[i].flags &= ~MSF_FLIPSPECIAL_FLOOR;
-	else if (fastcmp(param, "flipspecial_ceiling") && fastcmp("true", val))
-		sectors[i].flags |= MSF_FLIPSPECIAL_CEILING;
-	else if (fastcmp(param, "triggerspecial_touch") && fastcmp("true", val))
-		sectors[i].flags |= MSF_TRIGGERSPECIAL_TOUCH;
-	else if (fastcmp(param, "triggerspecial_headbump") && fastcmp("true", val))
-		sectors[i].flags |= MSF_TRIGGERSPECIAL_HEADBUMP;
-	else if (fastcmp(param, "triggerline_plane") && fastcmp("true", val))
-		sectors[i].flags |= MSF_TRIGGERLINE_PLANE;
-	else if (fastcmp(param, "triggerline_mobj") && fastcmp("true", val))
-		sectors[i].flags |= MSF_TRIGGERLINE_MOBJ;
-	else if (fastcmp(param, "invertprecip") && fastcmp("true", val))
-		sectors[i].flags |= MSF_INVERTPRECIP;
-	else if (fastcmp(param, "gravityflip") && fastcmp("true", val))
-		sectors[i].flags |= MSF_GRAVITYFLIP;
-	else if (fastcmp(param, "heatwave") && fastcmp("true", val))
-		sectors[i].flags |= MSF_HEATWAVE;
-	else if (fastcmp(param, "noclipcamera") && fastcmp("true", val))
-		sectors[i].flags |= MSF_NOCLIPCAMERA;
-	else if (fastcmp(param, "outerspace") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_OUTERSPACE;
-	else if (fastcmp(param, "doublestepup") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_DOUBLESTEPUP;
-	else if (fastcmp(param, "nostepdown") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_NOSTEPDOWN;
-	else if (fastcmp(param, "speedpad") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_SPEEDPAD;
-	else if (fastcmp(param, "starpostactivator") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_STARPOSTACTIVATOR;
-	else if (fastcmp(param, "exit") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_EXIT;
-	else if (fastcmp(param, "specialstagepit") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_SPECIALSTAGEPIT;
-	else if (fastcmp(param, "returnflag") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_RETURNFLAG;
-	else if (fastcmp(param, "redteambase") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_REDTEAMBASE;
-	else if (fastcmp(param, "blueteambase") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_BLUETEAMBASE;
-	else if (fastcmp(param, "fan") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_FAN;
-	else if (fastcmp(param, "supertransform") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_SUPERTRANSFORM;
-	else if (fastcmp(param, "forcespin") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_FORCESPIN;
-	else if (fastcmp(param, "zoomtubestart") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_ZOOMTUBESTART;
-	else if (fastcmp(param, "zoomtubeend") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_ZOOMTUBEEND;
-	else if (fastcmp(param, "finishline") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_FINISHLINE;
-	else if (fastcmp(param, "ropehang") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_ROPEHANG;
-	else if (fastcmp(param, "jumpflip") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_JUMPFLIP;
-	else if (fastcmp(param, "gravityoverride") && fastcmp("true", val))
-		sectors[i].specialflags |= SSF_GRAVITYOVERRIDE;
-	else if (fastcmp(param, "friction"))
-		sectors[i].friction = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "gravity"))
-		sectors[i].gravity = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "damagetype"))
-	{
-		if (fastcmp(val, "Generic"))
-			sectors[i].damagetype = SD_GENERIC;
-		if (fastcmp(val, "Water"))
-			sectors[i].damagetype = SD_WATER;
-		if (fastcmp(val, "Fire"))
-			sectors[i].damagetype = SD_FIRE;
-		if (fastcmp(val, "Lava"))
-			sectors[i].damagetype = SD_LAVA;
-		if (fastcmp(val, "Electric"))
-			sectors[i].damagetype = SD_ELECTRIC;
-		if (fastcmp(val, "Spike"))
-			sectors[i].damagetype = SD_SPIKE;
-		if (fastcmp(val, "DeathPitTilt"))
-			sectors[i].damagetype = SD_DEATHPITTILT;
-		if (fastcmp(val, "DeathPitNoTilt"))
-			sectors[i].damagetype = SD_DEATHPITNOTILT;
-		if (fastcmp(val, "Instakill"))
-			sectors[i].damagetype = SD_INSTAKILL;
-		if (fastcmp(val, "SpecialStage"))
-			sectors[i].damagetype = SD_SPECIALSTAGE;
-	}
-	else if (fastcmp(param, "triggertag"))
-		sectors[i].triggertag = atol(val);
-	else if (fastcmp(param, "triggerer"))
-	{
-		if (fastcmp(val, "Player"))
-			sectors[i].triggerer = TO_PLAYER;
-		if (fastcmp(val, "AllPlayers"))
-			sectors[i].triggerer = TO_ALLPLAYERS;
-		if (fastcmp(val, "Mobj"))
-			sectors[i].triggerer = TO_MOBJ;
-	}
-}
-
-static void ParseTextmapSidedefParameter(UINT32 i, const char *param, const char *val)
-{
-	if (fastcmp(param, "offsetx"))
-		sides[i].textureoffset = atol(val)<<FRACBITS;
-	else if (fastcmp(param, "offsety"))
-		sides[i].rowoffset = atol(val)<<FRACBITS;
-	else if (fastcmp(param, "offsetx_top"))
-		sides[i].offsetx_top = atol(val) << FRACBITS;
-	else if (fastcmp(param, "offsetx_mid"))
-		sides[i].offsetx_mid = atol(val) << FRACBITS;
-	else if (fastcmp(param, "offsetx_bottom"))
-		sides[i].offsetx_bot = atol(val) << FRACBITS;
-	else if (fastcmp(param, "offsety_top"))
-		sides[i].offsety_top = atol(val) << FRACBITS;
-	else if (fastcmp(param, "offsety_mid"))
-		sides[i].offsety_mid = atol(val) << FRACBITS;
-	else if (fastcmp(param, "offsety_bottom"))
-		sides[i].offsety_bot = atol(val) << FRACBITS;
-	else if (fastcmp(param, "texturetop"))
-		sides[i].toptexture = R_TextureNumForName(val);
-	else if (fastcmp(param, "texturebottom"))
-		sides[i].bottomtexture = R_TextureNumForName(val);
-	else if (fastcmp(param, "texturemiddle"))
-		sides[i].midtexture = R_TextureNumForName(val);
-	else if (fastcmp(param, "sector"))
-		P_SetSidedefSector(i, atol(val));
-	else if (fastcmp(param, "repeatcnt"))
-		sides[i].repeatcnt = atol(val);
-}
-
-static void ParseTextmapLinedefParameter(UINT32 i, const char *param, const char *val)
-{
-	if (fastcmp(param, "id"))
-		Tag_FSet(&lines[i].tags, atol(val));
-	else if (fastcmp(param, "moreids"))
-	{
-		const char* id = val;
-		while (id)
-		{
-			Tag_Add(&lines[i].tags, atol(id));
-			if ((id = strchr(id, ' ')))
-				id++;
-		}
+		case TMK_HEIGHTFLOOR:
+			sectors[i].floorheight = TextmapInt(field) << FRACBITS;
+			break;
+		case TMK_HEIGHTCEILING:
+			sectors[i].ceilingheight = TextmapInt(field) << FRACBITS;
+			break;
+		case TMK_TEXTUREFLOOR:
+			sectors[i].floorpic = P_AddLevelFlat(TextmapString(field, name, sizeof (name)), foundflats);
+			break;
+		case TMK_TEXTURECEILING:
+			sectors[i].ceilingpic = P_AddLevelFlat(TextmapString(field, name, sizeof (name)), foundflats);
+			break;
+		case TMK_LIGHTLEVEL:
+			sectors[i].lightlevel = TextmapInt(field);
+			break;
+		case TMK_LIGHTFLOOR:
+			sectors[i].floorlightlevel = TextmapInt(field);
+			break;
+		case TMK_LIGHTFLOORABSOLUTE:
+			if (TextmapTrue(field))
+				sectors[i].floorlightabsolute = true;
+			break;
+		case TMK_LIGHTCEILING:
+			sectors[i].ceilinglightlevel = TextmapInt(field);
+			break;
+		case TMK_LIGHTCEILINGABSOLUTE:
+			if (TextmapTrue(field))
+				sectors[i].ceilinglightabsolute = true;
+			break;
+		case TMK_ID:
+			Tag_FSet(&sectors[i].tags, TextmapInt(field));
+			break;
+		case TMK_MOREIDS:
+			TextmapAddMoreIDs(&sectors[i].tags, field);
+			break;
+		case TMK_XPANNINGFLOOR:
+			sectors[i].floorxoffset = TextmapFixed(field);
+			break;
+		case TMK_YPANNINGFLOOR:
+			sectors[i].flooryoffset = TextmapFixed(field);
+			break;
+		case TMK_XPANNINGCEILING:
+			sectors[i].ceilingxoffset = TextmapFixed(field);
+			break;
+		case TMK_YPANNINGCEILING:
+			sectors[i].ceilingyoffset = TextmapFixed(field);
+			break;
+		case TMK_ROTATIONFLOOR:
+			sectors[i].floorangle = FixedAngle(TextmapFixed(field));
+			break;
+		case TMK_ROTATIONCEILING:
+			sectors[i].ceilingangle = FixedAngle(TextmapFixed(field));
+			break;
+		case TMK_FLOORPLANE_A:
+			textmap_planefloor.defined |= PD_A;
+			textmap_planefloor.a = TextmapFixed(field);
+			break;
+		case TMK_FLOORPLANE_B:
+			textmap_planefloor.defined |= PD_B;
+			textmap_planefloor.b = TextmapFixed(field);
+			break;
+		case TMK_FLOORPLANE_C:
+			textmap_planefloor.defined |= PD_C;
+			textmap_planefloor.c = TextmapFixed(field);
+			break;
+		case TMK_FLOORPLANE_D:
+			textmap_planefloor.defined |= PD_D;
+			textmap_planefloor.d = TextmapFixed(field);
+			break;
+		case TMK_CEILINGPLANE_A:
+			textmap_planeceiling.defined |= PD_A;
+			textmap_planeceiling.a = TextmapFixed(field);
+			break;
+		case TMK_CEILINGPLANE_B:
+			textmap_planeceiling.defined |= PD_B;
+			textmap_planeceiling.b = TextmapFixed(field);
+			break;
+		case TMK_CEILINGPLANE_C:
+			textmap_planeceiling.defined |= PD_C;
+			textmap_planeceiling.c = TextmapFixed(field);
+			break;
+		case TMK_CEILINGPLANE_D:
+			textmap_planeceiling.defined |= PD_D;
+			textmap_planeceiling.d = TextmapFixed(field);
+			break;
+		case TMK_LIGHTCOLOR:
+			textmap_colormap.used = true;
+			textmap_colormap.lightcolor = TextmapInt(field);
+			break;
+		case TMK_LIGHTALPHA:
+			textmap_colormap.used = true;
+			textmap_colormap.lightalpha = TextmapInt(field);
+			break;
+		case TMK_FADECOLOR:
+			textmap_colormap.used = true;
+			textmap_colormap.fadecolor = TextmapInt(field);
+			break;
+		case TMK_FADEALPHA:
+			textmap_colormap.used = true;
+			textmap_colormap.fadealpha = TextmapInt(field);
+			break;
+		case TMK_FADESTART:
+			textmap_colormap.used = true;
+			textmap_colormap.fadestart = TextmapInt(field);
+			break;
+		case TMK_FADEEND:
+			textmap_colormap.used = true;
+			textmap_colormap.fadeend = TextmapInt(field);
+			break;
+		case TMK_COLORMAPFOG:
+			if (TextmapTrue(field))
+			{
+				textmap_colormap.used = true;
+				textmap_colormap.flags |= CMF_FOG;
+			}
+			break;
+		case TMK_COLORMAPFADESPRITES:
+			if (TextmapTrue(field))
+			{
+				textmap_colormap.used = true;
+				textmap_colormap.flags |= CMF_FADEFULLBRIGHTSPRITES;
+			}
+			break;
+		case TMK_COLORMAPPROTECTED:
+			if (TextmapTrue(field))
+				sectors[i].colormap_protected = true;
+			break;
+		case TMK_FLIPSPECIAL_NOFLOOR:
+			if (TextmapTrue(field))
+				sectors[i].flags &= ~MSF_FLIPSPECIAL_FLOOR;
+			break;
+		case TMK_FLIPSPECIAL_CEILING:    flag = MSF_FLIPSPECIAL_CEILING; break;
+		case TMK_TRIGGERSPECIAL_TOUCH:   flag = MSF_TRIGGERSPECIAL_TOUCH; break;
+		case TMK_TRIGGERSPECIAL_HEADBUMP: flag = MSF_TRIGGERSPECIAL_HEADBUMP; break;
+		case TMK_TRIGGERLINE_PLANE:      flag = MSF_TRIGGERLINE_PLANE; break;
+		case TMK_TRIGGERLINE_MOBJ:       flag = MSF_TRIGGERLINE_MOBJ; break;
+		case TMK_INVERTPRECIP:           flag = MSF_INVERTPRECIP; break;
+		case TMK_GRAVITYFLIP:            flag = MSF_GRAVITYFLIP; break;
+		case TMK_HEATWAVE:               flag = MSF_HEATWAVE; break;
+		case TMK_NOCLIPCAMERA:           flag = MSF_NOCLIPCAMERA; break;
+		case TMK_OUTERSPACE:        specialflag = SSF_OUTERSPACE; break;
+		case TMK_DOUBLESTEPUP:      specialflag = SSF_DOUBLESTEPUP; break;
+		case TMK_NOSTEPDOWN:        specialflag = SSF_NOSTEPDOWN; break;
+		case TMK_SPEEDPAD:          specialflag = SSF_SPEEDPAD; break;
+		case TMK_STARPOSTACTIVATOR: specialflag = SSF_STARPOSTACTIVATOR; break;
+		case TMK_EXIT:              specialflag = SSF_EXIT; break;
+		case TMK_SPECIALSTAGEPIT:   specialflag = SSF_SPECIALSTAGEPIT; break;
+		case TMK_RETURNFLAG:        specialflag = SSF_RETURNFLAG; break;
+		case TMK_REDTEAMBASE:       specialflag = SSF_REDTEAMBASE; break;
+		case TMK_BLUETEAMBASE:      specialflag = SSF_BLUETEAMBASE; break;
+		case TMK_FAN:               specialflag = SSF_FAN; break;
+		case TMK_SUPERTRANSFORM:    specialflag = SSF_SUPERTRANSFORM; break;
+		case TMK_FORCESPIN:         specialflag = SSF_FORCESPIN; break;
+		case TMK_ZOOMTUBESTART:     specialflag = SSF_ZOOMTUBESTART; break;
+		case TMK_ZOOMTUBEEND:       specialflag = SSF_ZOOMTUBEEND; break;
+		case TMK_FINISHLINE:        specialflag = SSF_FINISHLINE; break;
+		case TMK_ROPEHANG:          specialflag = SSF_ROPEHANG; break;
+		case TMK_JUMPFLIP:          specialflag = SSF_JUMPFLIP; break;
+		case TMK_GRAVITYOVERRIDE:   specialflag = SSF_GRAVITYOVERRIDE; break;
+		case TMK_FRICTION:
+			sectors[i].friction = TextmapFixed(field);
+			break;
+		case TMK_GRAVITY:
+			sectors[i].gravity = TextmapFixed(field);
+			break;
+		case TMK_DAMAGETYPE:
+			if (TextmapValueIs(field, "Generic"))
+				sectors[i].damagetype = SD_GENERIC;
+			else if (TextmapValueIs(field, "Water"))
+				sectors[i].damagetype = SD_WATER;
+			else if (TextmapValueIs(field, "Fire"))
+				sectors[i].damagetype = SD_FIRE;
+			else if (TextmapValueIs(field, "Lava"))
+				sectors[i].damagetype = SD_LAVA;
+			else if (TextmapValueIs(field, "Electric"))
+				sectors[i].damagetype = SD_ELECTRIC;
+			else if (TextmapValueIs(field, "Spike"))
+				sectors[i].damagetype = SD_SPIKE;
+			else if (TextmapValueIs(field, "DeathPitTilt"))
+				sectors[i].damagetype = SD_DEATHPITTILT;
+			else if (TextmapValueIs(field, "DeathPitNoTilt"))
+				sectors[i].damagetype = SD_DEATHPITNOTILT;
+			else if (TextmapValueIs(field, "Instakill"))
+				sectors[i].damagetype = SD_INSTAKILL;
+			else if (TextmapValueIs(field, "SpecialStage"))
+				sectors[i].damagetype = SD_SPECIALSTAGE;
+			break;
+		case TMK_TRIGGERTAG:
+			sectors[i].triggertag = TextmapInt(field);
+			break;
+		case TMK_TRIGGERER:
+			if (TextmapValueIs(field, "Player"))
+				sectors[i].triggerer = TO_PLAYER;
+			else if (TextmapValueIs(field, "AllPlayers"))
+				sectors[i].triggerer = TO_ALLPLAYERS;
+			else if (TextmapValueIs(field, "Mobj"))
+				sectors[i].triggerer = TO_MOBJ;
+			break;
+		default:
+			break;
 	}
-	else if (fastcmp(param, "special"))
-		lines[i].special = atol(val);
-	else if (fastcmp(param, "v1"))
-		P_SetLinedefV1(i, atol(val));
-	else if (fastcmp(param, "v2"))
-		P_SetLinedefV2(i, atol(val));
-	else if (fastncmp(param, "stringarg", 9) && strlen(param) > 9)
+
+	if ((flag || specialflag) && TextmapTrue(field))
 	{
-		size_t argnum = atol(param + 9);
-		if (argnum >= NUMLINESTRINGARGS)
-			return;
-		lines[i].stringargs[argnum] = Z_Malloc(strlen(val) + 1, PU_LEVEL, NULL);
-		M_Memcpy(lines[i].stringargs[argnum], val, strlen(val) + 1);
+		sectors[i].flags |= flag;
+		sectors[i].specialflags |= specialflag;
 	}
-	else if (fastncmp(param, "arg", 3) && strlen(param) > 3)
+}
+
+static void ParseTextmapSidedefParameter(UINT32 i, const textmapfield_t *field)
+{
+	char name[64];
+
+	switch (field->key)
 	{
-		size_t argnum = atol(param + 3);
-		if (argnum >= NUMLINEARGS)
-			return;
-		lines[i].args[argnum] = atol(val);
-	}
-	else if (fastcmp(param, "sidefront"))
-		lines[i].sidenum[0] = atol(val);
-	else if (fastcmp(param, "sideback"))
-		lines[i].sidenum[1] = atol(val);
-	else if (fastcmp(param, "alpha"))
-		lines[i].alpha = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "blendmode") || fastcmp(param, "renderstyle"))
-	{
-		if (fastcmp(val, "translucent"))
-			lines[i].blendmode = AST_COPY;
-		else if (fastcmp(val, "add"))
-			lines[i].blendmode = AST_ADD;
-		else if (fastcmp(val, "subtract"))
-			lines[i].blendmode = AST_SUBTRACT;
-		else if (fastcmp(val, "reversesubtract"))
-			lines[i].blendmode = AST_REVERSESUBTRACT;
-		else if (fastcmp(val, "modulate"))
-			lines[i].blendmode = AST_MODULATE;
-		if (fastcmp(val, "fog"))
-			lines[i].blendmode = AST_FOG;
-	}
-	else if (fastcmp(param, "executordelay"))
-		lines[i].executordelay = atol(val);
-
-	// Flags
-	else if (fastcmp(param, "blocking") && fastcmp("true", val))
-		lines[i].flags |= ML_IMPASSIBLE;
-	else if (fastcmp(param, "blockmonsters") && fastcmp("true", val))
-		lines[i].flags |= ML_BLOCKMONSTERS;
-	else if (fastcmp(param, "twosided") && fastcmp("true", val))
-		lines[i].flags |= ML_TWOSIDED;
-	else if (fastcmp(param, "dontpegtop") && fastcmp("true", val))
-		lines[i].flags |= ML_DONTPEGTOP;
-	else if (fastcmp(param, "dontpegbottom") && fastcmp("true", val))
-		lines[i].flags |= ML_DONTPEGBOTTOM;
-	else if (fastcmp(param, "skewtd") && fastcmp("true", val))
-		lines[i].flags |= ML_SKEWTD;
-	else if (fastcmp(param, "noclimb") && fastcmp("true", val))
-		lines[i].flags |= ML_NOCLIMB;
-	else if (fastcmp(param, "noskew") && fastcmp("true", val))
-		lines[i].flags |= ML_NOSKEW;
-	else if (fastcmp(param, "midpeg") && fastcmp("true", val))
-		lines[i].flags |= ML_MIDPEG;
-	else if (fastcmp(param, "midsolid") && fastcmp("true", val))
-		lines[i].flags |= ML_MIDSOLID;
-	else if (fastcmp(param, "wrapmidtex") && fastcmp("true", val))
-		lines[i].flags |= ML_WRAPMIDTEX;
-	/*else if (fastcmp(param, "effect6") && fastcmp("true", val))
-		lines[i].flags |= ML_EFFECT6;*/
-	else if (fastcmp(param, "nonet") && fastcmp("true", val))
-		lines[i].flags |= ML_NONET;
-	else if (fastcmp(param, "netonly") && fastcmp("true", val))
-		lines[i].flags |= ML_NETONLY;
-	else if (fastcmp(param, "bouncy") && fastcmp("true", val))
-		lines[i].flags |= ML_BOUNCY;
-	else if (fastcmp(param, "transfer") && fastcmp("true", val))
-		lines[i].flags |= ML_TFERLINE;
-}
-
-static void ParseTextmapThingParameter(UINT32 i, const char *param, const char *val)
-{
-	if (fastcmp(param, "id"))
-		Tag_FSet(&mapthings[i].tags, atol(val));
-	else if (fastcmp(param, "moreids"))
-	{
-		const char* id = val;
-		while (id)
-		{
-			Tag_Add(&mapthings[i].tags, atol(id));
-			if ((id = strchr(id, ' ')))
-				id++;
-		}
+		case TMK_OFFSETX:
+			sides[i].textureoffset = TextmapInt(field)<<FRACBITS;
+			break;
+		case TMK_OFFSETY:
+			sides[i].rowoffset = TextmapInt(field)<<FRACBITS;
+			break;
+		case TMK_OFFSETX_TOP:
+			sides[i].offsetx_top = TextmapInt(field) << FRACBITS;
+			break;
+		case TMK_OFFSETX_MID:
+			sides[i].offsetx_mid = TextmapInt(field) << FRACBITS;
+			break;
+		case TMK_OFFSETX_BOTTOM:
+			sides[i].offsetx_bot = TextmapInt(field) << FRACBITS;
+			break;
+		case TMK_OFFSETY_TOP:
+			sides[i].offsety_top = TextmapInt(field) << FRACBITS;
+			break;
+		case TMK_OFFSETY_MID:
+			sides[i].offsety_mid = TextmapInt(field) << FRACBITS;
+			break;
+		case TMK_OFFSETY_BOTTOM:
+			sides[i].offsety_bot = TextmapInt(field) << FRACBITS;
+			break;
+		case TMK_TEXTURETOP:
+			sides[i].toptexture = R_TextureNumForName(TextmapString(field, name, sizeof (name)));
+			break;
+		case TMK_TEXTUREBOTTOM:
+			sides[i].bottomtexture = R_TextureNumForName(TextmapString(field, name, sizeof (name)));
+			break;
+		case TMK_TEXTUREMIDDLE:
+			sides[i].midtexture = R_TextureNumForName(TextmapString(field, name, sizeof (name)));
+			break;
+		case TMK_SECTOR:
+			P_SetSidedefSector(i, TextmapInt(field));
+			break;
+		case TMK_REPEATCNT:
+			sides[i].repeatcnt = TextmapInt(field);
+			break;
+		default:
+			break;
 	}
-	else if (fastcmp(param, "x"))
-		mapthings[i].x = atol(val);
-	else if (fastcmp(param, "y"))
-		mapthings[i].y = atol(val);
-	else if (fastcmp(param, "height"))
-		mapthings[i].z = atol(val);
-	else if (fastcmp(param, "angle"))
-		mapthings[i].angle = atol(val);
-	else if (fastcmp(param, "pitch"))
-		mapthings[i].pitch = atol(val);
-	else if (fastcmp(param, "roll"))
-		mapthings[i].roll = atol(val);
-	else if (fastcmp(param, "type"))
-		mapthings[i].type = atol(val);
-	else if (fastcmp(param, "scale"))
-		mapthings[i].spritexscale = mapthings[i].spriteyscale = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "scalex"))
-		mapthings[i].spritexscale = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "scaley"))
-		mapthings[i].spriteyscale = FLOAT_TO_FIXED(atof(val));
-	else if (fastcmp(param, "mobjscale"))
-		mapthings[i].scale = FLOAT_TO_FIXED(atof(val));
-	// Flags
-	else if (fastcmp(param, "flip") && fastcmp("true", val))
-		mapthings[i].options |= MTF_OBJECTFLIP;
-	else if (fastcmp(param, "absolutez") && fastcmp("true", val))
-		mapthings[i].options |= MTF_ABSOLUTEZ;
-
-	else if (fastncmp(param, "stringarg", 9) && strlen(param) > 9)
-	{
-		size_t argnum = atol(param + 9);
-		if (argnum >= NUMMAPTHINGSTRINGARGS)
-			return;
-		mapthings[i].stringargs[argnum] = Z_Malloc(strlen(val) + 1, PU_LEVEL, NULL);
-		M_Memcpy(mapthings[i].stringargs[argnum], val, strlen(val) + 1);
+}
+
+static void ParseTextmapLinedefParameter(UINT32 i, const textmapfield_t *field)
+{
+	UINT32 flag = 0;
+
+	switch (field->key)
+	{
+		case TMK_ID:
+			Tag_FSet(&lines[i].tags, TextmapInt(field));
+			break;
+		case TMK_MOREIDS:
+			TextmapAddMoreIDs(&lines[i].tags, field);
+			break;
+		case TMK_SPECIAL:
+			lines[i].special = TextmapInt(field);
+			break;
+		case TMK_V1:
+			P_SetLinedefV1(i, TextmapInt(field));
+			break;
+		case TMK_V2:
+			P_SetLinedefV2(i, TextmapInt(field));
+			break;
+		case TMK_STRINGARG:
+			if (field->argnum < NUMLINESTRINGARGS)
+				lines[i].stringargs[field->argnum] = TextmapStringArg(field);
+			break;
+		case TMK_ARG:
+			if (field->argnum < NUMLINEARGS)
+				lines[i].args[field->argnum] = TextmapInt(field);
+			break;
+		case TMK_SIDEFRONT:
+			lines[i].sidenum[0] = TextmapInt(field);
+			break;
+		case TMK_SIDEBACK:
+			lines[i].sidenum[1] = TextmapInt(field);
+			break;
+		case TMK_ALPHA:
+			lines[i].alpha = TextmapFixed(field);
+			break;
+		case TMK_BLENDMODE:
+		case TMK_RENDERSTYLE:
+			if (TextmapValueIs(field, "translucent"))
+				lines[i].blendmode = AST_COPY;
+			else if (TextmapValueIs(field, "add"))
+				lines[i].blendmode = AST_ADD;
+			else if (TextmapValueIs(field, "subtract"))
+				lines[i].blendmode = AST_SUBTRACT;
+			else if (TextmapValueIs(field, "reversesubtract"))
+				lines[i].blendmode = AST_REVERSESUBTRACT;
+			else if (TextmapValueIs(field, "modulate"))
+				lines[i].blendmode = AST_MODULATE;
+			else if (TextmapValueIs(field, "fog"))
+				lines[i].blendmode = AST_FOG;
+			break;
+		case TMK_EXECUTORDELAY:
+			lines[i].executordelay = TextmapInt(field);
+			break;
+
+		// Flags
+		case TMK_BLOCKING:      flag = ML_IMPASSIBLE; break;
+		case TMK_BLOCKMONSTERS: flag = ML_BLOCKMONSTERS; break;
+		case TMK_TWOSIDED:      flag = ML_TWOSIDED; break;
+		case TMK_DONTPEGTOP:    flag = ML_DONTPEGTOP; break;
+		case TMK_DONTPEGBOTTOM: flag = ML_DONTPEGBOTTOM; break;
+		case TMK_SKEWTD:        flag = ML_SKEWTD; break;
+		case TMK_NOCLIMB:       flag = ML_NOCLIMB; break;
+		case TMK_NOSKEW:        flag = ML_NOSKEW; break;
+		case TMK_MIDPEG:        flag = ML_MIDPEG; break;
+		case TMK_MIDSOLID:      flag = ML_MIDSOLID; break;
+		case TMK_WRAPMIDTEX:    flag = ML_WRAPMIDTEX; break;
+		case TMK_NONET:         flag = ML_NONET; break;
+		case TMK_NETONLY:       flag = ML_NETONLY; break;
+		case TMK_BOUNCY:        flag = ML_BOUNCY; break;
+		case TMK_TRANSFER:      flag = ML_TFERLINE; break;
+		default:
+			break;
 	}
-	else if (fastncmp(param, "arg", 3) && strlen(param) > 3)
+
+	if (flag && TextmapTrue(field))
+		lines[i].flags |= flag;
+}
+
+static void ParseTextmapThingParameter(UINT32 i, const textmapfield_t *field)
+{
+	switch (field->key)
 	{
-		size_t argnum = atol(param + 3);
-		if (argnum >= NUMMAPTHINGARGS)
-			return;
-		mapthings[i].args[argnum] = atol(val);
+		case TMK_ID:
+			Tag_FSet(&mapthings[i].tags, TextmapInt(field));
+			break;
+		case TMK_MOREIDS:
+			TextmapAddMoreIDs(&mapthings[i].tags, field);
+			break;
+		case TMK_X:
+			mapthings[i].x = TextmapInt(field);
+			break;
+		case TMK_Y:
+			mapthings[i].y = TextmapInt(field);
+			break;
+		case TMK_HEIGHT:
+			mapthings[i].z = TextmapInt(field);
+			break;
+		case TMK_ANGLE:
+			mapthings[i].angle = TextmapInt(field);
+			break;
+		case TMK_PITCH:
+			mapthings[i].pitch = TextmapInt(field);
+			break;
+		case TMK_ROLL:
+			mapthings[i].roll = TextmapInt(field);
+			break;
+		case TMK_TYPE:
+			mapthings[i].type = TextmapInt(field);
+			break;
+		case TMK_SCALE:
+			mapthings[i].spritexscale = mapthings[i].spriteyscale = TextmapFixed(field);
+			break;
+		case TMK_SCALEX:
+			mapthings[i].spritexscale = TextmapFixed(field);
+			break;
+		case TMK_SCALEY:
+			mapthings[i].spriteyscale = TextmapFixed(field);
+			break;
+		case TMK_MOBJSCALE:
+			mapthings[i].scale = TextmapFixed(field);
+			break;
+
+		// Flags
+		case TMK_FLIP:
+			if (TextmapTrue(field))
+				mapthings[i].options |= MTF_OBJECTFLIP;
+			break;
+		case TMK_ABSOLUTEZ:
+			if (TextmapTrue(field))
+				mapthings[i].options |= MTF_ABSOLUTEZ;
+			break;
+
+		case TMK_STRINGARG:
+			if (field->argnum < NUMMAPTHINGSTRINGARGS)
+				mapthings[i].stringargs[field->argnum] = TextmapStringArg(field);
+			break;
+		case TMK_ARG:
+			if (field->argnum < NUMMAPTHINGARGS)
+				mapthings[i].args[field->argnum] = TextmapInt(field);
+			break;
+		default:
+			break;
 	}
 }
 
-/** From a given position table, run a specified parser function through a {}-encapsuled text.
+/** Runs a parser function through the fields of a {}-encapsulated element.
   *
-  * \param Position of the data to parse, in the textmap.
+  * \param Element to parse, as found by TextmapScan.
   * \param Structure number (mapthings, sectors, ...).
   * \param Parser function pointer.
   */
-static void TextmapParse(UINT32 dataPos, size_t num, void (*parser)(UINT32, const char *, const char *))
+static void TextmapParse(const textmapblock_t *block, UINT32 num, void (*parser)(UINT32, const textmapfield_t *))
 {
-	const char *param, *val;
-
-	M_TokenizerSetEndPos(dataPos);
-	param = M_TokenizerRead(0);
-	if (!fastcmp(param, "{"))
-	{
-		CONS_Alert(CONS_WARNING, "Invalid UDMF data capsule!\n");
-		return;
-	}
+	const textmapfield_t *field = &textmapfields[block->field];
+	UINT32 i;
 
-	while (true)
-	{
-		param = M_TokenizerRead(0);
-		if (fastcmp(param, "}"))
-			break;
-		val = M_TokenizerRead(1);
-		parser(num, param, val);
-	}
+	for (i = 0; i < block->numfields; i++, field++)
+		parser(num, field);
 }
 
 /** Provides a fix to the flat alignment coordinate transform from standard Textmaps.
@@ -2861,7 +3470,7 @@ static void P_LoadTextmap(void)
 		vt->floorzset = vt->ceilingzset = false;
 		vt->floorz = vt->ceilingz = 0;
 
-		TextmapParse(vertexesPos[i], i, ParseTextmapVertexParameter);
+		TextmapParse(&textmapblocks[TMK_VERTEX - TMK_THING][i], i, ParseTextmapVertexParameter);
 
 		if (vt->x == INT32_MAX)
 			I_Error("P_LoadTextmap: vertex %s has no x value set!\n", sizeu1(i));
@@ -2915,7 +3524,7 @@ static void P_LoadTextmap(void)
 		textmap_planefloor.defined = 0;
 		textmap_planeceiling.defined = 0;
 
-		TextmapParse(sectorsPos[i], i, ParseTextmapSectorParameter);
+		TextmapParse(&textmapblocks[TMK_SECTOR - TMK_THING][i], i, ParseTextmapSectorParameter);
 
 		P_InitializeSector(sc);
 		if (textmap_colormap.used)
@@ -2955,7 +3564,7 @@ static void P_LoadTextmap(void)
 		ld->sidenum[0] = 0xffff;
 		ld->sidenum[1] = 0xffff;
 
-		TextmapParse(linesPos[i], i, ParseTextmapLinedefParameter);
+		TextmapParse(&textmapblocks[TMK_LINEDEF - TMK_THING][i], i, ParseTextmapLinedefParameter);
 
 		if (!ld->v1)
 			I_Error("P_LoadTextmap: linedef %s has no v1 value set!\n", sizeu1(i));
@@ -2980,7 +3589,7 @@ static void P_LoadTextmap(void)
 		sd->sector = NULL;
 		sd->repeatcnt = 0;
 
-		TextmapParse(sidesPos[i], i, ParseTextmapSidedefParameter);
+		TextmapParse(&textmapblocks[TMK_SIDEDEF - TMK_THING][i], i, ParseTextmapSidedefParameter);
 
 		if (!sd->sector)
 			I_Error("P_LoadTextmap: sidedef %s has no sector value set!\n", sizeu1(i));
@@ -3004,7 +3613,7 @@ static void P_LoadTextmap(void)
 		memset(mt->stringargs, 0x00, NUMMAPTHINGSTRINGARGS*sizeof(*mt->stringargs));
 		mt->mobj = NULL;
 
-		TextmapParse(mapthingsPos[i], i, ParseTextmapThingParameter);
+		TextmapParse(&textmapblocks[TMK_THING - TMK_THING][i], i, ParseTextmapThingParameter);
 	}
 }
 
@@ -3083,15 +3692,16 @@ static void P_ProcessLinedefsAfterSidedefs(void)
 static boolean P_LoadMapData(const virtres_t *virt)
 {
 	virtlump_t *virtvertexes = NULL, *virtsectors = NULL, *virtsidedefs = NULL, *virtlinedefs = NULL, *virtthings = NULL;
+	precise_t textmaptime = 0;
 
 	// Count map data.
 	if (udmf) // Count how many entries for each type we got in textmap.
 	{
-		virtlump_t *textmap = vres_Find(virt, "TEXTMAP");
-		M_TokenizerOpen((char *)textmap->data);
-		if (!TextmapCount(textmap->size))
+		virtlump_t *textmaplump = vres_Find(virt, "TEXTMAP");
+		textmaptime = I_GetPreciseTime();
+		if (!TextmapScan((char *)textmaplump->data, textmaplump->size))
 		{
-			M_TokenizerClose();
+			TextmapFreeFields();
 			return false;
 		}
 	}
@@ -3149,7 +3759,9 @@ static boolean P_LoadMapData(const virtres_t *virt)
 	if (udmf)
 	{
 		P_LoadTextmap();
-		M_TokenizerClose();
+		CONS_Debug(DBG_SETUP, "P_LoadMapData: TEXTMAP parsed in %s us (%s fields)\n",
+			sizeu1((size_t)((I_GetPreciseTime() - textmaptime) * 1000000 / I_GetPrecisePrecision())), sizeu2(numtextmapfields));
+		TextmapFreeFields();
 	}
 	else
 	{
@@ -3646,6 +4258,21 @@ static void P_ReadBlockMapLump(INT16 *wadblockmaplump, size_t count)
 	}
 }
 
+// Allocates the mobj and polyobject chains for each block of the blockmap.
+static void P_SetupBlockLinks(void)
+{
+	size_t count = sizeof (*blocklinks) * bmapwidth * bmapheight;
+
+	// clear out mobj chains
+	blocklinks = Z_Calloc(count, PU_LEVEL, NULL);
+	blockmap = blockmaplump + 4;
+	P_InitThingIndex();
+
+	// haleyjd 2/22/06: setup polyobject blockmap
+	count = sizeof(*polyblocklinks) * bmapwidth * bmapheight;
+	polyblocklinks = Z_Calloc(count, PU_LEVEL, NULL);
+}
+
 // This needs to be a separate function
 // because making both the WAD and PK3 loading code use
 // the same functions is trickier than it looks for blockmap
@@ -3666,14 +4293,34 @@ static boolean P_LoadBlockMap(UINT8 *data, size_t count)
 	bmapwidth = blockmaplump[2];
 	bmapheight = blockmaplump[3];
 
-	// clear out mobj chains
-	count = sizeof (*blocklinks)* bmapwidth*bmapheight;
-	blocklinks = Z_Calloc(count, PU_LEVEL, NULL);
-	blockmap = blockmaplump+4;
+	P_SetupBlockLinks();
+	return true;
+}
 
-	// haleyjd 2/22/06: setup polyobject blockmap
-	count = sizeof(*polyblocklinks) * bmapwidth * bmapheight;
-	polyblocklinks = Z_Calloc(count, PU_LEVEL, NULL);
+// Loads the blockmap P_CreateBlockMap made last time, if it's in the level cache.
+// The section is the blockmap's origin, width and height, the size of
+// blockmaplump, then blockmaplump itself.
+static boolean P_LoadCachedBlockMap(void)
+{
+	size_t length, count;
+	UINT8 *p = P_FindLevelCacheSection("BMAP", &length);
+
+	if (!p || length < 5*4)
+		return false;
+
+	bmaporgx = READINT32(p);
+	bmaporgy = READINT32(p);
+	bmapwidth = READINT32(p);
+	bmapheight = READINT32(p);
+	count = READUINT32(p);
+	if (length != 5*4 + count*4 || count < 4 + (size_t)bmapwidth*bmapheight)
+		return false;
+
+	blockmaplump = Z_Malloc(sizeof (*blockmaplump) * count, PU_LEVEL, NULL);
+	for (length = 0; length < count; length++)
+		blockmaplump[length] = READINT32(p);
+
+	P_SetupBlockLinks();
 	return true;
 }
 
@@ -3742,6 +4389,7 @@ static boolean LineInBlock(fixed_t cx1, fixed_t cy1, fixed_t cx2, fixed_t cy2, f
 static void P_CreateBlockMap(void)
 {
 	register size_t i;
+	size_t count;
 	fixed_t minx = INT32_MAX, miny = INT32_MAX, maxx = INT32_MIN, maxy = INT32_MIN;
 	// First find limits of map
 
@@ -3883,16 +4531,14 @@ static void P_CreateBlockMap(void)
 		// at tot and tot+1.
 		//
 		// 4 words, unused if this routine is called, are reserved at the start.
-		{
-			size_t count = tot + 6; // we need at least 1 word per block, plus reserved's
+		count = tot + 6; // we need at least 1 word per block, plus reserved's
 
-			for (i = 0; i < tot; i++)
-				if (bmap[i].n)
-					count += bmap[i].n + 2; // 1 header word + 1 trailer word + blocklist
+		for (i = 0; i < tot; i++)
+			if (bmap[i].n)
+				count += bmap[i].n + 2; // 1 header word + 1 trailer word + blocklist
 
-			// Allocate blockmap lump with computed count
-			blockmaplump = Z_Calloc(sizeof (*blockmaplump) * count, PU_LEVEL, NULL);
-		}
+		// Allocate blockmap lump with computed count
+		blockmaplump = Z_Calloc(sizeof (*blockmaplump) * count, PU_LEVEL, NULL);
 
 		// Now compress the blockmap.
 		{
@@ -3918,15 +4564,24 @@ static void P_CreateBlockMap(void)
 			free(bmap); // Free uncompressed blockmap
 		}
 	}
+
+	P_SetupBlockLinks();
+
+	// Save it for next time
 	{
-		size_t count = sizeof (*blocklinks) * bmapwidth * bmapheight;
-		// clear out mobj chains (copied from from P_LoadBlockMap)
-		blocklinks = Z_Calloc(count, PU_LEVEL, NULL);
-		blockmap = blockmaplump + 4;
+		UINT8 *data = Z_Malloc(5*4 + count*4, PU_STATIC, NULL);
+		UINT8 *p = data;
+
+		WRITEINT32(p, bmaporgx);
+		WRITEINT32(p, bmaporgy);
+		WRITEINT32(p, bmapwidth);
+		WRITEINT32(p, bmapheight);
+		WRITEUINT32(p, count);
+		for (i = 0; i < count; i++)
+			WRITEINT32(p, blockmaplump[i]);
 
-		// haleyjd 2/22/06: setup polyobject blockmap
-		count = sizeof(*polyblocklinks) * bmapwidth * bmapheight;
-		polyblocklinks = Z_Calloc(count, PU_LEVEL, NULL);
+		P_AddLevelCacheSection("BMAP", data, p - data);
+		Z_Free(data);
 	}
 }
 
@@ -3934,11 +4589,22 @@ static void P_CreateBlockMap(void)
 // -- Monster Iestyn 09/01/18
 static void P_LoadReject(UINT8 *data, size_t count)
 {
+	size_t i;
+
+	// All zeroes rejects nothing, so it's as good as not having one
+	for (i = 0; i < count && !data[i]; i++)
+		;
+
 	if (!count) // zero length, someone probably used ZDBSP
 	{
 		rejectmatrix = NULL;
 		CONS_Debug(DBG_SETUP, "P_LoadReject: REJECT lump has size 0, will not be loaded\n");
 	}
+	else if (i == count)
+	{
+		rejectmatrix = NULL;
+		CONS_Debug(DBG_SETUP, "P_LoadReject: REJECT lump is empty, will not be loaded\n");
+	}
 	else
 	{
 		rejectmatrix = Z_Malloc(count, PU_LEVEL, NULL); // allocate memory for the reject matrix
@@ -3957,7 +4623,8 @@ static void P_LoadMapLUT(const virtres_t *virt)
 	else
 		rejectmatrix = NULL;
 
-	if (!(virtblockmap && P_LoadBlockMap(virtblockmap->data, virtblockmap->size)))
+	if (!(virtblockmap && P_LoadBlockMap(virtblockmap->data, virtblockmap->size))
+		&& !P_LoadCachedBlockMap())
 		P_CreateBlockMap();
 }
 
@@ -6935,6 +7602,237 @@ static void P_MakeMapMD5(virtres_t *virt, void *dest)
 	M_Memcpy(dest, &resmd5, 16);
 }
 
+// ==========================================================================
+//                               LEVEL CACHE
+// ==========================================================================
+//
+// Things that are slow to work out from a map's lumps (a generated
+// blockmap, REJECT, OpenGL plane polygons) are kept in srb2home/cache/levels,
+// one file per map named after its map MD5. Each file also holds an MD5 of
+// every lump the map was loaded from, so an edited map is never handed
+// stale data.
+//
+// A file is "SRB2LVL", a version byte, the map MD5, the lumps' MD5 and a
+// section count, then each section's 4 character tag, length and data.
+
+#define LEVELCACHEVERSION 1
+#define LEVELCACHEHEADER (8 + 16 + 16 + 4)
+
+typedef struct levelcachesection_s
+{
+	char tag[4];
+	UINT8 *data;
+	size_t length;
+	boolean added; // data was copied by P_AddLevelCacheSection
+	struct levelcachesection_s *next;
+} levelcachesection_t;
+
+static levelcachesection_t *levelcache;
+static UINT8 *levelcachefile; // the file as read from disk
+static UINT8 levelcachelumpmd5[16];
+static boolean levelcacheopen, levelcachedirty;
+
+static void P_FreeLevelCache(void)
+{
+	while (levelcache)
+	{
+		levelcachesection_t *next = levelcache->next;
+		if (levelcache->added)
+			Z_Free(levelcache->data);
+		Z_Free(levelcache);
+		levelcache = next;
+	}
+
+	if (levelcachefile)
+		Z_Free(levelcachefile);
+	levelcachefile = NULL;
+	levelcacheopen = levelcachedirty = false;
+}
+
+static const char *P_LevelCachePath(void)
+{
+	char hex[33];
+	INT32 i;
+
+	for (i = 0; i < 16; i++)
+		sprintf(&hex[i*2], "%02x", mapmd5[i]);
+
+	return va("%s"PATHSEP"cache"PATHSEP"levels"PATHSEP"%s.lvl", srb2home, hex);
+}
+
+static levelcachesection_t *P_NewLevelCacheSection(const char *tag)
+{
+	levelcachesection_t *section = Z_Calloc(sizeof (*section), PU_STATIC, NULL);
+	M_Memcpy(section->tag, tag, 4);
+	section->next = levelcache;
+	levelcache = section;
+	return section;
+}
+
+/** Reads in the level cache for the map being loaded, if there is one and
+  * it was made from exactly the same lumps.
+  * mapmd5 has to be worked out first.
+  */
+static void P_OpenLevelCache(const virtres_t *virt)
+{
+#ifdef NOMD5
+	(void)virt;
+#else
+	UINT8 (*lumpmd5s)[16];
+	size_t length, i;
+	UINT32 numsections;
+	UINT8 *p, *end;
+
+	P_FreeLevelCache();
+
+	// MD5 the MD5s of every lump, in order
+	lumpmd5s = Z_Malloc(virt->numlumps*16 + 1, PU_STATIC, NULL);
+	for (i = 0; i < virt->numlumps; i++)
+		md5_buffer((char *)virt->vlumps[i].data, virt->vlumps[i].size, lumpmd5s[i]);
+	md5_buffer((char *)lumpmd5s, virt->numlumps*16, levelcachelumpmd5);
+	Z_Free(lumpmd5s);
+
+	levelcacheopen = true;
+
+	length = FIL_ReadFile(P_LevelCachePath(), &levelcachefile);
+	if (!length)
+		return;
+
+	p = levelcachefile;
+	end = levelcachefile + length;
+
+	if (length < LEVELCACHEHEADER
+		|| memcmp(p, "SRB2LVL", 7) || p[7] != LEVELCACHEVERSION
+		|| memcmp(p + 8, mapmd5, 16) || memcmp(p + 24, levelcachelumpmd5, 16))
+	{
+		CONS_Debug(DBG_SETUP, "P_OpenLevelCache: cache is out of date\n");
+		Z_Free(levelcachefile);
+		levelcachefile = NULL;
+		return;
+	}
+
+	p += 40;
+	numsections = READUINT32(p);
+	while (numsections--)
+	{
+		levelcachesection_t *section;
+		UINT32 sectionlength;
+
+		if (end - p < 8)
+			break;
+		section = P_NewLevelCacheSection((char *)p);
+		p += 4;
+		sectionlength = READUINT32(p);
+		if ((size_t)(end - p) < sectionlength)
+		{
+			// Truncated, so don't trust any of it
+			CONS_Debug(DBG_SETUP, "P_OpenLevelCache: cache is truncated\n");
+			P_FreeLevelCache();
+			levelcacheopen = true;
+			return;
+		}
+		section->data = p;
+		section->length = sectionlength;
+		p += sectionlength;
+	}
+#endif
+}
+
+/** Writes the level cache back out if anything was added to it,
+  * and lets go of it.
+  */
+static void P_CloseLevelCache(void)
+{
+	levelcachesection_t *section;
+	size_t length = LEVELCACHEHEADER;
+	UINT32 numsections = 0;
+	UINT8 *buf, *p;
+
+	if (!levelcachedirty)
+	{
+		P_FreeLevelCache();
+		return;
+	}
+
+	for (section = levelcache; section; section = section->next)
+	{
+		length += 8 + section->length;
+		numsections++;
+	}
+
+	p = buf = Z_Malloc(length, PU_STATIC, NULL);
+	M_Memcpy(p, "SRB2LVL", 7);
+	p[7] = LEVELCACHEVERSION;
+	M_Memcpy(p + 8, mapmd5, 16);
+	M_Memcpy(p + 24, levelcachelumpmd5, 16);
+	p += 40;
+	WRITEUINT32(p, numsections);
+	for (section = levelcache; section; section = section->next)
+	{
+		M_Memcpy(p, section->tag, 4);
+		p += 4;
+		WRITEUINT32(p, section->length);
+		M_Memcpy(p, section->data, section->length);
+		p += section->length;
+	}
+
+	I_mkdir(va("%s"PATHSEP"cache", srb2home), 0755);
+	I_mkdir(va("%s"PATHSEP"cache"PATHSEP"levels", srb2home), 0755);
+	if (!FIL_WriteFile(P_LevelCachePath(), buf, length))
+		CONS_Debug(DBG_SETUP, "P_CloseLevelCache: couldn't write the cache\n");
+
+	Z_Free(buf);
+	P_FreeLevelCache();
+}
+
+/** Finds a section of the level cache for the map being loaded.
+  *
+  * \param tag     4 character section name
+  * \param length  set to the section's length
+  * \return The section's data, or NULL if it isn't cached
+  */
+UINT8 *P_FindLevelCacheSection(const char *tag, size_t *length)
+{
+	levelcachesection_t *section;
+
+	for (section = levelcache; section; section = section->next)
+		if (!memcmp(section->tag, tag, 4))
+		{
+			*length = section->length;
+			return section->data;
+		}
+
+	return NULL;
+}
+
+/** Adds a section to the level cache for the map being loaded. The data is
+  * copied, and written out once the level has finished loading.
+  * Does nothing if no level is being loaded.
+  */
+void P_AddLevelCacheSection(const char *tag, const void *data, size_t length)
+{
+	levelcachesection_t *section;
+	UINT8 *copy;
+
+	if (!levelcacheopen)
+		return;
+
+	for (section = levelcache; section; section = section->next)
+		if (!memcmp(section->tag, tag, 4))
+			break;
+	if (!section)
+		section = P_NewLevelCacheSection(tag);
+	else if (section->added)
+		Z_Free(section->data);
+
+	copy = Z_Malloc(length + 1, PU_STATIC, NULL);
+	M_Memcpy(copy, data, length);
+	section->data = copy;
+	section->length = length;
+	section->added = true;
+	levelcachedirty = true;
+}
+
 static boolean P_LoadMapFromFile(void)
 {
 	virtres_t *virt = vres_GetMap(lastloadedmaplumpnum);
@@ -6942,6 +7840,9 @@ static boolean P_LoadMapFromFile(void)
 	size_t i;
 	udmf = textmap != NULL;
 
+	P_MakeMapMD5(virt, &mapmd5);
+	P_OpenLevelCache(virt);
+
 	if (!P_LoadMapData(virt))
 		return false;
 	P_LoadMapBSP(virt);
@@ -6970,7 +7871,9 @@ static boolean P_LoadMapFromFile(void)
 		if (sectors[i].tags.count)
 			spawnsectors[i].tags.tags = memcpy(Z_Malloc(sectors[i].tags.count*sizeof(mtag_t), PU_LEVEL, NULL), sectors[i].tags.tags, sectors[i].tags.count*sizeof(mtag_t));
 
-	P_MakeMapMD5(virt, &mapmd5);
+	// Work out a REJECT table if the map came without one
+	if (!rejectmatrix)
+		P_BuildRejectMatrix();
 
 	vres_Free(virt);
 	return true;
@@ -7873,6 +8776,9 @@ boolean P_LoadLevel(boolean fromnetsave, boolean reloadinggamestate)
 		HWR_LoadLevel();
 #endif
 
+	// Everything that gets cached has been worked out now
+	P_CloseLevelCache();
+
 	// oh god I hope this helps
 	// (addendum: apparently it does!
 	//  none of this needs to be done because it's not the beginning of the map when
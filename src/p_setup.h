@@ -99,6 +99,8 @@ void P_ScanThings(INT16 mapnum, INT16 wadnum, INT16 lumpnum);
 #endif
 void P_RespawnThings(void);
 boolean P_LoadLevel(boolean fromnetsave, boolean reloadinggamestate);
+UINT8 *P_FindLevelCacheSection(const char *tag, size_t *length);
+void P_AddLevelCacheSection(const char *tag, const void *data, size_t length);
 #ifdef HWRENDER
 void HWR_LoadLevel(void);
 #endif
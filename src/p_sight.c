@@ -17,6 +17,15 @@
 #include "p_slopes.h"
 #include "r_main.h"
 #include "r_state.h"
+#include "console.h"
+#include "i_threads.h"
+#include "i_time.h"
+#include "m_misc.h"
+#include "m_perfstats.h"
+#include "p_setup.h"
+#include "z_zone.h"
+
+#include <math.h>
 
 //
 // P_CheckSight
@@ -372,45 +381,63 @@ static boolean P_CrossBSPNode(INT32 bspnum, register los_t *los)
 }
 
 //
-// P_CheckSight
+// P_CheckSight cache
 //
-// Returns true if a straight line between t1 and t2 is unobstructed.
-// Uses REJECT.
+// Enemies check sight against the same few players over and over, so
+// during the mobj thinkers each trace's result is remembered, keyed on
+// exactly the positions it depends on. Anything that could change what a
+// trace sees (sector heights, FOFs, polyobjects, slopes) calls
+// P_InvalidateSightCache, which throws every entry away at once by bumping
+// the generation they have to match. Results are the same as tracing every
+// time, so demos and netgames are unaffected.
 //
-boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
-{
-	const sector_t *s1, *s2;
-	size_t pnum;
-	los_t los;
-
-	// First check for trivial rejection.
-	if (!t1 || !t2)
-		return false;
-
-	I_Assert(!P_MobjWasRemoved(t1));
-	I_Assert(!P_MobjWasRemoved(t2));
 
-	if (!t1->subsector || !t2->subsector
-	|| !t1->subsector->sector || !t2->subsector->sector)
-		return false;
-
-	s1 = t1->subsector->sector;
-	s2 = t2->subsector->sector;
-	pnum = (s1-sectors)*numsectors + (s2-sectors);
+#define SIGHTCACHESIZE 1024 // must be a power of 2
 
-	if (rejectmatrix != NULL)
+typedef struct
+{
+	UINT32 gen;
+	const subsector_t *ss1, *ss2;
+	fixed_t x1, y1, eyez;
+	fixed_t x2, y2, z2, height2;
+	boolean result;
+} sightcache_t;
+
+static sightcache_t sightcache[SIGHTCACHESIZE];
+static UINT32 sightcachegen = 1;
+static boolean sightcacheactive;
+
+void P_InvalidateSightCache(void)
+{
+	if (++sightcachegen == 0)
 	{
-		// Check in REJECT table.
-		if (rejectmatrix[pnum>>3] & (1 << (pnum&7))) // can't possibly be connected
-			return false;
+		// Wrapped around, so old entries could look current again
+		memset(sightcache, 0, sizeof(sightcache));
+		sightcachegen = 1;
 	}
+}
 
-	// killough 11/98: shortcut for melee situations
-	// same subsector? obviously visible
-	// haleyjd 02/23/06: can't do this if there are polyobjects in the subsec
-	if (!t1->subsector->polyList &&
-		t1->subsector == t2->subsector)
-		return true;
+// Only the mobj thinkers use the cache: everything else that runs in a
+// tic is free to move sectors around without telling it.
+void P_StartSightCache(void)
+{
+	P_InvalidateSightCache();
+	sightcacheactive = true;
+}
+
+void P_StopSightCache(void)
+{
+	sightcacheactive = false;
+}
+
+//
+// P_TraceSight
+//
+// Does the actual line of sight check for P_CheckSight.
+//
+static boolean P_TraceSight(mobj_t *t1, mobj_t *t2, const sector_t *s1, const sector_t *s2)
+{
+	los_t los;
 
 	// An unobstructed LOS is possible.
 	// Now look from eyes of t1 to any part of t2.
@@ -496,3 +523,591 @@ boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
 	// the head node is the last node output
 	return P_CrossBSPNode((INT32)numnodes - 1, &los);
 }
+
+//
+// P_CheckSight
+//
+// Returns true if a straight line between t1 and t2 is unobstructed.
+// Uses REJECT.
+//
+boolean P_CheckSight(mobj_t *t1, mobj_t *t2)
+{
+	const sector_t *s1, *s2;
+	size_t pnum;
+	sightcache_t *entry;
+	fixed_t eyez;
+	boolean result;
+
+	// First check for trivial rejection.
+	if (!t1 || !t2)
+		return false;
+
+	I_Assert(!P_MobjWasRemoved(t1));
+	I_Assert(!P_MobjWasRemoved(t2));
+
+	if (!t1->subsector || !t2->subsector
+	|| !t1->subsector->sector || !t2->subsector->sector)
+		return false;
+
+	s1 = t1->subsector->sector;
+	s2 = t2->subsector->sector;
+	pnum = (s1-sectors)*numsectors + (s2-sectors);
+
+	if (rejectmatrix != NULL)
+	{
+		// Check in REJECT table.
+		if (rejectmatrix[pnum>>3] & (1 << (pnum&7))) // can't possibly be connected
+			return false;
+	}
+
+	// killough 11/98: shortcut for melee situations
+	// same subsector? obviously visible
+	// haleyjd 02/23/06: can't do this if there are polyobjects in the subsec
+	if (!t1->subsector->polyList &&
+		t1->subsector == t2->subsector)
+		return true;
+
+	if (!sightcacheactive)
+		return P_TraceSight(t1, t2, s1, s2);
+
+	eyez = t1->z + t1->height - (t1->height>>2);
+	entry = &sightcache[(size_t)(((UINT32)t1->x>>FRACBITS)*31 + ((UINT32)t1->y>>FRACBITS)*131 + ((UINT32)eyez>>FRACBITS)*7
+		+ ((UINT32)t2->x>>FRACBITS)*37 + ((UINT32)t2->y>>FRACBITS)*137 + ((UINT32)t2->z>>FRACBITS)*11) & (SIGHTCACHESIZE-1)];
+
+	if (entry->gen == sightcachegen
+		&& entry->ss1 == t1->subsector && entry->ss2 == t2->subsector
+		&& entry->x1 == t1->x && entry->y1 == t1->y && entry->eyez == eyez
+		&& entry->x2 == t2->x && entry->y2 == t2->y && entry->z2 == t2->z
+		&& entry->height2 == t2->height)
+	{
+		ps_sightcache_hits.value.i++;
+		return entry->result;
+	}
+
+	ps_sightcache_misses.value.i++;
+	result = P_TraceSight(t1, t2, s1, s2);
+
+	entry->gen = sightcachegen;
+	entry->ss1 = t1->subsector;
+	entry->ss2 = t2->subsector;
+	entry->x1 = t1->x;
+	entry->y1 = t1->y;
+	entry->eyez = eyez;
+	entry->x2 = t2->x;
+	entry->y2 = t2->y;
+	entry->z2 = t2->z;
+	entry->height2 = t2->height;
+	entry->result = result;
+	return result;
+}
+
+// ==========================================================================
+//                              REJECT BUILDER
+// ==========================================================================
+//
+// Most node builders these days write an empty REJECT lump, and UDMF maps
+// don't have one at all, so P_CheckSight can't turn anything down early for
+// them. P_BuildRejectMatrix works one out at load time instead.
+//
+// Two sectors are only marked as unable to see each other if no straight
+// line could get from one to the other through two-sided lines, whatever
+// the heights are. P_CheckSight's trace would turn every such pair down
+// anyway, so filling in REJECT never changes what it returns.
+//
+// Visibility is flooded out from each sector through "portals" (lines with
+// a different sector on each side): every portal a line could cross next is
+// clipped down to the part of it still reachable through the portals before
+// it, 2D Quake vis style. Sectors are shared out between worker threads, and
+// the result goes in the level cache.
+
+#define REJECTEPSILON 4.0 // map units of slack for P_DivlineSide's rounding
+#define REJECTBUDGET 65536 // portals looked through per sector before giving up
+#define REJECTMAXDEPTH 256 // longest chain of portals followed
+#define REJECTTHREADS 3 // worker threads, not counting the main one
+
+typedef struct
+{
+	double x1, y1, x2, y2; // lengthened by REJECTEPSILON at both ends
+	double nx, ny, dist; // unit normal pointing out of the front side
+	INT32 front, back;
+} rejectportal_t;
+
+typedef struct
+{
+	INT32 portal;
+	INT32 to; // sector on the other side of it
+} rejectlink_t;
+
+typedef struct
+{
+	double x1, y1, x2, y2;
+} rejectseg_t;
+
+// A portal in a chain, and the part of it that is still in view
+typedef struct
+{
+	rejectseg_t seg;
+	const rejectportal_t *portal;
+	double side; // 1 if lines come out on the front side, -1 for the back
+} rejectwindow_t;
+
+typedef struct
+{
+	UINT8 *onpath; // portals in the chain being followed
+	UINT8 *row; // sectors seen so far
+	INT32 budget;
+} rejectwork_t;
+
+static rejectportal_t *rejectportals;
+static INT32 numrejectportals;
+static rejectlink_t *rejectlinks;
+static INT32 *rejectfirstlink; // numsectors + 1 offsets into rejectlinks
+static UINT8 *rejectvis; // a row of bits per sector, padded to a byte
+static size_t rejectrowbytes;
+static INT32 rejectnextsector;
+
+#ifdef HAVE_THREADS
+static I_mutex rejectthread_mutex;
+static I_cond rejectthread_cond;
+static INT32 rejectthread_alive;
+#endif
+
+// Cuts seg down to where a*x + b*y - c >= -REJECTEPSILON.
+// Returns false if there's nothing left of it.
+static boolean P_RejectClip(rejectseg_t *seg, double a, double b, double c)
+{
+	const double f1 = a*seg->x1 + b*seg->y1 - c + REJECTEPSILON;
+	const double f2 = a*seg->x2 + b*seg->y2 - c + REJECTEPSILON;
+	double t;
+
+	if (f1 >= 0 && f2 >= 0)
+		return true;
+	if (f1 < 0 && f2 < 0)
+		return false;
+
+	t = f1/(f1 - f2);
+	if (f1 < 0)
+	{
+		seg->x1 += t*(seg->x2 - seg->x1);
+		seg->y1 += t*(seg->y2 - seg->y1);
+	}
+	else
+	{
+		seg->x2 = seg->x1 + t*(seg->x2 - seg->x1);
+		seg->y2 = seg->y1 + t*(seg->y2 - seg->y1);
+	}
+	return true;
+}
+
+// Cuts seg down to the side of window's portal that lines come out on.
+static boolean P_RejectClipPast(rejectseg_t *seg, const rejectwindow_t *window)
+{
+	const rejectportal_t *p = window->portal;
+	return P_RejectClip(seg, window->side*p->nx, window->side*p->ny, window->side*p->dist);
+}
+
+// Is any of seg on the given side of the portal?
+static boolean P_RejectOnSide(const rejectseg_t *seg, const rejectportal_t *p, double side)
+{
+	const double f1 = side*(p->nx*seg->x1 + p->ny*seg->y1 - p->dist);
+	const double f2 = side*(p->nx*seg->x2 + p->ny*seg->y2 - p->dist);
+	return (f1 >= -REJECTEPSILON || f2 >= -REJECTEPSILON);
+}
+
+// Cuts target down to the part a line through both source and pass can
+// reach on pass's side, using the separating lines between the two:
+// those through an end of each with source and pass on opposite sides.
+// Nearly collinear cases are skipped, which only ever leaves more in view.
+static boolean P_RejectClipSeparators(const rejectseg_t *source, const rejectseg_t *pass, rejectseg_t *target)
+{
+	double sx[2], sy[2], px[2], py[2];
+	double dx, dy, len, a, b, c, sside, pside;
+	INT32 i, j;
+
+	sx[0] = source->x1; sy[0] = source->y1;
+	sx[1] = source->x2; sy[1] = source->y2;
+	px[0] = pass->x1; py[0] = pass->y1;
+	px[1] = pass->x2; py[1] = pass->y2;
+
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < 2; j++)
+		{
+			dx = px[j] - sx[i];
+			dy = py[j] - sy[i];
+			len = sqrt(dx*dx + dy*dy);
+			if (len < REJECTEPSILON)
+				continue;
+
+			a = dy/len;
+			b = -dx/len;
+			c = a*sx[i] + b*sy[i];
+			sside = a*sx[i^1] + b*sy[i^1] - c;
+			pside = a*px[j^1] + b*py[j^1] - c;
+
+			if (sside > REJECTEPSILON && pside < -REJECTEPSILON)
+			{
+				a = -a;
+				b = -b;
+				c = -c;
+			}
+			else if (!(sside < -REJECTEPSILON && pside > REJECTEPSILON))
+				continue;
+
+			if (!P_RejectClip(target, a, b, c))
+				return false;
+		}
+
+	return true;
+}
+
+// Follows every chain of portals out of sector sec that a line coming in
+// through source and then pass (NULL at the first step) could carry on along.
+static void P_RejectFlood(rejectwork_t *work, const rejectwindow_t *source, const rejectwindow_t *pass, INT32 sec, INT32 depth)
+{
+	const rejectwindow_t *last = pass ? pass : source;
+	rejectwindow_t next, nextsource;
+	const rejectlink_t *link;
+	const rejectportal_t *p;
+	INT32 i;
+
+	if (depth >= REJECTMAXDEPTH)
+	{
+		work->budget = 0;
+		return;
+	}
+
+	for (i = rejectfirstlink[sec]; i < rejectfirstlink[sec + 1]; i++)
+	{
+		if (work->budget <= 0)
+			return;
+
+		link = &rejectlinks[i];
+		if (work->onpath[link->portal])
+			continue;
+
+		p = &rejectportals[link->portal];
+		next.portal = p;
+		next.side = (p->front == sec) ? -1.0 : 1.0;
+		next.seg.x1 = p->x1;
+		next.seg.y1 = p->y1;
+		next.seg.x2 = p->x2;
+		next.seg.y2 = p->y2;
+
+		// Lines come into this portal from sec's side,
+		// so the portals they went through have to be there too...
+		if (!P_RejectOnSide(&last->seg, p, -next.side)
+		|| (pass && !P_RejectOnSide(&source->seg, p, -next.side)))
+			continue;
+
+		// ...and only the part past all of them can be reached.
+		if (!P_RejectClipPast(&next.seg, source))
+			continue;
+		if (pass && (!P_RejectClipPast(&next.seg, pass)
+		|| !P_RejectClipSeparators(&source->seg, &pass->seg, &next.seg)))
+			continue;
+
+		work->budget--;
+		work->row[link->to>>3] |= 1<<(link->to&7);
+
+		// Narrow the source down to the part that can see this far.
+		nextsource = *source;
+		if (pass && !P_RejectClipSeparators(&next.seg, &pass->seg, &nextsource.seg))
+			nextsource = *source;
+
+		work->onpath[link->portal] = 1;
+		P_RejectFlood(work, &nextsource, &next, link->to, depth + 1);
+		work->onpath[link->portal] = 0;
+	}
+}
+
+// Works out every sector that sector sec could possibly see.
+static void P_RejectSector(rejectwork_t *work, INT32 sec)
+{
+	rejectwindow_t source;
+	const rejectlink_t *link;
+	const rejectportal_t *p;
+	INT32 i;
+
+	work->row = rejectvis + (size_t)sec*rejectrowbytes;
+	work->row[sec>>3] |= 1<<(sec&7);
+	work->budget = REJECTBUDGET;
+
+	for (i = rejectfirstlink[sec]; i < rejectfirstlink[sec + 1] && work->budget > 0; i++)
+	{
+		link = &rejectlinks[i];
+		p = &rejectportals[link->portal];
+		work->row[link->to>>3] |= 1<<(link->to&7);
+
+		source.portal = p;
+		source.side = (p->front == sec) ? -1.0 : 1.0;
+		source.seg.x1 = p->x1;
+		source.seg.y1 = p->y1;
+		source.seg.x2 = p->x2;
+		source.seg.y2 = p->y2;
+
+		work->onpath[link->portal] = 1;
+		P_RejectFlood(work, &source, NULL, link->to, 0);
+		work->onpath[link->portal] = 0;
+	}
+
+	// Too much to look through, so give up and say it can see everything.
+	if (work->budget <= 0)
+		memset(work->row, 0xFF, rejectrowbytes);
+}
+
+static INT32 P_RejectTakeSector(void)
+{
+	INT32 sec;
+#ifdef HAVE_THREADS
+	I_lock_mutex(&rejectthread_mutex);
+#endif
+	sec = rejectnextsector++;
+#ifdef HAVE_THREADS
+	I_unlock_mutex(rejectthread_mutex);
+#endif
+	return sec;
+}
+
+static void P_RejectWork(rejectwork_t *work)
+{
+	INT32 sec;
+	while ((sec = P_RejectTakeSector()) < (INT32)numsectors)
+		P_RejectSector(work, sec);
+}
+
+#ifdef HAVE_THREADS
+static void P_RejectWorker(void *userdata)
+{
+	P_RejectWork(userdata);
+
+	I_lock_mutex(&rejectthread_mutex);
+	if (--rejectthread_alive == 0)
+		I_wake_all_cond(&rejectthread_cond);
+	I_unlock_mutex(rejectthread_mutex);
+}
+#endif
+
+typedef struct
+{
+	INT32 sector, vertex;
+} rejectcorner_t;
+
+static int P_RejectCompareCorners(const void *a, const void *b)
+{
+	const rejectcorner_t *ca = a, *cb = b;
+	if (ca->sector != cb->sector)
+		return (ca->sector < cb->sector) ? -1 : 1;
+	if (ca->vertex != cb->vertex)
+		return (ca->vertex < cb->vertex) ? -1 : 1;
+	return 0;
+}
+
+// Every sector has to be closed off for the flood to be right: a line could
+// get out of an unclosed sector without going through any of its portals.
+// A sector is closed if each vertex on its edge has an even number of its
+// edge lines meeting there.
+static boolean P_RejectSectorsClosed(void)
+{
+	rejectcorner_t *corners = Z_Malloc((numlines*4 + 1)*sizeof(*corners), PU_STATIC, NULL);
+	size_t numcorners = 0, i, j;
+	boolean closed = true;
+
+	for (i = 0; i < numlines; i++)
+	{
+		const line_t *ld = &lines[i];
+		if (ld->frontsector == ld->backsector)
+			continue;
+
+		corners[numcorners].sector = (INT32)(ld->frontsector - sectors);
+		corners[numcorners++].vertex = (INT32)(ld->v1 - vertexes);
+		corners[numcorners].sector = (INT32)(ld->frontsector - sectors);
+		corners[numcorners++].vertex = (INT32)(ld->v2 - vertexes);
+		if (ld->backsector)
+		{
+			corners[numcorners].sector = (INT32)(ld->backsector - sectors);
+			corners[numcorners++].vertex = (INT32)(ld->v1 - vertexes);
+			corners[numcorners].sector = (INT32)(ld->backsector - sectors);
+			corners[numcorners++].vertex = (INT32)(ld->v2 - vertexes);
+		}
+	}
+
+	qsort(corners, numcorners, sizeof(*corners), P_RejectCompareCorners);
+
+	for (i = 0; i < numcorners && closed; i = j)
+	{
+		for (j = i + 1; j < numcorners && !P_RejectCompareCorners(&corners[i], &corners[j]); j++)
+			;
+		if ((j - i) & 1)
+		{
+			CONS_Debug(DBG_SETUP, "P_BuildRejectMatrix: sector %d isn't closed at vertex %d\n", corners[i].sector, corners[i].vertex);
+			closed = false;
+		}
+	}
+
+	Z_Free(corners);
+	return closed;
+}
+
+// Sets up the portals, and the list of them going out of each sector.
+static void P_RejectMakePortals(void)
+{
+	INT32 *count;
+	INT32 i, n;
+	size_t l;
+
+	numrejectportals = 0;
+	for (l = 0; l < numlines; l++)
+		if (lines[l].backsector && lines[l].frontsector != lines[l].backsector)
+			numrejectportals++;
+
+	rejectportals = Z_Malloc((numrejectportals + 1)*sizeof(*rejectportals), PU_STATIC, NULL);
+	rejectlinks = Z_Malloc((numrejectportals + 1)*2*sizeof(*rejectlinks), PU_STATIC, NULL);
+	rejectfirstlink = Z_Calloc((numsectors + 1)*sizeof(*rejectfirstlink), PU_STATIC, NULL);
+	count = Z_Calloc(numsectors*sizeof(*count), PU_STATIC, NULL);
+
+	for (l = 0, n = 0; l < numlines; l++)
+	{
+		const line_t *ld = &lines[l];
+		rejectportal_t *p;
+		double dx, dy, len;
+
+		if (!ld->backsector || ld->frontsector == ld->backsector)
+			continue;
+
+		p = &rejectportals[n++];
+		p->front = (INT32)(ld->frontsector - sectors);
+		p->back = (INT32)(ld->backsector - sectors);
+		p->x1 = (double)ld->v1->x/FRACUNIT;
+		p->y1 = (double)ld->v1->y/FRACUNIT;
+		p->x2 = (double)ld->v2->x/FRACUNIT;
+		p->y2 = (double)ld->v2->y/FRACUNIT;
+
+		// The front side is on the right going from v1 to v2.
+		dx = p->x2 - p->x1;
+		dy = p->y2 - p->y1;
+		len = sqrt(dx*dx + dy*dy);
+		if (len > 0)
+		{
+			p->nx = dy/len;
+			p->ny = -dx/len;
+			dx /= len;
+			dy /= len;
+		}
+		else
+			p->nx = p->ny = 0;
+		p->dist = p->nx*p->x1 + p->ny*p->y1;
+
+		p->x1 -= dx*REJECTEPSILON;
+		p->y1 -= dy*REJECTEPSILON;
+		p->x2 += dx*REJECTEPSILON;
+		p->y2 += dy*REJECTEPSILON;
+
+		rejectfirstlink[p->front + 1]++;
+		rejectfirstlink[p->back + 1]++;
+	}
+
+	for (i = 0; i < (INT32)numsectors; i++)
+		rejectfirstlink[i + 1] += rejectfirstlink[i];
+
+	for (i = 0; i < numrejectportals; i++)
+	{
+		const rejectportal_t *p = &rejectportals[i];
+		rejectlink_t *link = &rejectlinks[rejectfirstlink[p->front] + count[p->front]++];
+		link->portal = i;
+		link->to = p->back;
+		link = &rejectlinks[rejectfirstlink[p->back] + count[p->back]++];
+		link->portal = i;
+		link->to = p->front;
+	}
+
+	Z_Free(count);
+}
+
+static void P_RejectFreePortals(void)
+{
+	Z_Free(rejectportals);
+	Z_Free(rejectlinks);
+	Z_Free(rejectfirstlink);
+	rejectportals = NULL;
+	rejectlinks = NULL;
+	rejectfirstlink = NULL;
+}
+
+/** Builds rejectmatrix for a map that didn't come with one, or loads it
+  * from the level cache if it's been built before.
+  * Leaves it NULL if the map is too broken to build one for.
+  */
+void P_BuildRejectMatrix(void)
+{
+	const size_t size = (numsectors*numsectors + 7)/8;
+	rejectwork_t work[REJECTTHREADS + 1];
+	tic_t starttime = I_GetTime();
+	INT32 numworkers = 0;
+	size_t a, b, pnum, length;
+	const UINT8 *cached;
+	INT32 i;
+
+	rejectmatrix = NULL;
+
+	cached = P_FindLevelCacheSection("REJT", &length);
+	if (cached && length == size)
+	{
+		CONS_Debug(DBG_SETUP, "P_BuildRejectMatrix: loaded from the level cache\n");
+		rejectmatrix = Z_Malloc(size, PU_LEVEL, NULL);
+		M_Memcpy(rejectmatrix, cached, size);
+		return;
+	}
+
+	if (!numsectors || !P_RejectSectorsClosed())
+		return;
+
+	P_RejectMakePortals();
+
+	rejectrowbytes = (numsectors + 7)/8;
+	rejectvis = Z_Calloc(numsectors*rejectrowbytes, PU_STATIC, NULL);
+	rejectnextsector = 0;
+
+#ifdef HAVE_THREADS
+	numworkers = REJECTTHREADS;
+#endif
+	for (i = 0; i <= numworkers; i++)
+		work[i].onpath = Z_Calloc(numrejectportals + 1, PU_STATIC, NULL);
+
+#ifdef HAVE_THREADS
+	rejectthread_alive = numworkers;
+	for (i = 1; i <= numworkers; i++)
+		I_spawn_thread(va("reject-worker-%d", i), P_RejectWorker, &work[i]);
+#endif
+
+	P_RejectWork(&work[0]);
+
+#ifdef HAVE_THREADS
+	I_lock_mutex(&rejectthread_mutex);
+	while (rejectthread_alive)
+		I_hold_cond(&rejectthread_cond, rejectthread_mutex);
+	I_unlock_mutex(rejectthread_mutex);
+#endif
+
+	// Only reject a pair if neither side could see the other.
+	rejectmatrix = Z_Calloc(size, PU_LEVEL, NULL);
+	for (a = 0; a < numsectors; a++)
+		for (b = 0; b < numsectors; b++)
+		{
+			if (rejectvis[a*rejectrowbytes + (b>>3)] & (1<<(b&7))
+			|| rejectvis[b*rejectrowbytes + (a>>3)] & (1<<(a&7)))
+				continue;
+			pnum = a*numsectors + b;
+			rejectmatrix[pnum>>3] |= 1<<(pnum&7);
+		}
+
+	for (i = 0; i <= numworkers; i++)
+		Z_Free(work[i].onpath);
+	Z_Free(rejectvis);
+	rejectvis = NULL;
+
+	P_AddLevelCacheSection("REJT", rejectmatrix, size);
+	P_RejectFreePortals();
+
+	CONS_Debug(DBG_SETUP, "P_BuildRejectMatrix: %s sectors, %d portals, took %f seconds\n",
+		sizeu1(numsectors), numrejectportals, (float)(I_GetTime() - starttime)/NEWTICRATE);
+}
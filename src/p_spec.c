@@ -2295,6 +2295,9 @@ static void P_ProcessLineSpecial(line_t *line, mobj_t *mo, sector_t *callsec)
 
 	I_Assert(!mo || !P_MobjWasRemoved(mo)); // If mo is there, mo must be valid!
 
+	// Just about any of these can move sectors, FOFs or polyobjects
+	P_InvalidateSightCache();
+
 	if (mo && mo->player && botingame)
 		bot = players[secondarydisplayplayer].mo;
 
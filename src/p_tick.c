@@ -26,6 +26,7 @@
 #include "r_main.h"
 #include "r_fps.h"
 #include "i_video.h" // rendermode
+#include "d_netcmd.h" // cv_groupmobjthinkers, cv_perfstats
 
 // Object place
 #include "m_cheat.h"
@@ -392,6 +393,88 @@ mobj_t *P_SetTarget2(mobj_t **mop, mobj_t *targ
 	return targ;
 }
 
+//
+// P_GroupMobjThinkers
+//
+// Reorders the mobj thinker list so that mobjs of the same type think back to
+// back, which keeps the same code and mobjinfo hot in the cache.
+//
+// This is a stable bucket sort: mobjs keep their relative order within a
+// type, and types run in ascending mobjtype_t order. The new order only
+// depends on the old order and each mobj's type, so every node in a netgame
+// and every demo playback arrives at the same one, as long as they all agree
+// on cv_groupmobjthinkers (it is a netvar, and is saved in demos).
+//
+// Mobjs spawned during the tic are still appended to the end of the list and
+// think in that same tic, as before; they get grouped on the next one.
+//
+static void P_GroupMobjThinkers(void)
+{
+	static thinker_t *heads[NUMMOBJTYPES], *tails[NUMMOBJTYPES];
+	thinker_t *list = &thlist[THINK_MOBJ];
+	thinker_t *th, *prev;
+	size_t type;
+
+	for (th = list->next; th != list; th = th->next)
+	{
+		type = ((mobj_t *)th)->type;
+		if (tails[type])
+			tails[type]->next = th;
+		else
+			heads[type] = th;
+		tails[type] = th;
+	}
+
+	prev = list;
+	for (type = 0; type < NUMMOBJTYPES; type++)
+	{
+		if (!heads[type])
+			continue;
+
+		prev->next = heads[type];
+		heads[type]->prev = prev;
+		for (th = heads[type]; th != tails[type]; th = th->next)
+			th->next->prev = th;
+
+		prev = tails[type];
+		heads[type] = tails[type] = NULL;
+	}
+	prev->next = list;
+	list->prev = prev;
+}
+
+//
+// P_RunMobjThinkersTimed
+//
+// Same as running the mobj thinker list normally, but charges the time
+// each mobj spends thinking to its type, for perfstats.
+//
+static void P_RunMobjThinkersTimed(void)
+{
+	thinker_t *list = &thlist[THINK_MOBJ];
+
+	PS_ResetMobjTypeStats();
+
+	for (currentthinker = list->next; currentthinker != list; currentthinker = currentthinker->next)
+	{
+		// Read these now, the thinker may free itself.
+		const boolean ismobj = (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker);
+		const mobjtype_t type = ((mobj_t *)currentthinker)->type;
+		precise_t start = I_GetPreciseTime();
+
+#ifdef PARANOIA
+		I_Assert(currentthinker->function.acp1 != NULL);
+#endif
+		currentthinker->function.acp1(currentthinker);
+
+		if (ismobj)
+		{
+			ps_mobjtype_times[type].value.p += I_GetPreciseTime() - start;
+			ps_mobjtype_counts[type]++;
+		}
+	}
+}
+
 //
 // P_RunThinkers
 //
@@ -420,6 +503,18 @@ static inline void P_RunThinkers(void)
 	for (i = 0; i < NUM_THINKERLISTS; i++)
 	{
 		PS_START_TIMING(ps_thlist_times[i]);
+		if (i == THINK_MOBJ && cv_groupmobjthinkers.value)
+			P_GroupMobjThinkers();
+		if (i == THINK_MOBJ)
+			P_StartSightCache();
+		if (i == THINK_MOBJ && cv_perfstats.value == 4)
+		{
+			P_RunMobjThinkersTimed();
+			P_StopSightCache();
+			LUA_HookMobjThinkerBatch();
+			PS_STOP_TIMING(ps_thlist_times[i]);
+			continue;
+		}
 		for (currentthinker = thlist[i].next; currentthinker != &thlist[i]; currentthinker = currentthinker->next)
 		{
 #ifdef PARANOIA
@@ -427,6 +522,12 @@ static inline void P_RunThinkers(void)
 #endif
 			currentthinker->function.acp1(currentthinker);
 		}
+		if (i == THINK_MOBJ)
+		{
+			P_StopSightCache();
+			// batched mobj hooks run once the whole mobj list has thought
+			LUA_HookMobjThinkerBatch();
+		}
 		PS_STOP_TIMING(ps_thlist_times[i]);
 	}
 
@@ -755,6 +856,8 @@ void P_Ticker(boolean run)
 
 		ps_lua_mobjhooks.value.i = 0;
 		ps_checkposition_calls.value.i = 0;
+		ps_sightcache_hits.value.i = 0;
+		ps_sightcache_misses.value.i = 0;
 
 		LUA_HOOK(PreThinkFrame);
 
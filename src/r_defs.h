@@ -494,6 +494,8 @@ typedef struct sector_s
 
 	// colormap structure
 	extracolormap_t *spawn_extra_colormap;
+
+	INT32 luahandle; // Lua userdata reference, see LUA_PushUserdataHandle
 } sector_t;
 
 //
@@ -548,6 +550,8 @@ typedef struct line_s
 	polyobj_t *polyobj; // Belongs to a polyobject?
 
 	INT16 callcount; // no. of calls left before triggering, for the "X calls" linedef specials, defaults to 0
+
+	INT32 luahandle; // Lua userdata reference, see LUA_PushUserdataHandle
 } line_t;
 
 typedef struct
@@ -576,6 +580,8 @@ typedef struct
 	INT16 repeatcnt; // # of times to repeat midtexture
 
 	extracolormap_t *colormap_data; // storage for colormaps; not applied to sectors.
+
+	INT32 luahandle; // Lua userdata reference, see LUA_PushUserdataHandle
 } side_t;
 
 //
@@ -591,6 +597,8 @@ typedef struct subsector_s
 	UINT32 firstline;
 	struct polyobj_s *polyList; // haleyjd 02/19/06: list of polyobjects
 	size_t validcount;
+
+	INT32 luahandle; // Lua userdata reference, see LUA_PushUserdataHandle
 } subsector_t;
 
 // Sector list node showing all sectors an object appears in.
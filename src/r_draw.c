@@ -19,6 +19,7 @@
 #include "doomstat.h"
 #include "r_local.h"
 #include "st_stuff.h" // need ST_HEIGHT
+#include "i_system.h" // I_GetPreciseTime, used by -benchdraw
 #include "i_video.h"
 #include "v_video.h"
 #include "m_misc.h"
@@ -27,6 +28,16 @@
 #include "console.h" // Until buffering gets finished
 #include "libdivide.h" // used by NPO2 tilted span functions
 
+#ifdef R_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef R_SIMD_AVX2
+#include <immintrin.h>
+#endif
+#ifdef R_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
 #ifdef HWRENDER
 #include "hardware/hw_main.h"
 #endif
@@ -62,13 +73,13 @@ UINT8 *topleft;
 //                      COLUMN DRAWING CODE STUFF
 // =========================================================================
 
-lighttable_t *dc_colormap;
-INT32 dc_x = 0, dc_yl = 0, dc_yh = 0;
+DRAWSTATE lighttable_t *dc_colormap;
+DRAWSTATE INT32 dc_x = 0, dc_yl = 0, dc_yh = 0;
 
-fixed_t dc_iscale, dc_texturemid;
+DRAWSTATE fixed_t dc_iscale, dc_texturemid;
 UINT8 dc_hires; // under MSVC boolean is a byte, while on other systems, it a bit,
                // soo lets make it a byte on all system for the ASM code
-UINT8 *dc_source;
+DRAWSTATE UINT8 *dc_source;
 
 // -----------------------
 // translucency stuff here
@@ -91,25 +102,26 @@ UINT8 *dc_transmap; // one of the translucency tables
 */
 UINT8 *dc_translation;
 
-struct r_lightlist_s *dc_lightlist = NULL;
-INT32 dc_numlights = 0, dc_maxlights, dc_texheight;
+DRAWSTATE struct r_lightlist_s *dc_lightlist = NULL;
+DRAWSTATE INT32 dc_numlights = 0, dc_texheight;
+INT32 dc_maxlights;
 
 // =========================================================================
 //                      SPAN DRAWING CODE STUFF
 // =========================================================================
 
-INT32 ds_y, ds_x1, ds_x2;
-lighttable_t *ds_colormap;
+DRAWSTATE INT32 ds_y, ds_x1, ds_x2;
+DRAWSTATE lighttable_t *ds_colormap;
 lighttable_t *ds_translation; // Lactozilla: Sprite splat drawer
 
-fixed_t ds_xfrac, ds_yfrac, ds_xstep, ds_ystep;
-INT32 ds_waterofs, ds_bgofs;
+DRAWSTATE fixed_t ds_xfrac, ds_yfrac, ds_xstep, ds_ystep;
+DRAWSTATE INT32 ds_waterofs, ds_bgofs;
 
-UINT16 ds_flatwidth, ds_flatheight;
+DRAWSTATE UINT16 ds_flatwidth, ds_flatheight;
 boolean ds_powersoftwo, ds_solidcolor;
 
-UINT8 *ds_source; // points to the start of a flat
-UINT8 *ds_transmap; // one of the translucency tables
+DRAWSTATE UINT8 *ds_source; // points to the start of a flat
+DRAWSTATE UINT8 *ds_transmap; // one of the translucency tables
 
 // Vectors for Software's tilted slope drawers
 floatv3_t *ds_su, *ds_sv, *ds_sz;
@@ -119,7 +131,7 @@ float focallengthf, zeroheight;
 /**	\brief Variable flat sizes
 */
 
-UINT32 nflatxshift, nflatyshift, nflatshiftup, nflatmask;
+DRAWSTATE UINT32 nflatxshift, nflatyshift, nflatshiftup, nflatmask;
 
 // =========================================================================
 //                   TRANSLATION COLORMAP CODE
@@ -923,6 +935,7 @@ static void R_CalcTiltedLighting(fixed_t start, fixed_t end)
 
 #include "r_draw8.c"
 #include "r_draw8_npo2.c"
+#include "r_draw8_simd.c"
 
 // ==========================================================================
 //                   INCLUDE 16bpp DRAWING CODE HERE
@@ -931,3 +944,194 @@ static void R_CalcTiltedLighting(fixed_t start, fixed_t end)
 #ifdef HIGHCOLOR
 #include "r_draw16.c"
 #endif
+
+// ==========================================================================
+//                   SPAN DRAWER BENCHMARK (-benchdraw)
+// ==========================================================================
+
+typedef struct
+{
+	const char *name;
+	void (*span)(void);
+	void (*transspan)(void);
+	void (*tiltedspan)(void);
+} benchdrawers_t;
+
+#define BENCHDRAWFRAMES 200
+
+static lighttable_t benchcolormap[256];
+static lighttable_t *benchzlight[MAXLIGHTSCALE];
+static floatv3_t benchszp, benchsup, benchsvp;
+
+// Draws every row of the screen with the given drawer.
+static void R_BenchDrawFrame(void (*func)(void), INT32 frame)
+{
+	INT32 y;
+
+	for (y = 0; y < vid.height; y++)
+	{
+		ds_y = y;
+		ds_x1 = 0;
+		ds_x2 = vid.width - 1;
+		ds_xfrac = (y + frame) * 0x3243F;
+		ds_yfrac = y * 0x1921F - frame * 0x2B7E1;
+		ds_xstep = FRACUNIT/3 + y * 97;
+		ds_ystep = FRACUNIT/5 - y * 61;
+		func();
+	}
+}
+
+// Draws one frame with func and keeps a copy of it.
+static void R_BenchDrawReference(void (*func)(void), UINT8 *out)
+{
+	memset(screens[0], 0, vid.width * vid.height);
+	R_BenchDrawFrame(func, 0);
+	M_Memcpy(out, screens[0], vid.width * vid.height);
+}
+
+// Times func, and checks its first frame against the reference.
+static void R_BenchDrawer(const char *kind, const char *name, void (*func)(void), const UINT8 *reference)
+{
+	const size_t size = vid.width * vid.height;
+	boolean match;
+	precise_t start;
+	double ms;
+	INT32 i;
+
+	memset(screens[0], 0, size);
+	R_BenchDrawFrame(func, 0);
+	match = !memcmp(screens[0], reference, size);
+
+	start = I_GetPreciseTime();
+	for (i = 0; i < BENCHDRAWFRAMES; i++)
+		R_BenchDrawFrame(func, i);
+	ms = (double)(I_GetPreciseTime() - start) * 1000.0 / I_GetPrecisePrecision() / BENCHDRAWFRAMES;
+
+	CONS_Printf("%-12s %-6s %8.3f ms/frame %8.1f Mpixels/s  %s\n", kind, name, ms,
+		(ms > 0.0) ? size / (ms * 1000.0) : 0.0, match ? "ok" : "MISMATCH");
+}
+
+/**	\brief	The R_BenchmarkDrawers function
+
+	Times every variant of the flat span drawers on an offscreen buffer,
+	and checks that each one draws exactly what the plain C drawer does.
+	Used by -benchdraw.
+
+	\param	width	width of the buffer
+	\param	height	height of the buffer
+
+	\return	void
+*/
+void R_BenchmarkDrawers(INT32 width, INT32 height)
+{
+	benchdrawers_t drawers[4];
+	INT32 numdrawers = 0;
+	viddef_t oldvid = vid;
+	UINT8 *oldscreen = screens[0];
+	lighttable_t *oldcolormaps = colormaps, **oldzlight = planezlight;
+	float oldzeroheight = zeroheight;
+	UINT8 *flat, *transmap, *reference[3];
+	UINT32 seed = 0x2545F491;
+	INT32 i, d;
+
+	width = min(max(width, 8), MAXVIDWIDTH);
+	height = min(max(height, 1), MAXVIDHEIGHT);
+
+	drawers[numdrawers].name = "C";
+	drawers[numdrawers].span = R_DrawSpan_8;
+	drawers[numdrawers].transspan = R_DrawTranslucentSpan_8;
+	drawers[numdrawers++].tiltedspan = R_DrawTiltedSpan_8;
+#ifdef R_SIMD_SSE2
+	drawers[numdrawers].name = "SSE2";
+	drawers[numdrawers].span = R_DrawSpan_8_SSE2;
+	drawers[numdrawers].transspan = R_DrawTranslucentSpan_8_SSE2;
+	drawers[numdrawers++].tiltedspan = R_DrawTiltedSpan_8_SSE2;
+#endif
+#ifdef R_SIMD_AVX2
+	if (R_AVX2)
+	{
+		drawers[numdrawers].name = "AVX2";
+		drawers[numdrawers].span = R_DrawSpan_8_AVX2;
+		drawers[numdrawers].transspan = R_DrawTranslucentSpan_8_AVX2;
+		drawers[numdrawers++].tiltedspan = R_DrawTiltedSpan_8_AVX2;
+	}
+#endif
+#ifdef R_SIMD_NEON
+	drawers[numdrawers].name = "NEON";
+	drawers[numdrawers].span = R_DrawSpan_8_NEON;
+	drawers[numdrawers].transspan = R_DrawTranslucentSpan_8_NEON;
+	drawers[numdrawers++].tiltedspan = R_DrawTiltedSpan_8_NEON;
+#endif
+
+	// Made-up flat, colormap and translucency table, so this doesn't need any game data
+	flat = Z_Malloc(256*256, PU_STATIC, NULL);
+	transmap = Z_Malloc(256*256, PU_STATIC, NULL);
+	for (i = 0; i < 256*256; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		flat[i] = (UINT8)(seed >> 24);
+		transmap[i] = (UINT8)(seed >> 16);
+	}
+	for (i = 0; i < 256; i++)
+		benchcolormap[i] = (lighttable_t)(255 - i);
+	for (i = 0; i < MAXLIGHTSCALE; i++)
+		benchzlight[i] = benchcolormap;
+
+	// Draw into a buffer of our own, as if it were the screen
+	vid.width = width;
+	vid.height = height;
+	vid.rowbytes = width;
+	screens[0] = Z_Malloc(width * height, PU_STATIC, NULL);
+	for (i = 0; i < height; i++)
+		ylookup[i] = screens[0] + i*width;
+	for (i = 0; i < width; i++)
+		columnofs[i] = i;
+
+	ds_source = flat;
+	ds_transmap = transmap;
+	ds_colormap = colormaps = benchcolormap;
+	planezlight = benchzlight;
+	zeroheight = 1.0f;
+	R_SetFlatVars(256*256);
+
+	benchszp.x = 1.0e-5f; benchszp.y = 2.0e-5f; benchszp.z = 1.0f;
+	benchsup.x = 0.7f*FRACUNIT; benchsup.y = 0.1f*FRACUNIT; benchsup.z = 0.0f;
+	benchsvp.x = -0.2f*FRACUNIT; benchsvp.y = 0.9f*FRACUNIT; benchsvp.z = 0.0f;
+	ds_szp = &benchszp;
+	ds_sup = &benchsup;
+	ds_svp = &benchsvp;
+
+	CONS_Printf("Span drawer benchmark, %dx%d, %d frames each:\n", vid.width, vid.height, BENCHDRAWFRAMES);
+
+	for (i = 0; i < 3; i++)
+		reference[i] = Z_Malloc(width * height, PU_STATIC, NULL);
+	R_BenchDrawReference(drawers[0].span, reference[0]);
+	R_BenchDrawReference(drawers[0].transspan, reference[1]);
+	R_BenchDrawReference(drawers[0].tiltedspan, reference[2]);
+
+	for (d = 0; d < numdrawers; d++)
+	{
+		R_BenchDrawer("span", drawers[d].name, drawers[d].span, reference[0]);
+		R_BenchDrawer("transspan", drawers[d].name, drawers[d].transspan, reference[1]);
+		R_BenchDrawer("tiltedspan", drawers[d].name, drawers[d].tiltedspan, reference[2]);
+	}
+
+	for (i = 0; i < 3; i++)
+		Z_Free(reference[i]);
+	Z_Free(flat);
+	Z_Free(transmap);
+	Z_Free(screens[0]);
+
+	// The view buffer tables get rebuilt on the next R_ExecuteSetViewSize
+	vid = oldvid;
+	screens[0] = oldscreen;
+	setsizeneeded = true;
+	colormaps = oldcolormaps;
+	planezlight = oldzlight;
+	zeroheight = oldzeroheight;
+	ds_source = NULL;
+	ds_transmap = NULL;
+	ds_colormap = NULL;
+}
+
+#undef BENCHDRAWFRAMES
@@ -29,12 +29,20 @@ extern UINT8 *topleft;
 // COLUMN DRAWING CODE STUFF
 // -------------------------
 
-extern lighttable_t *dc_colormap;
-extern INT32 dc_x, dc_yl, dc_yh;
-extern fixed_t dc_iscale, dc_texturemid;
+// The state read by the wall column and flat span drawers is per thread,
+// so r_threads workers can draw what was queued (see R_DrawInBands).
+#ifdef HAVE_THREADS
+#define DRAWSTATE ATTRTHREADLOCAL
+#else
+#define DRAWSTATE
+#endif
+
+extern DRAWSTATE lighttable_t *dc_colormap;
+extern DRAWSTATE INT32 dc_x, dc_yl, dc_yh;
+extern DRAWSTATE fixed_t dc_iscale, dc_texturemid;
 extern UINT8 dc_hires;
 
-extern UINT8 *dc_source; // first pixel in a column
+extern DRAWSTATE UINT8 *dc_source; // first pixel in a column
 
 // translucency stuff here
 extern UINT8 *dc_transmap;
@@ -43,28 +51,29 @@ extern UINT8 *dc_transmap;
 
 extern UINT8 *dc_translation;
 
-extern struct r_lightlist_s *dc_lightlist;
-extern INT32 dc_numlights, dc_maxlights;
+extern DRAWSTATE struct r_lightlist_s *dc_lightlist;
+extern DRAWSTATE INT32 dc_numlights;
+extern INT32 dc_maxlights;
 
 //Fix TUTIFRUTI
-extern INT32 dc_texheight;
+extern DRAWSTATE INT32 dc_texheight;
 
 // -----------------------
 // SPAN DRAWING CODE STUFF
 // -----------------------
 
-extern INT32 ds_y, ds_x1, ds_x2;
-extern lighttable_t *ds_colormap;
+extern DRAWSTATE INT32 ds_y, ds_x1, ds_x2;
+extern DRAWSTATE lighttable_t *ds_colormap;
 extern lighttable_t *ds_translation;
 
-extern fixed_t ds_xfrac, ds_yfrac, ds_xstep, ds_ystep;
-extern INT32 ds_waterofs, ds_bgofs;
+extern DRAWSTATE fixed_t ds_xfrac, ds_yfrac, ds_xstep, ds_ystep;
+extern DRAWSTATE INT32 ds_waterofs, ds_bgofs;
 
-extern UINT16 ds_flatwidth, ds_flatheight;
+extern DRAWSTATE UINT16 ds_flatwidth, ds_flatheight;
 extern boolean ds_powersoftwo, ds_solidcolor;
 
-extern UINT8 *ds_source;
-extern UINT8 *ds_transmap;
+extern DRAWSTATE UINT8 *ds_source;
+extern DRAWSTATE UINT8 *ds_transmap;
 
 typedef struct {
 	float x, y, z;
@@ -76,10 +85,10 @@ extern floatv3_t *ds_sup, *ds_svp, *ds_szp;
 extern float focallengthf, zeroheight;
 
 // Variable flat sizes
-extern UINT32 nflatxshift;
-extern UINT32 nflatyshift;
-extern UINT32 nflatshiftup;
-extern UINT32 nflatmask;
+extern DRAWSTATE UINT32 nflatxshift;
+extern DRAWSTATE UINT32 nflatyshift;
+extern DRAWSTATE UINT32 nflatshiftup;
+extern DRAWSTATE UINT32 nflatmask;
 
 /// \brief Top border
 #define BRDR_T 0
@@ -218,6 +227,30 @@ void R_DrawTiltedTranslucentFloorSprite_NPO2_8(void);
 void R_DrawWaterSpan_NPO2_8(void);
 void R_DrawTiltedWaterSpan_NPO2_8(void);
 
+// Span drawers that work out several texels at a time
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define R_SIMD_SSE2
+void R_DrawSpan_8_SSE2(void);
+void R_DrawTranslucentSpan_8_SSE2(void);
+void R_DrawTiltedSpan_8_SSE2(void);
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define R_SIMD_AVX2
+void R_DrawSpan_8_AVX2(void);
+void R_DrawTranslucentSpan_8_AVX2(void);
+void R_DrawTiltedSpan_8_AVX2(void);
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define R_SIMD_NEON
+void R_DrawSpan_8_NEON(void);
+void R_DrawTranslucentSpan_8_NEON(void);
+void R_DrawTiltedSpan_8_NEON(void);
+#endif
+
+void R_BenchmarkDrawers(INT32 width, INT32 height);
+
 void R_DrawSolidColorSpan_8(void);
 void R_DrawTransSolidColorSpan_8(void);
 void R_DrawTiltedSolidColorSpan_8(void);
@@ -0,0 +1,122 @@
+// SONIC ROBO BLAST 2
+//-----------------------------------------------------------------------------
+// Copyright (C) 1999-2023 by Sonic Team Junior.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  r_draw8_simd.c
+/// \brief 8bpp span drawers that work out texel offsets several pixels at a time
+/// \note  no includes because this is included as part of r_draw.c
+///
+///        Each instruction set gets its own R_CalcSpanIndices, which fills
+///        an array with the flat offsets of the next pixels in a span, a
+///        multiple of 8 at a time. The drawers themselves live in
+///        r_draw8_simdspan.c, which is included once per instruction set
+///        below. Texel and colormap fetches stay scalar: the tables are
+///        bytes, and a 32-bit gather would read past the end of them.
+
+#if defined(R_SIMD_SSE2) || defined(R_SIMD_AVX2) || defined(R_SIMD_NEON)
+
+// ==========================================================================
+// SSE2
+// ==========================================================================
+
+#ifdef R_SIMD_SSE2
+static inline void R_CalcSpanIndices_SSE2(UINT32 *idx, UINT32 u, UINT32 v, UINT32 stepu, UINT32 stepv, INT32 count)
+{
+	const __m128i xshift = _mm_cvtsi32_si128(nflatxshift);
+	const __m128i yshift = _mm_cvtsi32_si128(nflatyshift);
+	const __m128i mask = _mm_set1_epi32(nflatmask);
+	const __m128i ustep = _mm_set1_epi32(stepu*4);
+	const __m128i vstep = _mm_set1_epi32(stepv*4);
+	__m128i uvec = _mm_setr_epi32(u, u + stepu, u + stepu*2, u + stepu*3);
+	__m128i vvec = _mm_setr_epi32(v, v + stepv, v + stepv*2, v + stepv*3);
+
+	for (; count > 0; count -= 4, idx += 4)
+	{
+		__m128i spot = _mm_and_si128(_mm_srl_epi32(vvec, yshift), mask);
+		spot = _mm_or_si128(spot, _mm_srl_epi32(uvec, xshift));
+		_mm_storeu_si128((__m128i *)idx, spot);
+		uvec = _mm_add_epi32(uvec, ustep);
+		vvec = _mm_add_epi32(vvec, vstep);
+	}
+}
+
+#define SIMD(fn) fn##_SSE2
+#define SIMDTARGET
+#include "r_draw8_simdspan.c"
+#undef SIMD
+#undef SIMDTARGET
+#endif
+
+// ==========================================================================
+// AVX2
+// ==========================================================================
+
+#ifdef R_SIMD_AVX2
+__attribute__((target("avx2")))
+static inline void R_CalcSpanIndices_AVX2(UINT32 *idx, UINT32 u, UINT32 v, UINT32 stepu, UINT32 stepv, INT32 count)
+{
+	const __m128i xshift = _mm_cvtsi32_si128(nflatxshift);
+	const __m128i yshift = _mm_cvtsi32_si128(nflatyshift);
+	const __m256i mask = _mm256_set1_epi32(nflatmask);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256i ustep = _mm256_set1_epi32(stepu*8);
+	const __m256i vstep = _mm256_set1_epi32(stepv*8);
+	__m256i uvec = _mm256_add_epi32(_mm256_set1_epi32(u), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(stepu)));
+	__m256i vvec = _mm256_add_epi32(_mm256_set1_epi32(v), _mm256_mullo_epi32(lanes, _mm256_set1_epi32(stepv)));
+
+	for (; count > 0; count -= 8, idx += 8)
+	{
+		__m256i spot = _mm256_and_si256(_mm256_srl_epi32(vvec, yshift), mask);
+		spot = _mm256_or_si256(spot, _mm256_srl_epi32(uvec, xshift));
+		_mm256_storeu_si256((__m256i *)idx, spot);
+		uvec = _mm256_add_epi32(uvec, ustep);
+		vvec = _mm256_add_epi32(vvec, vstep);
+	}
+}
+
+#define SIMD(fn) fn##_AVX2
+#define SIMDTARGET __attribute__((target("avx2")))
+#include "r_draw8_simdspan.c"
+#undef SIMD
+#undef SIMDTARGET
+#endif
+
+// ==========================================================================
+// NEON
+// ==========================================================================
+
+#ifdef R_SIMD_NEON
+static inline void R_CalcSpanIndices_NEON(UINT32 *idx, UINT32 u, UINT32 v, UINT32 stepu, UINT32 stepv, INT32 count)
+{
+	// NEON only shifts left by a register, so shift by a negative amount
+	const int32x4_t xshift = vdupq_n_s32(-(INT32)nflatxshift);
+	const int32x4_t yshift = vdupq_n_s32(-(INT32)nflatyshift);
+	const uint32x4_t mask = vdupq_n_u32(nflatmask);
+	const UINT32 lanes[4] = {0, 1, 2, 3};
+	const uint32x4_t ustep = vdupq_n_u32(stepu*4);
+	const uint32x4_t vstep = vdupq_n_u32(stepv*4);
+	uint32x4_t uvec = vmlaq_n_u32(vdupq_n_u32(u), vld1q_u32(lanes), stepu);
+	uint32x4_t vvec = vmlaq_n_u32(vdupq_n_u32(v), vld1q_u32(lanes), stepv);
+
+	for (; count > 0; count -= 4, idx += 4)
+	{
+		uint32x4_t spot = vandq_u32(vshlq_u32(vvec, yshift), mask);
+		spot = vorrq_u32(spot, vshlq_u32(uvec, xshift));
+		vst1q_u32(idx, spot);
+		uvec = vaddq_u32(uvec, ustep);
+		vvec = vaddq_u32(vvec, vstep);
+	}
+}
+
+#define SIMD(fn) fn##_NEON
+#define SIMDTARGET
+#include "r_draw8_simdspan.c"
+#undef SIMD
+#undef SIMDTARGET
+#endif
+
+#endif // R_SIMD_SSE2 || R_SIMD_AVX2 || R_SIMD_NEON
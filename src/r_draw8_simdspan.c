@@ -0,0 +1,211 @@
+// SONIC ROBO BLAST 2
+//-----------------------------------------------------------------------------
+// Copyright (C) 1999-2023 by Sonic Team Junior.
+//
+// This program is free software distributed under the
+// terms of the GNU General Public License, version 2.
+// See the 'LICENSE' file for more details.
+//-----------------------------------------------------------------------------
+/// \file  r_draw8_simdspan.c
+/// \brief 8bpp span drawers shared by every instruction set in r_draw8_simd.c
+/// \note  no includes because this is included as part of r_draw8_simd.c,
+///        with SIMD(fn) naming the variant and SIMDTARGET its function attributes
+///
+///        These match the plain drawers in r_draw8.c pixel for pixel.
+
+/**	\brief The R_DrawSpan_8 function, SIMD variant
+	Draws the actual span.
+*/
+SIMDTARGET void SIMD(R_DrawSpan_8) (void)
+{
+	UINT32 xposition;
+	UINT32 yposition;
+	UINT32 xstep, ystep;
+	UINT32 idx[8];
+
+	UINT8 *source;
+	UINT8 *colormap;
+	UINT8 *dest;
+	const UINT8 *deststop = screens[0] + vid.rowbytes * vid.height;
+
+	size_t count = (ds_x2 - ds_x1 + 1);
+
+	xposition = (UINT32)ds_xfrac << nflatshiftup; yposition = (UINT32)ds_yfrac << nflatshiftup;
+	xstep = (UINT32)ds_xstep << nflatshiftup; ystep = (UINT32)ds_ystep << nflatshiftup;
+
+	source = ds_source;
+	colormap = ds_colormap;
+	dest = ylookup[ds_y] + columnofs[ds_x1];
+
+	if (dest+8 > deststop)
+		return;
+
+	while (count >= 8)
+	{
+		SIMD(R_CalcSpanIndices)(idx, xposition, yposition, xstep, ystep, 8);
+		dest[0] = colormap[source[idx[0]]];
+		dest[1] = colormap[source[idx[1]]];
+		dest[2] = colormap[source[idx[2]]];
+		dest[3] = colormap[source[idx[3]]];
+		dest[4] = colormap[source[idx[4]]];
+		dest[5] = colormap[source[idx[5]]];
+		dest[6] = colormap[source[idx[6]]];
+		dest[7] = colormap[source[idx[7]]];
+		xposition += xstep*8;
+		yposition += ystep*8;
+
+		dest += 8;
+		count -= 8;
+	}
+	while (count-- && dest <= deststop)
+	{
+		*dest++ = colormap[source[((yposition >> nflatyshift) & nflatmask) | (xposition >> nflatxshift)]];
+		xposition += xstep;
+		yposition += ystep;
+	}
+}
+
+/**	\brief The R_DrawTranslucentSpan_8 function, SIMD variant
+	Draws the actual span with translucency.
+*/
+SIMDTARGET void SIMD(R_DrawTranslucentSpan_8) (void)
+{
+	UINT32 xposition;
+	UINT32 yposition;
+	UINT32 xstep, ystep;
+	UINT32 idx[8];
+	INT32 i;
+
+	UINT8 *source;
+	UINT8 *colormap;
+	UINT8 *dest;
+	const UINT8 *deststop = screens[0] + vid.rowbytes * vid.height;
+
+	size_t count = (ds_x2 - ds_x1 + 1);
+
+	xposition = (UINT32)ds_xfrac << nflatshiftup; yposition = (UINT32)ds_yfrac << nflatshiftup;
+	xstep = (UINT32)ds_xstep << nflatshiftup; ystep = (UINT32)ds_ystep << nflatshiftup;
+
+	source = ds_source;
+	colormap = ds_colormap;
+	dest = ylookup[ds_y] + columnofs[ds_x1];
+
+	while (count >= 8)
+	{
+		SIMD(R_CalcSpanIndices)(idx, xposition, yposition, xstep, ystep, 8);
+		for (i = 0; i < 8; i++)
+			dest[i] = *(ds_transmap + (colormap[source[idx[i]]] << 8) + dest[i]);
+		xposition += xstep*8;
+		yposition += ystep*8;
+
+		dest += 8;
+		count -= 8;
+	}
+	while (count-- && dest <= deststop)
+	{
+		*dest = *(ds_transmap + (colormap[source[((yposition >> nflatyshift) & nflatmask) | (xposition >> nflatxshift)]] << 8) + *dest);
+		dest++;
+		xposition += xstep;
+		yposition += ystep;
+	}
+}
+
+/**	\brief The R_DrawTiltedSpan_8 function, SIMD variant
+	Draw slopes! Holy sheit!
+*/
+SIMDTARGET void SIMD(R_DrawTiltedSpan_8) (void)
+{
+	// x1, x2 = ds_x1, ds_x2
+	int width = ds_x2 - ds_x1;
+	double iz, uz, vz;
+	UINT32 u, v;
+	UINT32 idx[SPANSIZE];
+	int i;
+
+	UINT8 *source;
+	UINT8 *colormap;
+	UINT8 *dest;
+
+	double startz, startu, startv;
+	double izstep, uzstep, vzstep;
+	double endz, endu, endv;
+	UINT32 stepu, stepv;
+
+	iz = ds_szp->z + ds_szp->y*(centery-ds_y) + ds_szp->x*(ds_x1-centerx);
+
+	CALC_SLOPE_LIGHT
+
+	uz = ds_sup->z + ds_sup->y*(centery-ds_y) + ds_sup->x*(ds_x1-centerx);
+	vz = ds_svp->z + ds_svp->y*(centery-ds_y) + ds_svp->x*(ds_x1-centerx);
+
+	dest = ylookup[ds_y] + columnofs[ds_x1];
+	source = ds_source;
+
+	startz = 1.f/iz;
+	startu = uz*startz;
+	startv = vz*startz;
+
+	izstep = ds_szp->x * SPANSIZE;
+	uzstep = ds_sup->x * SPANSIZE;
+	vzstep = ds_svp->x * SPANSIZE;
+	width++;
+
+	while (width >= SPANSIZE)
+	{
+		iz += izstep;
+		uz += uzstep;
+		vz += vzstep;
+
+		endz = 1.f/iz;
+		endu = uz*endz;
+		endv = vz*endz;
+		stepu = (INT64)((endu - startu) * INVSPAN);
+		stepv = (INT64)((endv - startv) * INVSPAN);
+		u = (INT64)(startu);
+		v = (INT64)(startv);
+
+		SIMD(R_CalcSpanIndices)(idx, u, v, stepu, stepv, SPANSIZE);
+		for (i = 0; i < SPANSIZE; i++)
+		{
+			colormap = planezlight[tiltlighting[ds_x1++]] + (ds_colormap - colormaps);
+			*dest++ = colormap[source[idx[i]]];
+		}
+		startu = endu;
+		startv = endv;
+		width -= SPANSIZE;
+	}
+	if (width > 0)
+	{
+		if (width == 1)
+		{
+			u = (INT64)(startu);
+			v = (INT64)(startv);
+			colormap = planezlight[tiltlighting[ds_x1++]] + (ds_colormap - colormaps);
+			*dest = colormap[source[((v >> nflatyshift) & nflatmask) | (u >> nflatxshift)]];
+		}
+		else
+		{
+			double left = width;
+			iz += ds_szp->x * left;
+			uz += ds_sup->x * left;
+			vz += ds_svp->x * left;
+
+			endz = 1.f/iz;
+			endu = uz*endz;
+			endv = vz*endz;
+			left = 1.f/left;
+			stepu = (INT64)((endu - startu) * left);
+			stepv = (INT64)((endv - startv) * left);
+			u = (INT64)(startu);
+			v = (INT64)(startv);
+
+			// width is below SPANSIZE here, so rounding up to 8 still fits in idx
+			SIMD(R_CalcSpanIndices)(idx, u, v, stepu, stepv, (width + 7) & ~7);
+			for (i = 0; i < width; i++)
+			{
+				colormap = planezlight[tiltlighting[ds_x1++]] + (ds_colormap - colormaps);
+				*dest++ = colormap[source[idx[i]]];
+			}
+		}
+	}
+}
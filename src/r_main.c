@@ -36,6 +36,9 @@
 #include "r_main.h"
 #include "i_system.h" // I_GetPreciseTime
 #include "r_fps.h" // Frame interpolation/uncapped
+#ifdef HAVE_THREADS
+#include "i_threads.h"
+#endif
 
 #ifdef HWRENDER
 #include "hardware/hw_main.h"
@@ -105,6 +108,7 @@ ps_metric_t ps_bsptime = {0};
 
 ps_metric_t ps_sw_spritecliptime = {0};
 ps_metric_t ps_sw_portaltime = {0};
+ps_metric_t ps_sw_walltime = {0};
 ps_metric_t ps_sw_planetime = {0};
 ps_metric_t ps_sw_maskedtime = {0};
 
@@ -130,12 +134,18 @@ static CV_PossibleValue_t fov_cons_t[] = {{60*FRACUNIT, "MIN"}, {179*FRACUNIT, "
 static CV_PossibleValue_t translucenthud_cons_t[] = {{0, "MIN"}, {10, "MAX"}, {0, NULL}};
 static CV_PossibleValue_t maxportals_cons_t[] = {{0, "MIN"}, {12, "MAX"}, {0, NULL}}; // lmao rendering 32 portals, you're a card
 static CV_PossibleValue_t homremoval_cons_t[] = {{0, "No"}, {1, "Yes"}, {2, "Flash"}, {0, NULL}};
+#ifdef HAVE_THREADS
+static CV_PossibleValue_t renderthreads_cons_t[] = {{1, "MIN"}, {16, "MAX"}, {0, NULL}};
+#endif
 
 static void Fov_OnChange(void);
 static void ChaseCam_OnChange(void);
 static void ChaseCam2_OnChange(void);
 static void FlipCam_OnChange(void);
 static void FlipCam2_OnChange(void);
+#ifdef HAVE_THREADS
+static void RenderThreads_OnChange(void);
+#endif
 void SendWeaponPref(void);
 void SendWeaponPref2(void);
 
@@ -167,6 +177,150 @@ consvar_t cv_maxportals = CVAR_INIT ("maxportals", "2", CV_SAVE, maxportals_cons
 
 consvar_t cv_renderstats = CVAR_INIT ("renderstats", "Off", 0, CV_OnOff, NULL);
 
+#ifdef HAVE_THREADS
+// Threads used to draw walls, floors and ceilings in the software renderer.
+consvar_t cv_renderthreads = CVAR_INIT ("r_threads", "1", CV_SAVE|CV_CALL|CV_NOINIT, renderthreads_cons_t, RenderThreads_OnChange);
+
+static void RenderThreads_OnChange(void)
+{
+	R_SetRenderThreads(cv_renderthreads.value);
+}
+
+//
+// Threaded drawing (r_threads)
+//
+// Wall columns and flat spans are queued while the view is rendered, then
+// drawn by the main thread and the workers at once. Each thread draws one
+// band of the queue, which the queue's owner picks so that two threads
+// never draw to the same pixel: vertical strips for wall columns, and
+// interleaved rows for flat spans. Within a band everything is drawn in
+// the order it was queued, so the output is the same as with one thread.
+//
+
+#define MAXRENDERTHREADS 16
+
+static I_mutex renderthread_mutex;
+static I_cond renderthread_cond; // workers wait on this for a new batch
+static I_cond renderthread_done_cond; // main thread waits on this for workers
+static void (*renderthread_draw)(INT32 band, INT32 numbands); // draws the current batch
+static UINT32 renderthread_batch; // bumped for each batch
+static UINT32 renderthread_spawnbatch; // last batch before the workers were spawned
+static INT32 renderthread_busy; // workers still drawing the current batch
+static INT32 renderthread_alive; // workers not yet exited
+static INT32 renderthread_count; // workers, not counting the main thread
+static boolean renderthread_quit;
+
+static void R_RenderWorker(void *userdata)
+{
+	const INT32 band = (INT32)(size_t)userdata;
+	void (*draw)(INT32 band, INT32 numbands);
+	UINT32 batch;
+	INT32 numbands;
+
+	// Only the batches started after this worker was spawned count it as busy
+	I_lock_mutex(&renderthread_mutex);
+	batch = renderthread_spawnbatch;
+	I_unlock_mutex(renderthread_mutex);
+
+	for (;;)
+	{
+		I_lock_mutex(&renderthread_mutex);
+		while (renderthread_batch == batch && !renderthread_quit)
+			I_hold_cond(&renderthread_cond, renderthread_mutex);
+		if (renderthread_quit)
+		{
+			if (--renderthread_alive == 0)
+				I_wake_all_cond(&renderthread_done_cond);
+			I_unlock_mutex(renderthread_mutex);
+			return;
+		}
+		batch = renderthread_batch;
+		draw = renderthread_draw;
+		numbands = renderthread_count + 1;
+		I_unlock_mutex(renderthread_mutex);
+
+		draw(band, numbands);
+
+		I_lock_mutex(&renderthread_mutex);
+		if (--renderthread_busy == 0)
+			I_wake_all_cond(&renderthread_done_cond);
+		I_unlock_mutex(renderthread_mutex);
+	}
+}
+
+// Stops all workers and waits for them to exit.
+static void R_StopRenderThreads(void)
+{
+	if (!renderthread_count)
+		return;
+
+	I_lock_mutex(&renderthread_mutex);
+	renderthread_quit = true;
+	I_wake_all_cond(&renderthread_cond);
+	while (renderthread_alive)
+		I_hold_cond(&renderthread_done_cond, renderthread_mutex);
+	renderthread_quit = false;
+	renderthread_count = 0;
+	I_unlock_mutex(renderthread_mutex);
+}
+
+// Sets how many threads, including the main one, draw the view.
+void R_SetRenderThreads(INT32 numthreads)
+{
+	static boolean registeredexit = false;
+	INT32 i;
+
+	numthreads = min(max(numthreads, 1), MAXRENDERTHREADS);
+
+	if (numthreads - 1 == renderthread_count)
+		return;
+
+	R_StopRenderThreads();
+
+	if (numthreads == 1)
+		return;
+
+	if (!registeredexit)
+	{
+		// Exit functions run last to first, so this runs before I_stop_threads.
+		I_AddExitFunc(R_StopRenderThreads);
+		registeredexit = true;
+	}
+
+	I_lock_mutex(&renderthread_mutex);
+	renderthread_spawnbatch = renderthread_batch;
+	renderthread_count = renderthread_alive = numthreads - 1;
+	I_unlock_mutex(renderthread_mutex);
+	for (i = 1; i < numthreads; i++)
+		I_spawn_thread(va("render-worker-%d", i), R_RenderWorker, (void *)(size_t)i);
+}
+
+// Returns how many threads, including the main one, draw the view.
+INT32 R_NumRenderThreads(void)
+{
+	return renderthread_count + 1;
+}
+
+// Calls draw for every band at once, band 0 on the main thread and the
+// others on the workers, and returns once they are all drawn.
+void R_DrawInBands(void (*draw)(INT32 band, INT32 numbands))
+{
+	I_lock_mutex(&renderthread_mutex);
+	renderthread_draw = draw;
+	renderthread_busy = renderthread_count;
+	renderthread_batch++;
+	I_wake_all_cond(&renderthread_cond);
+	I_unlock_mutex(renderthread_mutex);
+
+	draw(0, renderthread_count + 1);
+
+	I_lock_mutex(&renderthread_mutex);
+	while (renderthread_busy)
+		I_hold_cond(&renderthread_done_cond, renderthread_mutex);
+	I_unlock_mutex(renderthread_mutex);
+}
+#endif
+
 void SplitScreen_OnChange(void)
 {
 	if (!cv_debug && netgame)
@@ -1023,6 +1177,10 @@ void R_Init(void)
 
 	R_InitDrawNodes();
 
+#ifdef HAVE_THREADS
+	R_SetRenderThreads(cv_renderthreads.value);
+#endif
+
 	framecount = 0;
 }
 
@@ -1455,6 +1613,9 @@ void R_RenderPlayerView(player_t *player)
 
 	// Clear buffers.
 	R_ClearPlanes();
+#ifdef HAVE_THREADS
+	R_QueueWallColumns();
+#endif
 	if (viewmorph.use)
 	{
 		portalclipstart = viewmorph.x1;
@@ -1540,6 +1701,13 @@ void R_RenderPlayerView(player_t *player)
 	}
 	PS_STOP_TIMING(ps_sw_portaltime);
 
+#ifdef HAVE_THREADS
+	// Draw the walls of every BSP pass before anything can go over them
+	PS_START_TIMING(ps_sw_walltime);
+	R_FlushWallColumns();
+	PS_STOP_TIMING(ps_sw_walltime);
+#endif
+
 	PS_START_TIMING(ps_sw_planetime);
 	R_DrawPlanes();
 	PS_STOP_TIMING(ps_sw_planetime);
@@ -1618,6 +1786,9 @@ void R_RegisterEngineStuff(void)
 	CV_RegisterVar(&cv_translucenthud);
 
 	CV_RegisterVar(&cv_maxportals);
+#ifdef HAVE_THREADS
+	CV_RegisterVar(&cv_renderthreads);
+#endif
 
 	CV_RegisterVar(&cv_movebob);
 
@@ -96,6 +96,7 @@ extern ps_metric_t ps_bsptime;
 
 extern ps_metric_t ps_sw_spritecliptime;
 extern ps_metric_t ps_sw_portaltime;
+extern ps_metric_t ps_sw_walltime;
 extern ps_metric_t ps_sw_planetime;
 extern ps_metric_t ps_sw_maskedtime;
 
@@ -120,6 +121,14 @@ extern consvar_t cv_drawdist, cv_drawdist_nights, cv_drawdist_precip;
 extern consvar_t cv_fov;
 extern consvar_t cv_skybox;
 extern consvar_t cv_tailspickup;
+#ifdef HAVE_THREADS
+extern consvar_t cv_renderthreads;
+
+// Threaded drawing, see R_DrawInBands
+void R_SetRenderThreads(INT32 numthreads);
+INT32 R_NumRenderThreads(void);
+void R_DrawInBands(void (*draw)(INT32 band, INT32 numbands));
+#endif
 
 // Called by startup code.
 void R_Init(void);
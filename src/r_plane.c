@@ -91,6 +91,126 @@ fixed_t cachedystep[MAXVIDHEIGHT];
 static fixed_t xoffs, yoffs;
 static floatv3_t ds_slope_origin, ds_slope_u, ds_slope_v;
 
+#ifdef HAVE_THREADS
+//
+// Threaded plane drawing (r_threads)
+//
+// Visplanes never overlap on screen, so the order flat spans are drawn in
+// does not matter. While R_DrawPlanes runs, R_MapPlane and R_MapFogPlane
+// queue their spans instead of drawing them. At the end, the queue is split
+// into interleaved rows, and each row set is drawn by the main thread or one
+// of the workers (see R_DrawInBands), using the same span drawers as always.
+// Sky planes and sloped planes are still drawn straight away.
+//
+
+typedef struct
+{
+	void (*func)(void);
+	INT32 y, x1, x2;
+	lighttable_t *colormap;
+	fixed_t xfrac, yfrac, xstep, ystep;
+	INT32 waterofs, bgofs;
+	UINT16 flatwidth, flatheight;
+	UINT8 *source;
+	UINT8 *transmap;
+	UINT32 flatxshift, flatyshift, flatshiftup, flatmask;
+} planespan_t;
+
+static planespan_t *planespans;
+static size_t numplanespans, maxplanespans;
+static boolean queueplanespans;
+
+static void R_SaveSpanState(planespan_t *span)
+{
+	span->func = spanfunc;
+	span->y = ds_y;
+	span->x1 = ds_x1;
+	span->x2 = ds_x2;
+	span->colormap = ds_colormap;
+	span->xfrac = ds_xfrac;
+	span->yfrac = ds_yfrac;
+	span->xstep = ds_xstep;
+	span->ystep = ds_ystep;
+	span->waterofs = ds_waterofs;
+	span->bgofs = ds_bgofs;
+	span->flatwidth = ds_flatwidth;
+	span->flatheight = ds_flatheight;
+	span->source = ds_source;
+	span->transmap = ds_transmap;
+	span->flatxshift = nflatxshift;
+	span->flatyshift = nflatyshift;
+	span->flatshiftup = nflatshiftup;
+	span->flatmask = nflatmask;
+}
+
+static void R_LoadSpanState(const planespan_t *span)
+{
+	ds_y = span->y;
+	ds_x1 = span->x1;
+	ds_x2 = span->x2;
+	ds_colormap = span->colormap;
+	ds_xfrac = span->xfrac;
+	ds_yfrac = span->yfrac;
+	ds_xstep = span->xstep;
+	ds_ystep = span->ystep;
+	ds_waterofs = span->waterofs;
+	ds_bgofs = span->bgofs;
+	ds_flatwidth = span->flatwidth;
+	ds_flatheight = span->flatheight;
+	ds_source = span->source;
+	ds_transmap = span->transmap;
+	nflatxshift = span->flatxshift;
+	nflatyshift = span->flatyshift;
+	nflatshiftup = span->flatshiftup;
+	nflatmask = span->flatmask;
+}
+
+// Queues the span described by the current span drawer state.
+static void R_QueueSpan(void)
+{
+	if (numplanespans == maxplanespans)
+	{
+		maxplanespans = maxplanespans ? maxplanespans * 2 : 1024;
+		planespans = Z_Realloc(planespans, maxplanespans * sizeof (*planespans), PU_STATIC, NULL);
+	}
+	R_SaveSpanState(&planespans[numplanespans++]);
+}
+
+// Draws every queued span on the rows that belong to this band.
+static void R_DrawSpanBand(INT32 band, INT32 numbands)
+{
+	const planespan_t *span = planespans;
+	const planespan_t *end = planespans + numplanespans;
+
+	for (; span < end; span++)
+	{
+		if (span->y % numbands != band)
+			continue;
+		R_LoadSpanState(span);
+		span->func();
+	}
+}
+
+// Draws every queued span, spread over the main thread and the workers.
+static void R_FlushPlaneSpans(void)
+{
+	planespan_t mainstate;
+
+	if (!numplanespans)
+		return;
+
+	R_SaveSpanState(&mainstate);
+	R_DrawInBands(R_DrawSpanBand);
+	R_LoadSpanState(&mainstate);
+	spanfunc = mainstate.func;
+	numplanespans = 0;
+}
+
+#define R_DrawPlaneSpan() (queueplanespans ? R_QueueSpan() : spanfunc())
+#else
+#define R_DrawPlaneSpan() spanfunc()
+#endif
+
 //
 // R_InitPlanes
 // Only at game startup.
@@ -220,7 +340,7 @@ static void R_MapPlane(INT32 y, INT32 x1, INT32 x2)
 	ds_x1 = x1;
 	ds_x2 = x2;
 
-	spanfunc();
+	R_DrawPlaneSpan();
 }
 
 static void R_MapTiltedPlane(INT32 y, INT32 x1, INT32 x2)
@@ -292,7 +412,7 @@ static void R_MapFogPlane(INT32 y, INT32 x1, INT32 x2)
 	ds_x1 = x1;
 	ds_x2 = x2;
 
-	spanfunc();
+	R_DrawPlaneSpan();
 }
 
 static void R_MapTiltedFogPlane(INT32 y, INT32 x1, INT32 x2)
@@ -616,6 +736,10 @@ void R_DrawPlanes(void)
 
 	R_UpdatePlaneRipple();
 
+#ifdef HAVE_THREADS
+	queueplanespans = (R_NumRenderThreads() > 1);
+#endif
+
 	for (i = 0; i < MAXVISPLANES; i++, pl++)
 	{
 		for (pl = visplanes[i]; pl; pl = pl->next)
@@ -626,6 +750,14 @@ void R_DrawPlanes(void)
 			R_DrawSinglePlane(pl);
 		}
 	}
+
+#ifdef HAVE_THREADS
+	if (queueplanespans)
+	{
+		queueplanespans = false;
+		R_FlushPlaneSpans();
+	}
+#endif
 }
 
 // R_DrawSkyPlane
@@ -1041,6 +1041,124 @@ UINT32 nombre = 100000;
 #endif
 //profile stuff ---------------------------------------------------------
 
+#ifdef HAVE_THREADS
+//
+// Threaded wall drawing (r_threads)
+//
+// While the BSP is rendered, R_RenderSegLoop queues its wall columns instead
+// of drawing them. R_FlushWallColumns then splits the screen into vertical
+// strips, one per thread (see R_DrawInBands). Every column only touches its
+// own x, so each strip drawing its columns in order gives the same result.
+// Shadowed columns keep a copy of their light list, which changes per column.
+//
+
+typedef struct
+{
+	void (*func)(void);
+	INT32 x, yl, yh;
+	lighttable_t *colormap;
+	fixed_t iscale, texturemid;
+	UINT8 *source;
+	INT32 texheight;
+	size_t lights; // index of the first light in wallcolumnlights
+	INT32 numlights;
+} wallcolumn_t;
+
+static wallcolumn_t *wallcolumns;
+static size_t numwallcolumns, maxwallcolumns;
+static r_lightlist_t *wallcolumnlights;
+static size_t numwallcolumnlights, maxwallcolumnlights;
+static boolean queuewallcolumns;
+
+// Queues the column described by the current column drawer state.
+static void R_QueueWallColumn(void)
+{
+	wallcolumn_t *column;
+
+	if (numwallcolumns == maxwallcolumns)
+	{
+		maxwallcolumns = maxwallcolumns ? maxwallcolumns * 2 : 1024;
+		wallcolumns = Z_Realloc(wallcolumns, maxwallcolumns * sizeof (*wallcolumns), PU_STATIC, NULL);
+	}
+
+	column = &wallcolumns[numwallcolumns++];
+	column->func = colfunc;
+	column->x = dc_x;
+	column->yl = dc_yl;
+	column->yh = dc_yh;
+	column->colormap = dc_colormap;
+	column->iscale = dc_iscale;
+	column->texturemid = dc_texturemid;
+	column->source = dc_source;
+	column->texheight = dc_texheight;
+	column->lights = numwallcolumnlights;
+	column->numlights = dc_numlights;
+
+	if (dc_numlights)
+	{
+		if (numwallcolumnlights + dc_numlights > maxwallcolumnlights)
+		{
+			maxwallcolumnlights = max(numwallcolumnlights + dc_numlights, maxwallcolumnlights * 2);
+			wallcolumnlights = Z_Realloc(wallcolumnlights, maxwallcolumnlights * sizeof (*wallcolumnlights), PU_STATIC, NULL);
+		}
+		M_Memcpy(&wallcolumnlights[numwallcolumnlights], dc_lightlist, dc_numlights * sizeof (*dc_lightlist));
+		numwallcolumnlights += dc_numlights;
+	}
+}
+
+// Draws every queued column in this band's strip of the screen.
+static void R_DrawWallColumnBand(INT32 band, INT32 numbands)
+{
+	const wallcolumn_t *column = wallcolumns;
+	const wallcolumn_t *end = wallcolumns + numwallcolumns;
+
+	for (; column < end; column++)
+	{
+		if (column->x * numbands / viewwidth != band)
+			continue;
+		dc_x = column->x;
+		dc_yl = column->yl;
+		dc_yh = column->yh;
+		dc_colormap = column->colormap;
+		dc_iscale = column->iscale;
+		dc_texturemid = column->texturemid;
+		dc_source = column->source;
+		dc_texheight = column->texheight;
+		dc_lightlist = &wallcolumnlights[column->lights];
+		dc_numlights = column->numlights;
+		column->func();
+	}
+}
+
+// Starts queueing wall columns if more than one thread draws the view.
+void R_QueueWallColumns(void)
+{
+	queuewallcolumns = (R_NumRenderThreads() > 1);
+}
+
+// Draws every queued wall column, spread over the main thread and the workers.
+void R_FlushWallColumns(void)
+{
+	r_lightlist_t *lightlist = dc_lightlist;
+	const INT32 numlights = dc_numlights;
+
+	queuewallcolumns = false;
+	if (!numwallcolumns)
+		return;
+
+	R_DrawInBands(R_DrawWallColumnBand);
+
+	// The main thread drew a band too, so put back what it had
+	dc_lightlist = lightlist;
+	dc_numlights = numlights;
+	numwallcolumns = numwallcolumnlights = 0;
+}
+
+#define R_DrawWallColumn() (queuewallcolumns ? R_QueueWallColumn() : colfunc())
+#else
+#define R_DrawWallColumn() colfunc()
+#endif
+
 static void R_RenderSegLoop (void)
 {
 	angle_t angle;
@@ -1300,7 +1418,7 @@ static void R_RenderSegLoop (void)
 #ifdef TIMING
 				ProfZeroTimer();
 #endif
-				colfunc();
+				R_DrawWallColumn();
 #ifdef TIMING
 				RDMSR(0x10,&mycount);
 				mytotal += mycount;      //64bit add
@@ -1356,7 +1474,7 @@ static void R_RenderSegLoop (void)
 						dc_texturemid = rw_toptexturemid;
 						dc_source = R_GetColumn(toptexture, itexturecolumn + (rw_offset_top>>FRACBITS));
 						dc_texheight = textureheight[toptexture]>>FRACBITS;
-						colfunc();
+						R_DrawWallColumn();
 						ceilingclip[rw_x] = (INT16)mid;
 					}
 					else if (!rw_ceilingmarked) // entirely off top of screen
@@ -1392,7 +1510,7 @@ static void R_RenderSegLoop (void)
 						dc_texturemid = rw_bottomtexturemid;
 						dc_source = R_GetColumn(bottomtexture, itexturecolumn + (rw_offset_bot>>FRACBITS));
 						dc_texheight = textureheight[bottomtexture]>>FRACBITS;
-						colfunc();
+						R_DrawWallColumn();
 						floorclip[rw_x] = (INT16)mid;
 					}
 					else if (!rw_floormarked)  // entirely off bottom of screen
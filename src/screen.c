@@ -105,6 +105,7 @@ boolean R_SSE = false;
 boolean R_3DNow = false;
 boolean R_MMXExt = false;
 boolean R_SSE2 = false;
+boolean R_AVX2 = false;
 
 void SCR_SetDrawFuncs(void)
 {
@@ -164,6 +165,25 @@ void SCR_SetDrawFuncs(void)
 		spanfuncs_npo2[SPANDRAWFUNC_WATER] = R_DrawWaterSpan_NPO2_8;
 		spanfuncs_npo2[SPANDRAWFUNC_TILTEDWATER] = R_DrawTiltedWaterSpan_NPO2_8;
 
+		// Span drawers that work out several texels at a time
+#if defined(R_SIMD_SSE2)
+		spanfuncs[BASEDRAWFUNC] = R_DrawSpan_8_SSE2;
+		spanfuncs[SPANDRAWFUNC_TRANS] = R_DrawTranslucentSpan_8_SSE2;
+		spanfuncs[SPANDRAWFUNC_TILTED] = R_DrawTiltedSpan_8_SSE2;
+#elif defined(R_SIMD_NEON)
+		spanfuncs[BASEDRAWFUNC] = R_DrawSpan_8_NEON;
+		spanfuncs[SPANDRAWFUNC_TRANS] = R_DrawTranslucentSpan_8_NEON;
+		spanfuncs[SPANDRAWFUNC_TILTED] = R_DrawTiltedSpan_8_NEON;
+#endif
+#ifdef R_SIMD_AVX2
+		if (R_AVX2)
+		{
+			spanfuncs[BASEDRAWFUNC] = R_DrawSpan_8_AVX2;
+			spanfuncs[SPANDRAWFUNC_TRANS] = R_DrawTranslucentSpan_8_AVX2;
+			spanfuncs[SPANDRAWFUNC_TILTED] = R_DrawTiltedSpan_8_AVX2;
+		}
+#endif
+		spanfunc = spanfuncs[BASEDRAWFUNC];
 	}
 /*	else if (vid.bpp > 1)
 	{
@@ -243,7 +263,9 @@ void SCR_Startup(void)
 			R_SSE = true;
 		if (RCpuInfo->SSE2)
 			R_SSE2 = true;
-		CONS_Printf("CPU Info: 486: %i, 586: %i, MMX: %i, 3DNow: %i, MMXExt: %i, SSE2: %i\n", R_486, R_586, R_MMX, R_3DNow, R_MMXExt, R_SSE2);
+		if (RCpuInfo->AVX2)
+			R_AVX2 = true;
+		CONS_Printf("CPU Info: 486: %i, 586: %i, MMX: %i, 3DNow: %i, MMXExt: %i, SSE2: %i, AVX2: %i\n", R_486, R_586, R_MMX, R_3DNow, R_MMXExt, R_SSE2, R_AVX2);
 	}
 
 	if (M_CheckParm("-486"))
@@ -265,6 +287,11 @@ void SCR_Startup(void)
 	if (M_CheckParm("-SSE2"))
 		R_SSE2 = true;
 
+	if (M_CheckParm("-AVX2"))
+		R_AVX2 = true;
+	if (M_CheckParm("-noAVX2"))
+		R_AVX2 = false;
+
 	M_SetupMemcpy();
 
 	if (dedicated)
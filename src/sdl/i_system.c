@@ -3180,6 +3180,9 @@ const CPUInfoFlags *I_CPUInfo(void)
 	}
 	WIN_CPUInfo.MMXExt      = SDL_FALSE; //SDL_HasMMXExt(); No longer in SDL2
 	WIN_CPUInfo.AMD3DNowExt = SDL_FALSE; //SDL_Has3DNowExt(); No longer in SDL2
+#if SDL_VERSION_ATLEAST(2,0,4)
+	WIN_CPUInfo.AVX2        = SDL_HasAVX2();
+#endif
 #endif
 	GetSystemInfo(&SI);
 	WIN_CPUInfo.CPUs = SI.dwNumberOfProcessors;
@@ -3197,6 +3200,9 @@ const CPUInfoFlags *I_CPUInfo(void)
 	SDL_CPUInfo.SSE         = SDL_HasSSE();
 	SDL_CPUInfo.SSE2        = SDL_HasSSE2();
 	SDL_CPUInfo.AltiVec     = SDL_HasAltiVec();
+#if SDL_VERSION_ATLEAST(2,0,4)
+	SDL_CPUInfo.AVX2        = SDL_HasAVX2();
+#endif
 	return &SDL_CPUInfo;
 #else
 	return NULL; /// \todo CPUID asm
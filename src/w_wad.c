@@ -108,6 +108,97 @@ static UINT16 lumpnumcacheindex = 0;
 UINT16 numwadfiles; // number of active wadfiles
 wadfile_t **wadfiles; // 0 to numwadfiles-1 are valid
 
+//===========================================================================
+//                                                          LUMP NAME INDEX
+//===========================================================================
+
+// Ends a lump hash chain.
+#define LUMPINDEXEND UINT16_MAX
+
+static UINT32 W_LongNameHash(const char *name)
+{
+	return quickncasehash(name, strlen(name));
+}
+
+// Compares two strings the same way strnicmp does, but without a length limit.
+static int W_FullNameCmp(const char *a, const char *b)
+{
+	int ca, cb;
+	do
+	{
+		ca = tolower((unsigned char)*a++);
+		cb = tolower((unsigned char)*b++);
+	} while (ca && ca == cb);
+	return ca - cb;
+}
+
+static const lumpinfo_t *sortlumpinfo;
+
+static int W_FullNameSortCmp(const void *a, const void *b)
+{
+	const UINT16 la = *(const UINT16 *)a, lb = *(const UINT16 *)b;
+	int cmp = W_FullNameCmp(sortlumpinfo[la].fullname, sortlumpinfo[lb].fullname);
+	if (cmp)
+		return cmp;
+	return la - lb; // keep equal names in lump order
+}
+
+// Builds the lump name lookup tables for a newly added file.
+// Hash chains are linked in ascending lump order, so walking a chain
+// finds the same lump the old linear forward scan did.
+static void W_BuildLumpIndex(wadfile_t *wadfile)
+{
+	lumpindex_t *index = &wadfile->lumpindex;
+	const UINT16 numlumps = wadfile->numlumps;
+	const size_t chainsize = max(numlumps, 1) * sizeof (UINT16);
+	UINT32 numbuckets = 1;
+	UINT16 i;
+
+	while (numbuckets < numlumps)
+		numbuckets <<= 1;
+
+	index->mask = numbuckets - 1;
+	index->namehead = Z_Malloc(numbuckets * sizeof (UINT16), PU_STATIC, NULL);
+	index->longhead = Z_Malloc(numbuckets * sizeof (UINT16), PU_STATIC, NULL);
+	index->namenext = Z_Malloc(chainsize, PU_STATIC, NULL);
+	index->longnext = Z_Malloc(chainsize, PU_STATIC, NULL);
+	index->fullsorted = Z_Malloc(chainsize, PU_STATIC, NULL);
+
+	memset(index->namehead, 0xFF, numbuckets * sizeof (UINT16));
+	memset(index->longhead, 0xFF, numbuckets * sizeof (UINT16));
+
+	// Link backwards so each chain ends up in ascending order.
+	for (i = numlumps; i-- > 0;)
+	{
+		const lumpinfo_t *lump_p = &wadfile->lumpinfo[i];
+		UINT32 bucket;
+
+		bucket = lump_p->hash & index->mask;
+		index->namenext[i] = index->namehead[bucket];
+		index->namehead[bucket] = i;
+
+		bucket = W_LongNameHash(lump_p->longname) & index->mask;
+		index->longnext[i] = index->longhead[bucket];
+		index->longhead[bucket] = i;
+
+		index->fullsorted[i] = i;
+	}
+
+	sortlumpinfo = wadfile->lumpinfo;
+	qsort(index->fullsorted, numlumps, sizeof (UINT16), W_FullNameSortCmp);
+	sortlumpinfo = NULL;
+}
+
+static void W_FreeLumpIndex(wadfile_t *wadfile)
+{
+	lumpindex_t *index = &wadfile->lumpindex;
+	Z_Free(index->namehead);
+	Z_Free(index->namenext);
+	Z_Free(index->longhead);
+	Z_Free(index->longnext);
+	Z_Free(index->fullsorted);
+}
+
 // W_Shutdown
 // Closes all of the WAD files before quitting
 // If not done on a Mac then open wad files
@@ -132,6 +223,7 @@ void W_Shutdown(void)
 			Z_Free(wad->lumpinfo[wad->numlumps].fullname);
 		}
 
+		W_FreeLumpIndex(wad);
 		Z_Free(wad->lumpinfo);
 		Z_Free(wad);
 	}
@@ -962,6 +1054,8 @@ UINT16 W_InitFile(const char *filename, boolean mainfile, boolean startup)
 	// already generated, just copy it over
 	M_Memcpy(&wadfile->md5sum, &md5sum, 16);
 
+	W_BuildLumpIndex(wadfile);
+
 	//
 	// set up caching
 	//
@@ -1146,6 +1240,8 @@ UINT16 W_InitFolder(const char *path, boolean mainfile, boolean startup)
 	wadfile->filesize = 0;
 	memset(wadfile->md5sum, 0x00, 16);
 
+	W_BuildLumpIndex(wadfile);
+
 	Z_Calloc(numlumps * sizeof (*wadfile->lumpcache), PU_STATIC, &wadfile->lumpcache);
 	Z_Calloc(numlumps * sizeof (*wadfile->patchcache), PU_STATIC, &wadfile->patchcache);
 
@@ -1240,16 +1336,19 @@ UINT16 W_CheckNumForNamePwad(const char *name, UINT16 wad, UINT16 startlump)
 	hash = quickncasehash(uname, 8);
 
 	//
-	// scan forward
+	// walk the hash chain forward
 	// start at 'startlump', useful parameter when there are multiple
 	//                       resources with the same name
 	//
 	if (startlump < wadfiles[wad]->numlumps)
 	{
-		lumpinfo_t *lump_p = wadfiles[wad]->lumpinfo + startlump;
-		for (i = startlump; i < wadfiles[wad]->numlumps; i++, lump_p++)
-			if (lump_p->hash == hash && !strncmp(lump_p->name, uname, sizeof(uname) - 1))
+		const lumpindex_t *index = &wadfiles[wad]->lumpindex;
+		for (i = index->namehead[hash & index->mask]; i != LUMPINDEXEND; i = index->namenext[i])
+		{
+			lumpinfo_t *lump_p = wadfiles[wad]->lumpinfo + i;
+			if (i >= startlump && lump_p->hash == hash && !strncmp(lump_p->name, uname, sizeof(uname) - 1))
 				return i;
+		}
 	}
 
 	// not found.
@@ -1266,23 +1365,25 @@ UINT16 W_CheckNumForLongNamePwad(const char *name, UINT16 wad, UINT16 startlump)
 {
 	UINT16 i;
 	static char uname[256 + 1];
+	UINT32 hash;
 
 	if (!TestValidLump(wad,0))
 		return INT16_MAX;
 
 	strlcpy(uname, name, sizeof uname);
 	strupr(uname);
+	hash = W_LongNameHash(uname);
 
 	//
-	// scan forward
+	// walk the hash chain forward
 	// start at 'startlump', useful parameter when there are multiple
 	//                       resources with the same name
 	//
 	if (startlump < wadfiles[wad]->numlumps)
 	{
-		lumpinfo_t *lump_p = wadfiles[wad]->lumpinfo + startlump;
-		for (i = startlump; i < wadfiles[wad]->numlumps; i++, lump_p++)
-			if (!strcmp(lump_p->longname, uname))
+		const lumpindex_t *index = &wadfiles[wad]->lumpindex;
+		for (i = index->longhead[hash & index->mask]; i != LUMPINDEXEND; i = index->longnext[i])
+			if (i >= startlump && !strcmp(wadfiles[wad]->lumpinfo[i].longname, uname))
 				return i;
 	}
 
@@ -1337,19 +1438,37 @@ UINT16 W_CheckNumForFolderEndPK3(const char *name, UINT16 wad, UINT16 startlump)
 
 // In a PK3 type of resource file, it looks for an entry with the specified full name.
 // Returns lump position in PK3's lumpinfo, or INT16_MAX if not found.
+//
+// Like it always has, this matches the first entry whose full name *starts*
+// with 'name'. Those entries are contiguous in the sorted full name table,
+// so binary search for the start of the run and take the lowest lump in it.
 UINT16 W_CheckNumForFullNamePK3(const char *name, UINT16 wad, UINT16 startlump)
 {
-	INT32 i;
-	lumpinfo_t *lump_p = wadfiles[wad]->lumpinfo + startlump;
-	for (i = startlump; i < wadfiles[wad]->numlumps; i++, lump_p++)
+	const lumpindex_t *index = &wadfiles[wad]->lumpindex;
+	const lumpinfo_t *lumpinfo = wadfiles[wad]->lumpinfo;
+	const size_t name_length = strlen(name);
+	size_t lo = 0, hi = wadfiles[wad]->numlumps;
+	UINT16 found = INT16_MAX;
+
+	while (lo < hi)
 	{
-		if (!strnicmp(name, lump_p->fullname, strlen(name)))
-		{
-			return i;
-		}
+		size_t mid = lo + (hi - lo) / 2;
+		if (W_FullNameCmp(lumpinfo[index->fullsorted[mid]].fullname, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-	// Not found at all?
-	return INT16_MAX;
+
+	for (; lo < wadfiles[wad]->numlumps; lo++)
+	{
+		UINT16 lump = index->fullsorted[lo];
+		if (strnicmp(name, lumpinfo[lump].fullname, name_length))
+			break;
+		if (lump >= startlump && lump < found)
+			found = lump;
+	}
+
+	return found;
 }
 
 //
@@ -1459,7 +1578,8 @@ lumpnum_t W_CheckNumForMap(const char *name)
 	{
 		if (wadfiles[i]->type == RET_WAD)
 		{
-			for (lumpNum = 0; lumpNum < wadfiles[i]->numlumps; lumpNum++)
+			const lumpindex_t *index = &wadfiles[i]->lumpindex;
+			for (lumpNum = index->namehead[hash & index->mask]; lumpNum != LUMPINDEXEND; lumpNum = index->namenext[lumpNum])
 			{
 				p = wadfiles[i]->lumpinfo + lumpNum;
 				if (p->hash == hash && !strncmp(name, p->name, 8))
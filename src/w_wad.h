@@ -121,6 +121,17 @@ typedef enum restype
 	RET_UNKNOWN,
 } restype_t;
 
+// Per-file lump name lookup tables, built once when the file is added
+typedef struct
+{
+	UINT32 mask;         // number of hash buckets - 1
+	UINT16 *namehead;    // first lump in each bucket, keyed on lumpinfo_t.hash
+	UINT16 *namenext;    // next lump with the same short name bucket
+	UINT16 *longhead;    // first lump in each bucket, keyed on the long name
+	UINT16 *longnext;    // next lump with the same long name bucket
+	UINT16 *fullsorted;  // lump numbers sorted case-insensitively by full name
+} lumpindex_t;
+
 typedef struct wadfile_s
 {
 	char *filename, *path;
@@ -130,6 +141,7 @@ typedef struct wadfile_s
 	lumpcache_t *patchcache;
 	UINT16 numlumps; // this wad's number of resources
 	UINT16 foldercount; // folder count
+	lumpindex_t lumpindex;
 	FILE *handle;
 	UINT32 filesize; // for network
 	UINT8 md5sum[16];
@@ -24,6 +24,11 @@
 ///        caught with this direct-malloc version. We also suspected that SRB2's
 ///        allocator was fragmenting badly. Finally, this version is a bit
 ///        simpler (about half the lines of code).
+///
+///        Small blocks are the exception: those come out of slabs, one set of
+///        slabs for every size class and tag, so that things like mobjs and
+///        thinkers aren't each a separate malloc() and Z_FreeTags() can hand
+///        whole slabs back at once.
 
 #include "doomdef.h"
 #include "doomstat.h"
@@ -34,6 +39,7 @@
 #include "z_zone.h"
 #include "m_misc.h" // M_Memcpy
 #include "lua_script.h"
+#include "p_mobj.h" // mobj_t and precipmobj_t, for the size classes
 
 #ifdef HWRENDER
 #include "hardware/hw_main.h" // For hardware memory info
@@ -59,6 +65,7 @@ typedef struct memblock_s
 
 	size_t size; // including the header and blocks
 	size_t realsize; // size of real data only
+	struct zslab_s *slab; // Slab it was taken from, or NULL if malloced
 
 #ifdef ZDEBUG
 	const char *ownerfile;
@@ -74,13 +81,53 @@ typedef struct memblock_s
 // both the head and tail of the zone memory block list
 static memblock_t head;
 
+// --------------------------
+// Size class pools
+// --------------------------
+
+#define ZSLABSIZE (64*1024) // Bytes in one slab, header included
+#define ZPOOLTAGS 128 // Tags that can be pooled: 0 to ZPOOLTAGS-1
+#define ZPOOLALIGN 16
+#define ZPOOLROUND(x) (((x) + ZPOOLALIGN - 1) & ~(size_t)(ZPOOLALIGN - 1))
+
+// One slab of same-sized blocks, with a header in front
+typedef struct zslab_s
+{
+	struct zpool_s *pool;
+	struct zslab_s *next, *prev; // Slabs with free blocks come first
+	memblock_t *freelist; // Linked through next
+	UINT32 used, capacity;
+} zslab_t;
+
+#define ZSLABHEADER ZPOOLROUND(sizeof (zslab_t))
+#define ZSLABBLOCK(slab, i) (memblock_t *)((UINT8 *)(slab) + ZSLABHEADER + (i)*(slab)->pool->blocksize)
+
+// Every slab for one size class and tag
+typedef struct zpool_s
+{
+	size_t realsize; // Largest allocation it can take
+	size_t blocksize; // Header and data, rounded up
+	INT32 tag;
+	zslab_t *slabs;
+	UINT32 numslabs;
+} zpool_t;
+
+// Size classes, smallest first. The exact sizes of
+// mobj_t and precipmobj_t are added in Z_Init.
+static size_t zclasses[] = {32, 64, 96, 128, 192, 256, 384, 0, 0};
+#define NUMZCLASSES (sizeof zclasses / sizeof *zclasses)
+
+static zpool_t *zpools[NUMZCLASSES][ZPOOLTAGS];
+
+// Smallest size class that could fit each size, in ZPOOLALIGN steps
+static UINT8 zclassforsize[1024/ZPOOLALIGN + 1];
+static size_t zpoolmaxsize; // 0 until Z_Init
+
 //
 // Function prototypes
 //
 static void Command_Memfree_f(void);
-#ifdef ZDEBUG
 static void Command_Memdump_f(void);
-#endif
 
 // --------------------------
 // Zone memory initialisation
@@ -94,20 +141,38 @@ static void Command_Memdump_f(void);
 void Z_Init(void)
 {
 	size_t total, memfree;
+	size_t i, j;
 
 	memset(&head, 0x00, sizeof(head));
 
 	head.next = head.prev = &head;
 
+	// Set up the size classes
+	zclasses[NUMZCLASSES - 2] = sizeof (precipmobj_t);
+	zclasses[NUMZCLASSES - 1] = sizeof (mobj_t);
+	for (i = 1; i < NUMZCLASSES; i++) // insertion sort
+		for (j = i; j > 0 && zclasses[j - 1] > zclasses[j]; j--)
+		{
+			size_t t = zclasses[j];
+			zclasses[j] = zclasses[j - 1];
+			zclasses[j - 1] = t;
+		}
+	for (i = 0, j = 0; i < sizeof zclassforsize; i++)
+	{
+		// Smallest size that falls in this step
+		const size_t size = i ? (i - 1) * ZPOOLALIGN + 1 : 0;
+		while (j < NUMZCLASSES - 1 && zclasses[j] < size)
+			j++;
+		zclassforsize[i] = (UINT8)j;
+	}
+	zpoolmaxsize = min(zclasses[NUMZCLASSES - 1], 1024);
+
 	memfree = I_GetFreeMem(&total)>>20;
 	CONS_Printf("System memory: %sMB - Free: %sMB\n", sizeu1(total>>20), sizeu2(memfree));
 
 	// Note: This allocates memory. Watch out.
 	COM_AddCommand("memfree", Command_Memfree_f, COM_LUA);
-
-#ifdef ZDEBUG
 	COM_AddCommand("memdump", Command_Memdump_f, COM_LUA);
-#endif
 }
 
 
@@ -115,6 +180,86 @@ void Z_Init(void)
 // Zone memory allocation
 // ----------------------
 
+/** Takes a block out of the zone, before its memory is given back.
+  *
+  * \param block The block being freed.
+  */
+static void Z_UnlinkBlock(memblock_t *block)
+{
+	void *ptr = MEMORY(block);
+
+	// anything that isn't by lua gets passed to lua just in case.
+	if (block->tag != PU_LUA)
+		LUA_InvalidateUserdata(ptr);
+
+	// TODO: if zdebugging, make sure no other block has a user
+	// that is about to be freed.
+
+	// Clear the user's mark.
+	if (block->user != NULL)
+		*block->user = NULL;
+
+#ifdef VALGRIND_DESTROY_MEMPOOL
+	VALGRIND_DESTROY_MEMPOOL(block);
+#endif
+	block->prev->next = block->next;
+	block->next->prev = block->prev;
+}
+
+/** Moves a slab to the front of its pool, where blocks are taken from.
+  */
+static void Z_PoolSlabToFront(zslab_t *slab)
+{
+	zpool_t *pool = slab->pool;
+
+	if (pool->slabs == slab)
+		return;
+
+	slab->prev->next = slab->next;
+	if (slab->next)
+		slab->next->prev = slab->prev;
+
+	slab->next = pool->slabs;
+	slab->prev = NULL;
+	pool->slabs->prev = slab;
+	pool->slabs = slab;
+}
+
+/** Gives a slab's memory back to the system.
+  */
+static void Z_FreeSlab(zslab_t *slab)
+{
+	zpool_t *pool = slab->pool;
+
+	if (slab->prev)
+		slab->prev->next = slab->next;
+	else
+		pool->slabs = slab->next;
+	if (slab->next)
+		slab->next->prev = slab->prev;
+
+	pool->numslabs--;
+	free(slab);
+}
+
+/** Puts a freed block back into its slab.
+  * Empty slabs are released, except for the last one in the pool.
+  */
+static void Z_PoolFree(memblock_t *block)
+{
+	zslab_t *slab = block->slab;
+
+	block->id = 0;
+	block->next = slab->freelist;
+	slab->freelist = block;
+	slab->used--;
+
+	if (!slab->used && slab->pool->numslabs > 1)
+		Z_FreeSlab(slab);
+	else
+		Z_PoolSlabToFront(slab);
+}
+
 /** Frees allocated memory.
   *
   * \param ptr A pointer to allocated memory,
@@ -151,23 +296,12 @@ void Z_Free(void *ptr)
 	CONS_Debug(DBG_MEMORY, "Z_Free at %s:%d\n", file, line);
 #endif
 
-	// anything that isn't by lua gets passed to lua just in case.
-	if (block->tag != PU_LUA)
-		LUA_InvalidateUserdata(ptr);
-
-	// TODO: if zdebugging, make sure no other block has a user
-	// that is about to be freed.
+	Z_UnlinkBlock(block);
 
-	// Clear the user's mark.
-	if (block->user != NULL)
-		*block->user = NULL;
-
-#ifdef VALGRIND_DESTROY_MEMPOOL
-	VALGRIND_DESTROY_MEMPOOL(block);
-#endif
-	block->prev->next = block->next;
-	block->next->prev = block->prev;
-	free(block);
+	if (block->slab)
+		Z_PoolFree(block);
+	else
+		free(block);
 }
 
 /** malloc() that doesn't accept failure.
@@ -199,6 +333,77 @@ static void *xm(size_t size)
 	return p;
 }
 
+/** Takes a block out of the pool for a size class and tag,
+  * adding a new slab to the pool if they are all full.
+  *
+  * \param zclass Size class to use.
+  * \param tag Purge tag.
+  * \return A block, not yet linked into the zone.
+  */
+static memblock_t *Z_PoolAlloc(size_t zclass, INT32 tag)
+{
+	zpool_t *pool = zpools[zclass][tag];
+	zslab_t *slab;
+	memblock_t *block;
+
+	if (!pool)
+	{
+		pool = zpools[zclass][tag] = xm(sizeof *pool);
+		pool->realsize = zclasses[zclass];
+		pool->blocksize = ZPOOLROUND(sizeof (memblock_t) + pool->realsize);
+		pool->tag = tag;
+		pool->slabs = NULL;
+		pool->numslabs = 0;
+	}
+
+	slab = pool->slabs;
+	if (!slab || !slab->freelist)
+	{
+		UINT32 i;
+
+		slab = xm(ZSLABSIZE);
+		slab->pool = pool;
+		slab->used = 0;
+		slab->capacity = (UINT32)((ZSLABSIZE - ZSLABHEADER) / pool->blocksize);
+		slab->freelist = NULL;
+		for (i = slab->capacity; i-- > 0;)
+		{
+			block = ZSLABBLOCK(slab, i);
+			block->id = 0;
+			block->next = slab->freelist;
+			slab->freelist = block;
+		}
+
+		slab->prev = NULL;
+		slab->next = pool->slabs;
+		if (pool->slabs)
+			pool->slabs->prev = slab;
+		pool->slabs = slab;
+		pool->numslabs++;
+	}
+
+	block = slab->freelist;
+	slab->freelist = block->next;
+	slab->used++;
+
+	// Full slabs go to the back, so the front always has room
+	if (!slab->freelist && slab->next)
+	{
+		zslab_t *last = slab->next;
+		while (last->next)
+			last = last->next;
+
+		pool->slabs = slab->next;
+		pool->slabs->prev = NULL;
+		last->next = slab;
+		slab->prev = last;
+		slab->next = NULL;
+	}
+
+	block->slab = slab;
+	return block;
+}
+
 /** The Z_MallocAlign function.
   * Allocates a block of memory, adds it to a linked list so we can keep track of it.
   *
@@ -226,7 +431,18 @@ void *Z_MallocAlign(size_t size, INT32 tag, void *user, INT32 alignbits)
 	CONS_Debug(DBG_MEMORY, "Z_Malloc %s:%d\n", file, line);
 #endif
 
-	block = xm(sizeof (memblock_t) + size);
+	if (size <= zpoolmaxsize && tag >= 0 && tag < ZPOOLTAGS)
+	{
+		size_t zclass = zclassforsize[(size + ZPOOLALIGN - 1) / ZPOOLALIGN];
+		while (zclasses[zclass] < size) // classes aren't all multiples of ZPOOLALIGN
+			zclass++;
+		block = Z_PoolAlloc(zclass, tag);
+	}
+	else
+	{
+		block = xm(sizeof (memblock_t) + size);
+		block->slab = NULL;
+	}
 	ptr = MEMORY(block);
 	I_Assert((intptr_t)ptr % sizeof (void *) == 0);
 
@@ -393,14 +609,57 @@ void *Z_ReallocAlign(void *ptr, size_t size, INT32 tag, void *user, INT32 alignb
 void Z_FreeTags(INT32 lowtag, INT32 hightag)
 {
 	memblock_t *block, *next;
+	zpool_t *pool;
+	zslab_t *slab, *nextslab;
+	size_t c;
+	INT32 tag;
+	UINT32 i;
 
 	Z_CheckHeap(420);
+
+	// Empty out the pools for these tags slab by slab,
+	// rather than returning every block one at a time.
+	for (c = 0; c < NUMZCLASSES; c++)
+		for (tag = max(lowtag, 0); tag <= hightag && tag < ZPOOLTAGS; tag++)
+		{
+			if (!(pool = zpools[c][tag]))
+				continue;
+			for (slab = pool->slabs; slab; slab = slab->next)
+				for (i = 0; i < slab->capacity && slab->used; i++)
+				{
+					block = ZSLABBLOCK(slab, i);
+					if (block->id != ZONEID || block->tag < lowtag || block->tag > hightag)
+						continue;
+					Z_UnlinkBlock(block);
+					block->id = 0;
+					block->next = slab->freelist;
+					slab->freelist = block;
+					slab->used--;
+				}
+		}
+
 	for (block = head.next; block != &head; block = next)
 	{
 		next = block->next; // get link before freeing
 		if (block->tag >= lowtag && block->tag <= hightag)
 			Z_Free(MEMORY(block));
 	}
+
+	// Only now that nothing else can point into them, let go of the empty slabs
+	for (c = 0; c < NUMZCLASSES; c++)
+		for (tag = max(lowtag, 0); tag <= hightag && tag < ZPOOLTAGS; tag++)
+		{
+			if (!(pool = zpools[c][tag]))
+				continue;
+			for (slab = pool->slabs; slab; slab = nextslab)
+			{
+				nextslab = slab->next;
+				if (!slab->used)
+					Z_FreeSlab(slab);
+				else if (slab->freelist)
+					Z_PoolSlabToFront(slab);
+			}
+		}
 }
 
 /** Iterates through all memory for a given set of tags.
@@ -636,6 +895,33 @@ size_t Z_TagsUsage(INT32 lowtag, INT32 hightag)
 	return cnt;
 }
 
+/** Calculates how much of the pools is in use.
+  *
+  * \param used Set to the bytes handed out from the pools.
+  * \param slabs Set to the number of slabs.
+  * \return Bytes the pools take up in total.
+  */
+static size_t Z_PoolUsage(size_t *used, size_t *slabs)
+{
+	size_t c, total = 0;
+	INT32 tag;
+	zslab_t *slab;
+
+	*used = *slabs = 0;
+	for (c = 0; c < NUMZCLASSES; c++)
+		for (tag = 0; tag < ZPOOLTAGS; tag++)
+		{
+			if (!zpools[c][tag])
+				continue;
+			for (slab = zpools[c][tag]->slabs; slab; slab = slab->next)
+				*used += slab->used * zpools[c][tag]->blocksize;
+			*slabs += zpools[c][tag]->numslabs;
+			total += zpools[c][tag]->numslabs * ZSLABSIZE;
+		}
+
+	return total;
+}
+
 // -----------------------
 // Miscellaneous functions
 // -----------------------
@@ -664,6 +950,30 @@ static void Command_Memfree_f(void)
 	CONS_Printf(M_GetText("All purgable           : %7s KB\n"),
 		sizeu1(Z_TagsUsage(PU_PURGELEVEL, INT32_MAX)>>10));
 
+	{
+		size_t pooltotal, poolused, poolslabs;
+		pooltotal = Z_PoolUsage(&poolused, &poolslabs);
+		CONS_Printf(M_GetText("Pooled                 : %7s KB in %s slabs (%s KB unused)\n"),
+			sizeu1(pooltotal>>10), sizeu2(poolslabs), sizeu3((pooltotal - poolused)>>10));
+	}
+
+	{
+		const luaarenastats_t *lua = LUA_GetArenaStats();
+		char blocks[LUA_ARENACLASSES * 16] = "";
+		size_t c, len = 0;
+
+		CONS_Printf(M_GetText("Lua                    : %7s KB (peak %s KB, %s KB reserved)\n"),
+			sizeu1(lua->live>>10), sizeu2(lua->peak>>10), sizeu3(lua->reserved>>10));
+
+		// live blocks by size
+		for (c = 0; c < LUA_ARENACLASSES; c++)
+			if (lua->blocks[c])
+				len += snprintf(blocks + len, sizeof blocks - len, " %s:%u",
+					sizeu1((c + 1) * LUA_ARENASTEP), lua->blocks[c]);
+		CONS_Printf(M_GetText("Lua blocks             :%s >%d:%u\n"),
+			blocks, LUA_ARENASTEP * LUA_ARENACLASSES, lua->blocks[LUA_ARENACLASSES]);
+	}
+
 #ifdef HWRENDER
 	if (rendermode == render_opengl)
 	{
@@ -682,17 +992,20 @@ static void Command_Memfree_f(void)
 	CONS_Printf(M_GetText("Available physical memory: %s KB\n"), sizeu1(freebytes>>10));
 }
 
-#ifdef ZDEBUG
 /** The function called by the "memdump" console command.
-  * Prints zone memory debugging information (i.e. tag, size, location in code allocated).
+  * Prints how full each size class pool is, for every tag.
+  * If ZDEBUG is enabled, also prints zone memory debugging information
+  * (i.e. tag, size, location in code allocated) for every block.
   * Can be all memory allocated in game, or between a set of tags (if -min/-max args used).
-  * This command is available only if ZDEBUG is enabled.
   */
 static void Command_Memdump_f(void)
 {
+#ifdef ZDEBUG
 	memblock_t *block;
+#endif
 	INT32 mintag = 0, maxtag = INT32_MAX;
 	INT32 i;
+	size_t c;
 
 	if ((i = COM_CheckParm("-min")))
 		mintag = atoi(COM_Argv(i + 1));
@@ -700,15 +1013,34 @@ static void Command_Memdump_f(void)
 	if ((i = COM_CheckParm("-max")))
 		maxtag = atoi(COM_Argv(i + 1));
 
+#ifdef ZDEBUG
 	for (block = head.next; block != &head; block = block->next)
 		if (block->tag >= mintag && block->tag <= maxtag)
 		{
 			char *filename = strrchr(block->ownerfile, PATHSEP[0]);
-			CONS_Printf("[%3d] %s (%s) bytes @ %s:%d\n", block->tag, sizeu1(block->size), sizeu2(block->realsize), filename ? filename + 1 : block->ownerfile, block->ownerline);
+			CONS_Printf("[%3d] %s (%s) bytes @ %s:%d%s\n", block->tag, sizeu1(block->size), sizeu2(block->realsize), filename ? filename + 1 : block->ownerfile, block->ownerline, block->slab ? " (pooled)" : "");
 		}
-}
 #endif
 
+	CONS_Printf("\x82%s", M_GetText("Pools\n"));
+	for (c = 0; c < NUMZCLASSES; c++)
+		for (i = max(mintag, 0); i <= maxtag && i < ZPOOLTAGS; i++)
+		{
+			zpool_t *pool = zpools[c][i];
+			zslab_t *slab;
+			size_t used = 0, capacity = 0;
+
+			if (!pool || !pool->numslabs)
+				continue;
+			for (slab = pool->slabs; slab; slab = slab->next)
+			{
+				used += slab->used;
+				capacity += slab->capacity;
+			}
+			CONS_Printf("[%3d] %4s bytes: %6s of %6s blocks used, %s slabs\n", i, sizeu1(pool->realsize), sizeu2(used), sizeu3(capacity), sizeu4(pool->numslabs));
+		}
+}
+
 /** Creates a copy of a string.
   *
   * \param s The string to be copied.